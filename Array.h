@@ -0,0 +1,120 @@
+/**
+ * @file Array.h
+ * @author  Nimrod Kremer
+ * @version 1.0
+ * @date 26.5.2020
+ *
+ * @brief Read only array that owns its elements or views memory owned elsewhere
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * The arrays of the model are either built in memory or used in place from a
+ * mapped snapshot file. Both look the same to the code that reads them, and
+ * copies share the elements, which are never changed.
+ * Input  : a vector, or a pointer into memory kept alive by an owner
+ * Process: none
+ * Output : read only access to the elements.
+ */
+
+#ifndef CPP4_ARRAY_H
+#define CPP4_ARRAY_H
+
+#include <memory>
+#include <vector>
+
+/**
+ * read only array of trivially copyable elements
+ * @tparam T the elements
+ */
+template <typename T>
+class Array
+{
+private:
+    /**
+     * the first element
+     */
+    const T *_data = nullptr;
+    /**
+     * number of elements
+     */
+    size_t _size = 0;
+    /**
+     * keeps the elements alive, shared by the copies of the array
+     */
+    std::shared_ptr<const void> _owner;
+public:
+    Array() = default;
+    /**
+     * takes the elements of the vector
+     * @param elements the elements
+     */
+    Array(std::vector<T> &&elements)
+    {
+        assign(std::move(elements));
+    }
+    /**
+     * takes the elements of the vector
+     * @param elements the elements
+     */
+    void assign(std::vector<T> &&elements)
+    {
+        auto owned = std::make_shared<const std::vector<T>>(std::move(elements));
+        _data = owned->data();
+        _size = owned->size();
+        _owner = std::move(owned);
+    }
+    /**
+     * views elements owned elsewhere
+     * @param data the first element
+     * @param size number of elements
+     * @param owner keeps the elements alive
+     */
+    void view(const T *data, size_t size, std::shared_ptr<const void> owner)
+    {
+        _owner = std::move(owner);
+        _data = data;
+        _size = size;
+    }
+    /**
+     * @return a copy of the elements that may be changed
+     */
+    std::vector<T> toVector() const
+    {
+        return std::vector<T>(begin(), end());
+    }
+    /**
+     * removes all of the elements
+     */
+    void clear()
+    {
+        assign(std::vector<T>());
+    }
+    const T *data() const
+    {
+        return _data;
+    }
+    size_t size() const
+    {
+        return _size;
+    }
+    bool empty() const
+    {
+        return _size == 0;
+    }
+    const T &operator[](size_t i) const
+    {
+        return _data[i];
+    }
+    const T *begin() const
+    {
+        return _data;
+    }
+    const T *end() const
+    {
+        return _data + _size;
+    }
+};
+
+#endif //CPP4_ARRAY_H
@@ -0,0 +1,587 @@
+/**
+ * @file Benchmark.cpp
+ * @author  Nimrod Kremer
+ * @version 1.0
+ * @date 26.5.2020
+ *
+ * @brief Measures the speed of the recommendation system on synthetic data
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * Generates a movies file and a ranks file of the given size in the formats loadData
+ * reads, then times loading them and every kind of query.
+ * Input  : the size of the data and the number of queries, as --name value options
+ * Process: timing and counting the heap allocations of every load and every query
+ * Output : the throughput, the latency percentiles and the allocations of every benchmark as JSON.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+#include "RecommenderSystem.h"
+#include "Metrics.h"
+
+/**
+ * the usage of the benchmark
+ */
+#define USAGE "Usage: cpp4_benchmark [--users N] [--movies N] [--features N] [--density D] [--seed N]\n" \
+              "                      [--loads N] [--queries N] [--k N] [--neighbors N] [--threads N]\n" \
+              "                      [--warmup N] [--precision double|float|int8] [--factors N]\n" \
+              "                      [--user-cf 0|1] [--user-neighbors N] [--result-cache N] [--dir PATH]\n" \
+              "                      [--out PATH] [--metrics PATH]"
+/**
+ * the highest rank and feature of the generated data
+ */
+#define MAX_VALUE 10
+/**
+ * number of movies and of users the predictions of the precision report cross
+ */
+#define PRECISION_SAMPLE 100
+
+/**
+ * the size of the generated data and of the runs
+ */
+typedef struct BenchmarkOptions
+{
+    int users = 2000;
+    int movies = 2000;
+    int features = 20;
+    /**
+     * part of the users x movies a user ranked
+     */
+    double density = 0.1;
+    unsigned long seed = 1;
+    /**
+     * number of times the data is loaded
+     */
+    int loads = 3;
+    /**
+     * number of queries of every kind
+     */
+    int queries = 2000;
+    /**
+     * number of untimed passes over the queries before the timed one, they fill the caches
+     */
+    int warmup = 1;
+    /**
+     * number of movies the CF queries check with
+     */
+    int k = 10;
+    int neighbors = DEFAULT_NEIGHBORS;
+    int threads = 0;
+    /**
+     * the precision the similarities are calculated in
+     */
+    FeaturePrecision precision = FeaturePrecision::DOUBLE;
+    /**
+     * number of factors of the factorization, 0 trains none and skips its queries
+     */
+    int factors = 0;
+    /**
+     * true to time the queries of the user based CF
+     */
+    bool userCF = false;
+    /**
+     * number of most similar users kept for every user, 0 finds them on every query
+     */
+    int userNeighbors = 0;
+    /**
+     * number of recommendations cached, 0 so that the repeated queries are calculated again
+     */
+    size_t resultCache = 0;
+    /**
+     * where the data files are generated
+     */
+    std::string dir = "/tmp";
+    /**
+     * the file of the results, empty prints them
+     */
+    std::string out;
+    /**
+     * the file of the metrics of the queries as JSON, empty writes none
+     */
+    std::string metrics;
+} BenchmarkOptions;
+
+/**
+ * the timing of one benchmark
+ */
+typedef struct BenchmarkResult
+{
+    std::string name;
+    size_t iterations = 0;
+    double seconds = 0;
+    double p50 = 0;
+    double p99 = 0;
+    double max = 0;
+    /**
+     * number of heap allocations of all of the runs
+     */
+    uint64_t allocations = 0;
+} BenchmarkResult;
+
+#ifdef CPP4_METRICS
+/**
+ * @return number of heap allocations of the process so far, counted by the metrics
+ */
+static uint64_t allocations()
+{
+    return Metrics::read().counters[ALLOCATIONS];
+}
+#else
+/**
+ * number of heap allocations of the process so far
+ */
+static std::atomic<uint64_t> gAllocations(0);
+
+/**
+ * @return number of heap allocations of the process so far
+ */
+static uint64_t allocations()
+{
+    return gAllocations.load(std::memory_order_relaxed);
+}
+
+void *operator new(std::size_t size)
+{
+    gAllocations.fetch_add(1, std::memory_order_relaxed);
+    void *memory = std::malloc(size == 0 ? 1 : size);
+    if (memory == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void *operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void *memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void *memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void *memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+#endif
+
+/**
+ * reads the options of the command line
+ * @param argc number of arguments
+ * @param argv the arguments
+ * @param options receives the options
+ * @return success or fail on an unknown option or a missing value
+ */
+static int parseOptions(int argc, char **argv, BenchmarkOptions &options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (i + 1 >= argc)
+        {
+            return FAIL;
+        }
+        std::string name = argv[i];
+        const char *value = argv[++i];
+        if (name == "--users")
+        {
+            options.users = std::atoi(value);
+        }
+        else if (name == "--movies")
+        {
+            options.movies = std::atoi(value);
+        }
+        else if (name == "--features")
+        {
+            options.features = std::atoi(value);
+        }
+        else if (name == "--density")
+        {
+            options.density = std::atof(value);
+        }
+        else if (name == "--seed")
+        {
+            options.seed = std::strtoul(value, nullptr, 10);
+        }
+        else if (name == "--loads")
+        {
+            options.loads = std::atoi(value);
+        }
+        else if (name == "--queries")
+        {
+            options.queries = std::atoi(value);
+        }
+        else if (name == "--warmup")
+        {
+            options.warmup = std::atoi(value);
+        }
+        else if (name == "--k")
+        {
+            options.k = std::atoi(value);
+        }
+        else if (name == "--neighbors")
+        {
+            options.neighbors = std::atoi(value);
+        }
+        else if (name == "--threads")
+        {
+            options.threads = std::atoi(value);
+        }
+        else if (name == "--precision")
+        {
+            if (std::strcmp(value, "double") == 0)
+            {
+                options.precision = FeaturePrecision::DOUBLE;
+            }
+            else if (std::strcmp(value, "float") == 0)
+            {
+                options.precision = FeaturePrecision::FLOAT;
+            }
+            else if (std::strcmp(value, "int8") == 0)
+            {
+                options.precision = FeaturePrecision::INT8;
+            }
+            else
+            {
+                return FAIL;
+            }
+        }
+        else if (name == "--factors")
+        {
+            options.factors = std::atoi(value);
+        }
+        else if (name == "--user-cf")
+        {
+            options.userCF = std::atoi(value) != 0;
+        }
+        else if (name == "--user-neighbors")
+        {
+            options.userNeighbors = std::atoi(value);
+        }
+        else if (name == "--result-cache")
+        {
+            options.resultCache = std::strtoul(value, nullptr, 10);
+        }
+        else if (name == "--dir")
+        {
+            options.dir = value;
+        }
+        else if (name == "--out")
+        {
+            options.out = value;
+        }
+        else if (name == "--metrics")
+        {
+            options.metrics = value;
+        }
+        else
+        {
+            return FAIL;
+        }
+    }
+    return options.users > 0 && options.movies > 0 && options.features > 0 && options.loads > 0 &&
+           options.queries > 0 && options.k > 0 && options.factors >= 0 ? SUCCESS : FAIL;
+}
+
+/**
+ * writes the movies file and the ranks file. Every user ranks every movie with the chance of
+ * the density, and ranks at least one movie so that every user can be recommended to
+ * @param options the size of the data
+ * @param moviesPath the path of the movies file
+ * @param ranksPath the path of the ranks file
+ * @return success or fail if a file can't be written
+ */
+static int generate(const BenchmarkOptions &options, const std::string &moviesPath, const std::string &ranksPath)
+{
+    std::mt19937_64 random(options.seed);
+    std::uniform_int_distribution<int> value(1, MAX_VALUE);
+    std::uniform_int_distribution<int> anyMovie(0, options.movies - 1);
+    std::bernoulli_distribution ranked(std::min(std::max(options.density, 0.0), 1.0));
+
+    std::ofstream movies(moviesPath);
+    for (int movie = 0; movie < options.movies; movie++)
+    {
+        movies << "Movie" << movie;
+        for (int feature = 0; feature < options.features; feature++)
+        {
+            movies << ' ' << value(random);
+        }
+        movies << '\n';
+    }
+
+    std::ofstream ranks(ranksPath);
+    for (int movie = 0; movie < options.movies; movie++)
+    {
+        ranks << (movie == 0 ? "" : " ") << "Movie" << movie;
+    }
+    ranks << '\n';
+    std::vector<int> row(options.movies);
+    for (int user = 0; user < options.users; user++)
+    {
+        bool any = false;
+        for (int movie = 0; movie < options.movies; movie++)
+        {
+            row[movie] = ranked(random) ? value(random) : 0;
+            any = any || row[movie] != 0;
+        }
+        if (!any)
+        {
+            row[anyMovie(random)] = value(random);
+        }
+        ranks << "User" << user;
+        for (int movie = 0; movie < options.movies; movie++)
+        {
+            if (row[movie] == 0)
+            {
+                ranks << " NA";
+            }
+            else
+            {
+                ranks << ' ' << row[movie];
+            }
+        }
+        ranks << '\n';
+    }
+    movies.close();
+    ranks.close();
+    return movies && ranks ? SUCCESS : FAIL;
+}
+
+/**
+ * times every run of the function
+ * @param name the name of the benchmark
+ * @param runs number of times to run the function
+ * @param warmup number of untimed passes over the runs before the timed one
+ * @param run the function, gets the number of the run
+ * @return the total time, the latency percentiles and the allocations of the runs
+ */
+template<typename Run>
+static BenchmarkResult measure(const std::string &name, size_t runs, int warmup, Run run)
+{
+    for (int pass = 0; pass < warmup; pass++)
+    {
+        for (size_t i = 0; i < runs; i++)
+        {
+            run(i);
+        }
+    }
+    BenchmarkResult result;
+    result.name = name;
+    result.iterations = runs;
+    std::vector<double> latencies(runs);
+    uint64_t allocationsBefore = allocations();
+    for (size_t i = 0; i < runs; i++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        run(i);
+        latencies[i] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        result.seconds += latencies[i];
+    }
+    result.allocations = allocations() - allocationsBefore;
+    std::sort(latencies.begin(), latencies.end());
+    // the nearest rank percentiles
+    result.p50 = latencies[(runs * 50 + 99) / 100 - 1];
+    result.p99 = latencies[(runs * 99 + 99) / 100 - 1];
+    result.max = latencies.back();
+    return result;
+}
+
+/**
+ * writes the results in the layout of the JSON output of Google Benchmark, with the times in
+ * nanoseconds
+ * @param out the stream to write to
+ * @param options the size of the data
+ * @param results the results of the benchmarks
+ * @param precision how far the predictions of the precision are from double precision
+ * @param factors how the factors were trained in the last load
+ * @param resultCache what the cache of recommendations did in all of the queries
+ */
+static void writeResults(std::ostream &out, const BenchmarkOptions &options,
+                         const std::vector<BenchmarkResult> &results, const PrecisionReport &precision,
+                         const FactorTrainStats &factors, const ResultCacheStats &resultCache)
+{
+    char buffer[512];
+    std::snprintf(buffer, sizeof(buffer),
+                  "{\n  \"context\": {\"users\": %d, \"movies\": %d, \"features\": %d, \"density\": %g, "
+                  "\"seed\": %lu, \"k\": %d, \"neighbors\": %d, \"threads\": %d, \"warmup\": %d, "
+                  "\"precision\": \"%s\"},\n",
+                  options.users, options.movies, options.features, options.density, options.seed, options.k,
+                  options.neighbors, options.threads, options.warmup,
+                  FeatureMatrix::precisionName(options.precision));
+    out << buffer;
+    std::snprintf(buffer, sizeof(buffer),
+                  "  \"precision_report\": {\"predictions\": %zu, \"max_error\": %g, \"mean_error\": %g, "
+                  "\"rmse\": %g, \"feature_bytes\": %zu, \"double_bytes\": %zu},\n",
+                  precision.predictions, precision.maxError, precision.meanError, precision.rmse,
+                  precision.featureBytes, precision.doubleBytes);
+    out << buffer;
+    std::snprintf(buffer, sizeof(buffer),
+                  "  \"factor_report\": {\"factors\": %d, \"iterations\": %d, \"ranks\": %zu, \"train_rmse\": %g, "
+                  "\"train_seconds\": %g, \"threads\": %d},\n",
+                  factors.factors, factors.iterations, factors.ranks, factors.rmse, factors.seconds, factors.threads);
+    out << buffer;
+    std::snprintf(buffer, sizeof(buffer),
+                  "  \"result_cache_report\": {\"capacity\": %zu, \"entries\": %zu, \"hits\": %llu, "
+                  "\"misses\": %llu, \"evictions\": %llu, \"invalidations\": %llu},\n  \"benchmarks\": [\n",
+                  resultCache.capacity, resultCache.entries, (unsigned long long) resultCache.hits,
+                  (unsigned long long) resultCache.misses, (unsigned long long) resultCache.evictions,
+                  (unsigned long long) resultCache.invalidations);
+    out << buffer;
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const BenchmarkResult &result = results[i];
+        std::snprintf(buffer, sizeof(buffer),
+                      "    {\"name\": \"%s\", \"iterations\": %zu, \"real_time\": %.1f, \"p50\": %.1f, "
+                      "\"p99\": %.1f, \"max\": %.1f, \"items_per_second\": %.3f, \"allocations_per_iteration\": %.3f, "
+                      "\"time_unit\": \"ns\"}%s\n",
+                      result.name.c_str(), result.iterations, result.seconds * 1e9 / result.iterations,
+                      result.p50 * 1e9, result.p99 * 1e9, result.max * 1e9,
+                      result.seconds > 0 ? result.iterations / result.seconds : 0.0,
+                      (double) result.allocations / result.iterations,
+                      i + 1 < results.size() ? "," : "");
+        out << buffer;
+    }
+    out << "  ]\n}\n";
+}
+
+/**
+ * generates the data, runs the benchmarks and writes the results
+ * @param argc number of arguments
+ * @param argv the options
+ * @return 0 on success, 1 on bad options or files
+ */
+int main(int argc, char **argv)
+{
+    BenchmarkOptions options;
+    if (parseOptions(argc, argv, options) == FAIL)
+    {
+        std::cerr << USAGE << std::endl;
+        return 1;
+    }
+    std::string moviesPath = options.dir + "/cpp4_benchmark_movies.txt";
+    std::string ranksPath = options.dir + "/cpp4_benchmark_ranks.txt";
+    if (generate(options, moviesPath, ranksPath) == FAIL)
+    {
+        std::cerr << "Unable to write the data to " << options.dir << std::endl;
+        return 1;
+    }
+
+    RecommenderConfig config;
+    config.neighbors = options.neighbors;
+    config.threads = options.threads;
+    config.precision = options.precision;
+    config.factors = options.factors;
+    config.userNeighbors = options.userNeighbors;
+    config.resultCacheSize = options.resultCache;
+    RecommenderSystem system(config);
+    std::vector<BenchmarkResult> results;
+    int loaded = SUCCESS;
+    results.push_back(measure("loadData", options.loads, 0, [&](size_t)
+    {
+        loaded |= system.loadData(moviesPath, ranksPath);
+    }));
+    if (loaded != SUCCESS)
+    {
+        return 1;
+    }
+
+    // the queries are drawn before the timing, so building the names isn't measured
+    std::mt19937_64 random(options.seed + 1);
+    std::uniform_int_distribution<int> anyUser(0, options.users - 1);
+    std::uniform_int_distribution<int> anyMovie(0, options.movies - 1);
+    std::vector<std::string> users(options.queries);
+    std::vector<std::string> movies(options.queries);
+    for (int i = 0; i < options.queries; i++)
+    {
+        users[i] = "User" + std::to_string(anyUser(random));
+        movies[i] = "Movie" + std::to_string(anyMovie(random));
+    }
+    // the metrics count only the queries, they are empty unless built with CPP4_METRICS
+    Metrics::reset();
+    // the answers are summed so that the queries can't be optimized away
+    size_t answers = 0;
+    double scores = 0;
+    results.push_back(measure("recommendByContent", options.queries, options.warmup, [&](size_t i)
+    {
+        answers += system.recommendByContent(users[i]).size();
+    }));
+    results.push_back(measure("predictMovieScoreForUser", options.queries, options.warmup, [&](size_t i)
+    {
+        scores += system.predictMovieScoreForUser(movies[i], users[i], options.k);
+    }));
+    results.push_back(measure("recommendByCF", options.queries, options.warmup, [&](size_t i)
+    {
+        answers += system.recommendByCF(users[i], options.k).size();
+    }));
+    if (options.userCF)
+    {
+        results.push_back(measure("predictByUserCF", options.queries, options.warmup, [&](size_t i)
+        {
+            scores += system.predictByUserCF(movies[i], users[i], options.k);
+        }));
+        results.push_back(measure("recommendByUserCF", options.queries, options.warmup, [&](size_t i)
+        {
+            answers += system.recommendByUserCF(users[i], options.k).size();
+        }));
+    }
+    if (options.factors > 0)
+    {
+        results.push_back(measure("predictByMF", options.queries, options.warmup, [&](size_t i)
+        {
+            scores += system.predictByMF(movies[i], users[i]);
+        }));
+        results.push_back(measure("recommendByMF", options.queries, options.warmup, [&](size_t i)
+        {
+            answers += system.recommendByMF(users[i], 1).size();
+        }));
+    }
+    if (answers == 0 && scores == 0)
+    {
+        std::cerr << "No query was answered" << std::endl;
+    }
+
+    // the report is untimed, it predicts every sampled movie for every sampled user in both precisions
+    size_t sample = std::min((size_t) PRECISION_SAMPLE, users.size());
+    std::vector<std::string> sampleMovies(movies.begin(), movies.begin() + sample);
+    std::vector<std::string> sampleUsers(users.begin(), users.begin() + sample);
+    PrecisionReport precision = system.precisionReport(options.precision, sampleMovies, sampleUsers, options.k);
+
+    if (!options.metrics.empty() && Metrics::write(options.metrics, true) == FAIL)
+    {
+        std::cerr << "Unable to write the metrics to " << options.metrics << std::endl;
+        return 1;
+    }
+    if (options.out.empty())
+    {
+        writeResults(std::cout, options, results, precision, system.factorTrainStats(),
+                     system.resultCacheStats());
+        return 0;
+    }
+    std::ofstream out(options.out);
+    writeResults(out, options, results, precision, system.factorTrainStats(), system.resultCacheStats());
+    return out ? 0 : 1;
+}
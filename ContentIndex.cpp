@@ -0,0 +1,184 @@
+/**
+ * @file ContentIndex.cpp
+ * @author  Nimrod Kremer
+ * @version 1.0
+ * @date 26.5.2020
+ *
+ * @brief Approximate index of the movies by the direction of their features
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * An inverted file (IVF-flat) over the normalized features of the ranked movies.
+ * The movies are clustered by k-means around unit centroids, and a query only
+ * scores the movies of the clusters whose centroids are the most similar to it.
+ * The more clusters are probed the closer the result is to the exact scan.
+ * Input  : the loaded model
+ * Process: spherical k-means of the ranked movies
+ * Output : lists of ranked columns by cluster.
+ */
+
+#include "ContentIndex.h"
+#include "SimilarityKernels.h"
+#include <algorithm>
+
+/**
+ * number of rounds of k-means
+ */
+#define KMEANS_ITERATIONS 10
+/**
+ * number of movies a task of the assignment handles
+ */
+#define ASSIGN_CHUNK 1024
+
+/**
+ * removes the clusters
+ */
+void ContentIndex::clear()
+{
+    _columns = 0;
+    _numFeatures = 0;
+    _centroids.clear();
+    _listStart.clear();
+    _listColumns.clear();
+}
+
+/**
+ * clusters the ranked movies by spherical k-means.
+ * Movies without a direction (all features 0) are never recommended, so they are left out. The
+ * centroids start at movies spread evenly over the columns, and a cluster that lost all of its
+ * movies keeps its centroid, so the result is deterministic.
+ * @param model the loaded model
+ * @param numClusters number of clusters, 0 builds nothing
+ * @param pool the threads to build with
+ */
+void ContentIndex::build(const RecommenderModel &model, int numClusters, ThreadPool &pool)
+{
+    clear();
+    const Array<int> &ranked = model.rankedMovies();
+    size_t numFeatures = model.numFeatures();
+    std::vector<int> columns;
+    for (size_t column = 0; column < ranked.size(); column++)
+    {
+        int movie = ranked[column];
+        if (model.columnOf(movie) == (int) column && model.movieNormal(movie) > 0)
+        {
+            columns.push_back((int) column);
+        }
+    }
+    if (numClusters <= 0 || columns.empty() || numFeatures == 0)
+    {
+        return;
+    }
+    size_t clusters = std::min((size_t) numClusters, columns.size());
+
+    // the unit direction of every movie
+    std::vector<double> points(columns.size() * numFeatures);
+    for (size_t p = 0; p < columns.size(); p++)
+    {
+        int movie = ranked[columns[p]];
+        const double *features = model.features(movie);
+        for (size_t i = 0; i < numFeatures; i++)
+        {
+            points[p * numFeatures + i] = features[i] / model.movieNormal(movie);
+        }
+    }
+    std::vector<double> centroids(clusters * numFeatures);
+    for (size_t c = 0; c < clusters; c++)
+    {
+        std::copy_n(points.begin() + (c * columns.size() / clusters) * numFeatures, numFeatures,
+                    centroids.begin() + c * numFeatures);
+    }
+
+    std::vector<int> assignment(columns.size(), 0);
+    size_t numChunks = (columns.size() + ASSIGN_CHUNK - 1) / ASSIGN_CHUNK;
+    for (int iteration = 0; iteration < KMEANS_ITERATIONS; iteration++)
+    {
+        pool.parallelFor(numChunks, [&](size_t chunk)
+        {
+            size_t end = std::min((chunk + 1) * ASSIGN_CHUNK, columns.size());
+            for (size_t p = chunk * ASSIGN_CHUNK; p < end; p++)
+            {
+                double best = -2;
+                for (size_t c = 0; c < clusters; c++)
+                {
+                    double similarity = SimilarityKernels::dot(points.data() + p * numFeatures,
+                                                               centroids.data() + c * numFeatures, numFeatures);
+                    if (similarity > best)
+                    {
+                        best = similarity;
+                        assignment[p] = (int) c;
+                    }
+                }
+            }
+        });
+        std::vector<double> sums(clusters * numFeatures, 0);
+        for (size_t p = 0; p < columns.size(); p++)
+        {
+            for (size_t i = 0; i < numFeatures; i++)
+            {
+                sums[assignment[p] * numFeatures + i] += points[p * numFeatures + i];
+            }
+        }
+        for (size_t c = 0; c < clusters; c++)
+        {
+            double normal = SimilarityKernels::normal(sums.data() + c * numFeatures, numFeatures);
+            if (normal > 0)
+            {
+                for (size_t i = 0; i < numFeatures; i++)
+                {
+                    centroids[c * numFeatures + i] = sums[c * numFeatures + i] / normal;
+                }
+            }
+        }
+    }
+
+    std::vector<uint64_t> listStart(clusters + 1, 0);
+    for (int cluster : assignment)
+    {
+        listStart[cluster + 1]++;
+    }
+    for (size_t c = 0; c < clusters; c++)
+    {
+        listStart[c + 1] += listStart[c];
+    }
+    std::vector<uint64_t> next(listStart.begin(), listStart.end() - 1);
+    std::vector<int> listColumns(columns.size());
+    for (size_t p = 0; p < columns.size(); p++)
+    {
+        listColumns[next[assignment[p]]++] = columns[p];
+    }
+    _columns = (int) ranked.size();
+    _numFeatures = numFeatures;
+    _centroids.assign(std::move(centroids));
+    _listStart.assign(std::move(listStart));
+    _listColumns.assign(std::move(listColumns));
+}
+
+/**
+ * orders the clusters by the similarity of their centroids to the query, ties by the smaller
+ * cluster
+ * @param query the features to look for
+ * @return the clusters, the most similar first, in the scratch memory of the thread
+ */
+ScratchVector<int> ContentIndex::nearestClusters(const double *query) const
+{
+    int clusters = numClusters();
+    ScratchVector<std::pair<double, int>> similarity(clusters);
+    for (int c = 0; c < clusters; c++)
+    {
+        similarity[c] = {SimilarityKernels::dot(query, _centroids.data() + c * _numFeatures, _numFeatures), c};
+    }
+    auto closer = [](const std::pair<double, int> &a, const std::pair<double, int> &b)
+    {
+        return a.first > b.first || (a.first == b.first && a.second < b.second);
+    };
+    std::sort(similarity.begin(), similarity.end(), closer);
+    ScratchVector<int> order(clusters);
+    for (int c = 0; c < clusters; c++)
+    {
+        order[c] = similarity[c].second;
+    }
+    return order;
+}
@@ -0,0 +1,114 @@
+/**
+ * @file ContentIndex.h
+ * @author  Nimrod Kremer
+ * @version 1.0
+ * @date 26.5.2020
+ *
+ * @brief Approximate index of the movies by the direction of their features
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * An inverted file (IVF-flat) over the normalized features of the ranked movies.
+ * The movies are clustered by k-means around unit centroids, and a query only
+ * scores the movies of the clusters whose centroids are the most similar to it.
+ * The more clusters are probed the closer the result is to the exact scan.
+ * Input  : the loaded model
+ * Process: spherical k-means of the ranked movies
+ * Output : lists of ranked columns by cluster.
+ */
+
+#ifndef CPP4_CONTENTINDEX_H
+#define CPP4_CONTENTINDEX_H
+
+#include <vector>
+#include "RecommenderModel.h"
+#include "ThreadPool.h"
+#include "ScratchArena.h"
+
+/**
+ * the clusters of the ranked movies
+ */
+class ContentIndex
+{
+private:
+    /**
+     * number of ranked columns the clusters were built from, columns added later aren't in them
+     */
+    int _columns = 0;
+    /**
+     * number of features of every centroid
+     */
+    size_t _numFeatures = 0;
+    /**
+     * clusters x features, every centroid of unit length
+     */
+    Array<double> _centroids;
+    /**
+     * where the columns of every cluster start in _listColumns, with the end of the last
+     * cluster at the end
+     */
+    Array<uint64_t> _listStart;
+    /**
+     * the ranked columns of every cluster, ascending within a cluster
+     */
+    Array<int> _listColumns;
+public:
+    /**
+     * clusters the ranked movies, the result doesn't depend on the number of threads of the pool
+     * @param model the loaded model
+     * @param numClusters number of clusters, 0 builds nothing
+     * @param pool the threads to build with
+     */
+    void build(const RecommenderModel &model, int numClusters, ThreadPool &pool);
+    /**
+     * removes the clusters
+     */
+    void clear();
+    /**
+     * @return true if the clusters were built
+     */
+    bool empty() const
+    {
+        return _listColumns.empty();
+    }
+    /**
+     * @return number of ranked columns the clusters were built from
+     */
+    int columns() const
+    {
+        return _columns;
+    }
+    /**
+     * @return number of clusters
+     */
+    int numClusters() const
+    {
+        return _listStart.empty() ? 0 : (int) _listStart.size() - 1;
+    }
+    /**
+     * orders the clusters by the similarity of their centroids to the query
+     * @param query the features to look for
+     * @return the clusters, the most similar first, in the scratch memory of the thread
+     */
+    ScratchVector<int> nearestClusters(const double *query) const;
+    /**
+     * @param cluster the cluster
+     * @return the ranked columns of the cluster, ascending
+     */
+    const int *list(int cluster) const
+    {
+        return _listColumns.data() + _listStart[cluster];
+    }
+    /**
+     * @param cluster the cluster
+     * @return number of ranked columns in the cluster
+     */
+    size_t listSize(int cluster) const
+    {
+        return _listStart[cluster + 1] - _listStart[cluster];
+    }
+};
+
+#endif //CPP4_CONTENTINDEX_H
@@ -0,0 +1,891 @@
+/**
+ * @file Evaluate.cpp
+ * @author  Nimrod Kremer
+ * @version 1.0
+ * @date 26.5.2020
+ *
+ * @brief Measures how accurate the recommendation system is on ranks it didn't see
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * Holds out some of the ranks of every user, loads the rest and predicts the held
+ * out ranks through the queries of the system. The ranks are held out at random or
+ * by time, the order of the columns of the ranks file standing for the order the
+ * ranks were given since the file has no dates. A random fold holds out every rank
+ * with the chance of the holdout, a time fold holds out a window of the latest ranks
+ * of every user and trains on the ranks before it only, the folds moving back in time.
+ * Input  : the movies file, the ranks file and the methods to check, as --name value options
+ * Process: loading every fold and querying its users on the threads
+ * Output : the errors of the predictions, precision and recall at N and the throughput as JSON.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "RecommenderSystem.h"
+
+/**
+ * the usage of the evaluation
+ */
+#define USAGE "Usage: cpp4_evaluate --movies PATH --ranks PATH [--split random|time] [--holdout F] [--folds N]\n" \
+              "                     [--methods cf,user-cf,mf,content] [--k N,N,...] [--n N] [--relevant R]\n" \
+              "                     [--users N] [--seed N] [--threads N] [--neighbors N] [--user-neighbors N]\n" \
+              "                     [--factors N] [--precision double|float|int8] [--content-clusters N]\n" \
+              "                     [--content-probes N] [--dir PATH] [--out PATH]"
+/**
+ * number of users a task of the evaluation queries
+ */
+#define USER_CHUNK 16
+/**
+ * how NA looks in the ranks file
+ */
+#define NA "NA"
+
+/**
+ * the ways the system recommends, by the names of the options
+ */
+enum EvaluateMethod
+{
+    METHOD_CF,
+    METHOD_USER_CF,
+    METHOD_MF,
+    METHOD_CONTENT,
+    NUM_METHODS
+};
+
+/**
+ * the names of the methods, by method
+ */
+static const char *const METHOD_NAMES[NUM_METHODS] = {"cf", "user-cf", "mf", "content"};
+
+/**
+ * what to evaluate and how
+ */
+typedef struct EvaluateOptions
+{
+    std::string movies;
+    std::string ranks;
+    /**
+     * true to hold out the latest ranks of every user instead of random ones
+     */
+    bool timeSplit = false;
+    /**
+     * the part of the ranks of every user held out in every fold
+     */
+    double holdout = 0.2;
+    int folds = 3;
+    /**
+     * the methods to evaluate, by method
+     */
+    std::vector<int> methods = {METHOD_CF};
+    /**
+     * the numbers of movies or users the CF methods check with, each evaluated on its own
+     */
+    std::vector<int> ks = {10};
+    /**
+     * number of movies recommended for precision and recall
+     */
+    int n = 10;
+    /**
+     * the least held out rank a recommended movie must have to count as a hit
+     */
+    double relevant = 7;
+    /**
+     * number of users of every fold whose recommendations are checked, 0 checks all of them
+     */
+    int users = 0;
+    unsigned long seed = 1;
+    /**
+     * number of threads of the whole evaluation, 0 for all of the cores
+     */
+    int threads = 0;
+    int neighbors = DEFAULT_NEIGHBORS;
+    int userNeighbors = 0;
+    /**
+     * number of factors trained for the mf method
+     */
+    int factors = 10;
+    FeaturePrecision precision = FeaturePrecision::DOUBLE;
+    int contentClusters = 0;
+    int contentProbes = DEFAULT_CONTENT_PROBES;
+    /**
+     * where the ranks of the folds are written to be loaded
+     */
+    std::string dir = "/tmp";
+    /**
+     * the file of the results, empty prints them
+     */
+    std::string out;
+} EvaluateOptions;
+
+/**
+ * a rank a user gave, by the column of the movie in the ranks file
+ */
+typedef struct Observation
+{
+    int column;
+    double rank;
+} Observation;
+
+/**
+ * the ranks file, the ranks of every user in the order of the columns
+ */
+typedef struct RanksData
+{
+    std::vector<std::string> movies;
+    std::vector<std::string> users;
+    std::vector<std::vector<Observation>> ranks;
+} RanksData;
+
+/**
+ * the ranks a fold loads and the ranks it predicts, by user
+ */
+typedef struct FoldSplit
+{
+    std::vector<std::vector<Observation>> train;
+    std::vector<std::vector<Observation>> test;
+    size_t trainRanks = 0;
+    size_t testRanks = 0;
+} FoldSplit;
+
+/**
+ * the accuracy and the speed of a method with one k, summed over the folds
+ */
+typedef struct MethodResult
+{
+    int method = METHOD_CF;
+    /**
+     * the k of the CF methods, 0 for the others
+     */
+    int k = 0;
+    double squaredError = 0;
+    double absoluteError = 0;
+    /**
+     * number of held out ranks predicted, and how many of them the method had no prediction for
+     */
+    size_t predictions = 0;
+    size_t uncovered = 0;
+    /**
+     * the time the predictions took, summed over the folds
+     */
+    double predictSeconds = 0;
+    /**
+     * precision and recall at n summed over the users checked, the users with a relevant
+     * held out rank
+     */
+    double precision = 0;
+    double recall = 0;
+    size_t rankedUsers = 0;
+    /**
+     * the time the recommendations took, summed over the folds
+     */
+    double recommendSeconds = 0;
+} MethodResult;
+
+/**
+ * the size of a fold and how long it took to load
+ */
+typedef struct FoldReport
+{
+    size_t trainRanks = 0;
+    size_t testRanks = 0;
+    double loadSeconds = 0;
+    bool loaded = false;
+} FoldReport;
+
+/**
+ * splits a list of numbers separated by commas
+ * @param value the list
+ * @param numbers receives the numbers
+ * @return success or fail if a number isn't positive
+ */
+static int parseNumbers(const char *value, std::vector<int> &numbers)
+{
+    numbers.clear();
+    std::stringstream list(value);
+    std::string item;
+    while (std::getline(list, item, ','))
+    {
+        int number = std::atoi(item.c_str());
+        if (number <= 0)
+        {
+            return FAIL;
+        }
+        numbers.push_back(number);
+    }
+    return numbers.empty() ? FAIL : SUCCESS;
+}
+
+/**
+ * splits a list of methods separated by commas
+ * @param value the list
+ * @param methods receives the methods
+ * @return success or fail on an unknown method
+ */
+static int parseMethods(const char *value, std::vector<int> &methods)
+{
+    methods.clear();
+    std::stringstream list(value);
+    std::string item;
+    while (std::getline(list, item, ','))
+    {
+        int method = 0;
+        while (method < NUM_METHODS && item != METHOD_NAMES[method])
+        {
+            method++;
+        }
+        if (method == NUM_METHODS)
+        {
+            return FAIL;
+        }
+        methods.push_back(method);
+    }
+    return methods.empty() ? FAIL : SUCCESS;
+}
+
+/**
+ * reads the options of the command line
+ * @param argc number of arguments
+ * @param argv the arguments
+ * @param options receives the options
+ * @return success or fail on an unknown option, a bad or missing value or a missing file
+ */
+static int parseOptions(int argc, char **argv, EvaluateOptions &options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (i + 1 >= argc)
+        {
+            return FAIL;
+        }
+        std::string name = argv[i];
+        const char *value = argv[++i];
+        int result = SUCCESS;
+        if (name == "--movies")
+        {
+            options.movies = value;
+        }
+        else if (name == "--ranks")
+        {
+            options.ranks = value;
+        }
+        else if (name == "--split")
+        {
+            if (std::strcmp(value, "random") != 0 && std::strcmp(value, "time") != 0)
+            {
+                return FAIL;
+            }
+            options.timeSplit = std::strcmp(value, "time") == 0;
+        }
+        else if (name == "--holdout")
+        {
+            options.holdout = std::atof(value);
+        }
+        else if (name == "--folds")
+        {
+            options.folds = std::atoi(value);
+        }
+        else if (name == "--methods")
+        {
+            result = parseMethods(value, options.methods);
+        }
+        else if (name == "--k")
+        {
+            result = parseNumbers(value, options.ks);
+        }
+        else if (name == "--n")
+        {
+            options.n = std::atoi(value);
+        }
+        else if (name == "--relevant")
+        {
+            options.relevant = std::atof(value);
+        }
+        else if (name == "--users")
+        {
+            options.users = std::atoi(value);
+        }
+        else if (name == "--seed")
+        {
+            options.seed = std::strtoul(value, nullptr, 10);
+        }
+        else if (name == "--threads")
+        {
+            options.threads = std::atoi(value);
+        }
+        else if (name == "--neighbors")
+        {
+            options.neighbors = std::atoi(value);
+        }
+        else if (name == "--user-neighbors")
+        {
+            options.userNeighbors = std::atoi(value);
+        }
+        else if (name == "--factors")
+        {
+            options.factors = std::atoi(value);
+        }
+        else if (name == "--precision")
+        {
+            if (std::strcmp(value, "double") == 0)
+            {
+                options.precision = FeaturePrecision::DOUBLE;
+            }
+            else if (std::strcmp(value, "float") == 0)
+            {
+                options.precision = FeaturePrecision::FLOAT;
+            }
+            else if (std::strcmp(value, "int8") == 0)
+            {
+                options.precision = FeaturePrecision::INT8;
+            }
+            else
+            {
+                return FAIL;
+            }
+        }
+        else if (name == "--content-clusters")
+        {
+            options.contentClusters = std::atoi(value);
+        }
+        else if (name == "--content-probes")
+        {
+            options.contentProbes = std::atoi(value);
+        }
+        else if (name == "--dir")
+        {
+            options.dir = value;
+        }
+        else if (name == "--out")
+        {
+            options.out = value;
+        }
+        else
+        {
+            return FAIL;
+        }
+        if (result == FAIL)
+        {
+            return FAIL;
+        }
+    }
+    return !options.movies.empty() && !options.ranks.empty() && options.holdout > 0 && options.holdout < 1 &&
+           options.folds > 0 && options.n > 0 && options.users >= 0 && options.factors > 0 ? SUCCESS : FAIL;
+}
+
+/**
+ * reads the ranks file, the names of the movies and then a line of ranks for every user
+ * @param path the path of the ranks file
+ * @param data receives the ranks
+ * @return success or fail if the file can't be read or a line has the wrong number of ranks
+ */
+static int readRanks(const std::string &path, RanksData &data)
+{
+    std::ifstream in(path);
+    std::string line;
+    if (!in || !std::getline(in, line))
+    {
+        return FAIL;
+    }
+    std::istringstream header(line);
+    std::string token;
+    while (header >> token)
+    {
+        data.movies.push_back(token);
+    }
+    while (std::getline(in, line))
+    {
+        std::istringstream row(line);
+        std::string user;
+        if (!(row >> user))
+        {
+            continue;
+        }
+        std::vector<Observation> ranks;
+        int column = 0;
+        for (; row >> token; column++)
+        {
+            if (token != NA)
+            {
+                ranks.push_back({column, std::strtod(token.c_str(), nullptr)});
+            }
+        }
+        if (column != (int) data.movies.size())
+        {
+            return FAIL;
+        }
+        data.users.push_back(user);
+        data.ranks.push_back(std::move(ranks));
+    }
+    return SUCCESS;
+}
+
+/**
+ * holds out the ranks of a fold. Every user keeps at least one rank to be recommended from
+ * @param options how to hold out
+ * @param data the ranks
+ * @param fold the number of the fold
+ * @return the ranks to load and the ranks to predict
+ */
+static FoldSplit splitFold(const EvaluateOptions &options, const RanksData &data, int fold)
+{
+    FoldSplit split;
+    size_t numUsers = data.users.size();
+    split.train.resize(numUsers);
+    split.test.resize(numUsers);
+    std::mt19937_64 random(options.seed + fold);
+    std::bernoulli_distribution heldOut(options.holdout);
+    for (size_t user = 0; user < numUsers; user++)
+    {
+        const std::vector<Observation> &ranks = data.ranks[user];
+        if (options.timeSplit)
+        {
+            // the window of the fold, the later ranks are neither loaded nor predicted
+            size_t window = std::max((size_t) 1, (size_t) std::lround(ranks.size() * options.holdout));
+            size_t end = ranks.size() >= (size_t) fold * window ? ranks.size() - (size_t) fold * window : 0;
+            size_t start = end >= window ? end - window : 0;
+            if (start == 0)
+            {
+                // too few ranks for the window, the user is only loaded
+                split.train[user].assign(ranks.begin(), ranks.begin() + end);
+            }
+            else
+            {
+                split.train[user].assign(ranks.begin(), ranks.begin() + start);
+                split.test[user].assign(ranks.begin() + start, ranks.begin() + end);
+            }
+        }
+        else
+        {
+            for (const Observation &observation: ranks)
+            {
+                (heldOut(random) ? split.test : split.train)[user].push_back(observation);
+            }
+            if (split.train[user].empty() && !split.test[user].empty())
+            {
+                split.train[user].push_back(split.test[user].front());
+                split.test[user].erase(split.test[user].begin());
+            }
+        }
+        split.trainRanks += split.train[user].size();
+        split.testRanks += split.test[user].size();
+    }
+    return split;
+}
+
+/**
+ * writes the ranks a fold loads in the layout of the ranks file
+ * @param path the path of the file
+ * @param data the names of the movies and the users
+ * @param train the ranks to write, by user
+ * @return success or fail if the file can't be written
+ */
+static int writeRanks(const std::string &path, const RanksData &data,
+                      const std::vector<std::vector<Observation>> &train)
+{
+    std::ofstream out(path);
+    for (size_t movie = 0; movie < data.movies.size(); movie++)
+    {
+        out << (movie == 0 ? "" : " ") << data.movies[movie];
+    }
+    out << '\n';
+    char buffer[32];
+    for (size_t user = 0; user < data.users.size(); user++)
+    {
+        out << data.users[user];
+        size_t next = 0;
+        const std::vector<Observation> &ranks = train[user];
+        for (int column = 0; column < (int) data.movies.size(); column++)
+        {
+            if (next < ranks.size() && ranks[next].column == column)
+            {
+                std::snprintf(buffer, sizeof(buffer), " %.17g", ranks[next++].rank);
+                out << buffer;
+            }
+            else
+            {
+                out << " " NA;
+            }
+        }
+        out << '\n';
+    }
+    out.close();
+    return out ? SUCCESS : FAIL;
+}
+
+/**
+ * predicts a held out rank by the method
+ * @param system the loaded fold
+ * @param method the method
+ * @param movie the name of the movie
+ * @param user the name of the user
+ * @param k number of movies or users to check with
+ * @return the prediction, fail if the method has none
+ */
+static double predict(const RecommenderSystem &system, int method, const std::string &movie,
+                      const std::string &user, int k)
+{
+    switch (method)
+    {
+        case METHOD_CF:
+            return system.predictMovieScoreForUser(movie, user, k);
+        case METHOD_USER_CF:
+            return system.predictByUserCF(movie, user, k);
+        case METHOD_MF:
+            return system.predictByMF(movie, user);
+        default:
+            return FAIL;
+    }
+}
+
+/**
+ * recommends the n best movies by the method
+ * @param system the loaded fold
+ * @param method the method
+ * @param user the name of the user
+ * @param k number of movies or users to check with
+ * @param n number of movies to recommend
+ * @return the recommended movies from the best
+ */
+static std::vector<Recommendation> recommend(const RecommenderSystem &system, int method, const std::string &user,
+                                             int k, int n)
+{
+    switch (method)
+    {
+        case METHOD_CF:
+            return system.recommendTopByCF(user, k, n);
+        case METHOD_USER_CF:
+            return system.recommendTopByUserCF(user, k, n);
+        case METHOD_MF:
+            return system.recommendByMF(user, n);
+        default:
+            return system.recommendTopByContent(user, n);
+    }
+}
+
+/**
+ * @param start when the time started
+ * @return the seconds since then
+ */
+static double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * loads a fold and evaluates every method on it. The users are spread on the threads in
+ * chunks, and every chunk is summed on its own and then in order, so the result doesn't
+ * depend on the threads
+ * @param options what to evaluate
+ * @param data the ranks
+ * @param fold the number of the fold
+ * @param threads number of threads of the fold
+ * @param results receives the results of the fold, by method and k
+ * @param report receives the size of the fold and how long it took to load
+ * @return success or fail if the fold couldn't be written or loaded
+ */
+static int evaluateFold(const EvaluateOptions &options, const RanksData &data, int fold, int threads,
+                        std::vector<MethodResult> &results, FoldReport &report)
+{
+    FoldSplit split = splitFold(options, data, fold);
+    report.trainRanks = split.trainRanks;
+    report.testRanks = split.testRanks;
+    std::string path = options.dir + "/cpp4_evaluate_" + std::to_string(::getpid()) + "_" +
+                       std::to_string(fold) + ".txt";
+    if (writeRanks(path, data, split.train) == FAIL)
+    {
+        std::cerr << "Unable to write the ranks to " << path << std::endl;
+        return FAIL;
+    }
+
+    RecommenderConfig config;
+    config.threads = threads;
+    config.neighbors = options.neighbors;
+    config.userNeighbors = options.userNeighbors;
+    config.precision = options.precision;
+    config.contentClusters = options.contentClusters;
+    config.contentProbes = options.contentProbes;
+    for (const MethodResult &result: results)
+    {
+        if (result.method == METHOD_MF)
+        {
+            config.factors = options.factors;
+        }
+    }
+    RecommenderSystem system(config);
+    auto start = std::chrono::steady_clock::now();
+    int loaded = system.loadData(options.movies, path);
+    report.loadSeconds = secondsSince(start);
+    ::unlink(path.c_str());
+    if (loaded == FAIL)
+    {
+        return FAIL;
+    }
+    report.loaded = true;
+
+    // the users checked for precision and recall are drawn once, the same for every method
+    std::vector<size_t> testUsers;
+    for (size_t user = 0; user < data.users.size(); user++)
+    {
+        if (!split.test[user].empty())
+        {
+            testUsers.push_back(user);
+        }
+    }
+    std::vector<size_t> rankedUsers = testUsers;
+    if (options.users > 0 && (size_t) options.users < rankedUsers.size())
+    {
+        std::mt19937_64 random(options.seed + fold);
+        std::shuffle(rankedUsers.begin(), rankedUsers.end(), random);
+        rankedUsers.resize(options.users);
+        std::sort(rankedUsers.begin(), rankedUsers.end());
+    }
+
+    ThreadPool pool(threads);
+    for (MethodResult &result: results)
+    {
+        size_t numChunks = (testUsers.size() + USER_CHUNK - 1) / USER_CHUNK;
+        std::vector<MethodResult> chunks(numChunks);
+        if (result.method != METHOD_CONTENT)
+        {
+            start = std::chrono::steady_clock::now();
+            pool.parallelFor(numChunks, [&](size_t chunk)
+            {
+                size_t end = std::min(testUsers.size(), (chunk + 1) * USER_CHUNK);
+                for (size_t i = chunk * USER_CHUNK; i < end; i++)
+                {
+                    size_t user = testUsers[i];
+                    for (const Observation &observation: split.test[user])
+                    {
+                        double score = predict(system, result.method, data.movies[observation.column],
+                                               data.users[user], result.k);
+                        chunks[chunk].predictions++;
+                        if (score == FAIL || score != score)
+                        {
+                            chunks[chunk].uncovered++;
+                            continue;
+                        }
+                        double error = score - observation.rank;
+                        chunks[chunk].squaredError += error * error;
+                        chunks[chunk].absoluteError += std::fabs(error);
+                    }
+                }
+            });
+            result.predictSeconds += secondsSince(start);
+        }
+
+        numChunks = (rankedUsers.size() + USER_CHUNK - 1) / USER_CHUNK;
+        chunks.resize(std::max(chunks.size(), numChunks));
+        start = std::chrono::steady_clock::now();
+        pool.parallelFor(numChunks, [&](size_t chunk)
+        {
+            size_t end = std::min(rankedUsers.size(), (chunk + 1) * USER_CHUNK);
+            for (size_t i = chunk * USER_CHUNK; i < end; i++)
+            {
+                size_t user = rankedUsers[i];
+                std::vector<int> relevant;
+                for (const Observation &observation: split.test[user])
+                {
+                    if (observation.rank >= options.relevant)
+                    {
+                        relevant.push_back(observation.column);
+                    }
+                }
+                if (relevant.empty())
+                {
+                    continue;
+                }
+                size_t hits = 0;
+                for (const Recommendation &recommendation: recommend(system, result.method, data.users[user],
+                                                                     result.k, options.n))
+                {
+                    for (int column: relevant)
+                    {
+                        if (data.movies[column] == recommendation.movie)
+                        {
+                            hits++;
+                            break;
+                        }
+                    }
+                }
+                chunks[chunk].precision += (double) hits / options.n;
+                chunks[chunk].recall += (double) hits / relevant.size();
+                chunks[chunk].rankedUsers++;
+            }
+        });
+        result.recommendSeconds += secondsSince(start);
+
+        for (const MethodResult &chunk: chunks)
+        {
+            result.predictions += chunk.predictions;
+            result.uncovered += chunk.uncovered;
+            result.squaredError += chunk.squaredError;
+            result.absoluteError += chunk.absoluteError;
+            result.precision += chunk.precision;
+            result.recall += chunk.recall;
+            result.rankedUsers += chunk.rankedUsers;
+        }
+    }
+    return SUCCESS;
+}
+
+/**
+ * @param sum a sum
+ * @param count number of items summed
+ * @return the mean as JSON, null if nothing was summed
+ */
+static std::string mean(double sum, size_t count)
+{
+    char buffer[32];
+    if (count == 0)
+    {
+        return "null";
+    }
+    std::snprintf(buffer, sizeof(buffer), "%.6f", sum / count);
+    return buffer;
+}
+
+/**
+ * writes the results as JSON. The throughput of a method is of one fold on its threads
+ * @param out the stream to write to
+ * @param options what was evaluated
+ * @param threads number of threads of every fold
+ * @param seconds the time of the whole evaluation
+ * @param reports the size of every fold
+ * @param results the results of every method and k, summed over the folds
+ */
+static void writeResults(std::ostream &out, const EvaluateOptions &options, int threads, double seconds,
+                         const std::vector<FoldReport> &reports, const std::vector<MethodResult> &results)
+{
+    char buffer[512];
+    std::snprintf(buffer, sizeof(buffer),
+                  "{\n  \"context\": {\"split\": \"%s\", \"holdout\": %g, \"folds\": %d, \"n\": %d, "
+                  "\"relevant\": %g, \"users\": %d, \"seed\": %lu, \"threads_per_fold\": %d, \"neighbors\": %d, "
+                  "\"user_neighbors\": %d, \"precision\": \"%s\", \"content_clusters\": %d, "
+                  "\"content_probes\": %d, \"seconds\": %.3f},\n  \"folds\": [\n",
+                  options.timeSplit ? "time" : "random", options.holdout, options.folds, options.n,
+                  options.relevant, options.users, options.seed, threads, options.neighbors,
+                  options.userNeighbors, FeatureMatrix::precisionName(options.precision),
+                  options.contentClusters, options.contentProbes, seconds);
+    out << buffer;
+    for (size_t fold = 0; fold < reports.size(); fold++)
+    {
+        std::snprintf(buffer, sizeof(buffer),
+                      "    {\"fold\": %zu, \"train_ranks\": %zu, \"test_ranks\": %zu, \"load_seconds\": %.3f}%s\n",
+                      fold, reports[fold].trainRanks, reports[fold].testRanks, reports[fold].loadSeconds,
+                      fold + 1 < reports.size() ? "," : "");
+        out << buffer;
+    }
+    out << "  ],\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const MethodResult &result = results[i];
+        size_t covered = result.predictions - result.uncovered;
+        std::snprintf(buffer, sizeof(buffer),
+                      "    {\"method\": \"%s\", \"k\": %d, \"rmse\": %s, \"mae\": %s, \"predictions\": %zu, "
+                      "\"uncovered\": %zu, \"predictions_per_second\": %.1f, \"precision_at_n\": %s, "
+                      "\"recall_at_n\": %s, \"ranked_users\": %zu, \"recommendations_per_second\": %.1f}%s\n",
+                      METHOD_NAMES[result.method], result.k,
+                      covered == 0 ? "null" : std::to_string(std::sqrt(result.squaredError / covered)).c_str(),
+                      mean(result.absoluteError, covered).c_str(), result.predictions, result.uncovered,
+                      result.predictSeconds > 0 ? result.predictions / result.predictSeconds : 0.0,
+                      mean(result.precision, result.rankedUsers).c_str(),
+                      mean(result.recall, result.rankedUsers).c_str(), result.rankedUsers,
+                      result.recommendSeconds > 0 ? result.rankedUsers / result.recommendSeconds : 0.0,
+                      i + 1 < results.size() ? "," : "");
+        out << buffer;
+    }
+    out << "  ]\n}\n";
+}
+
+/**
+ * evaluates the methods on every fold and writes the results
+ * @param argc number of arguments
+ * @param argv the options
+ * @return 0 on success, 1 on bad options or files
+ */
+int main(int argc, char **argv)
+{
+    EvaluateOptions options;
+    if (parseOptions(argc, argv, options) == FAIL)
+    {
+        std::cerr << USAGE << std::endl;
+        return 1;
+    }
+    RanksData data;
+    if (readRanks(options.ranks, data) == FAIL)
+    {
+        std::cerr << "Unable to open file " << options.ranks << std::endl;
+        return 1;
+    }
+
+    std::vector<MethodResult> results;
+    for (int method: options.methods)
+    {
+        bool usesK = method == METHOD_CF || method == METHOD_USER_CF;
+        for (size_t i = 0; i < (usesK ? options.ks.size() : 1); i++)
+        {
+            MethodResult result;
+            result.method = method;
+            result.k = usesK ? options.ks[i] : 0;
+            results.push_back(result);
+        }
+    }
+
+    // the folds run at once as far as the threads go, and split the threads between them
+    int threads = options.threads > 0 ? options.threads : std::max(1, (int) std::thread::hardware_concurrency());
+    int foldsAtOnce = std::min(options.folds, threads);
+    int foldThreads = std::max(1, threads / foldsAtOnce);
+    std::vector<std::vector<MethodResult>> foldResults(options.folds, results);
+    std::vector<FoldReport> reports(options.folds);
+    auto start = std::chrono::steady_clock::now();
+    ThreadPool foldPool(foldsAtOnce);
+    foldPool.parallelFor((size_t) options.folds, [&](size_t fold)
+    {
+        evaluateFold(options, data, (int) fold, foldThreads, foldResults[fold], reports[fold]);
+    });
+    double seconds = secondsSince(start);
+
+    for (size_t fold = 0; fold < reports.size(); fold++)
+    {
+        if (!reports[fold].loaded)
+        {
+            return 1;
+        }
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            const MethodResult &part = foldResults[fold][i];
+            MethodResult &result = results[i];
+            result.squaredError += part.squaredError;
+            result.absoluteError += part.absoluteError;
+            result.predictions += part.predictions;
+            result.uncovered += part.uncovered;
+            result.predictSeconds += part.predictSeconds;
+            result.precision += part.precision;
+            result.recall += part.recall;
+            result.rankedUsers += part.rankedUsers;
+            result.recommendSeconds += part.recommendSeconds;
+        }
+    }
+    if (options.out.empty())
+    {
+        writeResults(std::cout, options, foldThreads, seconds, reports, results);
+        return 0;
+    }
+    std::ofstream out(options.out);
+    writeResults(out, options, foldThreads, seconds, reports, results);
+    return out ? 0 : 1;
+}
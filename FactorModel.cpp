@@ -0,0 +1,296 @@
+/**
+ * @file FactorModel.cpp
+ * @author  Nimrod Kremer
+ * @version 1.0
+ * @date 26.5.2020
+ *
+ * @brief Low rank factors of the users and the movies, learned from the ranks
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * Alternating least squares with the regularization weighted by the number of ranks
+ * of every row. A row is solved from the normal equations of its ranks by Cholesky,
+ * the bias being one more unknown against a constant 1 of the other side.
+ * Input  : the loaded model and the size of the factors
+ * Process: solving every user and then every movie, round after round
+ * Output : the factors of the users and of the movies.
+ */
+
+#include "FactorModel.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <random>
+
+/**
+ * number of rows a task of the training solves
+ */
+#define SOLVE_CHUNK 64
+/**
+ * the seed of the first factors of the movies, fixed so that every training gives the same factors
+ */
+#define FACTOR_SEED 20200526
+/**
+ * the first factors of the movies are drawn from [-FACTOR_INIT, FACTOR_INIT]
+ */
+#define FACTOR_INIT 0.1
+
+/**
+ * removes the factors
+ */
+void FactorModel::clear()
+{
+    _factors = 0;
+    _mean = 0;
+    _numUsers = 0;
+    _numColumns = 0;
+    _users.clear();
+    _movies.clear();
+    _stats = FactorTrainStats();
+}
+
+/**
+ * solves the factors and the bias of one row from the rows it was ranked with. The other side
+ * is held fixed, so every rank is a linear equation of the row, and the normal equations with
+ * the regularization are positive definite.
+ * @param others the rows of the other side, (factors + 1) doubles each with the bias last
+ * @param ids the rows of the other side the ranks were given with
+ * @param ranks the ranks
+ * @param count number of ranks
+ * @param numOthers number of rows of the other side, ids beyond them count as 0
+ * @param regularization how much the row is pulled to 0, for every rank it has
+ * @param normal scratch of (factors + 1)^2 doubles
+ * @param out receives the factors and then the bias
+ */
+void FactorModel::_solve(const double *others, const int *ids, const double *ranks, size_t count, size_t numOthers,
+                         double regularization, double *normal, double *out) const
+{
+    size_t size = _stride();
+    std::fill_n(normal, size * size, 0.0);
+    std::fill_n(out, size, 0.0);
+    size_t used = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        if ((size_t) ids[i] >= numOthers)
+        {
+            continue;
+        }
+        const double *other = others + ids[i] * size;
+        // the row is multiplied by the factors of the other side and by 1 for its bias
+        double target = ranks[i] - _mean - other[_factors];
+        for (int a = 0; a < _factors; a++)
+        {
+            double *line = normal + a * size;
+            for (int b = 0; b <= a; b++)
+            {
+                line[b] += other[a] * other[b];
+            }
+            out[a] += target * other[a];
+        }
+        double *biasLine = normal + _factors * size;
+        for (int b = 0; b < _factors; b++)
+        {
+            biasLine[b] += other[b];
+        }
+        biasLine[_factors] += 1;
+        out[_factors] += target;
+        used++;
+    }
+    if (used == 0)
+    {
+        std::fill_n(out, size, 0.0);
+        return;
+    }
+    double lambda = regularization * used;
+    // Cholesky of the lower triangle in place, then the two triangular solves
+    for (size_t a = 0; a < size; a++)
+    {
+        double *line = normal + a * size;
+        line[a] += lambda;
+        for (size_t b = 0; b <= a; b++)
+        {
+            double sum = line[b];
+            const double *other = normal + b * size;
+            for (size_t c = 0; c < b; c++)
+            {
+                sum -= line[c] * other[c];
+            }
+            if (a == b)
+            {
+                if (sum <= 0)
+                {
+                    // not positive definite, only without regularization
+                    std::fill_n(out, size, 0.0);
+                    return;
+                }
+                line[a] = std::sqrt(sum);
+            }
+            else
+            {
+                line[b] = sum / other[b];
+            }
+        }
+    }
+    for (size_t a = 0; a < size; a++)
+    {
+        const double *line = normal + a * size;
+        double sum = out[a];
+        for (size_t c = 0; c < a; c++)
+        {
+            sum -= line[c] * out[c];
+        }
+        out[a] = sum / line[a];
+    }
+    for (size_t a = size; a-- > 0; )
+    {
+        double sum = out[a];
+        for (size_t c = a + 1; c < size; c++)
+        {
+            sum -= normal[c * size + a] * out[c];
+        }
+        out[a] = sum / normal[a * size + a];
+    }
+}
+
+/**
+ * trains the factors by alternating least squares. Every half of a round solves every user
+ * from the fixed movies and then every movie from the fixed users, each row on its own, so the
+ * rows are spread on the threads and the result doesn't depend on how.
+ * @param model the loaded model
+ * @param factors number of factors of every user and movie, 0 trains nothing
+ * @param iterations number of rounds of alternating least squares
+ * @param regularization how much the factors are pulled to 0, for every rank they have
+ * @param pool the threads to train with
+ */
+void FactorModel::build(const RecommenderModel &model, int factors, int iterations, double regularization,
+                        ThreadPool &pool)
+{
+    clear();
+    const Array<int> &ranked = model.rankedMovies();
+    size_t numUsers = (size_t) model.users().size();
+    if (factors <= 0 || numUsers == 0 || ranked.empty() || model.numRanks() == 0)
+    {
+        return;
+    }
+    auto start = std::chrono::steady_clock::now();
+    _factors = factors;
+    _numUsers = numUsers;
+    _numColumns = ranked.size();
+    size_t size = _stride();
+
+    double sum = 0;
+    for (size_t user = 0; user < numUsers; user++)
+    {
+        const double *ranks = model.userRanks((int) user);
+        for (size_t i = 0; i < model.rankedCount((int) user); i++)
+        {
+            sum += ranks[i];
+        }
+    }
+    _mean = sum / model.numRanks();
+
+    std::vector<double> users(numUsers * size, 0.0);
+    std::vector<double> movies(_numColumns * size, 0.0);
+    std::mt19937_64 random(FACTOR_SEED);
+    std::uniform_real_distribution<double> init(-FACTOR_INIT, FACTOR_INIT);
+    for (size_t column = 0; column < _numColumns; column++)
+    {
+        for (int factor = 0; factor < _factors; factor++)
+        {
+            movies[column * size + factor] = init(random);
+        }
+    }
+
+    auto solveAll = [&](size_t numRows, const std::function<void(size_t, double *)> &solveRow)
+    {
+        pool.parallelFor((numRows + SOLVE_CHUNK - 1) / SOLVE_CHUNK, [&](size_t chunk)
+        {
+            std::vector<double> normal(size * size);
+            size_t end = std::min(numRows, (chunk + 1) * SOLVE_CHUNK);
+            for (size_t row = chunk * SOLVE_CHUNK; row < end; row++)
+            {
+                solveRow(row, normal.data());
+            }
+        });
+    };
+    for (int iteration = 0; iteration < iterations; iteration++)
+    {
+        solveAll(numUsers, [&](size_t user, double *normal)
+        {
+            _solve(movies.data(), model.rankedColumns((int) user), model.userRanks((int) user),
+                   model.rankedCount((int) user), _numColumns, regularization, normal, users.data() + user * size);
+        });
+        solveAll(_numColumns, [&](size_t column, double *normal)
+        {
+            // the earlier column of a movie listed twice has no ranks
+            int movie = ranked[column];
+            if (model.columnOf(movie) != (int) column)
+            {
+                return;
+            }
+            _solve(users.data(), model.raters(movie), model.raterRanks(movie), model.raterCount(movie), numUsers,
+                   regularization, normal, movies.data() + column * size);
+        });
+    }
+
+    // the error of every user is summed alone and then in order, so it doesn't depend on the threads
+    std::vector<double> errors(numUsers, 0.0);
+    pool.parallelFor((numUsers + SOLVE_CHUNK - 1) / SOLVE_CHUNK, [&](size_t chunk)
+    {
+        size_t end = std::min(numUsers, (chunk + 1) * SOLVE_CHUNK);
+        for (size_t user = chunk * SOLVE_CHUNK; user < end; user++)
+        {
+            const double *factorsOfUser = users.data() + user * size;
+            const int *columns = model.rankedColumns((int) user);
+            const double *ranks = model.userRanks((int) user);
+            for (size_t i = 0; i < model.rankedCount((int) user); i++)
+            {
+                const double *movie = movies.data() + columns[i] * size;
+                double error = ranks[i] - (_mean + factorsOfUser[_factors] + movie[_factors] +
+                                           SimilarityKernels::dot(factorsOfUser, movie, _factors));
+                errors[user] += error * error;
+            }
+        }
+    });
+    double squared = 0;
+    for (double error: errors)
+    {
+        squared += error;
+    }
+
+    _users.assign(std::move(users));
+    _movies.assign(std::move(movies));
+    _stats.factors = _factors;
+    _stats.iterations = iterations;
+    _stats.regularization = regularization;
+    _stats.ranks = model.numRanks();
+    _stats.rmse = std::sqrt(squared / model.numRanks());
+    _stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    _stats.threads = pool.size();
+}
+
+/**
+ * finds the factors of the user. A trained user whose ranks didn't change since the training
+ * is read as it is, any other user is solved against the trained movies from its ranks now,
+ * which is one half round of the training for one user
+ * @param model the loaded model
+ * @param user the id of the user
+ * @return the factors and then the bias of the user, in the scratch memory of the thread
+ */
+ScratchVector<double> FactorModel::userFactors(const RecommenderModel &model, int user) const
+{
+    size_t size = _stride();
+    ScratchVector<double> factors(size);
+    if ((size_t) user < _numUsers && model.userVersion(user) == 0)
+    {
+        std::copy_n(_users.data() + user * size, size, factors.begin());
+        return factors;
+    }
+    ScratchVector<double> normal(size * size);
+    _solve(_movies.data(), model.rankedColumns(user), model.userRanks(user), model.rankedCount(user), _numColumns,
+           _stats.regularization, normal.data(), factors.data());
+    return factors;
+}
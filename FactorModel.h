@@ -0,0 +1,181 @@
+/**
+ * @file FactorModel.h
+ * @author  Nimrod Kremer
+ * @version 1.0
+ * @date 26.5.2020
+ *
+ * @brief Low rank factors of the users and the movies, learned from the ranks
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * Learns a vector and a bias for every user and every ranked movie by alternating
+ * least squares, so that the mean rank plus the biases plus the dot product of the
+ * vectors is close to every known rank. Every half of a round solves all of the
+ * users or all of the movies at once, each of them independently, on the threads.
+ * Input  : the loaded model and the size of the factors
+ * Process: alternating least squares
+ * Output : a predicted rank of any movie for any user.
+ */
+
+#ifndef CPP4_FACTORMODEL_H
+#define CPP4_FACTORMODEL_H
+
+#include "RecommenderModel.h"
+#include "ThreadPool.h"
+#include "ScratchArena.h"
+#include "SimilarityKernels.h"
+
+/**
+ * how the factors were trained
+ */
+typedef struct FactorTrainStats
+{
+    /**
+     * number of factors of every user and movie
+     */
+    int factors = 0;
+    /**
+     * number of rounds of alternating least squares
+     */
+    int iterations = 0;
+    /**
+     * how much the factors were pulled to 0, for every rank they have. Users solved after the
+     * training are pulled the same
+     */
+    double regularization = 0;
+    /**
+     * number of ranks the factors were trained on
+     */
+    size_t ranks = 0;
+    /**
+     * the root of the mean squared error of the predictions of the trained ranks
+     */
+    double rmse = 0;
+    /**
+     * the time the training took
+     */
+    double seconds = 0;
+    /**
+     * number of threads the training ran on
+     */
+    int threads = 0;
+} FactorTrainStats;
+
+/**
+ * the factors of the users and of the movies
+ */
+class FactorModel
+{
+private:
+    /**
+     * number of factors of every user and movie, the bias is kept after them
+     */
+    int _factors = 0;
+    /**
+     * the mean of all of the ranks
+     */
+    double _mean = 0;
+    /**
+     * users x (factors + 1), the factors of every user and then its bias
+     */
+    Array<double> _users;
+    /**
+     * number of users trained, users added later are solved when they are queried
+     */
+    size_t _numUsers = 0;
+    /**
+     * number of ranked columns trained, columns added later predict from the biases only
+     */
+    size_t _numColumns = 0;
+    /**
+     * columns x (factors + 1), the factors of the movie of every ranked column and then its
+     * bias. A column that has no ranks has 0
+     */
+    Array<double> _movies;
+    FactorTrainStats _stats;
+    /**
+     * @return number of doubles of every row
+     */
+    size_t _stride() const
+    {
+        return (size_t) _factors + 1;
+    }
+    /**
+     * solves the factors and the bias of one row from the rows it was ranked with
+     * @param others the rows of the other side, (factors + 1) doubles each with the bias last
+     * @param ids the rows of the other side the ranks were given with, ascending
+     * @param ranks the ranks
+     * @param count number of ranks
+     * @param numOthers number of rows of the other side, ids beyond them count as 0
+     * @param regularization how much the row is pulled to 0, for every rank it has
+     * @param normal scratch of (factors + 1)^2 doubles
+     * @param out receives the factors and then the bias
+     */
+    void _solve(const double *others, const int *ids, const double *ranks, size_t count, size_t numOthers,
+                double regularization, double *normal, double *out) const;
+public:
+    /**
+     * trains the factors of the users and of the ranked movies, the result doesn't depend on
+     * the number of threads of the pool
+     * @param model the loaded model
+     * @param factors number of factors of every user and movie, 0 trains nothing
+     * @param iterations number of rounds of alternating least squares
+     * @param regularization how much the factors are pulled to 0, for every rank they have
+     * @param pool the threads to train with
+     */
+    void build(const RecommenderModel &model, int factors, int iterations, double regularization, ThreadPool &pool);
+    /**
+     * removes the factors
+     */
+    void clear();
+    /**
+     * @return true if the factors were trained
+     */
+    bool empty() const
+    {
+        return _factors == 0;
+    }
+    /**
+     * @return number of factors of every user and movie
+     */
+    int factors() const
+    {
+        return _factors;
+    }
+    /**
+     * @return how the factors were trained
+     */
+    const FactorTrainStats &stats() const
+    {
+        return _stats;
+    }
+    /**
+     * finds the factors of the user. A user whose ranks changed since the training, or that
+     * was added after it, is solved against the trained movies from its ranks now
+     * @param model the loaded model
+     * @param user the id of the user
+     * @return the factors and then the bias of the user, in the scratch memory of the thread
+     */
+    ScratchVector<double> userFactors(const RecommenderModel &model, int user) const;
+    /**
+     * predicts the rank of a movie from the factors of the user, a single dot product
+     * @param userFactors the factors and then the bias of the user, from userFactors
+     * @param column the ranked column of the movie
+     * @return the predicted rank, the mean rank and the bias of the user for a column that
+     * wasn't trained or NO_ID
+     */
+    double predict(const ScratchVector<double> &userFactors, int column) const
+    {
+        double score = _mean + userFactors[_factors];
+        if (column >= 0 && (size_t) column < _numColumns)
+        {
+            const double *movie = _movies.data() + column * _stride();
+            score += movie[_factors] + SimilarityKernels::dot(userFactors.data(), movie, _factors);
+        }
+        return score;
+    }
+};
+
+#endif //CPP4_FACTORMODEL_H
@@ -0,0 +1,546 @@
+/**
+ * @file FeatureMatrix.cpp
+ * @author  Nimrod Kremer
+ * @version 1.0
+ * @date 26.5.2020
+ *
+ * @brief The features the similarities are calculated from, in the configured precision
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * The conversion of the features and the kernels of every precision. The cosine of
+ * int8 vectors is calculated on the integers, since the scales of both vectors
+ * cancel out in it. Like the double kernels, the kernels run with AVX2 when the kernels of
+ * SimilarityKernels do.
+ * Input  : the loaded model and the precision
+ * Process: conversion of the features of every movie
+ * Output : cosine similarities of queries and movies.
+ */
+
+#include "FeatureMatrix.h"
+#include "ScratchArena.h"
+#include "SimilarityKernels.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+/**
+ * the largest int8 feature, the largest feature of every movie is scaled to it
+ */
+#define INT8_LIMIT 127
+/**
+ * number of movies a task of the conversion handles
+ */
+#define CONVERT_CHUNK 1024
+
+/**
+ * how features are kept in a precision
+ * @tparam T the type of a kept feature
+ */
+template <typename T>
+struct Stored;
+
+/**
+ * float32 features, kept as they are
+ */
+template <>
+struct Stored<float>
+{
+    typedef float Accumulator;
+    /**
+     * @return the factor that takes the features to the kept units
+     */
+    static double scale(const double *, size_t)
+    {
+        return 1;
+    }
+    static float convert(double value)
+    {
+        return (float) value;
+    }
+};
+
+/**
+ * int8 features, scaled so that the largest of every vector is INT8_LIMIT
+ */
+template <>
+struct Stored<int8_t>
+{
+    typedef int32_t Accumulator;
+    /**
+     * @return the factor that takes the features to the kept units, 0 for an all zero vector
+     */
+    static double scale(const double *features, size_t size)
+    {
+        double largest = 0;
+        for (size_t i = 0; i < size; i++)
+        {
+            largest = std::max(largest, std::fabs(features[i]));
+        }
+        return largest > 0 ? INT8_LIMIT / largest : 0;
+    }
+    static int8_t convert(double value)
+    {
+        return (int8_t) std::max(-INT8_LIMIT, std::min(INT8_LIMIT, (int) std::lround(value)));
+    }
+};
+
+/**
+ * dot product of kept vectors, four accumulators so that the loop vectorizes
+ * @return the dot product in the kept units
+ */
+template <typename T>
+static inline double dotStored(const T *vec1, const T *vec2, size_t size)
+{
+    typedef typename Stored<T>::Accumulator Accumulator;
+    Accumulator acc0 = 0;
+    Accumulator acc1 = 0;
+    Accumulator acc2 = 0;
+    Accumulator acc3 = 0;
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4)
+    {
+        acc0 += (Accumulator) vec1[i] * vec2[i];
+        acc1 += (Accumulator) vec1[i + 1] * vec2[i + 1];
+        acc2 += (Accumulator) vec1[i + 2] * vec2[i + 2];
+        acc3 += (Accumulator) vec1[i + 3] * vec2[i + 3];
+    }
+    for (; i < size; i++)
+    {
+        acc0 += (Accumulator) vec1[i] * vec2[i];
+    }
+    return (double) ((acc0 + acc1) + (acc2 + acc3));
+}
+
+/**
+ * converts a vector to the kept units
+ * @param features the vector
+ * @param size the size of the vector
+ * @param out receives the kept vector
+ * @return what the kept vector is multiplied by to get back the vector
+ */
+template <typename T>
+static double convertVector(const double *features, size_t size, T *out)
+{
+    double scale = Stored<T>::scale(features, size);
+    for (size_t i = 0; i < size; i++)
+    {
+        out[i] = Stored<T>::convert(features[i] * scale);
+    }
+    return scale > 0 ? 1 / scale : 0;
+}
+
+#ifdef KERNELS_X86
+/**
+ * AVX2 dot product of float32 vectors, eight lanes with four accumulators
+ */
+__attribute__((target("avx2,fma")))
+static inline double dotAvx2(const float *vec1, const float *vec2, size_t size)
+{
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    __m256 acc2 = _mm256_setzero_ps();
+    __m256 acc3 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32)
+    {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(vec1 + i), _mm256_loadu_ps(vec2 + i), acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(vec1 + i + 8), _mm256_loadu_ps(vec2 + i + 8), acc1);
+        acc2 = _mm256_fmadd_ps(_mm256_loadu_ps(vec1 + i + 16), _mm256_loadu_ps(vec2 + i + 16), acc2);
+        acc3 = _mm256_fmadd_ps(_mm256_loadu_ps(vec1 + i + 24), _mm256_loadu_ps(vec2 + i + 24), acc3);
+    }
+    for (; i + 8 <= size; i += 8)
+    {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(vec1 + i), _mm256_loadu_ps(vec2 + i), acc0);
+    }
+    acc0 = _mm256_add_ps(_mm256_add_ps(acc0, acc1), _mm256_add_ps(acc2, acc3));
+    float lanes[8];
+    _mm256_storeu_ps(lanes, acc0);
+    float sum = ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) + ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+    for (; i < size; i++)
+    {
+        sum += vec1[i] * vec2[i];
+    }
+    return sum;
+}
+
+/**
+ * AVX2 dot product of int8 vectors, sixteen features are widened to int16 and multiplied in
+ * pairs into eight int32 lanes
+ */
+__attribute__((target("avx2")))
+static inline double dotAvx2(const int8_t *vec1, const int8_t *vec2, size_t size)
+{
+    __m256i acc0 = _mm256_setzero_si256();
+    __m256i acc1 = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32)
+    {
+        __m256i a0 = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *) (vec1 + i)));
+        __m256i b0 = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *) (vec2 + i)));
+        __m256i a1 = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *) (vec1 + i + 16)));
+        __m256i b1 = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *) (vec2 + i + 16)));
+        acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(a0, b0));
+        acc1 = _mm256_add_epi32(acc1, _mm256_madd_epi16(a1, b1));
+    }
+    for (; i + 16 <= size; i += 16)
+    {
+        __m256i a0 = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *) (vec1 + i)));
+        __m256i b0 = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *) (vec2 + i)));
+        acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(a0, b0));
+    }
+    acc0 = _mm256_add_epi32(acc0, acc1);
+    int32_t lanes[8];
+    _mm256_storeu_si256((__m256i *) lanes, acc0);
+    int32_t sum = lanes[0] + lanes[1] + lanes[2] + lanes[3] + lanes[4] + lanes[5] + lanes[6] + lanes[7];
+    for (; i < size; i++)
+    {
+        sum += (int32_t) vec1[i] * vec2[i];
+    }
+    return sum;
+}
+
+/**
+ * AVX2 cosine similarity of many kept queries against many kept rows, every row read once
+ */
+template <typename T>
+__attribute__((target("avx2,fma")))
+static void cosineBlockAvx2(const T *matrix, const double *normals, size_t numFeatures, const T *queries,
+                            const double *queryNormals, size_t numQueries, const int *rows, size_t numRows,
+                            double *out)
+{
+    for (size_t i = 0; i < numRows; i++)
+    {
+        const T *row = matrix + (size_t) rows[i] * numFeatures;
+        if (i + 1 < numRows)
+        {
+            _mm_prefetch((const char *) (matrix + (size_t) rows[i + 1] * numFeatures), _MM_HINT_T0);
+        }
+        for (size_t q = 0; q < numQueries; q++)
+        {
+            out[q * numRows + i] = dotAvx2(queries + q * numFeatures, row, numFeatures) /
+                                   (queryNormals[q] * normals[rows[i]]);
+        }
+    }
+}
+#endif
+
+/**
+ * cosine similarity of many kept queries against many kept rows, every row read once
+ */
+template <typename T>
+static void cosineBlockStored(const T *matrix, const double *normals, size_t numFeatures, const T *queries,
+                              const double *queryNormals, size_t numQueries, const int *rows, size_t numRows,
+                              double *out)
+{
+#ifdef KERNELS_X86
+    if (SimilarityKernels::isa() >= KernelIsa::AVX2)
+    {
+        cosineBlockAvx2(matrix, normals, numFeatures, queries, queryNormals, numQueries, rows, numRows, out);
+        return;
+    }
+#endif
+    for (size_t i = 0; i < numRows; i++)
+    {
+        const T *row = matrix + (size_t) rows[i] * numFeatures;
+        for (size_t q = 0; q < numQueries; q++)
+        {
+            out[q * numRows + i] = dotStored(queries + q * numFeatures, row, numFeatures) /
+                                   (queryNormals[q] * normals[rows[i]]);
+        }
+    }
+}
+
+/**
+ * cosine similarity of double queries against many kept rows, the queries are converted first
+ */
+template <typename T>
+static void cosineQueries(const T *matrix, const double *normals, size_t numFeatures, const double *queries,
+                          size_t numQueries, const int *rows, size_t numRows, double *out)
+{
+    ScratchScope scope;
+    ScratchVector<T> converted(numQueries * numFeatures);
+    ScratchVector<double> convertedNormals(numQueries);
+    for (size_t q = 0; q < numQueries; q++)
+    {
+        T *query = converted.data() + q * numFeatures;
+        convertVector(queries + q * numFeatures, numFeatures, query);
+        convertedNormals[q] = std::sqrt(dotStored(query, query, numFeatures));
+    }
+    cosineBlockStored(matrix, normals, numFeatures, converted.data(), convertedNormals.data(), numQueries, rows,
+                      numRows, out);
+}
+
+/**
+ * cosine similarity of kept rows against many kept rows, the rows compared are packed first
+ */
+template <typename T>
+static void cosineRowBlock(const T *matrix, const double *normals, size_t numFeatures, const int *queries,
+                           size_t numQueries, const int *rows, size_t numRows, double *out)
+{
+    ScratchScope scope;
+    ScratchVector<T> packed(numQueries * numFeatures);
+    ScratchVector<double> packedNormals(numQueries);
+    for (size_t q = 0; q < numQueries; q++)
+    {
+        std::copy_n(matrix + (size_t) queries[q] * numFeatures, numFeatures, packed.begin() + q * numFeatures);
+        packedNormals[q] = normals[queries[q]];
+    }
+    cosineBlockStored(matrix, normals, numFeatures, packed.data(), packedNormals.data(), numQueries, rows, numRows,
+                      out);
+}
+
+/**
+ * converts the features of all of the movies of the model
+ * @param model the loaded model
+ * @param precision the precision to keep the features in
+ * @param pool the threads to convert with
+ */
+void FeatureMatrix::build(const RecommenderModel &model, FeaturePrecision precision, ThreadPool &pool)
+{
+    *this = FeatureMatrix();
+    _precision = precision;
+    _convert(model, &pool);
+}
+
+/**
+ * converts the movies added to the model since the last conversion
+ * @param model the loaded model
+ */
+void FeatureMatrix::update(const RecommenderModel &model)
+{
+    _convert(model, nullptr);
+}
+
+/**
+ * converts the movies the model added since the last conversion. The arrays are shared by the
+ * copies of the snapshot, so they are copied with the new movies instead of being changed
+ * @param model the loaded model
+ * @param pool the threads to convert with, null converts on the calling thread
+ */
+void FeatureMatrix::_convert(const RecommenderModel &model, ThreadPool *pool)
+{
+    size_t numMovies = model.movies().size();
+    if (_precision == FeaturePrecision::DOUBLE || numMovies == _numMovies)
+    {
+        return;
+    }
+    if (_numMovies == 0)
+    {
+        _numFeatures = model.numFeatures();
+    }
+    std::vector<float> floats = _floats.toVector();
+    std::vector<int8_t> bytes = _bytes.toVector();
+    std::vector<float> scales = _scales.toVector();
+    std::vector<double> normals = _normals.toVector();
+    if (_precision == FeaturePrecision::FLOAT)
+    {
+        floats.resize(numMovies * _numFeatures);
+    }
+    else
+    {
+        bytes.resize(numMovies * _numFeatures);
+        scales.resize(numMovies);
+    }
+    normals.resize(numMovies);
+
+    size_t first = _numMovies;
+    size_t numChunks = (numMovies - first + CONVERT_CHUNK - 1) / CONVERT_CHUNK;
+    auto convertChunk = [&](size_t chunk)
+    {
+        size_t end = std::min(first + (chunk + 1) * CONVERT_CHUNK, numMovies);
+        for (size_t movie = first + chunk * CONVERT_CHUNK; movie < end; movie++)
+        {
+            const double *features = model.features((int) movie);
+            if (_precision == FeaturePrecision::FLOAT)
+            {
+                float *row = floats.data() + movie * _numFeatures;
+                convertVector(features, _numFeatures, row);
+                normals[movie] = std::sqrt(dotStored(row, row, _numFeatures));
+            }
+            else
+            {
+                int8_t *row = bytes.data() + movie * _numFeatures;
+                scales[movie] = (float) convertVector(features, _numFeatures, row);
+                normals[movie] = std::sqrt(dotStored(row, row, _numFeatures));
+            }
+        }
+    };
+    if (pool != nullptr)
+    {
+        pool->parallelFor(numChunks, convertChunk);
+    }
+    else
+    {
+        for (size_t chunk = 0; chunk < numChunks; chunk++)
+        {
+            convertChunk(chunk);
+        }
+    }
+    _floats.assign(std::move(floats));
+    _bytes.assign(std::move(bytes));
+    _scales.assign(std::move(scales));
+    _normals.assign(std::move(normals));
+    _numMovies = numMovies;
+}
+
+/**
+ * @param model the loaded model
+ * @return number of bytes the similarities are calculated from, with the normals
+ */
+size_t FeatureMatrix::bytes(const RecommenderModel &model) const
+{
+    if (_precision == FeaturePrecision::DOUBLE)
+    {
+        return model.movies().size() * (model.numFeatures() + 1) * sizeof(double);
+    }
+    return _floats.size() * sizeof(float) + _bytes.size() * sizeof(int8_t) + _scales.size() * sizeof(float) +
+           _normals.size() * sizeof(double);
+}
+
+/**
+ * cosine similarity of one query against many movies
+ * @param model the loaded model
+ * @param query the query, numFeatures doubles
+ * @param queryNormal the normal of the query
+ * @param movies the movies to compare against
+ * @param numMovies number of movies to compare against
+ * @param out receives the similarity of every movie, in the order of the movies
+ */
+void FeatureMatrix::cosineMany(const RecommenderModel &model, const double *query, double queryNormal,
+                               const int *movies, size_t numMovies, double *out) const
+{
+    switch (_precision)
+    {
+        case FeaturePrecision::FLOAT:
+            cosineQueries(_floats.data(), _normals.data(), _numFeatures, query, 1, movies, numMovies, out);
+            break;
+        case FeaturePrecision::INT8:
+            cosineQueries(_bytes.data(), _normals.data(), _numFeatures, query, 1, movies, numMovies, out);
+            break;
+        default:
+            SimilarityKernels::cosineMany(query, queryNormal, model.features(0), model.movieNormals(),
+                                          model.numFeatures(), movies, numMovies, out);
+    }
+}
+
+/**
+ * cosine similarity of a movie against many movies
+ * @param model the loaded model
+ * @param movie the movie to compare
+ * @param movies the movies to compare against
+ * @param numMovies number of movies to compare against
+ * @param out receives the similarity of every movie, in the order of the movies
+ */
+void FeatureMatrix::cosineMovie(const RecommenderModel &model, int movie, const int *movies, size_t numMovies,
+                                double *out) const
+{
+    switch (_precision)
+    {
+        case FeaturePrecision::FLOAT:
+            cosineBlockStored(_floats.data(), _normals.data(), _numFeatures, _floats.data() + movie * _numFeatures,
+                              _normals.data() + movie, 1, movies, numMovies, out);
+            break;
+        case FeaturePrecision::INT8:
+            cosineBlockStored(_bytes.data(), _normals.data(), _numFeatures, _bytes.data() + movie * _numFeatures,
+                              _normals.data() + movie, 1, movies, numMovies, out);
+            break;
+        default:
+            SimilarityKernels::cosineMany(model.features(movie), model.movieNormal(movie), model.features(0),
+                                          model.movieNormals(), model.numFeatures(), movies, numMovies, out);
+    }
+}
+
+/**
+ * cosine similarity of many queries against many movies, every movie read once for all of the
+ * queries
+ * @param model the loaded model
+ * @param queries row-major matrix of numQueries x numFeatures doubles
+ * @param queryNormals the normal of every query
+ * @param numQueries number of queries
+ * @param movies the movies to compare against
+ * @param numMovies number of movies to compare against
+ * @param out receives numQueries x numMovies similarities, row-major by query
+ */
+void FeatureMatrix::cosineBlock(const RecommenderModel &model, const double *queries, const double *queryNormals,
+                                size_t numQueries, const int *movies, size_t numMovies, double *out) const
+{
+    switch (_precision)
+    {
+        case FeaturePrecision::FLOAT:
+            cosineQueries(_floats.data(), _normals.data(), _numFeatures, queries, numQueries, movies, numMovies,
+                          out);
+            break;
+        case FeaturePrecision::INT8:
+            cosineQueries(_bytes.data(), _normals.data(), _numFeatures, queries, numQueries, movies, numMovies,
+                          out);
+            break;
+        default:
+            SimilarityKernels::cosineBlock(queries, queryNormals, numQueries, model.features(0),
+                                           model.movieNormals(), model.numFeatures(), movies, numMovies, out);
+    }
+}
+
+/**
+ * cosine similarity of many movies against many movies, every movie compared against read once
+ * for all of them
+ * @param model the loaded model
+ * @param queries the movies to compare
+ * @param numQueries number of movies to compare
+ * @param movies the movies to compare against
+ * @param numMovies number of movies to compare against
+ * @param out receives numQueries x numMovies similarities, row-major by query
+ */
+void FeatureMatrix::cosineMovieBlock(const RecommenderModel &model, const int *queries, size_t numQueries,
+                                     const int *movies, size_t numMovies, double *out) const
+{
+    switch (_precision)
+    {
+        case FeaturePrecision::FLOAT:
+            cosineRowBlock(_floats.data(), _normals.data(), _numFeatures, queries, numQueries, movies, numMovies,
+                           out);
+            break;
+        case FeaturePrecision::INT8:
+            cosineRowBlock(_bytes.data(), _normals.data(), _numFeatures, queries, numQueries, movies, numMovies,
+                           out);
+            break;
+        default:
+        {
+            // the features of the movies compared are packed, so they stay in the cache
+            ScratchScope scope;
+            size_t numFeatures = model.numFeatures();
+            ScratchVector<double> packed(numQueries * numFeatures);
+            ScratchVector<double> packedNormals(numQueries);
+            for (size_t q = 0; q < numQueries; q++)
+            {
+                std::copy_n(model.features(queries[q]), numFeatures, packed.begin() + q * numFeatures);
+                packedNormals[q] = model.movieNormal(queries[q]);
+            }
+            SimilarityKernels::cosineBlock(packed.data(), packedNormals.data(), numQueries, model.features(0),
+                                           model.movieNormals(), numFeatures, movies, numMovies, out);
+        }
+    }
+}
+
+/**
+ * @param precision a precision
+ * @return printable name of the precision
+ */
+const char *FeatureMatrix::precisionName(FeaturePrecision precision)
+{
+    switch (precision)
+    {
+        case FeaturePrecision::FLOAT:
+            return "float32";
+        case FeaturePrecision::INT8:
+            return "int8";
+        default:
+            return "double";
+    }
+}
@@ -0,0 +1,154 @@
+/**
+ * @file FeatureMatrix.h
+ * @author  Nimrod Kremer
+ * @version 1.0
+ * @date 26.5.2020
+ *
+ * @brief The features the similarities are calculated from, in the configured precision
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * In double precision the features of the model are used as they are. In float32 and
+ * in int8 with a scale for every movie, a compact copy of the features is kept and
+ * every similarity is calculated from it, a query being converted to the same
+ * precision first. The kernels are templates, instantiated for every precision.
+ * Input  : the loaded model and the precision
+ * Process: conversion of the features of every movie
+ * Output : cosine similarities of queries and movies.
+ */
+
+#ifndef CPP4_FEATUREMATRIX_H
+#define CPP4_FEATUREMATRIX_H
+
+#include <cstdint>
+#include "RecommenderModel.h"
+#include "ThreadPool.h"
+
+/**
+ * the precision the features of the similarities are kept in
+ */
+enum class FeaturePrecision
+{
+    DOUBLE,
+    FLOAT,
+    INT8
+};
+
+/**
+ * the features of the movies in the configured precision
+ */
+class FeatureMatrix
+{
+private:
+    FeaturePrecision _precision = FeaturePrecision::DOUBLE;
+    /**
+     * number of features of every movie
+     */
+    size_t _numFeatures = 0;
+    /**
+     * number of movies converted
+     */
+    size_t _numMovies = 0;
+    /**
+     * movies x features in float32
+     */
+    Array<float> _floats;
+    /**
+     * movies x features in int8, every movie scaled so that its largest feature is 127
+     */
+    Array<int8_t> _bytes;
+    /**
+     * what every int8 movie is multiplied by to get back its features
+     */
+    Array<float> _scales;
+    /**
+     * the normal of every converted movie, in the units it is kept in
+     */
+    Array<double> _normals;
+    /**
+     * converts the movies the model added since the last conversion
+     * @param model the loaded model
+     * @param pool the threads to convert with, null converts on the calling thread
+     */
+    void _convert(const RecommenderModel &model, ThreadPool *pool);
+public:
+    /**
+     * converts the features of all of the movies of the model
+     * @param model the loaded model
+     * @param precision the precision to keep the features in
+     * @param pool the threads to convert with
+     */
+    void build(const RecommenderModel &model, FeaturePrecision precision, ThreadPool &pool);
+    /**
+     * converts the movies added to the model since the last conversion
+     * @param model the loaded model
+     */
+    void update(const RecommenderModel &model);
+    /**
+     * @return the precision of the features
+     */
+    FeaturePrecision precision() const
+    {
+        return _precision;
+    }
+    /**
+     * @param model the loaded model
+     * @return number of bytes the similarities are calculated from, with the normals
+     */
+    size_t bytes(const RecommenderModel &model) const;
+    /**
+     * cosine similarity of one query against many movies
+     * @param model the loaded model
+     * @param query the query, numFeatures doubles
+     * @param queryNormal the normal of the query
+     * @param movies the movies to compare against
+     * @param numMovies number of movies to compare against
+     * @param out receives the similarity of every movie, in the order of the movies
+     */
+    void cosineMany(const RecommenderModel &model, const double *query, double queryNormal, const int *movies,
+                    size_t numMovies, double *out) const;
+    /**
+     * cosine similarity of a movie against many movies
+     * @param model the loaded model
+     * @param movie the movie to compare
+     * @param movies the movies to compare against
+     * @param numMovies number of movies to compare against
+     * @param out receives the similarity of every movie, in the order of the movies
+     */
+    void cosineMovie(const RecommenderModel &model, int movie, const int *movies, size_t numMovies,
+                     double *out) const;
+    /**
+     * cosine similarity of many queries against many movies, every movie read once for all of
+     * the queries
+     * @param model the loaded model
+     * @param queries row-major matrix of numQueries x numFeatures doubles
+     * @param queryNormals the normal of every query
+     * @param numQueries number of queries
+     * @param movies the movies to compare against
+     * @param numMovies number of movies to compare against
+     * @param out receives numQueries x numMovies similarities, row-major by query
+     */
+    void cosineBlock(const RecommenderModel &model, const double *queries, const double *queryNormals,
+                     size_t numQueries, const int *movies, size_t numMovies, double *out) const;
+    /**
+     * cosine similarity of many movies against many movies, every movie compared against read
+     * once for all of them
+     * @param model the loaded model
+     * @param queries the movies to compare
+     * @param numQueries number of movies to compare
+     * @param movies the movies to compare against
+     * @param numMovies number of movies to compare against
+     * @param out receives numQueries x numMovies similarities, row-major by query
+     */
+    void cosineMovieBlock(const RecommenderModel &model, const int *queries, size_t numQueries, const int *movies,
+                          size_t numMovies, double *out) const;
+    /**
+     * @param precision a precision
+     * @return printable name of the precision
+     */
+    static const char *precisionName(FeaturePrecision precision);
+};
+
+#endif //CPP4_FEATUREMATRIX_H
@@ -0,0 +1,262 @@
+/**
+ * @file MappedFile.cpp
+ * @author  Nimrod Kremer
+ * @version 1.0
+ * @date 26.5.2020
+ *
+ * @brief Read only view of a whole file, and a file written in place
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * Maps the file into memory where the system supports it, so the file is read
+ * by the page cache with no copy, and reads it into a buffer elsewhere. A file
+ * written in place is mapped shared, so what is written goes to the page cache
+ * and the pages already written can be dropped from the process.
+ * Input  : path of a file
+ * Process: memory mapping
+ * Output : the bytes of the file.
+ */
+
+#include "MappedFile.h"
+#include <algorithm>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define HAS_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <iterator>
+#endif
+#include <fstream>
+
+/**
+ * unmaps the file
+ */
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+/**
+ * unmaps the file
+ */
+void MappedFile::close()
+{
+#ifdef HAS_MMAP
+    if (_mapped)
+    {
+        munmap((void *) _data, _size);
+    }
+#endif
+    std::vector<char>().swap(_buffer);
+    _data = nullptr;
+    _size = 0;
+    _mapped = false;
+}
+
+/**
+ * maps the given file, replacing the file mapped before
+ * @param path the path to the file
+ * @param sequential true if the file is read from the start to the end, false if it is
+ * read in place at random
+ * @return false if the file can't be read
+ */
+bool MappedFile::open(const char *path, bool sequential)
+{
+    close();
+#ifdef HAS_MMAP
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode))
+    {
+        ::close(fd);
+        return false;
+    }
+    _size = (size_t) info.st_size;
+    if (_size > 0)
+    {
+        void *address = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (address == MAP_FAILED)
+        {
+            ::close(fd);
+            _size = 0;
+            return false;
+        }
+        madvise(address, _size, sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+        _data = (const char *) address;
+        _mapped = true;
+    }
+    ::close(fd);
+    return true;
+#else
+    std::ifstream fs(path, std::ios::binary);
+    if (!fs)
+    {
+        return false;
+    }
+    _buffer.assign(std::istreambuf_iterator<char>(fs), std::istreambuf_iterator<char>());
+    _data = _buffer.data();
+    _size = _buffer.size();
+    return true;
+#endif
+}
+
+/**
+ * drops the pages of a range already read from the process, they are read again from the page
+ * cache or the file if they are read again
+ * @param offset the first byte of the range
+ * @param size number of bytes in the range
+ */
+void MappedFile::release(size_t offset, size_t size) const
+{
+#ifdef HAS_MMAP
+    // only the whole pages inside the range
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    size_t begin = (offset + page - 1) / page * page;
+    size_t end = std::min(offset + size, _size) / page * page;
+    if (_mapped && begin < end)
+    {
+        madvise((void *) (_data + begin), end - begin, MADV_DONTNEED);
+    }
+#else
+    (void) offset;
+    (void) size;
+#endif
+}
+
+/**
+ * closes the file
+ */
+MappedOutput::~MappedOutput()
+{
+    close();
+}
+
+/**
+ * unmaps the file without closing it
+ */
+void MappedOutput::_unmap()
+{
+#ifdef HAS_MMAP
+    if (_data != nullptr)
+    {
+        munmap(_data, _size);
+    }
+    _data = nullptr;
+#endif
+}
+
+/**
+ * creates the file, replacing a file of the same path, empty until it is resized
+ * @param path the path to the file
+ * @return false if the file can't be created
+ */
+bool MappedOutput::create(const char *path)
+{
+    close();
+    _path = path;
+#ifdef HAS_MMAP
+    _fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    return _fd >= 0;
+#else
+    return (bool) std::ofstream(path, std::ios::binary | std::ios::trunc);
+#endif
+}
+
+/**
+ * changes the size of the file and maps all of it again, the bytes added are zero
+ * @param size the new number of bytes
+ * @return false if the file can't be resized
+ */
+bool MappedOutput::resize(size_t size)
+{
+#ifdef HAS_MMAP
+    _unmap();
+    _size = 0;
+    if (_fd < 0 || ftruncate(_fd, (off_t) size) != 0)
+    {
+        return false;
+    }
+    if (size > 0)
+    {
+        void *address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+        if (address == MAP_FAILED)
+        {
+            return false;
+        }
+        _data = (char *) address;
+    }
+    _size = size;
+    return true;
+#else
+    _buffer.resize(size, 0);
+    _data = _buffer.data();
+    _size = size;
+    return true;
+#endif
+}
+
+/**
+ * lets the system drop the written pages of the range from the memory of the process, they
+ * are read back from the page cache or the file when touched again
+ * @param offset the first byte of the range
+ * @param size number of bytes in the range
+ */
+void MappedOutput::release(size_t offset, size_t size)
+{
+#ifdef HAS_MMAP
+    // only the whole pages inside the range
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    size_t begin = (offset + page - 1) / page * page;
+    size_t end = std::min(offset + size, _size) / page * page;
+    if (_data != nullptr && begin < end)
+    {
+        msync(_data + begin, end - begin, MS_ASYNC);
+        madvise(_data + begin, end - begin, MADV_DONTNEED);
+    }
+#else
+    (void) offset;
+    (void) size;
+#endif
+}
+
+/**
+ * writes everything to the file
+ * @return false if the file can't be written
+ */
+bool MappedOutput::sync()
+{
+#ifdef HAS_MMAP
+    return _data == nullptr || msync(_data, _size, MS_SYNC) == 0;
+#else
+    std::ofstream fs(_path, std::ios::binary | std::ios::trunc);
+    fs.write(_buffer.data(), _buffer.size());
+    return (bool) fs.flush();
+#endif
+}
+
+/**
+ * unmaps and closes the file
+ */
+void MappedOutput::close()
+{
+#ifdef HAS_MMAP
+    _unmap();
+    if (_fd >= 0)
+    {
+        ::close(_fd);
+    }
+#endif
+    _fd = -1;
+    _size = 0;
+    _data = nullptr;
+    std::vector<char>().swap(_buffer);
+}
@@ -0,0 +1,176 @@
+/**
+ * @file MappedFile.h
+ * @author  Nimrod Kremer
+ * @version 1.0
+ * @date 26.5.2020
+ *
+ * @brief Read only view of a whole file, and a file written in place
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * Maps the file into memory where the system supports it, so the file is read
+ * by the page cache with no copy, and reads it into a buffer elsewhere. A file
+ * written in place is mapped shared, so what is written goes to the page cache
+ * and the pages already written can be dropped from the process.
+ * Input  : path of a file
+ * Process: memory mapping
+ * Output : the bytes of the file.
+ */
+
+#ifndef CPP4_MAPPEDFILE_H
+#define CPP4_MAPPEDFILE_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ * the bytes of a file, valid as long as the object lives
+ */
+class MappedFile
+{
+private:
+    /**
+     * the first byte of the file
+     */
+    const char *_data = nullptr;
+    /**
+     * number of bytes in the file
+     */
+    size_t _size = 0;
+    /**
+     * true if _data is a mapping that has to be unmapped
+     */
+    bool _mapped = false;
+    /**
+     * holds the file when it can't be mapped
+     */
+    std::vector<char> _buffer;
+public:
+    MappedFile() = default;
+    /**
+     * unmaps the file
+     */
+    ~MappedFile();
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    /**
+     * maps the given file, replacing the file mapped before
+     * @param path the path to the file
+     * @param sequential true if the file is read from the start to the end, false if it is
+     * read in place at random
+     * @return false if the file can't be read
+     */
+    bool open(const char *path, bool sequential = true);
+    /**
+     * unmaps the file
+     */
+    void close();
+    /**
+     * drops the pages of a range already read from the process, they are read again from the
+     * page cache or the file if they are read again
+     * @param offset the first byte of the range
+     * @param size number of bytes in the range
+     */
+    void release(size_t offset, size_t size) const;
+    /**
+     * @return the first byte of the file
+     */
+    const char *data() const
+    {
+        return _data;
+    }
+    /**
+     * @return number of bytes in the file
+     */
+    size_t size() const
+    {
+        return _size;
+    }
+};
+
+/**
+ * a file written in place through a mapping, valid until it is resized or closed
+ */
+class MappedOutput
+{
+private:
+    /**
+     * the first byte of the file
+     */
+    char *_data = nullptr;
+    /**
+     * number of bytes in the file
+     */
+    size_t _size = 0;
+    /**
+     * the open file, -1 if there is none
+     */
+    int _fd = -1;
+    /**
+     * the path of the file
+     */
+    std::string _path;
+    /**
+     * holds the file when it can't be mapped, written out by sync
+     */
+    std::vector<char> _buffer;
+    /**
+     * unmaps the file without closing it
+     */
+    void _unmap();
+public:
+    MappedOutput() = default;
+    /**
+     * closes the file
+     */
+    ~MappedOutput();
+    MappedOutput(const MappedOutput &) = delete;
+    MappedOutput &operator=(const MappedOutput &) = delete;
+    /**
+     * creates the file, replacing a file of the same path, empty until it is resized
+     * @param path the path to the file
+     * @return false if the file can't be created
+     */
+    bool create(const char *path);
+    /**
+     * changes the size of the file and maps all of it again, the bytes added are zero
+     * @param size the new number of bytes
+     * @return false if the file can't be resized
+     */
+    bool resize(size_t size);
+    /**
+     * lets the system drop the written pages of the range from the memory of the process, they
+     * are read back from the page cache or the file when touched again
+     * @param offset the first byte of the range
+     * @param size number of bytes in the range
+     */
+    void release(size_t offset, size_t size);
+    /**
+     * writes everything to the file
+     * @return false if the file can't be written
+     */
+    bool sync();
+    /**
+     * unmaps and closes the file
+     */
+    void close();
+    /**
+     * @return the first byte of the file
+     */
+    char *data() const
+    {
+        return _data;
+    }
+    /**
+     * @return number of bytes in the file
+     */
+    size_t size() const
+    {
+        return _size;
+    }
+};
+
+#endif //CPP4_MAPPEDFILE_H
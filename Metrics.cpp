@@ -0,0 +1,299 @@
+/**
+ * @file Metrics.cpp
+ * @author  Nimrod Kremer
+ * @version 1.0
+ * @date 26.5.2020
+ *
+ * @brief Counters and stage timers of the hot paths
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * The shards of the counters, and their export. With CPP4_METRICS the global
+ * operator new is replaced as well, to count the allocations of the whole process.
+ * Input  : the events of the queries and of the loads
+ * Process: relaxed additions to the shard of the thread
+ * Output : the totals, as Prometheus text or as JSON.
+ */
+
+#include "Metrics.h"
+#include "ReturnCodes.h"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+
+/**
+ * number of shards, threads beyond it share shards
+ */
+#define METRIC_SHARDS 32
+/**
+ * the size of a cache line, a shard starts on its own line
+ */
+#define CACHE_LINE 64
+
+/**
+ * the totals of the threads of one shard
+ */
+typedef struct alignas(CACHE_LINE) MetricShard
+{
+    std::atomic<uint64_t> counters[NUM_COUNTERS];
+    std::atomic<uint64_t> stageCounts[NUM_STAGES];
+    std::atomic<uint64_t> stageNanos[NUM_STAGES];
+} MetricShard;
+
+/**
+ * static storage is zeroed before anything runs, so allocations of static constructors are counted
+ */
+static MetricShard gShards[METRIC_SHARDS];
+/**
+ * the shard of the next thread that adds
+ */
+static std::atomic<unsigned> gNextShard(0);
+
+/**
+ * the names of the counters in the export
+ */
+static const char *const COUNTER_NAMES[NUM_COUNTERS] = {"similarities_computed", "similarity_cache_hits",
+                                                        "neighbors_examined", "candidates_scored",
+                                                        "profiles_built", "profile_cache_hits", "allocations",
+                                                        "bytes_allocated"};
+/**
+ * the names of the stages in the export
+ */
+static const char *const STAGE_NAMES[NUM_STAGES] = {"load", "content_query", "predict_query", "cf_query",
+                                                    "profile", "similarity", "select", "mf_query",
+                                                    "user_cf_query"};
+
+/**
+ * @return the shard of the calling thread, picked on its first addition
+ */
+static MetricShard &shard()
+{
+    static thread_local int index = -1;
+    if (index < 0)
+    {
+        index = (int) (gNextShard.fetch_add(1, std::memory_order_relaxed) % METRIC_SHARDS);
+    }
+    return gShards[index];
+}
+
+/**
+ * @return true if the metrics were built in
+ */
+bool Metrics::enabled()
+{
+#ifdef CPP4_METRICS
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+ * adds to the counter
+ * @param counter the counter
+ * @param amount what to add
+ */
+void Metrics::add(MetricCounter counter, uint64_t amount)
+{
+    shard().counters[counter].fetch_add(amount, std::memory_order_relaxed);
+}
+
+/**
+ * adds a run of the stage
+ * @param stage the stage
+ * @param nanos how long the run took
+ */
+void Metrics::addStage(MetricStage stage, uint64_t nanos)
+{
+    MetricShard &mine = shard();
+    mine.stageCounts[stage].fetch_add(1, std::memory_order_relaxed);
+    mine.stageNanos[stage].fetch_add(nanos, std::memory_order_relaxed);
+}
+
+/**
+ * @return the totals of all of the threads, additions that run meanwhile may be seen partly
+ */
+MetricsSnapshot Metrics::read()
+{
+    MetricsSnapshot snapshot;
+    for (const MetricShard &each: gShards)
+    {
+        for (int i = 0; i < NUM_COUNTERS; i++)
+        {
+            snapshot.counters[i] += each.counters[i].load(std::memory_order_relaxed);
+        }
+        for (int i = 0; i < NUM_STAGES; i++)
+        {
+            snapshot.stageCounts[i] += each.stageCounts[i].load(std::memory_order_relaxed);
+            snapshot.stageNanos[i] += each.stageNanos[i].load(std::memory_order_relaxed);
+        }
+    }
+    return snapshot;
+}
+
+/**
+ * zeroes all of the totals
+ */
+void Metrics::reset()
+{
+    for (MetricShard &each: gShards)
+    {
+        for (int i = 0; i < NUM_COUNTERS; i++)
+        {
+            each.counters[i].store(0, std::memory_order_relaxed);
+        }
+        for (int i = 0; i < NUM_STAGES; i++)
+        {
+            each.stageCounts[i].store(0, std::memory_order_relaxed);
+            each.stageNanos[i].store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+/**
+ * the counters are counters and the stages one summary, labeled by the stage
+ * @param snapshot the totals
+ * @return the totals in the Prometheus text format
+ */
+std::string Metrics::toPrometheus(const MetricsSnapshot &snapshot)
+{
+    std::string text;
+    char line[256];
+    for (int i = 0; i < NUM_COUNTERS; i++)
+    {
+        std::snprintf(line, sizeof(line), "# TYPE cpp4_%s_total counter\ncpp4_%s_total %llu\n", COUNTER_NAMES[i],
+                      COUNTER_NAMES[i], (unsigned long long) snapshot.counters[i]);
+        text += line;
+    }
+    text += "# TYPE cpp4_stage_seconds summary\n";
+    for (int i = 0; i < NUM_STAGES; i++)
+    {
+        std::snprintf(line, sizeof(line), "cpp4_stage_seconds_count{stage=\"%s\"} %llu\n"
+                                          "cpp4_stage_seconds_sum{stage=\"%s\"} %.9f\n",
+                      STAGE_NAMES[i], (unsigned long long) snapshot.stageCounts[i], STAGE_NAMES[i],
+                      snapshot.stageNanos[i] / 1e9);
+        text += line;
+    }
+    return text;
+}
+
+/**
+ * @param snapshot the totals
+ * @return the totals as a JSON object
+ */
+std::string Metrics::toJson(const MetricsSnapshot &snapshot)
+{
+    std::string text = enabled() ? "{\"enabled\": true, \"counters\": {" : "{\"enabled\": false, \"counters\": {";
+    char field[256];
+    for (int i = 0; i < NUM_COUNTERS; i++)
+    {
+        std::snprintf(field, sizeof(field), "%s\"%s\": %llu", i == 0 ? "" : ", ", COUNTER_NAMES[i],
+                      (unsigned long long) snapshot.counters[i]);
+        text += field;
+    }
+    text += "}, \"stages\": {";
+    for (int i = 0; i < NUM_STAGES; i++)
+    {
+        std::snprintf(field, sizeof(field), "%s\"%s\": {\"count\": %llu, \"seconds\": %.9f}", i == 0 ? "" : ", ",
+                      STAGE_NAMES[i], (unsigned long long) snapshot.stageCounts[i], snapshot.stageNanos[i] / 1e9);
+        text += field;
+    }
+    return text + "}}\n";
+}
+
+/**
+ * writes the current totals next to the file and renames it into place, so a reader of the file
+ * never sees half of it
+ * @param path the path of the file
+ * @param json true for JSON, false for the Prometheus text format
+ * @return success or fail if the file can't be written
+ */
+int Metrics::write(const std::string &path, bool json)
+{
+    MetricsSnapshot snapshot = read();
+    std::string temporary = path + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::trunc);
+        out << (json ? toJson(snapshot) : toPrometheus(snapshot));
+        out.close();
+        if (!out)
+        {
+            std::remove(temporary.c_str());
+            return FAIL;
+        }
+    }
+    return std::rename(temporary.c_str(), path.c_str()) == 0 ? SUCCESS : FAIL;
+}
+
+#ifdef CPP4_METRICS
+/**
+ * allocates and counts the allocation
+ * @param size number of bytes
+ * @return the memory, or null if there is none
+ */
+static void *countedAllocate(std::size_t size)
+{
+    Metrics::add(ALLOCATIONS, 1);
+    Metrics::add(BYTES_ALLOCATED, size);
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+void *operator new(std::size_t size)
+{
+    void *memory = countedAllocate(size);
+    if (memory == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void *operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+    return countedAllocate(size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+    return countedAllocate(size);
+}
+
+void operator delete(void *memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void *memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void *memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void *memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void *memory, const std::nothrow_t &) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void *memory, const std::nothrow_t &) noexcept
+{
+    std::free(memory);
+}
+#endif
@@ -0,0 +1,168 @@
+/**
+ * @file Metrics.h
+ * @author  Nimrod Kremer
+ * @version 1.0
+ * @date 26.5.2020
+ *
+ * @brief Counters and stage timers of the hot paths
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * Built in only when CPP4_METRICS is defined, otherwise the macros expand to nothing
+ * and the export holds zeros. Every thread adds to its own shard of the counters, so
+ * the hot paths never share a cache line, and reading sums the shards.
+ * Input  : the events of the queries and of the loads
+ * Process: relaxed additions to the shard of the thread
+ * Output : the totals, as Prometheus text or as JSON.
+ */
+
+#ifndef CPP4_METRICS_H
+#define CPP4_METRICS_H
+
+#include <cstdint>
+#include <chrono>
+#include <string>
+
+/**
+ * the things that are counted
+ */
+enum MetricCounter
+{
+    SIMILARITIES_COMPUTED,
+    SIMILARITY_CACHE_HITS,
+    NEIGHBORS_EXAMINED,
+    CANDIDATES_SCORED,
+    PROFILES_BUILT,
+    PROFILE_CACHE_HITS,
+    ALLOCATIONS,
+    BYTES_ALLOCATED,
+    NUM_COUNTERS
+};
+
+/**
+ * the timed stages, an outer stage includes the time of the stages it runs
+ */
+enum MetricStage
+{
+    STAGE_LOAD,
+    STAGE_CONTENT_QUERY,
+    STAGE_PREDICT_QUERY,
+    STAGE_CF_QUERY,
+    STAGE_PROFILE,
+    STAGE_SIMILARITY,
+    STAGE_SELECT,
+    STAGE_MF_QUERY,
+    STAGE_USER_CF_QUERY,
+    NUM_STAGES
+};
+
+/**
+ * the totals of all of the threads at one moment
+ */
+typedef struct MetricsSnapshot
+{
+    uint64_t counters[NUM_COUNTERS] = {};
+    /**
+     * number of times every stage ran
+     */
+    uint64_t stageCounts[NUM_STAGES] = {};
+    /**
+     * total time of every stage in nanoseconds
+     */
+    uint64_t stageNanos[NUM_STAGES] = {};
+} MetricsSnapshot;
+
+/**
+ * the process wide metrics
+ */
+class Metrics
+{
+public:
+    /**
+     * @return true if the metrics were built in
+     */
+    static bool enabled();
+    /**
+     * adds to the counter
+     * @param counter the counter
+     * @param amount what to add
+     */
+    static void add(MetricCounter counter, uint64_t amount);
+    /**
+     * adds a run of the stage
+     * @param stage the stage
+     * @param nanos how long the run took
+     */
+    static void addStage(MetricStage stage, uint64_t nanos);
+    /**
+     * @return the totals of all of the threads, additions that run meanwhile may be seen partly
+     */
+    static MetricsSnapshot read();
+    /**
+     * zeroes all of the totals
+     */
+    static void reset();
+    /**
+     * @param snapshot the totals
+     * @return the totals in the Prometheus text format
+     */
+    static std::string toPrometheus(const MetricsSnapshot &snapshot);
+    /**
+     * @param snapshot the totals
+     * @return the totals as a JSON object
+     */
+    static std::string toJson(const MetricsSnapshot &snapshot);
+    /**
+     * writes the current totals to a file, replacing it
+     * @param path the path of the file
+     * @param json true for JSON, false for the Prometheus text format
+     * @return success or fail if the file can't be written
+     */
+    static int write(const std::string &path, bool json);
+};
+
+/**
+ * adds the time from its creation to its destruction to a stage
+ */
+class StageTimer
+{
+private:
+    MetricStage _stage;
+    std::chrono::steady_clock::time_point _start;
+public:
+    /**
+     * starts timing the stage
+     * @param stage the stage
+     */
+    explicit StageTimer(MetricStage stage) : _stage(stage), _start(std::chrono::steady_clock::now())
+    {
+    }
+    StageTimer(const StageTimer &) = delete;
+    StageTimer &operator=(const StageTimer &) = delete;
+    /**
+     * adds the time of the stage
+     */
+    ~StageTimer()
+    {
+        auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - _start);
+        Metrics::addStage(_stage, (uint64_t) nanos.count());
+    }
+};
+
+#ifdef CPP4_METRICS
+/**
+ * adds to a counter
+ */
+#define METRICS_ADD(counter, amount) Metrics::add(counter, amount)
+/**
+ * times the rest of the enclosing scope as the stage
+ */
+#define METRICS_TIMER(stage) StageTimer stageTimer_##stage(stage)
+#else
+#define METRICS_ADD(counter, amount) ((void) 0)
+#define METRICS_TIMER(stage) ((void) 0)
+#endif
+
+#endif //CPP4_METRICS_H
@@ -0,0 +1,190 @@
+/**
+ * @file ModelManager.cpp
+ * @author  Nimrod Kremer
+ * @version 1.0
+ * @date 26.5.2020
+ *
+ * @brief Loads new data for a recommendation system in the background
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * The loading thread and the requests handed to it. A request that comes while
+ * another waits replaces it, so a burst of reloads loads only the newest files.
+ * Input  : the files to load
+ * Process: loading and building aside from the queries
+ * Output : the new data published to the system.
+ */
+
+#include "ModelManager.h"
+#include <chrono>
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/**
+ * how much nicer than the queries the loading threads are
+ */
+#define LOADER_NICE 10
+
+/**
+ * starts the loading thread
+ * @param system the system to load the data of
+ * @param loadThreads number of threads a load parses and builds with, 0 for all of the cores
+ */
+ModelManager::ModelManager(RecommenderSystem &system, int loadThreads) :
+        _system(system), _loadThreads(loadThreads), _loader(&ModelManager::_loaderLoop, this)
+{
+}
+
+/**
+ * waits for the load that runs to finish, a load that didn't start is dropped
+ */
+ModelManager::~ModelManager()
+{
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        _stop = true;
+        _pending = nullptr;
+    }
+    _wake.notify_all();
+    _loader.join();
+}
+
+/**
+ * the loop of the loading thread. The old snapshot is held through the load and let go of right
+ * after, so the big free usually happens here. A query that still holds it frees it when done,
+ * the loader never waits for one
+ */
+void ModelManager::_loaderLoop()
+{
+#ifdef __linux__
+    // the threads of the pool are created below and inherit the priority
+    setpriority(PRIO_PROCESS, (id_t) syscall(SYS_gettid), LOADER_NICE);
+#endif
+    ThreadPool pool(_loadThreads);
+    std::unique_lock<std::mutex> lock(_lock);
+    while (true)
+    {
+        _wake.wait(lock, [this]
+        {
+            return _stop || _pending;
+        });
+        if (_stop)
+        {
+            return;
+        }
+        std::function<int(ThreadPool &)> load = std::move(_pending);
+        _pending = nullptr;
+        _running = true;
+        lock.unlock();
+
+        std::shared_ptr<const ModelSnapshot> old = _system.snapshot();
+        auto start = std::chrono::steady_clock::now();
+        int result = load(pool);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        old.reset();
+
+        lock.lock();
+        _running = false;
+        _lastResult = result;
+        if (result == SUCCESS)
+        {
+            _stats.loads++;
+            _stats.lastSeconds = seconds;
+        }
+        else
+        {
+            _stats.failures++;
+        }
+        _idle.notify_all();
+    }
+}
+
+/**
+ * hands a load to the loading thread, replacing a load that didn't start yet
+ * @param load loads on the given threads and returns success or fail
+ */
+void ModelManager::_request(std::function<int(ThreadPool &)> load)
+{
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        if (_pending)
+        {
+            _stats.skipped++;
+        }
+        _pending = std::move(load);
+    }
+    _wake.notify_one();
+}
+
+/**
+ * loads the text files in the background and publishes them to the system
+ * @param moviesAttributesFilePath the path of the movies file
+ * @param userRanksFilePath the path of the ranks file
+ */
+void ModelManager::reload(const std::string &moviesAttributesFilePath, const std::string &userRanksFilePath)
+{
+    _request([this, moviesAttributesFilePath, userRanksFilePath](ThreadPool &pool)
+    {
+        return _system.loadData(moviesAttributesFilePath, userRanksFilePath, pool);
+    });
+}
+
+/**
+ * loads a snapshot saved by saveSnapshot in the background and publishes it to the system
+ * @param snapshotFilePath the path of the snapshot
+ */
+void ModelManager::reloadSnapshot(const std::string &snapshotFilePath)
+{
+    _request([this, snapshotFilePath](ThreadPool &pool)
+    {
+        return _system.loadSnapshot(snapshotFilePath, pool);
+    });
+}
+
+/**
+ * loads the text files through a snapshot written in bounded memory in the background. The
+ * snapshot the queries map is replaced by a rename, so they keep reading the old one
+ * @param moviesAttributesFilePath the path of the movies file
+ * @param userRanksFilePath the path of the ranks file
+ * @param storeFilePath the path of the snapshot to write, replaced as a whole
+ * @param memoryBudget number of bytes of ranks to hold in memory at once while writing
+ */
+void ModelManager::reloadStreaming(const std::string &moviesAttributesFilePath, const std::string &userRanksFilePath,
+                                   const std::string &storeFilePath, size_t memoryBudget)
+{
+    _request([this, moviesAttributesFilePath, userRanksFilePath, storeFilePath, memoryBudget](ThreadPool &pool)
+    {
+        return _system.loadDataStreaming(moviesAttributesFilePath, userRanksFilePath, storeFilePath, memoryBudget,
+                                         pool);
+    });
+}
+
+/**
+ * waits until no load runs or waits to run
+ * @return what the last load returned, success or fail
+ */
+int ModelManager::wait()
+{
+    std::unique_lock<std::mutex> lock(_lock);
+    _idle.wait(lock, [this]
+    {
+        return !_running && !_pending;
+    });
+    return _lastResult;
+}
+
+/**
+ * @return what the manager loaded so far
+ */
+ModelLoadStats ModelManager::stats() const
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    ModelLoadStats stats = _stats;
+    stats.loading = _running || _pending;
+    return stats;
+}
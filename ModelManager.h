@@ -0,0 +1,159 @@
+/**
+ * @file ModelManager.h
+ * @author  Nimrod Kremer
+ * @version 1.0
+ * @date 26.5.2020
+ *
+ * @brief Loads new data for a recommendation system in the background
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * A thread of the manager loads the data into a new snapshot on threads of its own,
+ * at a lower priority than the queries, and publishes it at once. Queries that
+ * already hold the old snapshot finish on it, and the old snapshot is freed by
+ * whichever of them and the loading thread lets go of it last.
+ * Input  : the files to load
+ * Process: loading and building aside from the queries
+ * Output : the new data published to the system.
+ */
+
+#ifndef CPP4_MODELMANAGER_H
+#define CPP4_MODELMANAGER_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "RecommenderSystem.h"
+
+/**
+ * what the manager loaded so far
+ */
+typedef struct ModelLoadStats
+{
+    /**
+     * number of loads that were published
+     */
+    size_t loads = 0;
+    /**
+     * number of loads that failed, the data loaded before stays
+     */
+    size_t failures = 0;
+    /**
+     * number of requests replaced by a newer request before they started
+     */
+    size_t skipped = 0;
+    /**
+     * the time the last load took until it was published
+     */
+    double lastSeconds = 0;
+    /**
+     * true while a load runs or waits to run
+     */
+    bool loading = false;
+} ModelLoadStats;
+
+/**
+ * loads the data of a recommendation system on a background thread. The system must outlive
+ * the manager
+ */
+class ModelManager
+{
+private:
+    RecommenderSystem &_system;
+    /**
+     * number of threads a load parses and builds with
+     */
+    int _loadThreads;
+    /**
+     * guards the request and the stats
+     */
+    mutable std::mutex _lock;
+    /**
+     * wakes the loading thread when a load is requested
+     */
+    std::condition_variable _wake;
+    /**
+     * wakes the threads that wait for the loads to finish
+     */
+    std::condition_variable _idle;
+    /**
+     * the load waiting to run, empty if there is none
+     */
+    std::function<int(ThreadPool &)> _pending;
+    /**
+     * true while the loading thread runs a load
+     */
+    bool _running = false;
+    /**
+     * set when the manager is destroyed
+     */
+    bool _stop = false;
+    /**
+     * what the last load returned
+     */
+    int _lastResult = SUCCESS;
+    ModelLoadStats _stats;
+    /**
+     * the thread that loads, started last so it sees the rest of the manager built
+     */
+    std::thread _loader;
+    /**
+     * the loop of the loading thread
+     */
+    void _loaderLoop();
+    /**
+     * hands a load to the loading thread, replacing a load that didn't start yet
+     * @param load loads on the given threads and returns success or fail
+     */
+    void _request(std::function<int(ThreadPool &)> load);
+public:
+    /**
+     * starts the loading thread
+     * @param system the system to load the data of
+     * @param loadThreads number of threads a load parses and builds with, 0 for all of the cores
+     */
+    explicit ModelManager(RecommenderSystem &system, int loadThreads = 1);
+    /**
+     * waits for the load that runs to finish, a load that didn't start is dropped
+     */
+    ~ModelManager();
+    ModelManager(const ModelManager &) = delete;
+    ModelManager &operator=(const ModelManager &) = delete;
+    /**
+     * loads the text files in the background and publishes them to the system. Updates made to
+     * the system while the load runs are replaced with the loaded data
+     * @param moviesAttributesFilePath the path of the movies file
+     * @param userRanksFilePath the path of the ranks file
+     */
+    void reload(const std::string &moviesAttributesFilePath, const std::string &userRanksFilePath);
+    /**
+     * loads a snapshot saved by saveSnapshot in the background and publishes it to the system
+     * @param snapshotFilePath the path of the snapshot
+     */
+    void reloadSnapshot(const std::string &snapshotFilePath);
+    /**
+     * loads the text files through a snapshot written in bounded memory in the background, see
+     * RecommenderSystem::loadDataStreaming
+     * @param moviesAttributesFilePath the path of the movies file
+     * @param userRanksFilePath the path of the ranks file
+     * @param storeFilePath the path of the snapshot to write, replaced as a whole
+     * @param memoryBudget number of bytes of ranks to hold in memory at once while writing
+     */
+    void reloadStreaming(const std::string &moviesAttributesFilePath, const std::string &userRanksFilePath,
+                         const std::string &storeFilePath, size_t memoryBudget = DEFAULT_INGEST_BUDGET);
+    /**
+     * waits until no load runs or waits to run
+     * @return what the last load returned, success or fail
+     */
+    int wait();
+    /**
+     * @return what the manager loaded so far
+     */
+    ModelLoadStats stats() const;
+};
+
+#endif //CPP4_MODELMANAGER_H
@@ -0,0 +1,74 @@
+/**
+ * @file ProfileCache.cpp
+ * @author  Nimrod Kremer
+ * @version 1.0
+ * @date 26.5.2020
+ *
+ * @brief Cache of the average rank and the preferences of users
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * A fixed size direct mapped table of the profiles queries calculated, shared by
+ * the snapshots of the model. Every profile remembers the version of the ranks of
+ * its user, so a profile of ranks that changed since is never used.
+ * Input  : the profiles of users
+ * Process: the id of the user picks a slot
+ * Output : the profile if it is cached and up to date.
+ */
+
+#include "ProfileCache.h"
+#include <atomic>
+
+/**
+ * creates the cache
+ * @param capacity number of slots, rounded up to a power of 2, 0 disables the cache
+ */
+ProfileCache::ProfileCache(size_t capacity)
+{
+    if (capacity == 0)
+    {
+        return;
+    }
+    size_t size = 1;
+    while (size < capacity)
+    {
+        size <<= 1;
+    }
+    _slots.reset(new std::shared_ptr<const UserProfile>[size]);
+    _mask = size - 1;
+}
+
+/**
+ * looks for the profile of the user. The ids are dense, so the low bits of the id are the slot
+ * @param user id of the user
+ * @param version the current version of the ranks of the user
+ * @return the profile, nullptr if it isn't cached or is of other ranks
+ */
+std::shared_ptr<const UserProfile> ProfileCache::find(int user, uint64_t version) const
+{
+    if (!_slots)
+    {
+        return nullptr;
+    }
+    std::shared_ptr<const UserProfile> profile = std::atomic_load(&_slots[(size_t) user & _mask]);
+    if (profile && profile->user == user && profile->version == version)
+    {
+        return profile;
+    }
+    return nullptr;
+}
+
+/**
+ * caches the profile, replacing the profile in its slot
+ * @param profile the profile
+ */
+void ProfileCache::insert(std::shared_ptr<const UserProfile> profile) const
+{
+    if (_slots)
+    {
+        size_t slot = (size_t) profile->user & _mask;
+        std::atomic_store(&_slots[slot], std::move(profile));
+    }
+}
@@ -0,0 +1,89 @@
+/**
+ * @file ProfileCache.h
+ * @author  Nimrod Kremer
+ * @version 1.0
+ * @date 26.5.2020
+ *
+ * @brief Cache of the average rank and the preferences of users
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * A fixed size direct mapped table of the profiles queries calculated, shared by
+ * the snapshots of the model. Every profile remembers the version of the ranks of
+ * its user, so a profile of ranks that changed since is never used.
+ * Input  : the profiles of users
+ * Process: the id of the user picks a slot
+ * Output : the profile if it is cached and up to date.
+ */
+
+#ifndef CPP4_PROFILECACHE_H
+#define CPP4_PROFILECACHE_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/**
+ * what the content recommendation needs of a user
+ */
+typedef struct UserProfile
+{
+    /**
+     * id of the user
+     */
+    int user;
+    /**
+     * the version of the ranks of the user the profile was calculated from
+     */
+    uint64_t version;
+    /**
+     * the average rank of the user
+     */
+    double average;
+    /**
+     * the features of the ranked movies weighted by the normalized ranks
+     */
+    std::vector<double> preference;
+    /**
+     * the normal of the preference
+     */
+    double normal;
+} UserProfile;
+
+/**
+ * cache of the profiles of users, safe for any number of threads
+ */
+class ProfileCache
+{
+private:
+    /**
+     * the slots of the table, read and written atomically
+     */
+    std::unique_ptr<std::shared_ptr<const UserProfile>[]> _slots;
+    /**
+     * number of slots minus one, the number of slots is a power of 2
+     */
+    size_t _mask = 0;
+public:
+    /**
+     * creates the cache
+     * @param capacity number of slots, rounded up to a power of 2, 0 disables the cache
+     */
+    explicit ProfileCache(size_t capacity);
+    /**
+     * looks for the profile of the user
+     * @param user id of the user
+     * @param version the current version of the ranks of the user
+     * @return the profile, nullptr if it isn't cached or is of other ranks
+     */
+    std::shared_ptr<const UserProfile> find(int user, uint64_t version) const;
+    /**
+     * caches the profile, replacing the profile in its slot
+     * @param profile the profile
+     */
+    void insert(std::shared_ptr<const UserProfile> profile) const;
+};
+
+#endif //CPP4_PROFILECACHE_H
@@ -0,0 +1,693 @@
+/**
+ * @file RecommenderModel.cpp
+ * @author  Nimrod Kremer
+ * @version 1.0
+ * @date 26.5.2020
+ *
+ * @brief Dense storage of the data the recommendation system works on
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * Holds the movies and users interned to dense ids, the movie features as one
+ * row-major matrix and only the ranks that were given, by user (CSR) and by movie
+ * (CSC), so the memory grows with the number of ranks.
+ * Input  : the movies features file and the ranks matrix file
+ * Process: interning of names and filling of the matrices
+ * Output : id based access to the data.
+ */
+
+#include "RecommenderModel.h"
+#include "MappedFile.h"
+#include "ReturnCodes.h"
+#include "TextParser.h"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+/**
+ * How NA looks in the file
+ */
+#define NA "NA"
+
+/**
+ * FNV-1a offset basis
+ */
+#define HASH_BASIS 14695981039346656037ULL
+/**
+ * FNV-1a prime
+ */
+#define HASH_PRIME 1099511628211ULL
+
+/**
+ * @return the hash of the name
+ */
+uint64_t NameTable::_hash(const char *name, size_t length)
+{
+    uint64_t hash = HASH_BASIS;
+    for (size_t i = 0; i < length; i++)
+    {
+        hash = (hash ^ (unsigned char) name[i]) * HASH_PRIME;
+    }
+    return hash;
+}
+
+/**
+ * finds the shard of a name. The hash is mixed once more first, names that differ only in
+ * their last characters differ mostly in the low bits of FNV-1a, which the slots of the
+ * table use, and would fall in a few shards
+ * @param name a name
+ * @param length number of characters of the name
+ * @param numShards number of shards
+ * @return the shard the name belongs to, the same in every process
+ */
+int NameTable::shardOf(const char *name, size_t length, int numShards)
+{
+    if (numShards <= 1)
+    {
+        return 0;
+    }
+    // the finalizer of MurmurHash3, every bit of the hash moves every bit of the result
+    uint64_t hash = _hash(name, length);
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return (int) (hash % (uint64_t) numShards);
+}
+
+/**
+ * finds the id of the given name, adding it if it is new
+ * @param name the name to intern
+ * @return the id of the name
+ */
+int NameTable::intern(const std::string &name)
+{
+    int id = find(name);
+    if (id != NO_ID)
+    {
+        return id;
+    }
+    id = size();
+    _names.push_back(name);
+    _ids.insert({name, id});
+    return id;
+}
+
+/**
+ * packs all of the names
+ */
+void NameTable::freeze()
+{
+    if (_names.empty() && !_slots.empty())
+    {
+        return;
+    }
+    std::vector<char> chars(_chars.begin(), _chars.end());
+    std::vector<uint64_t> offsets(_offsets.begin(), _offsets.end());
+    if (offsets.empty())
+    {
+        offsets.push_back(0);
+    }
+    for (const std::string &name : _names)
+    {
+        chars.insert(chars.end(), name.begin(), name.end());
+        offsets.push_back(chars.size());
+    }
+    // at most half of the slots are taken so probing ends quickly
+    size_t numNames = offsets.size() - 1;
+    size_t numSlots = 1;
+    while (numSlots < numNames * 2)
+    {
+        numSlots *= 2;
+    }
+    std::vector<int> slots(numSlots, NO_ID);
+    for (size_t id = 0; id < numNames; id++)
+    {
+        size_t slot = _hash(chars.data() + offsets[id], offsets[id + 1] - offsets[id]) & (numSlots - 1);
+        while (slots[slot] != NO_ID)
+        {
+            slot = (slot + 1) & (numSlots - 1);
+        }
+        slots[slot] = (int) id;
+    }
+    _chars.assign(std::move(chars));
+    _offsets.assign(std::move(offsets));
+    _slots.assign(std::move(slots));
+    std::vector<std::string>().swap(_names);
+    std::unordered_map<std::string, int>().swap(_ids);
+}
+
+/**
+ * finds the id of the given name
+ * @param name the name to look for
+ * @return the id of the name or NO_ID if it is unknown
+ */
+int NameTable::find(const std::string &name) const
+{
+    if (!_slots.empty())
+    {
+        size_t mask = _slots.size() - 1;
+        for (size_t slot = _hash(name.data(), name.size()) & mask; _slots[slot] != NO_ID;
+             slot = (slot + 1) & mask)
+        {
+            int id = _slots[slot];
+            size_t length = _offsets[id + 1] - _offsets[id];
+            if (length == name.size() && name.compare(0, length, _chars.data() + _offsets[id], length) == 0)
+            {
+                return id;
+            }
+        }
+    }
+    auto res = _ids.find(name);
+    return res == _ids.end() ? NO_ID : res->second;
+}
+
+/**
+ * @param id an id given by this table
+ * @return the name of the id
+ */
+std::string NameTable::name(int id) const
+{
+    int numPacked = _numPacked();
+    if (id >= numPacked)
+    {
+        return _names[id - numPacked];
+    }
+    return std::string(_chars.data() + _offsets[id], _chars.data() + _offsets[id + 1]);
+}
+
+/**
+ * removes all of the names
+ */
+void NameTable::clear()
+{
+    _names.clear();
+    _ids.clear();
+    _chars.clear();
+    _offsets.clear();
+    _slots.clear();
+}
+
+/**
+ * removes all of the loaded data
+ */
+void RecommenderModel::clear()
+{
+    _movies.clear();
+    _users.clear();
+    _numFeatures = 0;
+    _features.clear();
+    _movieNormal.clear();
+    _rankedMovies.clear();
+    _movieColumn.clear();
+    _userStart.clear();
+    _userColumns.clear();
+    _userRanks.clear();
+    _movieStart.clear();
+    _movieUsers.clear();
+    _movieRanks.clear();
+    _changedUsers.clear();
+    _changedMovies.clear();
+    _userChecks.reset();
+    _movieChecks.reset();
+    _numChangedUsers = 0;
+    _numRanks = 0;
+    _version = 0;
+    _userVersion.clear();
+}
+
+/**
+ * sets or removes a rank in a row, copying the page of the row
+ * @param pages changed rows
+ * @param starts where the packed rows start
+ * @param ids the packed ids
+ * @param ranks the packed ranks
+ * @param checks the checked packed rows, nullptr if they need no check
+ * @param id id of the row
+ * @param key the id in the row to change
+ * @param rank the new rank, nullptr removes it
+ * @param version the version of the change
+ * @return true if the row had the key before
+ */
+bool RecommenderModel::_changeRow(RankPages &pages, const Array<uint64_t> &starts, const Array<int> &ids,
+                                  const Array<double> &ranks, const RowChecks *checks, int id, int key,
+                                  const double *rank, uint64_t version)
+{
+    const int *rowIds = nullptr;
+    const double *rowRanks = nullptr;
+    size_t count = _row(pages, starts, ids, ranks, checks, id, rowIds, rowRanks);
+    size_t pos = std::lower_bound(rowIds, rowIds + count, key) - rowIds;
+    bool found = pos < count && rowIds[pos] == key;
+    if (!found && rank == nullptr)
+    {
+        return false;
+    }
+
+    auto row = std::make_shared<RankRow>();
+    row->ids.assign(rowIds, rowIds + count);
+    row->ranks.assign(rowRanks, rowRanks + count);
+    row->version = version;
+    if (rank == nullptr)
+    {
+        row->ids.erase(row->ids.begin() + pos);
+        row->ranks.erase(row->ranks.begin() + pos);
+    }
+    else if (found)
+    {
+        row->ranks[pos] = *rank;
+    }
+    else
+    {
+        row->ids.insert(row->ids.begin() + pos, key);
+        row->ranks.insert(row->ranks.begin() + pos, *rank);
+    }
+
+    size_t page = (size_t) id / ROW_PAGE;
+    if (pages.size() <= page)
+    {
+        pages.resize(page + 1);
+    }
+    auto copy = pages[page] ? std::make_shared<RankPage>(*pages[page]) : std::make_shared<RankPage>(ROW_PAGE);
+    (*copy)[id % ROW_PAGE] = std::move(row);
+    pages[page] = std::move(copy);
+    return found;
+}
+
+/**
+ * makes the movie the last column of the ranks, done the first time it is ranked
+ * @param movie id of the movie
+ */
+void RecommenderModel::_addColumn(int movie)
+{
+    std::vector<int> rankedMovies = _rankedMovies.toVector();
+    std::vector<int> movieColumn = _movieColumn.toVector();
+    movieColumn[movie] = (int) rankedMovies.size();
+    rankedMovies.push_back(movie);
+    _rankedMovies.assign(std::move(rankedMovies));
+    _movieColumn.assign(std::move(movieColumn));
+}
+
+/**
+ * adds a user that ranked nothing yet
+ * @param userName the name of the user
+ * @return the id of the user, NO_ID if the user is already known
+ */
+int RecommenderModel::addUser(const std::string &userName)
+{
+    if (_users.find(userName) != NO_ID)
+    {
+        return NO_ID;
+    }
+    return _users.intern(userName);
+}
+
+/**
+ * adds a movie that can be recommended from now on, it is the last column of the ranks
+ * @param movieName the name of the movie
+ * @param features the features of the movie, as many as every other movie has
+ * @return the id of the movie, NO_ID if it is already known or the features don't fit
+ */
+int RecommenderModel::addMovie(const std::string &movieName, const std::vector<double> &features)
+{
+    if (_movies.size() == 0)
+    {
+        _numFeatures = features.size();
+    }
+    if (_movies.find(movieName) != NO_ID || features.size() != _numFeatures)
+    {
+        return NO_ID;
+    }
+    std::vector<double> allFeatures = _features.toVector();
+    std::vector<double> movieNormal = _movieNormal.toVector();
+    std::vector<int> movieColumn = _movieColumn.toVector();
+    allFeatures.insert(allFeatures.end(), features.begin(), features.end());
+    movieNormal.push_back(std::sqrt(std::inner_product(features.begin(), features.end(), features.begin(), 0.0)));
+    movieColumn.resize(_movies.size() + 1, NO_ID);
+    _features.assign(std::move(allFeatures));
+    _movieNormal.assign(std::move(movieNormal));
+    _movieColumn.assign(std::move(movieColumn));
+    int movie = _movies.intern(movieName);
+    _addColumn(movie);
+    return movie;
+}
+
+/**
+ * sets the rank of the user to the movie, replacing the rank given before. Only the rows of the
+ * user and of the movie change
+ * @param user id of the user
+ * @param movie id of the movie
+ * @param rank the rank
+ */
+void RecommenderModel::setRank(int user, int movie, double rank)
+{
+    if (_movieColumn[movie] == NO_ID)
+    {
+        _addColumn(movie);
+    }
+    bool userChanged = _changedRow(_changedUsers, user) != nullptr;
+    _version++;
+    if (!_changeRow(_changedUsers, _userStart, _userColumns, _userRanks, _userChecks.get(), user, _movieColumn[movie],
+                    &rank, _version))
+    {
+        _numRanks++;
+    }
+    _changeRow(_changedMovies, _movieStart, _movieUsers, _movieRanks, _movieChecks.get(), movie, user, &rank,
+               _version);
+    _numChangedUsers += !userChanged;
+}
+
+/**
+ * removes the rank of the user to the movie
+ * @param user id of the user
+ * @param movie id of the movie
+ * @return false if the user didn't rank the movie
+ */
+bool RecommenderModel::removeRank(int user, int movie)
+{
+    if (_movieColumn[movie] == NO_ID)
+    {
+        return false;
+    }
+    bool userChanged = _changedRow(_changedUsers, user) != nullptr;
+    if (!_changeRow(_changedUsers, _userStart, _userColumns, _userRanks, _userChecks.get(), user, _movieColumn[movie],
+                    nullptr, _version + 1))
+    {
+        return false;
+    }
+    _version++;
+    _changeRow(_changedMovies, _movieStart, _movieUsers, _movieRanks, _movieChecks.get(), movie, user, nullptr,
+               _version);
+    _numChangedUsers += !userChanged;
+    _numRanks--;
+    return true;
+}
+
+/**
+ * packs the names and the changed rows back into the arrays
+ */
+void RecommenderModel::compact()
+{
+    _movies.freeze();
+    _users.freeze();
+    if (_changedUsers.empty() && _userStart.size() == (size_t) _users.size() + 1 &&
+        _movieStart.size() == (size_t) _movies.size() + 1)
+    {
+        return;
+    }
+    std::vector<uint64_t> userStart(1, 0);
+    std::vector<int> userColumns;
+    std::vector<double> ranks;
+    std::vector<uint64_t> versions;
+    userColumns.reserve(_numRanks);
+    ranks.reserve(_numRanks);
+    for (int user = 0; user < _users.size(); user++)
+    {
+        const int *columns = nullptr;
+        const double *userRanks = nullptr;
+        size_t count = _userRow(user, columns, userRanks);
+        userColumns.insert(userColumns.end(), columns, columns + count);
+        ranks.insert(ranks.end(), userRanks, userRanks + count);
+        userStart.push_back(userColumns.size());
+        if (_version > 0)
+        {
+            versions.push_back(userVersion(user));
+        }
+    }
+    _userStart.assign(std::move(userStart));
+    _userColumns.assign(std::move(userColumns));
+    _userRanks.assign(std::move(ranks));
+    _userVersion.assign(std::move(versions));
+    _changedUsers.clear();
+    _userChecks.reset();
+    _numChangedUsers = 0;
+    _buildMovieRanks();
+    _changedMovies.clear();
+    _movieChecks.reset();
+}
+
+/**
+ * Reads the given movie paths to our data structure
+ * @param moviesAttributesFilePath path to the file
+ * @return fail to success
+ */
+int RecommenderModel::readMovies(char const *moviesAttributesFilePath)
+{
+    MappedFile file;
+    if (!file.open(moviesAttributesFilePath))
+    {
+        return FAIL;
+    }
+
+    const char *end = file.data() + file.size();
+    const char *tokenEnd = nullptr;
+    std::vector<double> characteristics;
+    std::vector<double> features = _features.toVector();
+    std::vector<double> movieNormal = _movieNormal.toVector();
+    // run each line
+    for (const char *line = file.data(); line < end; )
+    {
+        const char *lineEnd = TextParser::lineEnd(line, end);
+        const char *token = TextParser::nextToken(line, lineEnd, tokenEnd);
+        const char *nameEnd = tokenEnd;
+        characteristics.clear();
+        double normal = 0;
+        bool empty = token == lineEnd;
+        std::string movieName(token, nameEnd);
+        // run for each word in a line with space between them
+        for (token = TextParser::nextToken(nameEnd, lineEnd, tokenEnd); token < lineEnd;
+             token = TextParser::nextToken(tokenEnd, lineEnd, tokenEnd))
+        {
+            double num = 0;
+            if (!TextParser::parseDouble(token, tokenEnd, num))
+            {
+                return FAIL;
+            }
+            normal += num * num;
+            characteristics.push_back(num);
+        }
+        line = lineEnd < end ? lineEnd + 1 : end;
+        if (empty)
+        {
+            continue;
+        }
+        if (_movies.size() == 0)
+        {
+            _numFeatures = characteristics.size();
+        }
+        if (characteristics.size() != _numFeatures)
+        {
+            return FAIL;
+        }
+        // the first line of a movie is the one that counts
+        if (_movies.find(movieName) != NO_ID)
+        {
+            continue;
+        }
+        _movies.intern(movieName);
+        movieNormal.push_back(std::sqrt(normal));
+        features.insert(features.end(), characteristics.begin(), characteristics.end());
+    }
+    _movies.freeze();
+    _features.assign(std::move(features));
+    _movieNormal.assign(std::move(movieNormal));
+    return SUCCESS;
+}
+
+/**
+ * reads the ranks in the line of a user
+ * @param pos the first rank in the line
+ * @param end the end of the line
+ * @param columns receives the ranked columns of the line
+ * @param ranks receives the rank of every ranked column
+ * @return success or fail
+ */
+int RecommenderModel::_readRanksLine(const char *pos, const char *end, std::vector<int> &columns,
+                                     std::vector<double> &ranks) const
+{
+    const char *tokenEnd = nullptr;
+    size_t column = 0;
+    for (const char *token = TextParser::nextToken(pos, end, tokenEnd); token < end && column < _rankedMovies.size();
+         token = TextParser::nextToken(tokenEnd, end, tokenEnd), column++)
+    {
+        // a movie listed twice in the header is ranked by its last column
+        if (TextParser::equals(token, tokenEnd, NA) || _movieColumn[_rankedMovies[column]] != (int) column)
+        {
+            continue;
+        }
+        double rank = 0;
+        if (!TextParser::parseDouble(token, tokenEnd, rank))
+        {
+            return FAIL;
+        }
+        columns.push_back((int) column);
+        ranks.push_back(rank);
+    }
+    return SUCCESS;
+}
+
+/**
+ * builds the movie to users transpose of the ranks of the users, by counting the ranks of every
+ * movie and then placing them in the order of the users
+ */
+void RecommenderModel::_buildMovieRanks()
+{
+    size_t numMovies = _movies.size();
+    std::vector<uint64_t> movieStart(numMovies + 1, 0);
+    for (int column : _userColumns)
+    {
+        movieStart[_rankedMovies[column] + 1]++;
+    }
+    for (size_t movie = 0; movie < numMovies; movie++)
+    {
+        movieStart[movie + 1] += movieStart[movie];
+    }
+    std::vector<uint64_t> next(movieStart.begin(), movieStart.end() - 1);
+    std::vector<int> movieUsers(_userColumns.size());
+    std::vector<double> movieRanks(_userColumns.size());
+    for (int user = 0; user < _users.size(); user++)
+    {
+        const int *columns = rankedColumns(user);
+        const double *ranks = userRanks(user);
+        for (size_t i = 0; i < rankedCount(user); i++)
+        {
+            uint64_t slot = next[_rankedMovies[columns[i]]]++;
+            movieUsers[slot] = user;
+            movieRanks[slot] = ranks[i];
+        }
+    }
+    _movieStart.assign(std::move(movieStart));
+    _movieUsers.assign(std::move(movieUsers));
+    _movieRanks.assign(std::move(movieRanks));
+}
+
+/**
+ * reads the users ranks from the given file path, must be called after readMovies.
+ * The names are interned in the order of the file, then the lines are split into chunks that
+ * are parsed in parallel into buffers of their chunk. Once the number of ranks of every user is
+ * known the buffers are copied into the rows of the users.
+ * @param userRanksFilePath the path to the file
+ * @param pool the threads to parse with
+ * @param shard the shard of the users to read, the others are skipped
+ * @param numShards number of shards the users are split into, 1 reads all of them
+ * @return success or fail
+ */
+int RecommenderModel::readUserRanks(char const *userRanksFilePath, ThreadPool &pool, int shard, int numShards)
+{
+    MappedFile file;
+    if (!file.open(userRanksFilePath))
+    {
+        return FAIL;
+    }
+
+    const char *end = file.data() + file.size();
+    const char *headerEnd = TextParser::lineEnd(file.data(), end);
+    const char *tokenEnd = nullptr;
+    std::vector<int> rankedMovies;
+    std::vector<int> movieColumn(_movies.size(), NO_ID);
+    for (const char *token = TextParser::nextToken(file.data(), headerEnd, tokenEnd); token < headerEnd;
+         token = TextParser::nextToken(tokenEnd, headerEnd, tokenEnd))
+    {
+        int id = _movies.find(std::string(token, tokenEnd));
+        if (id == NO_ID)
+        {
+            return FAIL;
+        }
+        movieColumn[id] = (int) rankedMovies.size();
+        rankedMovies.push_back(id);
+    }
+    _rankedMovies.assign(std::move(rankedMovies));
+    _movieColumn.assign(std::move(movieColumn));
+
+    // the user of every line and where its ranks start, a later line of the same user wins
+    std::vector<int> lineUsers;
+    std::vector<const char *> lineStarts;
+    std::vector<const char *> lineEnds;
+    for (const char *line = headerEnd < end ? headerEnd + 1 : end; line < end; )
+    {
+        const char *lineEnd = TextParser::lineEnd(line, end);
+        const char *token = TextParser::nextToken(line, lineEnd, tokenEnd);
+        if (token < lineEnd && NameTable::shardOf(token, tokenEnd - token, numShards) == shard)
+        {
+            lineUsers.push_back(_users.intern(std::string(token, tokenEnd)));
+            lineStarts.push_back(tokenEnd);
+            lineEnds.push_back(lineEnd);
+        }
+        line = lineEnd < end ? lineEnd + 1 : end;
+    }
+    _users.freeze();
+    std::vector<size_t> lastLine(_users.size());
+    for (size_t i = 0; i < lineUsers.size(); i++)
+    {
+        lastLine[lineUsers[i]] = i;
+    }
+
+    size_t numChunks = std::min(lineUsers.size(), (size_t) pool.size() * 4);
+    std::vector<std::vector<int>> chunkColumns(numChunks);
+    std::vector<std::vector<double>> chunkRanks(numChunks);
+    std::vector<size_t> lineBegin(lineUsers.size(), 0);
+    std::vector<size_t> lineCount(lineUsers.size(), 0);
+    std::atomic<bool> failed(false);
+    auto chunkLines = [&](size_t chunk, size_t &first, size_t &last)
+    {
+        first = lineUsers.size() * chunk / numChunks;
+        last = lineUsers.size() * (chunk + 1) / numChunks;
+    };
+    pool.parallelFor(numChunks, [&](size_t chunk)
+    {
+        size_t first = 0;
+        size_t last = 0;
+        chunkLines(chunk, first, last);
+        for (size_t i = first; i < last; i++)
+        {
+            if (lastLine[lineUsers[i]] != i)
+            {
+                continue;
+            }
+            lineBegin[i] = chunkColumns[chunk].size();
+            if (_readRanksLine(lineStarts[i], lineEnds[i], chunkColumns[chunk], chunkRanks[chunk]) == FAIL)
+            {
+                failed = true;
+            }
+            lineCount[i] = chunkColumns[chunk].size() - lineBegin[i];
+        }
+    });
+    if (failed)
+    {
+        return FAIL;
+    }
+
+    std::vector<uint64_t> userStart(_users.size() + 1, 0);
+    for (int user = 0; user < _users.size(); user++)
+    {
+        userStart[user + 1] = userStart[user] + lineCount[lastLine[user]];
+    }
+    std::vector<int> userColumns(userStart.back());
+    std::vector<double> ranks(userStart.back());
+    pool.parallelFor(numChunks, [&](size_t chunk)
+    {
+        size_t first = 0;
+        size_t last = 0;
+        chunkLines(chunk, first, last);
+        for (size_t i = first; i < last; i++)
+        {
+            if (lastLine[lineUsers[i]] == i)
+            {
+                std::copy_n(chunkColumns[chunk].begin() + lineBegin[i], lineCount[i],
+                            userColumns.begin() + userStart[lineUsers[i]]);
+                std::copy_n(chunkRanks[chunk].begin() + lineBegin[i], lineCount[i],
+                            ranks.begin() + userStart[lineUsers[i]]);
+            }
+        }
+        std::vector<int>().swap(chunkColumns[chunk]);
+        std::vector<double>().swap(chunkRanks[chunk]);
+    });
+    _userStart.assign(std::move(userStart));
+    _userColumns.assign(std::move(userColumns));
+    _userRanks.assign(std::move(ranks));
+    _numRanks = _userColumns.size();
+    _buildMovieRanks();
+    return SUCCESS;
+}
@@ -0,0 +1,636 @@
+/**
+ * @file RecommenderModel.h
+ * @author  Nimrod Kremer
+ * @version 1.0
+ * @date 26.5.2020
+ *
+ * @brief Dense storage of the data the recommendation system works on
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * Holds the movies and users interned to dense ids, the movie features as one
+ * row-major matrix and only the ranks that were given, by user (CSR) and by movie
+ * (CSC), so the memory grows with the number of ranks.
+ * Input  : the movies features file and the ranks matrix file
+ * Process: interning of names and filling of the matrices
+ * Output : id based access to the data.
+ */
+
+#ifndef CPP4_RECOMMENDERMODEL_H
+#define CPP4_RECOMMENDERMODEL_H
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <memory>
+#include "Array.h"
+#include "RowChecks.h"
+#include "ThreadPool.h"
+
+/**
+ * the id given to a name that was not interned
+ */
+#define NO_ID -1
+
+/**
+ * maps names to dense ids, in the order they were first seen.
+ * Names are interned into a hash map. Freezing packs them one after the other with an open
+ * addressing table of their ids, arrays that can be saved and used in place from a snapshot
+ * file. Names interned after that are kept in the hash map again until the next freeze.
+ */
+class NameTable
+{
+    friend class SnapshotFile;
+private:
+    /**
+     * all of the packed names one after the other
+     */
+    Array<char> _chars;
+    /**
+     * where every packed name starts in _chars, with the end of the last name at the end
+     */
+    Array<uint64_t> _offsets;
+    /**
+     * open addressing table of the packed ids by the hash of their names, NO_ID is an empty slot
+     */
+    Array<int> _slots;
+    /**
+     * the names interned since the last freeze, their ids follow the packed ids
+     */
+    std::vector<std::string> _names;
+    /**
+     * the id of every name interned since the last freeze
+     */
+    std::unordered_map<std::string, int> _ids;
+    /**
+     * @return the hash of the name
+     */
+    static uint64_t _hash(const char *name, size_t length);
+    /**
+     * @return number of packed names
+     */
+    int _numPacked() const
+    {
+        return _offsets.empty() ? 0 : (int) _offsets.size() - 1;
+    }
+public:
+    /**
+     * finds the id of the given name, adding it if it is new
+     * @param name the name to intern
+     * @return the id of the name
+     */
+    int intern(const std::string &name);
+    /**
+     * packs all of the names
+     */
+    void freeze();
+    /**
+     * finds the id of the given name
+     * @param name the name to look for
+     * @return the id of the name or NO_ID if it is unknown
+     */
+    int find(const std::string &name) const;
+    /**
+     * @param id an id given by this table
+     * @return the name of the id
+     */
+    std::string name(int id) const;
+    /**
+     * @return number of names in the table
+     */
+    int size() const
+    {
+        return _numPacked() + (int) _names.size();
+    }
+    /**
+     * @return number of names interned since the last freeze
+     */
+    size_t numUnpacked() const
+    {
+        return _names.size();
+    }
+    /**
+     * removes all of the names
+     */
+    void clear();
+    /**
+     * @param name a name
+     * @param length number of characters of the name
+     * @param numShards number of shards
+     * @return the shard the name belongs to, the same in every process
+     */
+    static int shardOf(const char *name, size_t length, int numShards);
+};
+
+/**
+ * number of rows in a page of changed rows
+ */
+#define ROW_PAGE 256
+
+/**
+ * the ranks of a user or of a movie that changed since the ranks were packed
+ */
+typedef struct RankRow
+{
+    /**
+     * the ranked columns of a user or the users that ranked a movie, ascending
+     */
+    std::vector<int> ids;
+    /**
+     * the rank of every id
+     */
+    std::vector<double> ranks;
+    /**
+     * the version of the model when the row last changed
+     */
+    uint64_t version = 0;
+} RankRow;
+
+/**
+ * ROW_PAGE changed rows, nullptr for the rows that didn't change
+ */
+typedef std::vector<std::shared_ptr<const RankRow>> RankPage;
+
+/**
+ * the changed rows by id. A page is copied when one of its rows changes, so copies of the model
+ * share all of the other pages
+ */
+typedef std::vector<std::shared_ptr<const RankPage>> RankPages;
+
+/**
+ * the loaded data of the recommendation system, all of it accessed by ids.
+ * The packed arrays are shared by the copies of the model, and ranks that change afterwards are
+ * kept as changed rows until the model is compacted.
+ */
+class RecommenderModel
+{
+    friend class SnapshotFile;
+private:
+    /**
+     * the movies, ids are given by the order of the features file
+     */
+    NameTable _movies;
+    /**
+     * the users, ids are given by the order of the ranks file
+     */
+    NameTable _users;
+    /**
+     * number of features every movie has
+     */
+    size_t _numFeatures = 0;
+    /**
+     * row-major matrix of movies x features
+     */
+    Array<double> _features;
+    /**
+     * the normal of the features of every movie
+     */
+    Array<double> _movieNormal;
+    /**
+     * the movie ids in the order of the columns of the ranks file
+     */
+    Array<int> _rankedMovies;
+    /**
+     * the column of every movie in the ranks file, NO_ID for the movies that aren't ranked
+     */
+    Array<int> _movieColumn;
+    /**
+     * where the ranks of every user start in _userColumns and _userRanks, with the end of the
+     * last user at the end
+     */
+    Array<uint64_t> _userStart;
+    /**
+     * the columns every user ranked, ascending within a user
+     */
+    Array<int> _userColumns;
+    /**
+     * the rank of every column in _userColumns
+     */
+    Array<double> _userRanks;
+    /**
+     * where the ranks of every movie start in _movieUsers and _movieRanks, with the end of the
+     * last movie at the end
+     */
+    Array<uint64_t> _movieStart;
+    /**
+     * the users that ranked every movie, ascending within a movie
+     */
+    Array<int> _movieUsers;
+    /**
+     * the rank of every user in _movieUsers
+     */
+    Array<double> _movieRanks;
+    /**
+     * the users whose ranks changed since the ranks were packed
+     */
+    RankPages _changedUsers;
+    /**
+     * the movies whose ranks changed since the ranks were packed
+     */
+    RankPages _changedMovies;
+    /**
+     * the packed rows of the users read from a snapshot that were checked, nullptr for rows built
+     * in memory
+     */
+    std::shared_ptr<const RowChecks> _userChecks;
+    /**
+     * the packed rows of the movies read from a snapshot that were checked, nullptr for rows built
+     * in memory
+     */
+    std::shared_ptr<const RowChecks> _movieChecks;
+    /**
+     * number of rows in _changedUsers
+     */
+    size_t _numChangedUsers = 0;
+    /**
+     * number of ranks of all of the users
+     */
+    size_t _numRanks = 0;
+    /**
+     * counts the changes of ranks, every changed row gets the count it was changed at
+     */
+    uint64_t _version = 0;
+    /**
+     * the version of the ranks of every packed user that changed before the last compaction,
+     * empty if none did
+     */
+    Array<uint64_t> _userVersion;
+    /**
+     * @param pages changed rows
+     * @param id id of the row
+     * @return the row if it changed, nullptr if it didn't
+     */
+    static const RankRow *_changedRow(const RankPages &pages, int id)
+    {
+        size_t page = (size_t) id / ROW_PAGE;
+        return page < pages.size() && pages[page] ? (*pages[page])[id % ROW_PAGE].get() : nullptr;
+    }
+    /**
+     * finds a row of the user or movie ranks, the changed row if there is one
+     * @param pages changed rows
+     * @param starts where the packed rows start
+     * @param ids the packed ids
+     * @param ranks the packed ranks
+     * @param checks the checked packed rows, nullptr if they need no check
+     * @param id id of the row
+     * @param rowIds receives the ids of the row
+     * @param rowRanks receives the ranks of the row
+     * @return number of ranks in the row, 0 for a damaged row
+     */
+    static size_t _row(const RankPages &pages, const Array<uint64_t> &starts, const Array<int> &ids,
+                       const Array<double> &ranks, const RowChecks *checks, int id, const int *&rowIds,
+                       const double *&rowRanks)
+    {
+        const RankRow *changed = _changedRow(pages, id);
+        if (changed != nullptr)
+        {
+            rowIds = changed->ids.data();
+            rowRanks = changed->ranks.data();
+            return changed->ids.size();
+        }
+        rowIds = nullptr;
+        rowRanks = nullptr;
+        // added after the ranks were packed
+        if ((size_t) id + 1 >= starts.size())
+        {
+            return 0;
+        }
+        const int *first = ids.data() + starts[id];
+        size_t count = starts[id + 1] - starts[id];
+        if (checks != nullptr && !checks->valid(id, [&]()
+        {
+            return RowChecks::ascendingBelow(first, count, checks->limit());
+        }))
+        {
+            return 0;
+        }
+        rowIds = first;
+        rowRanks = ranks.data() + starts[id];
+        return count;
+    }
+    /**
+     * finds the ranks of the user, the changed row if there is one
+     * @param user id of the user
+     * @param columns receives the ranked columns of the user
+     * @param ranks receives the rank of every column
+     * @return number of ranks of the user
+     */
+    size_t _userRow(int user, const int *&columns, const double *&ranks) const
+    {
+        return _row(_changedUsers, _userStart, _userColumns, _userRanks, _userChecks.get(), user, columns, ranks);
+    }
+    /**
+     * finds the ranks of the movie, the changed row if there is one
+     * @param movie id of the movie
+     * @param users receives the users that ranked the movie
+     * @param ranks receives the rank of every user
+     * @return number of ranks of the movie
+     */
+    size_t _movieRow(int movie, const int *&users, const double *&ranks) const
+    {
+        return _row(_changedMovies, _movieStart, _movieUsers, _movieRanks, _movieChecks.get(), movie, users, ranks);
+    }
+    /**
+     * sets or removes a rank in a row, copying the page of the row
+     * @param pages changed rows
+     * @param starts where the packed rows start
+     * @param ids the packed ids
+     * @param ranks the packed ranks
+     * @param checks the checked packed rows, nullptr if they need no check
+     * @param id id of the row
+     * @param key the id in the row to change
+     * @param rank the new rank, nullptr removes it
+     * @param version the version of the change
+     * @return true if the row had the key before
+     */
+    static bool _changeRow(RankPages &pages, const Array<uint64_t> &starts, const Array<int> &ids,
+                           const Array<double> &ranks, const RowChecks *checks, int id, int key, const double *rank,
+                           uint64_t version);
+    /**
+     * makes the movie the last column of the ranks, done the first time it is ranked
+     * @param movie id of the movie
+     */
+    void _addColumn(int movie);
+    /**
+     * reads the ranks in the line of a user
+     * @param pos the first rank in the line
+     * @param end the end of the line
+     * @param columns receives the ranked columns of the line
+     * @param ranks receives the rank of every ranked column
+     * @return success or fail
+     */
+    int _readRanksLine(const char *pos, const char *end, std::vector<int> &columns, std::vector<double> &ranks) const;
+    /**
+     * builds the movie to users transpose of the ranks of the users
+     */
+    void _buildMovieRanks();
+    /**
+     * @param user id of the user
+     * @param movie id of the movie
+     * @return the rank the user gave the movie, nullptr if the user didn't rank it
+     */
+    const double *_findRank(int user, int movie) const
+    {
+        int column = _movieColumn[movie];
+        if (column == NO_ID)
+        {
+            return nullptr;
+        }
+        const int *first = nullptr;
+        const double *ranks = nullptr;
+        size_t count = _userRow(user, first, ranks);
+        const int *last = first + count;
+        const int *found = std::lower_bound(first, last, column);
+        return found != last && *found == column ? ranks + (found - first) : nullptr;
+    }
+public:
+    /**
+     * Reads the given movie paths to our data structure
+     * @param moviesAttributesFilePath path to the file
+     * @return fail to success
+     */
+    int readMovies(char const *moviesAttributesFilePath);
+    /**
+     * reads the users ranks from the given file path, must be called after readMovies.
+     * The lines of the users are split into chunks that are parsed in parallel.
+     * @param userRanksFilePath the path to the file
+     * @param pool the threads to parse with
+     * @param shard the shard of the users to read, the others are skipped
+     * @param numShards number of shards the users are split into, 1 reads all of them
+     * @return success or fail
+     */
+    int readUserRanks(char const *userRanksFilePath, ThreadPool &pool, int shard = 0, int numShards = 1);
+    /**
+     * removes all of the loaded data
+     */
+    void clear();
+    /**
+     * adds a user that ranked nothing yet
+     * @param userName the name of the user
+     * @return the id of the user, NO_ID if the user is already known
+     */
+    int addUser(const std::string &userName);
+    /**
+     * adds a movie that can be recommended from now on
+     * @param movieName the name of the movie
+     * @param features the features of the movie, as many as every other movie has
+     * @return the id of the movie, NO_ID if it is already known or the features don't fit
+     */
+    int addMovie(const std::string &movieName, const std::vector<double> &features);
+    /**
+     * sets the rank of the user to the movie, replacing the rank given before
+     * @param user id of the user
+     * @param movie id of the movie
+     * @param rank the rank
+     */
+    void setRank(int user, int movie, double rank);
+    /**
+     * removes the rank of the user to the movie
+     * @param user id of the user
+     * @param movie id of the movie
+     * @return false if the user didn't rank the movie
+     */
+    bool removeRank(int user, int movie);
+    /**
+     * @return number of users, movies and rows changed since the model was compacted
+     */
+    size_t numChanges() const
+    {
+        return _numChangedUsers + _users.numUnpacked() + _movies.numUnpacked();
+    }
+    /**
+     * packs the names and the changed rows back into the arrays
+     */
+    void compact();
+    /**
+     * @return the movies name table
+     */
+    const NameTable &movies() const
+    {
+        return _movies;
+    }
+    /**
+     * @return the users name table
+     */
+    const NameTable &users() const
+    {
+        return _users;
+    }
+    /**
+     * @return number of features every movie has
+     */
+    size_t numFeatures() const
+    {
+        return _numFeatures;
+    }
+    /**
+     * @param movie id of the movie
+     * @return pointer to the numFeatures() features of the movie
+     */
+    const double *features(int movie) const
+    {
+        return _features.data() + (size_t) movie * _numFeatures;
+    }
+    /**
+     * @param movie id of the movie
+     * @return the normal of the features of the movie
+     */
+    double movieNormal(int movie) const
+    {
+        return _movieNormal[movie];
+    }
+    /**
+     * @return the normal of every movie, indexed by id
+     */
+    const double *movieNormals() const
+    {
+        return _movieNormal.data();
+    }
+    /**
+     * @return the movie ids in the order of the columns of the ranks file
+     */
+    const Array<int> &rankedMovies() const
+    {
+        return _rankedMovies;
+    }
+    /**
+     * @param movie id of the movie
+     * @return the column of the movie in the ranks file, NO_ID if it isn't ranked
+     */
+    int columnOf(int movie) const
+    {
+        return _movieColumn[movie];
+    }
+    /**
+     * @return number of ranks of all of the users
+     */
+    size_t numRanks() const
+    {
+        return _numRanks;
+    }
+    /**
+     * @return number of changes of ranks since the load, changes whenever the ranks of any user do
+     */
+    uint64_t ranksVersion() const
+    {
+        return _version;
+    }
+    /**
+     * @param user id of the user
+     * @return the version of the ranks of the user, changes whenever the ranks of the user do
+     */
+    uint64_t userVersion(int user) const
+    {
+        const RankRow *changed = _changedRow(_changedUsers, user);
+        if (changed != nullptr)
+        {
+            return changed->version;
+        }
+        return (size_t) user < _userVersion.size() ? _userVersion[user] : 0;
+    }
+    /**
+     * @param user id of the user
+     * @return number of movies the user ranked
+     */
+    size_t rankedCount(int user) const
+    {
+        const int *columns = nullptr;
+        const double *ranks = nullptr;
+        return _userRow(user, columns, ranks);
+    }
+    /**
+     * @param user id of the user
+     * @return the columns of the movies the user ranked, ascending
+     */
+    const int *rankedColumns(int user) const
+    {
+        const int *columns = nullptr;
+        const double *ranks = nullptr;
+        _userRow(user, columns, ranks);
+        return columns;
+    }
+    /**
+     * @param user id of the user
+     * @return the rank of every column of rankedColumns
+     */
+    const double *userRanks(int user) const
+    {
+        const int *columns = nullptr;
+        const double *ranks = nullptr;
+        _userRow(user, columns, ranks);
+        return ranks;
+    }
+    /**
+     * @param movie id of the movie
+     * @return number of users that ranked the movie
+     */
+    size_t raterCount(int movie) const
+    {
+        const int *users = nullptr;
+        const double *ranks = nullptr;
+        return _movieRow(movie, users, ranks);
+    }
+    /**
+     * @param movie id of the movie
+     * @return the users that ranked the movie, ascending
+     */
+    const int *raters(int movie) const
+    {
+        const int *users = nullptr;
+        const double *ranks = nullptr;
+        _movieRow(movie, users, ranks);
+        return users;
+    }
+    /**
+     * @param movie id of the movie
+     * @return the rank every user of raters gave the movie
+     */
+    const double *raterRanks(int movie) const
+    {
+        const int *users = nullptr;
+        const double *ranks = nullptr;
+        _movieRow(movie, users, ranks);
+        return ranks;
+    }
+    /**
+     * @param user id of the user
+     * @param movie id of the movie
+     * @return true if the user ranked the movie
+     */
+    bool isRanked(int user, int movie) const
+    {
+        return _findRank(user, movie) != nullptr;
+    }
+    /**
+     * @param user id of the user
+     * @param movie id of the movie
+     * @return the rank the user gave the movie, 0 if the user didn't rank it
+     */
+    double rank(int user, int movie) const
+    {
+        const double *found = _findRank(user, movie);
+        return found == nullptr ? 0 : *found;
+    }
+    /**
+     * @param user id of the user
+     * @return the average rank of the user, the center its ranks are normalized around. Not a
+     * number if the user ranked nothing
+     */
+    double averageRank(int user) const
+    {
+        const double *ranks = userRanks(user);
+        size_t num = rankedCount(user);
+        double sum = 0;
+        for (size_t r = 0; r < num; r++)
+        {
+            sum += ranks[r];
+        }
+        return sum / num;
+    }
+};
+
+#endif //CPP4_RECOMMENDERMODEL_H
@@ -17,333 +17,523 @@
  */
 
 #include "RecommenderSystem.h"
+#include "SimilarityKernels.h"
+#include "SnapshotFile.h"
+#include "Metrics.h"
+#include "TopN.h"
 #include <iostream>
-#include <sstream>
 #include <string>
-#include <fstream>
-#include <istream>
 #include <algorithm>
+#include <chrono>
 #include <cmath>
 
 /**
  * when a file is bad and not able to open correctly
  */
 #define BAD_FILE "Unable to open file "
-/**
- * How NA looks in the file
- */
-#define NA "NA"
 /**
  * The message to give the user if the user wasn't found
  */
 #define NO_USER "USER NOT FOUND"
 /**
- * The value to give the number if it's NA
+ * number of users a batch scores together
+ */
+#define BATCH_CHUNK 64
+/**
+ * updates are packed back into arrays only after at least that many changes
  */
-#define NA_VALUE INT32_MAX
+#define COMPACT_MIN_CHANGES 1024
 /**
- * what to return when the funtion failed
+ * updates are packed back into arrays once the changes are at least 1/COMPACT_RATIO of the
+ * users and movies
  */
-#define FAIL -1
+#define COMPACT_RATIO 8
 
 /**
- * in charge of loading user data
- * @param moviesAttributesFilePath
- * @param userRanksFilePath
- * @return
+ * most movies the CF algorithm scores in one tile
  */
-int RecommenderSystem::loadData(const std::string &moviesAttributesFilePath, const std::string &userRanksFilePath)
+#define CF_TILE_ROWS 64
+/**
+ * most similarities of a tile of the CF algorithm, a tile of users with many ranks has fewer rows
+ */
+#define CF_TILE_SIMILARITIES ((size_t) 32768)
+
+/**
+ * creates an empty recommendation system
+ * @param config the knobs of the system
+ */
+RecommenderSystem::RecommenderSystem(const RecommenderConfig &config) :
+        _config(config), _snapshot(std::make_shared<ModelSnapshot>(0, 0)),
+        _pool(std::make_shared<ThreadPool>(config.threads)), _updateMutex(std::make_shared<std::mutex>()),
+        _results(std::make_shared<ResultCache>(config.resultCacheSize))
+{
+}
+
+/**
+ * @param snapshot the snapshot of the system copied
+ * @param config the knobs of the copy
+ * @return a snapshot of the same data with caches of its own, for a copy of the system
+ */
+std::shared_ptr<const ModelSnapshot> RecommenderSystem::_ownCaches(const std::shared_ptr<const ModelSnapshot> &snapshot,
+                                                                   const RecommenderConfig &config)
+{
+    auto copy = std::make_shared<ModelSnapshot>(*snapshot);
+    copy->cache = std::make_shared<SimilarityCache>(config.similarityCacheSize);
+    copy->profiles = std::make_shared<ProfileCache>(config.profileCacheSize);
+    return copy;
+}
+
+/**
+ * creates a system that answers like the other one until either of them changes, it shares the
+ * loaded data and the threads but caches of its own
+ * @param other the system to copy
+ */
+RecommenderSystem::RecommenderSystem(const RecommenderSystem &other) :
+        _config(other._config), _snapshot(_ownCaches(std::atomic_load(&other._snapshot), other._config)),
+        _pool(other._pool),
+        _updateMutex(other._updateMutex), _results(std::make_shared<ResultCache>(other._config.resultCacheSize))
+{
+}
+
+/**
+ * makes the system answer like the other one until either of them changes
+ * @param other the system to copy
+ * @return the system
+ */
+RecommenderSystem &RecommenderSystem::operator=(const RecommenderSystem &other)
 {
-    if (_readMovies(moviesAttributesFilePath.c_str()) == FAIL)
+    if (this != &other)
     {
-        std::cerr << BAD_FILE << moviesAttributesFilePath << std::endl;
-        return FAIL;
+        _config = other._config;
+        std::atomic_store(&_snapshot, _ownCaches(std::atomic_load(&other._snapshot), other._config));
+        _pool = other._pool;
+        _updateMutex = other._updateMutex;
+        _results = std::make_shared<ResultCache>(_config.resultCacheSize);
     }
+    return *this;
+}
 
-    if (_readUserRanks(userRanksFilePath.c_str()) == FAIL)
+/**
+ * makes the snapshot the one the queries read, queries that already hold the old one finish on it.
+ * The version follows the one published before, so no cached recommendation of the old data is used
+ * @param snapshot the new snapshot, given the next version
+ */
+void RecommenderSystem::_publish(std::shared_ptr<ModelSnapshot> snapshot)
+{
+    std::lock_guard<std::mutex> lock(*_updateMutex);
+    snapshot->version = std::atomic_load(&_snapshot)->version + 1;
+    std::atomic_store(&_snapshot, std::shared_ptr<const ModelSnapshot>(std::move(snapshot)));
+}
+
+/**
+ * changes a copy of the snapshot and publishes it if the change succeeded.
+ * The copy shares every array that doesn't change. Once enough changes piled up they are packed
+ * back into arrays, so the copies stay cheap and the rows fast to read.
+ * @param change changes the copy, returns success or fail
+ * @return what the change returned
+ */
+int RecommenderSystem::_update(const std::function<int(ModelSnapshot &)> &change)
+{
+    std::lock_guard<std::mutex> lock(*_updateMutex);
+    auto snapshot = std::make_shared<ModelSnapshot>(*std::atomic_load(&_snapshot));
+    if (change(*snapshot) == FAIL)
     {
-        std::cerr << BAD_FILE << userRanksFilePath << std::endl;
         return FAIL;
     }
-
+    RecommenderModel &model = snapshot->model;
+    size_t numChanges = model.numChanges();
+    if (numChanges >= COMPACT_MIN_CHANGES &&
+        numChanges * COMPACT_RATIO >= (size_t) model.users().size() + model.movies().size())
+    {
+        model.compact();
+    }
+    std::atomic_store(&_snapshot, std::shared_ptr<const ModelSnapshot>(std::move(snapshot)));
     return SUCCESS;
 }
 
 /**
- * Reads the given movie paths to our data structure
- * @param moviesAttributesFilePath path to the file
- * @return fail to success
+ * adds a user that ranked nothing yet, the user can be given ranks from now on
+ * @param userName the name of the user
+ * @return fail if the user is already known
  */
-int RecommenderSystem::_readMovies(char const *moviesAttributesFilePath)
+int RecommenderSystem::addUser(const std::string &userName)
 {
-    std::ifstream fs(moviesAttributesFilePath);
-    fs = std::ifstream(moviesAttributesFilePath);
-
-    if (!fs || !fs.is_open() || !fs.good())
+    return _update([&](ModelSnapshot &snapshot)
     {
-        return FAIL;
-    }
+        return snapshot.model.addUser(userName) == NO_ID ? FAIL : SUCCESS;
+    });
+}
 
-    std::string line;
-    // run each line
-    while (std::getline(fs, line))
+/**
+ * adds a movie that can be ranked and recommended from now on. It has no neighbor list, so its
+ * predictions calculate the similarities from the features until the next load
+ * @param movieName the name of the movie
+ * @param features the features of the movie, as many as every other movie has
+ * @return fail if the movie is already known or the features don't fit
+ */
+int RecommenderSystem::addMovie(const std::string &movieName, const std::vector<double> &features)
+{
+    return _update([&](ModelSnapshot &snapshot)
     {
-        std::istringstream iss(line);
-        int iteration = 0;
-        std::string movieName;
-        std::vector<double> characteristics;
-        double normal = 0;
-        // run for each word in a line with space between them
-        for (std::string s; iss >> s; )
+        if (snapshot.model.addMovie(movieName, features) == NO_ID)
         {
-            if (iteration == 0)
-            {
-                movieName = s;
-            }
-            else
-            {
-                double num = std::stod(s);
-                normal += std::pow(num, 2);
-                characteristics.push_back(num);
-            }
-            iteration++;
+            return FAIL;
         }
-        this->_movieNormal.insert({movieName, std::sqrt(normal)});
-        this->_moviesChar.insert({movieName, characteristics});
-    }
-    fs.close();
-    return SUCCESS;
+        snapshot.features.update(snapshot.model);
+        snapshot.version++;
+        return SUCCESS;
+    });
 }
 
 /**
- * builds a vector with all of the movies from the given stream
- * @param fs stream of data from file
- * @return vector with all of the movies
+ * sets the rank the user gave the movie, replacing the rank given before. The first rank of a
+ * movie makes it a column, which every user may be recommended from now on, so it changes the
+ * version like an added movie does
+ * @param userName the name of the user
+ * @param movieName the name of the movie
+ * @param rank the rank
+ * @return fail if the user or the movie is unknown
  */
-std::vector<std::string> RecommenderSystem::getMovies(std::ifstream &fs)
+int RecommenderSystem::addRating(const std::string &userName, const std::string &movieName, double rank)
 {
-    std::string line;
-    std::vector<std::string> movieList;
-    std::getline(fs, line);
-    std::istringstream iss(line);
+    return _update([&](ModelSnapshot &snapshot)
+    {
+        int user = snapshot.model.users().find(userName);
+        int movie = snapshot.model.movies().find(movieName);
+        if (user == NO_ID || movie == NO_ID)
+        {
+            return FAIL;
+        }
+        if (snapshot.model.columnOf(movie) == NO_ID)
+        {
+            snapshot.version++;
+        }
+        snapshot.model.setRank(user, movie, rank);
+        return SUCCESS;
+    });
+}
 
-    for (std::string s; iss >> s; )
+/**
+ * removes the rank the user gave the movie
+ * @param userName the name of the user
+ * @param movieName the name of the movie
+ * @return fail if the user or the movie is unknown or the user didn't rank the movie
+ */
+int RecommenderSystem::removeRating(const std::string &userName, const std::string &movieName)
+{
+    return _update([&](ModelSnapshot &snapshot)
     {
-        movieList.push_back(s);
-    }
+        int user = snapshot.model.users().find(userName);
+        int movie = snapshot.model.movies().find(movieName);
+        if (user == NO_ID || movie == NO_ID || !snapshot.model.removeRank(user, movie))
+        {
+            return FAIL;
+        }
+        return SUCCESS;
+    });
+}
 
-    return movieList;
+/**
+ * in charge of loading user data. The queries keep the data loaded before until the new data
+ * is published
+ * @param moviesAttributesFilePath
+ * @param userRanksFilePath
+ * @return
+ */
+int RecommenderSystem::loadData(const std::string &moviesAttributesFilePath, const std::string &userRanksFilePath)
+{
+    return loadData(moviesAttributesFilePath, userRanksFilePath, *_pool);
 }
 
 /**
- * reads the users ranks from the given file path
- * @param userRanksFilePath the path to the file
+ * loads the data like loadData, parsing and building on the given threads instead of the
+ * threads of the queries. The new snapshot is built aside and published at once, so the queries
+ * never see a half loaded model
+ * @param moviesAttributesFilePath the path of the movies file
+ * @param userRanksFilePath the path of the ranks file
+ * @param pool the threads to load with
  * @return success or fail
  */
-int RecommenderSystem::_readUserRanks(char const *userRanksFilePath)
+int RecommenderSystem::loadData(const std::string &moviesAttributesFilePath, const std::string &userRanksFilePath,
+                                ThreadPool &pool)
 {
-    std::ifstream fs(userRanksFilePath);
-    fs = std::ifstream(userRanksFilePath);
+    METRICS_TIMER(STAGE_LOAD);
+    // loading replaces whatever was loaded before
+    auto snapshot = std::make_shared<ModelSnapshot>(_config.similarityCacheSize, _config.profileCacheSize);
 
-    if (!fs || !fs.is_open() || !fs.good())
+    if (snapshot->model.readMovies(moviesAttributesFilePath.c_str()) == FAIL)
     {
+        std::cerr << BAD_FILE << moviesAttributesFilePath << std::endl;
         return FAIL;
     }
 
-    std::string line;
-    std::vector<std::string> movieList = getMovies(fs);
-
-    while (std::getline(fs, line))
+    if (snapshot->model.readUserRanks(userRanksFilePath.c_str(), pool, _config.shard, _config.numShards) == FAIL)
     {
-        std::istringstream iss(line);
-        std::vector<userMovieRank> movieRanks;
-        int iteration = 0;
-        std::string name;
-        for (std::string s; iss >> s; )
-        {
-            if (iteration == 0)
-            {
-                name = s;
-            }
-            else
-            {
-                userMovieRank movieRank;
-                movieRank.movie = movieList[iteration - 1];
-                if (s == NA)
-                {
-                    movieRank.rank = NA_VALUE;
-                }
-                else
-                {
-                    movieRank.rank = std::stod(s);
-                }
-                this->_MovieRanks[name][movieRank.movie] = movieRank.rank;
-                movieRanks.push_back(movieRank);
-            }
-            iteration++;
-        }
-        this->_userRank.insert({name, movieRanks});
-
+        std::cerr << BAD_FILE << userRanksFilePath << std::endl;
+        return FAIL;
     }
-    fs.close();
+
+    snapshot->features.build(snapshot->model, _config.precision, pool);
+    snapshot->index.build(snapshot->model, snapshot->features, _config.neighbors, pool);
+    snapshot->content.build(snapshot->model, _config.contentClusters, pool);
+    snapshot->factors.build(snapshot->model, _config.factors, _config.factorIterations, _config.factorRegularization,
+                            pool);
+    snapshot->users.build(snapshot->model, _config.userNeighbors, pool);
+    _publish(snapshot);
     return SUCCESS;
 }
 
 /**
- * dot product of the given vectors
- * @param vec1 vector 1
- * @param vec2 vector 2
- * @return the dot product of both
+ * writes the loaded data and its neighbor lists to a binary snapshot
+ * @param snapshotFilePath the path of the snapshot
+ * @return success or fail
  */
-double RecommenderSystem::dotProduct(const std::vector<double> &vec1, const std::vector<double> &vec2)
+int RecommenderSystem::saveSnapshot(const std::string &snapshotFilePath) const
 {
-    double sum = 0;
-    for (size_t i = 0; i < vec1.size(); i++)
+    std::shared_ptr<const ModelSnapshot> snapshot = std::atomic_load(&_snapshot);
+    if (SnapshotFile::save(snapshotFilePath, snapshot->model, snapshot->index) == FAIL)
     {
-        sum += vec1[i] * vec2[i];
+        std::cerr << BAD_FILE << snapshotFilePath << std::endl;
+        return FAIL;
     }
+    return SUCCESS;
+}
 
-    return sum;
+/**
+ * loads data saved by saveSnapshot instead of the text files, the snapshot is mapped and used
+ * in place. Its rows are checked when the queries first read them, unless verifySnapshots is set
+ * @param snapshotFilePath the path of the snapshot
+ * @return success or fail
+ */
+int RecommenderSystem::loadSnapshot(const std::string &snapshotFilePath)
+{
+    return loadSnapshot(snapshotFilePath, *_pool);
 }
+
 /**
- * calculates the normal of the given vector
- * @param vec the vector to normalize
- * @return the normal of the vector
+ * loads a snapshot like loadSnapshot, building on the given threads instead of the threads of
+ * the queries
+ * @param snapshotFilePath the path of the snapshot
+ * @param pool the threads to load with
+ * @return success or fail
  */
-double RecommenderSystem::normal(const std::vector<double> &vec)
+int RecommenderSystem::loadSnapshot(const std::string &snapshotFilePath, ThreadPool &pool)
 {
-    double sum = 0;
-    for (auto num: vec)
+    METRICS_TIMER(STAGE_LOAD);
+    auto snapshot = std::make_shared<ModelSnapshot>(_config.similarityCacheSize, _config.profileCacheSize);
+    if (SnapshotFile::load(snapshotFilePath, snapshot->model, snapshot->index, _config.verifySnapshots) == FAIL)
     {
-        sum += std::pow(num, 2);
+        std::cerr << BAD_FILE << snapshotFilePath << std::endl;
+        return FAIL;
     }
-
-    return std::sqrt(sum);
+    snapshot->features.build(snapshot->model, _config.precision, pool);
+    snapshot->content.build(snapshot->model, _config.contentClusters, pool);
+    snapshot->factors.build(snapshot->model, _config.factors, _config.factorIterations, _config.factorRegularization,
+                            pool);
+    snapshot->users.build(snapshot->model, _config.userNeighbors, pool);
+    _publish(snapshot);
+    return SUCCESS;
 }
+
 /**
- * calculates the similarity of the 2 vectors according to the equation given
- * @param vec1 the first vector
- * @param vec2 the second vector
- * @return the similarity
+ * loads the text files through a snapshot written in bounded memory, for ranks larger than the
+ * memory. The rows of the users and movies stay in the mapped snapshot and are paged in when the
+ * queries read them
+ * @param moviesAttributesFilePath the path of the movies file
+ * @param userRanksFilePath the path of the ranks file
+ * @param storeFilePath the path of the snapshot to write, replaced as a whole
+ * @param memoryBudget number of bytes of ranks to hold in memory at once while writing
+ * @return success or fail
  */
-double RecommenderSystem::_getSimilarity(const std::vector<double> &vec1, const std::vector<double> &vec2,
-                                         const std::string &movie)
+int RecommenderSystem::loadDataStreaming(const std::string &moviesAttributesFilePath,
+                                         const std::string &userRanksFilePath, const std::string &storeFilePath,
+                                         size_t memoryBudget)
 {
-    double curVal = dotProduct(vec1, vec2);
-    curVal /= (normal(vec1) * _movieNormal[movie]);
-    return curVal;
+    return loadDataStreaming(moviesAttributesFilePath, userRanksFilePath, storeFilePath, memoryBudget, *_pool);
 }
 
 /**
- * normalizes all of the users ranks, according the first step of the given algorithm in 3.2
- * @param userRank the users ranks
- * @return new vector with the given ranks
+ * loads the text files through a snapshot like loadDataStreaming, building on the given threads
+ * instead of the threads of the queries. The snapshot has no neighbor lists, they only need the
+ * features so they are built in memory after it is mapped
+ * @param moviesAttributesFilePath the path of the movies file
+ * @param userRanksFilePath the path of the ranks file
+ * @param storeFilePath the path of the snapshot to write, replaced as a whole
+ * @param memoryBudget number of bytes of ranks to hold in memory at once while writing
+ * @param pool the threads to load with
+ * @return success or fail
  */
-std::vector<userMovieRank> &RecommenderSystem::normalizeUser(std::vector<userMovieRank> &userRank)
+int RecommenderSystem::loadDataStreaming(const std::string &moviesAttributesFilePath,
+                                         const std::string &userRanksFilePath, const std::string &storeFilePath,
+                                         size_t memoryBudget, ThreadPool &pool)
 {
-    double sum = 0;
-    int num = 0;
-    for (auto &it: userRank)
+    METRICS_TIMER(STAGE_LOAD);
+    if (SnapshotFile::ingest(storeFilePath, moviesAttributesFilePath, userRanksFilePath, memoryBudget) == FAIL)
     {
-        if (it.rank != NA_VALUE)
-        {
-            sum += it.rank;
-            num++;
-        }
+        std::cerr << BAD_FILE << userRanksFilePath << std::endl;
+        return FAIL;
     }
-    double avg =  sum / num;
-    for (auto &it: userRank)
+    auto snapshot = std::make_shared<ModelSnapshot>(_config.similarityCacheSize, _config.profileCacheSize);
+    if (SnapshotFile::load(storeFilePath, snapshot->model, snapshot->index) == FAIL)
     {
-        if (it.rank != NA_VALUE)
-        {
-            it.rank -= avg;
-        }
+        std::cerr << BAD_FILE << storeFilePath << std::endl;
+        return FAIL;
     }
-    return userRank;
+    snapshot->features.build(snapshot->model, _config.precision, pool);
+    snapshot->index.build(snapshot->model, snapshot->features, _config.neighbors, pool);
+    snapshot->content.build(snapshot->model, _config.contentClusters, pool);
+    snapshot->factors.build(snapshot->model, _config.factors, _config.factorIterations, _config.factorRegularization,
+                            pool);
+    snapshot->users.build(snapshot->model, _config.userNeighbors, pool);
+    _publish(snapshot);
+    return SUCCESS;
 }
 
 /**
- * calculates users preference
- * @param userRank the users ranks
- * @param movies the movies
- * @return all of the users preferences
+ * calculates the average rank and the preferences of the user, according the given algorithm
+ * in 3.2. The ranks of the user are contiguous, so the average is one short loop and the
+ * preference is accumulated in a single pass over the ranked movies
+ * @param model the loaded model
+ * @param user the id of the user
+ * @return the profile of the user
  */
-std::vector<double> RecommenderSystem::getUserPreference(std::vector<userMovieRank> &userRank,
-                                                         std::unordered_map<std::string,
-                                                         std::vector<double>> movies)
+std::shared_ptr<const UserProfile> RecommenderSystem::_buildProfile(const RecommenderModel &model, int user)
 {
-    // holds the vectors after multiplied by the scalar of the rank
-    std::vector<std::vector<double>> userPref;
-    for (auto &it: userRank)
+    auto profile = std::make_shared<UserProfile>();
+    profile->user = user;
+    profile->version = model.userVersion(user);
+    const int *columns = model.rankedColumns(user);
+    const double *ranks = model.userRanks(user);
+    size_t num = model.rankedCount(user);
+    profile->average = model.averageRank(user);
+
+    size_t numFeatures = model.numFeatures();
+    std::vector<double> &pref = profile->preference;
+    pref.assign(numFeatures, 0);
+    // add the features of every ranked movie multiplied by the scalar of the normalized rank
+    for (size_t r = 0; r < num; r++)
     {
-        if (it.rank != NA_VALUE)
+        double rank = ranks[r] - profile->average;
+        const double *features = model.features(model.rankedMovies()[columns[r]]);
+        for (size_t i = 0; i < numFeatures; i++)
         {
-            std::vector<double>pref = movies[it.movie];
-            for (size_t i = 0; i < pref.size(); i++)
-            {
-                pref[i] *= it.rank;
-            }
-            userPref.push_back(pref);
+            pref[i] += features[i] * rank;
         }
     }
+    profile->normal = SimilarityKernels::normal(pref.data(), numFeatures);
+    return profile;
+}
 
-    // now add all vectors together in userPref
-    std::vector<double> retPref;
-    // at least 1 movie that the user likes
-    for (size_t i = 0; i < userPref[0].size(); i++)
+/**
+ * finds the profile of the user in the cache, calculating it if the ranks of the user changed
+ * since it was cached
+ * @param snapshot the loaded data
+ * @param user the id of the user
+ * @return the profile of the user
+ */
+std::shared_ptr<const UserProfile> RecommenderSystem::_userProfile(const ModelSnapshot &snapshot, int user)
+{
+    std::shared_ptr<const UserProfile> profile = snapshot.profiles->find(user, snapshot.model.userVersion(user));
+    if (!profile)
     {
-        double num = 0;
-        for (auto pref: userPref)
-        {
-            num += pref[i];
-        }
-        retPref.push_back(num);
+        METRICS_TIMER(STAGE_PROFILE);
+        METRICS_ADD(PROFILES_BUILT, 1);
+        profile = _buildProfile(snapshot.model, user);
+        snapshot.profiles->insert(profile);
     }
-
-    return retPref;
+    else
+    {
+        METRICS_ADD(PROFILE_CACHE_HITS, 1);
+    }
+    return profile;
 }
 
 /**
- * finds the recommended movies for the user from the given data
- * @param userPref the users preferences
- * @param movies the movies
- * @param userRank the ranks of the user
- * @return the movie recommended
+ * finds the n movies recommended for the user from the given preferences.
+ * Without the content index every movie the user didn't rank is scored. With it only the movies
+ * of the clusters nearest to the preferences are, at least probes clusters and more until there
+ * are surely n candidates, and the columns added after the clusters were built
+ * @param snapshot the loaded data
+ * @param profile the profile of the user
+ * @param n number of movies to recommend
+ * @param probes least number of clusters of the content index to score, 0 scans all of the movies
+ * @return the score of the recommended movies with their index in the ranked movies, from the best
  */
-std::string RecommenderSystem::_getMovieRecommended(const std::vector<double> &userPref,
-                                                    std::unordered_map<std::string, std::vector<double>> &movies,
-                                                    const std::vector<userMovieRank> &userRank)
+ScoredColumns RecommenderSystem::_getMoviesRecommended(const ModelSnapshot &snapshot, const UserProfile &profile,
+                                                       int n, int probes)
 {
-    double maxVal = INT8_MIN;
-    std::string bestMovie;
-    for (auto &it: userRank)
+    const RecommenderModel &model = snapshot.model;
+    const ContentIndex &content = snapshot.content;
+    const Array<int> &ranked = model.rankedMovies();
+    ScratchVector<int> candidates;
+    ScratchVector<int> positions;
+    const int *rankedColumns = model.rankedColumns(profile.user);
+    const int *rankedEnd = rankedColumns + model.rankedCount(profile.user);
+    // without the content index every column is probed
+    bool probing = probes > 0 && !content.empty();
+    ScratchVector<char> probed;
+    if (probing)
     {
-        if (it.rank == NA_VALUE)
+        probed.assign(ranked.size(), 0);
+        std::fill(probed.begin() + content.columns(), probed.end(), 1);
+        // at most the columns the user ranked of the probed ones aren't candidates
+        size_t wanted = (size_t) std::max(n, 0) + (rankedEnd - rankedColumns);
+        size_t numProbed = 0;
+        ScratchVector<int> clusters = content.nearestClusters(profile.preference.data());
+        for (size_t i = 0; i < clusters.size() && ((int) i < probes || numProbed < wanted); i++)
         {
-            double curVal = _getSimilarity(userPref, movies[it.movie], it.movie);
-            if (curVal > maxVal)
+            const int *list = content.list(clusters[i]);
+            for (size_t j = 0; j < content.listSize(clusters[i]); j++)
             {
-                maxVal = curVal;
-                bestMovie = it.movie;
+                probed[list[j]] = 1;
             }
+            numProbed += content.listSize(clusters[i]);
         }
     }
+    // the columns the user didn't rank are the gaps between the sorted columns the user ranked
+    const int *rankedColumn = rankedColumns;
+    for (size_t i = 0; i < ranked.size(); i++)
+    {
+        if (rankedColumn < rankedEnd && *rankedColumn == (int) i)
+        {
+            rankedColumn++;
+        }
+        else if ((!probing || probed[i]) && model.columnOf(ranked[i]) == (int) i)
+        {
+            candidates.push_back(ranked[i]);
+            positions.push_back((int) i);
+        }
+    }
+    // score all of the candidates in one pass over the feature matrix
+    METRICS_ADD(CANDIDATES_SCORED, candidates.size());
+    ScratchVector<double> similarity(candidates.size());
+    snapshot.features.cosineMany(model, profile.preference.data(), profile.normal, candidates.data(),
+                                 candidates.size(), similarity.data());
 
-    return bestMovie;
+    ScratchTopN best(ScratchTopN::capacityFor(n, candidates.size()));
+    for (size_t i = 0; i < candidates.size(); i++)
+    {
+        // a score that is not a number is never picked
+        if (similarity[i] == similarity[i])
+        {
+            best.push({similarity[i], positions[i]});
+        }
+    }
+    return best.sorted();
 }
 
 /**
- * finds the content best suited for the user
- * @param name the name of the user
- * @return the movie best fit for the given user
+ * finds the n movies recommended by content for the user
+ * @param snapshot the loaded data
+ * @param user the id of the user
+ * @param n number of movies to recommend
+ * @param probes least number of clusters of the content index to score, 0 scans all of the movies
+ * @return the score of the recommended movies with their index in the ranked movies, from the best
  */
-std::string RecommenderSystem::_getContentRecommendation(const std::string &name)
+ScoredColumns RecommenderSystem::_getContentRecommendation(const ModelSnapshot &snapshot, int user, int n,
+                                                           int probes)
 {
-    std::unordered_map<std::string, std::vector<double>> movies = _moviesChar;
-    std::vector<userMovieRank> userRank = _userRank[name];
-    userRank = normalizeUser(userRank);
-    std::vector<double> userPref = getUserPreference(userRank, movies);
-    return _getMovieRecommended(userPref, movies, userRank);
+    return _getMoviesRecommended(snapshot, *_userProfile(snapshot, user), n, probes);
 }
 
 /**
@@ -351,66 +541,247 @@ std::string RecommenderSystem::_getContentRecommendation(const std::string &name
  * @param userName the user name to check
  * @return the movie recommneded
  */
-std::string RecommenderSystem::recommendByContent(const std::string &userName)
+std::string RecommenderSystem::recommendByContent(const std::string &userName) const
 {
-    if (_userRank.find(userName) == _userRank.end())
+    METRICS_TIMER(STAGE_CONTENT_QUERY);
+    ScratchScope scope;
+    std::shared_ptr<const ModelSnapshot> snapshot = std::atomic_load(&_snapshot);
+    int user = snapshot->model.users().find(userName);
+    if (user == NO_ID)
     {
         return NO_USER;
     }
+    uint64_t userVersion = snapshot->model.userVersion(user);
+    std::string recommended;
+    if (_results->find(user, ResultMode::CONTENT, 0, userVersion, snapshot->version, recommended))
+    {
+        return recommended;
+    }
 
-    return _getContentRecommendation(userName);
+    ScoredColumns best = _getContentRecommendation(*snapshot, user, 1, _config.contentProbes);
+    if (!best.empty())
+    {
+        recommended = snapshot->model.movies().name(snapshot->model.rankedMovies()[best[0].second]);
+    }
+    _results->insert(user, ResultMode::CONTENT, 0, userVersion, snapshot->version, recommended);
+    return recommended;
 }
 
 /**
- * finds the movies most similiar for the user and the movie.
- * We want to save the angle between movies as they are constant for the full run of the
- * program.
- * So if we haven't calculated the angle, than we will have to calculate and enter it to our map
- * with saved angles.
- * If it was calculated already, than just take it out of the map
- * @param movieName the movie to check
- * @param name the user
- * @return a unordered_map with the movie and similarity to the given movie name
+ * finds the similarity of the movie to all of the movies the user ranked.
+ * Similarities of pairs that were asked for before come from the cache, the rest are
+ * calculated together and cached.
+ * @param snapshot the loaded data
+ * @param movie the id of the movie to check
+ * @param user the id of the user
+ * @return the ranked movies with their similarity to the given movie
  */
-std::unordered_map<std::string, double> RecommenderSystem::_getMoviesSimilarity(const std::string &movieName,
-                                                                                const std::string &name)
+SimilarMovies RecommenderSystem::_getMoviesSimilarity(const ModelSnapshot &snapshot, int movie, int user)
 {
-    std::vector<userMovieRank> userRank = _userRank[name];
-    std::unordered_map<std::string, double> similarity = {};
-    auto res = _anglesBetweenMovies.find(movieName);
-    for (auto &it: userRank)
+    METRICS_TIMER(STAGE_SIMILARITY);
+    const RecommenderModel &model = snapshot.model;
+    SimilarMovies similarity;
+    ScratchVector<int> missing;
+    const int *columns = model.rankedColumns(user);
+    for (size_t i = 0; i < model.rankedCount(user); i++)
     {
+        int other = model.rankedMovies()[columns[i]];
         double angle = 0;
+        if (other == movie)
+        {
+            continue;
+        }
+        if (snapshot.cache->find(movie, other, angle))
+        {
+            similarity.emplace_back(other, angle);
+        }
+        else
+        {
+            missing.push_back(other);
+        }
+    }
+
+    METRICS_ADD(SIMILARITY_CACHE_HITS, similarity.size());
+    METRICS_ADD(SIMILARITIES_COMPUTED, missing.size());
+    ScratchVector<double> angles(missing.size());
+    snapshot.features.cosineMovie(model, movie, missing.data(), missing.size(), angles.data());
+    for (size_t i = 0; i < missing.size(); i++)
+    {
+        snapshot.cache->insert(movie, missing[i], angles[i]);
+        similarity.emplace_back(missing[i], angles[i]);
+    }
+    return similarity;
+}
 
-        if (res == _anglesBetweenMovies.end())
+/**
+ * adds the similarity of the movie to the movies the user ranked in columns that were added
+ * after the neighbor lists were built, they compete with the movies found in the list
+ * @param snapshot the loaded data
+ * @param movie the id of the movie
+ * @param user the id of the user
+ * @param similarity receives the movies with their similarity
+ */
+void RecommenderSystem::_newColumnsSimilarity(const ModelSnapshot &snapshot, int movie, int user,
+                                              SimilarMovies &similarity)
+{
+    const RecommenderModel &model = snapshot.model;
+    if ((size_t) snapshot.index.columns() == model.rankedMovies().size())
+    {
+        return;
+    }
+    const int *columns = model.rankedColumns(user);
+    METRICS_TIMER(STAGE_SIMILARITY);
+    const int *end = columns + model.rankedCount(user);
+    ScratchVector<int> missing;
+    for (const int *column = std::lower_bound(columns, end, snapshot.index.columns()); column < end; column++)
+    {
+        int other = model.rankedMovies()[*column];
+        double angle = 0;
+        if (other == movie)
+        {
+            continue;
+        }
+        if (snapshot.cache->find(movie, other, angle))
         {
-            angle = _getSimilarity(_moviesChar[it.movie], _moviesChar[movieName], movieName);
-            _anglesBetweenMovies[it.movie][movieName] =  angle;
-            _anglesBetweenMovies[movieName][it.movie] =  angle;
+            METRICS_ADD(SIMILARITY_CACHE_HITS, 1);
+            similarity.emplace_back(other, angle);
         }
         else
         {
-            auto res2 = _anglesBetweenMovies[movieName].find(it.movie);
-            if (res2 == _anglesBetweenMovies[movieName].end())
-            {
-                angle = _getSimilarity(_moviesChar[it.movie], _moviesChar[movieName], movieName);
-                _anglesBetweenMovies[it.movie][movieName] =  angle;
-                _anglesBetweenMovies[movieName][it.movie] =  angle;
-            }
-            else
-            {
-                angle = _anglesBetweenMovies[it.movie][movieName];
-            }
+            missing.push_back(other);
         }
+    }
+    METRICS_ADD(SIMILARITIES_COMPUTED, missing.size());
+    ScratchVector<double> angles(missing.size());
+    snapshot.features.cosineMovie(model, movie, missing.data(), missing.size(), angles.data());
+    for (size_t i = 0; i < missing.size(); i++)
+    {
+        snapshot.cache->insert(movie, missing[i], angles[i]);
+        similarity.emplace_back(missing[i], angles[i]);
+    }
+}
 
+/**
+ * predicts the score of the movie for the user.
+ * The neighbor lists are sorted from the most similar, so the first k ranked movies in the list
+ * of the movie are the k ranked movies most similar to it.
+ * If the list runs out before k of them were found and it doesn't hold all of the movies, the
+ * similarities are calculated from the features. Movies ranked in columns added after the lists
+ * were built are checked on the side.
+ * @param snapshot the loaded data
+ * @param movie the id of the movie
+ * @param user the id of the user
+ * @param k number of movies to check with
+ * @return the score of the movie
+ */
+double RecommenderSystem::_predictScore(const ModelSnapshot &snapshot, int movie, int user, int k)
+{
+    double score = 0;
+    if (_neighborsScore(snapshot, movie, user, k, score))
+    {
+        return score;
+    }
+    ScratchScope scope;
+    SimilarMovies similarity = _getMoviesSimilarity(snapshot, movie, user);
+    return _movieScore(snapshot.model, similarity, user, k);
+}
 
-        if (it.rank != NA_VALUE && it.movie != movieName)
+/**
+ * predicts the score of the movie for the user from its neighbor list, if the list holds k movies
+ * the user ranked or all of the movies. Movies ranked in columns added after the lists were built
+ * are checked on the side.
+ * @param snapshot the loaded data
+ * @param movie the id of the movie
+ * @param user the id of the user
+ * @param k number of movies to check with
+ * @param score receives the score of the movie
+ * @return false if the list isn't enough and the similarities must be calculated
+ */
+bool RecommenderSystem::_neighborsScore(const ModelSnapshot &snapshot, int movie, int user, int k, double &score)
+{
+    const RecommenderModel &model = snapshot.model;
+    const SimilarityIndex &index = snapshot.index;
+    if (index.empty() || !index.covers(movie))
+    {
+        return false;
+    }
+    // the similarities of one prediction are given back before the next one
+    ScratchScope scope;
+    SimilarMovies nearest;
+    const Neighbor *neighbors = index.neighbors(movie);
+    int examined = 0;
+    for (; examined < index.count(movie) && (int) nearest.size() < k; examined++)
+    {
+        if (model.isRanked(user, neighbors[examined].movie))
         {
+            nearest.emplace_back(neighbors[examined].movie, neighbors[examined].similarity);
+        }
+    }
+    METRICS_ADD(NEIGHBORS_EXAMINED, examined);
+    if ((int) nearest.size() < k && !index.isComplete())
+    {
+        return false;
+    }
+    _newColumnsSimilarity(snapshot, movie, user, nearest);
+    score = _movieScore(model, nearest, user, k);
+    return true;
+}
+
+/**
+ * predicts the score of a tile of movies the user didn't rank and offers them to the best.
+ * The features of the movies are packed together and compared to all of the movies the user
+ * ranked in one block, then every row keeps its k most similar movies like _movieScore does.
+ * @param snapshot the loaded data
+ * @param user the id of the user
+ * @param rated the movies the user ranked, in the order of the ranks of the user
+ * @param columns the ranked columns of the movies to score
+ * @param k number of movies to check with
+ * @param best receives the score of every movie with its column
+ */
+void RecommenderSystem::_scoreTile(const ModelSnapshot &snapshot, int user, const ScratchVector<int> &rated,
+                                   const ScratchVector<int> &columns, int k, ScratchTopN &best)
+{
+    ScratchScope scope;
+    const RecommenderModel &model = snapshot.model;
+    const double *ranks = model.userRanks(user);
+    ScratchVector<int> movies(columns.size());
+    for (size_t row = 0; row < columns.size(); row++)
+    {
+        movies[row] = model.rankedMovies()[columns[row]];
+    }
+    ScratchVector<double> similarity(columns.size() * rated.size());
+    {
+        METRICS_TIMER(STAGE_SIMILARITY);
+        METRICS_ADD(SIMILARITIES_COMPUTED, similarity.size());
+        snapshot.features.cosineMovieBlock(model, movies.data(), movies.size(), rated.data(), rated.size(),
+                                           similarity.data());
+    }
 
-            similarity.insert({it.movie, angle});
+    SimilarMovies nearest;
+    nearest.reserve(rated.size());
+    for (size_t row = 0; row < columns.size(); row++)
+    {
+        // the positions in the ranks of the user stand for the movies, so the ranks need no search
+        nearest.clear();
+        for (size_t r = 0; r < rated.size(); r++)
+        {
+            nearest.emplace_back((int) r, similarity[row * rated.size() + r]);
+        }
+        selectLargest(nearest, k);
+        double numerator = 0;
+        double denominator = 0;
+        size_t count = std::min(nearest.size(), (size_t) std::max(k, 0));
+        for (size_t i = 0; i < count; i++)
+        {
+            numerator += nearest[i].second * ranks[nearest[i].first];
+            denominator += nearest[i].second;
+        }
+        double score = numerator / denominator;
+        if (score != FAIL && score == score)
+        {
+            best.push({score, columns[row]});
         }
     }
-    return similarity;
 }
 
 /**
@@ -419,59 +790,45 @@ std::unordered_map<std::string, double> RecommenderSystem::_getMoviesSimilarity(
  * @param b second pair
  * @return how to sort them
  */
-bool RecommenderSystem::sortBySimilarity(const std::pair<std::string, double> &a,
-                                         const std::pair<std::string, double> &b)
+bool RecommenderSystem::sortBySimilarity(const std::pair<int, double> &a, const std::pair<int, double> &b)
 {
     return (a.second > b.second);
 }
 
 /**
- * sorts the given unordered_map by value
- * @param m the unordered_map to sort
- * @return a vector with pairs after we sorted
+ * moves the k largest pairs by value to the front of the vector, in no particular order
+ * @param m the pairs
+ * @param k number of pairs to move
  */
-std::vector<std::pair<std::string, double>>
-RecommenderSystem::sortByValue(const std::unordered_map<std::string, double> &m)
+void RecommenderSystem::selectLargest(SimilarMovies &m, int k)
 {
-    std::vector<std::pair<std::string, double>> unordered_mapVector;
-    // Insert entries
-    for (auto &iterator : m)
+    if (k > 0 && (size_t) k < m.size())
     {
-            unordered_mapVector.emplace_back(iterator);
+        METRICS_TIMER(STAGE_SELECT);
+        std::nth_element(m.begin(), m.begin() + (k - 1), m.end(), sortBySimilarity);
     }
-    sort(unordered_mapVector.begin(), unordered_mapVector.end(), sortBySimilarity);
-
-    return unordered_mapVector;
 }
 
 /**
  * finds the score of the movie according to the algorithm of the targil
- * @param kLargest k movies to check with
- * @param name name of the suer
+ * @param model the loaded model
+ * @param similarity the ranked movies with their similarity to the movie
+ * @param user id of the user
+ * @param k k movies to check with
  * @return double with the score of the movie
  */
-double RecommenderSystem::_movieScore(const std::unordered_map<std::string, double> &similarity,
-                                      const std::string &name, int k)
+double RecommenderSystem::_movieScore(const RecommenderModel &model, SimilarMovies &similarity, int user, int k)
 {
     double numerator = 0;
     double denominator = 0;
-    std::vector<std::pair<std::string, double>> sim;
-    sim = sortByValue(similarity);
+    selectLargest(similarity, k);
 
-    int iterations = 0;
+    size_t count = std::min(similarity.size(), (size_t) std::max(k, 0));
     // final calculation for the movie score
-    for (auto &it : sim)
+    for (size_t i = 0; i < count; i++)
     {
-        if (iterations < k)
-        {
-            numerator += it.second * _MovieRanks[name][it.first];
-            denominator += it.second;
-        }
-        else
-		{
-			break;
-		}
-        iterations++;
+        numerator += similarity[i].second * model.rank(user, similarity[i].first);
+        denominator += similarity[i].second;
     }
     return numerator / denominator;
 }
@@ -483,14 +840,18 @@ double RecommenderSystem::_movieScore(const std::unordered_map<std::string, doub
  * @param k number of movie to check with
  * @return the score given
  */
-double RecommenderSystem::predictMovieScoreForUser(const std::string &movieName, const std::string &userName, int k)
+double RecommenderSystem::predictMovieScoreForUser(const std::string &movieName, const std::string &userName,
+                                                   int k) const
 {
-    if (_userRank.find(userName) == _userRank.end() || _moviesChar.find(movieName) == _moviesChar.end())
+    METRICS_TIMER(STAGE_PREDICT_QUERY);
+    std::shared_ptr<const ModelSnapshot> snapshot = std::atomic_load(&_snapshot);
+    int user = snapshot->model.users().find(userName);
+    int movie = snapshot->model.movies().find(movieName);
+    if (user == NO_ID || movie == NO_ID)
     {
         return FAIL;
     }
-    std::unordered_map<std::string, double> movieSimilarity = _getMoviesSimilarity(movieName, userName);
-    return _movieScore(movieSimilarity, userName, k);
+    return _predictScore(*snapshot, movie, user, k);
 }
 
 /**
@@ -499,28 +860,619 @@ double RecommenderSystem::predictMovieScoreForUser(const std::string &movieName,
  * @param k k movie to check withthe movie recommended
  * @return the movie recommended
  */
-std::string RecommenderSystem::recommendByCF(const std::string &userName, int k)
+std::string RecommenderSystem::recommendByCF(const std::string &userName, int k) const
 {
-    if (_userRank.find(userName) == _userRank.end())
+    METRICS_TIMER(STAGE_CF_QUERY);
+    ScratchScope scope;
+    std::shared_ptr<const ModelSnapshot> snapshot = std::atomic_load(&_snapshot);
+    const RecommenderModel &model = snapshot->model;
+    int user = model.users().find(userName);
+    if (user == NO_ID)
     {
         return NO_USER;
     }
+    uint64_t userVersion = model.userVersion(user);
+    std::string recommended;
+    if (_results->find(user, ResultMode::CF, k, userVersion, snapshot->version, recommended))
+    {
+        return recommended;
+    }
+
+    ScoredColumns best = _getCFRecommendation(*snapshot, user, k, 1);
+    if (!best.empty())
+    {
+        recommended = model.movies().name(model.rankedMovies()[best[0].second]);
+    }
+    _results->insert(user, ResultMode::CF, k, userVersion, snapshot->version, recommended);
+    return recommended;
+}
+
+/**
+ * finds the n movies recommended by the CF algorithm for the user.
+ * A movie whose neighbor list is enough is scored from it. The rest are gathered into tiles and
+ * scored against the movies the user ranked together, so the ranks of the user are read once
+ * for the whole query
+ * @param snapshot the loaded data
+ * @param user the id of the user
+ * @param k number of movies to check with
+ * @param n number of movies to recommend
+ * @return the score of the recommended movies with their index in the ranked movies, from the best
+ */
+ScoredColumns RecommenderSystem::_getCFRecommendation(const ModelSnapshot &snapshot, int user, int k, int n)
+{
+    const RecommenderModel &model = snapshot.model;
+    const Array<int> &ranked = model.rankedMovies();
+    // the movies the user ranked are loaded once for all of the candidates
+    const int *rankedColumn = model.rankedColumns(user);
+    const int *rankedEnd = rankedColumn + model.rankedCount(user);
+    ScratchTopN best(ScratchTopN::capacityFor(n, ranked.size() - (rankedEnd - rankedColumn)));
+    ScratchVector<int> rated;
+    rated.reserve(rankedEnd - rankedColumn);
+    for (const int *column = rankedColumn; column < rankedEnd; column++)
+    {
+        rated.push_back(ranked[*column]);
+    }
+    // a tile of similarities stays within CF_TILE_SIMILARITIES
+    size_t tileRows = std::min((size_t) CF_TILE_ROWS, CF_TILE_SIMILARITIES / std::max(rated.size(), (size_t) 1));
+    tileRows = std::max(tileRows, (size_t) 1);
+    ScratchVector<int> tile;
+    tile.reserve(tileRows);
+
+    // predict movie for all of the NA and keep the best
+    for (size_t i = 0; i < ranked.size(); i++)
+    {
+        if (rankedColumn < rankedEnd && *rankedColumn == (int) i)
+        {
+            rankedColumn++;
+        }
+        else if (model.columnOf(ranked[i]) == (int) i)
+        {
+            METRICS_ADD(CANDIDATES_SCORED, 1);
+            double score = 0;
+            if (_neighborsScore(snapshot, ranked[i], user, k, score))
+            {
+                if (score != FAIL && score == score)
+                {
+                    best.push({score, (int) i});
+                }
+                continue;
+            }
+            tile.push_back((int) i);
+            if (tile.size() == tileRows)
+            {
+                _scoreTile(snapshot, user, rated, tile, k, best);
+                tile.clear();
+            }
+        }
+    }
+    if (!tile.empty())
+    {
+        _scoreTile(snapshot, user, rated, tile, k, best);
+    }
+    return best.sorted();
+}
+
+/**
+ * finds the n best movies for the user by content
+ * @param userName the user name to check
+ * @param n number of movies to recommend
+ * @return the recommended movies from the best, empty if the user wasn't found
+ */
+std::vector<Recommendation> RecommenderSystem::recommendTopByContent(const std::string &userName, int n) const
+{
+    METRICS_TIMER(STAGE_CONTENT_QUERY);
+    ScratchScope scope;
+    std::shared_ptr<const ModelSnapshot> snapshot = std::atomic_load(&_snapshot);
+    int user = snapshot->model.users().find(userName);
+    if (user == NO_ID)
+    {
+        return {};
+    }
+    return _toRecommendations(snapshot->model, _getContentRecommendation(*snapshot, user, n, _config.contentProbes));
+}
+
+/**
+ * finds the n best movies for the user by the CF algorithm
+ * @param userName the user name to check
+ * @param k number of movies to check with
+ * @param n number of movies to recommend
+ * @return the recommended movies from the best, empty if the user wasn't found
+ */
+std::vector<Recommendation> RecommenderSystem::recommendTopByCF(const std::string &userName, int k, int n) const
+{
+    METRICS_TIMER(STAGE_CF_QUERY);
+    ScratchScope scope;
+    std::shared_ptr<const ModelSnapshot> snapshot = std::atomic_load(&_snapshot);
+    int user = snapshot->model.users().find(userName);
+    if (user == NO_ID)
+    {
+        return {};
+    }
+    return _toRecommendations(snapshot->model, _getCFRecommendation(*snapshot, user, k, n));
+}
+
+/**
+ * predicts the movie score for the user from the ranks the k users most similar to the user gave
+ * it. Every rank is centered around the average rank of its user, and the weighted average of
+ * them is added to the average rank of the user
+ * @param movieName the movie name
+ * @param userName the name of the user
+ * @param k number of users to check with
+ * @return the score given, the average rank of the user if none of them ranked the movie
+ */
+double RecommenderSystem::predictByUserCF(const std::string &movieName, const std::string &userName, int k) const
+{
+    METRICS_TIMER(STAGE_USER_CF_QUERY);
+    ScratchScope scope;
+    std::shared_ptr<const ModelSnapshot> snapshot = std::atomic_load(&_snapshot);
+    const RecommenderModel &model = snapshot->model;
+    int user = model.users().find(userName);
+    int movie = model.movies().find(movieName);
+    if (user == NO_ID || movie == NO_ID)
+    {
+        return FAIL;
+    }
+    double average = 0;
+    double normal = 0;
+    snapshot->users.centering(model, user, average, normal);
+    double numerator = 0;
+    double denominator = 0;
+    for (const UserNeighbor &neighbor: snapshot->users.neighbors(model, user, k))
+    {
+        if (!model.isRanked(neighbor.user, movie))
+        {
+            continue;
+        }
+        double neighborAverage = 0;
+        double neighborNormal = 0;
+        snapshot->users.centering(model, neighbor.user, neighborAverage, neighborNormal);
+        numerator += neighbor.similarity * (model.rank(neighbor.user, movie) - neighborAverage);
+        denominator += neighbor.similarity;
+    }
+    return denominator > 0 ? average + numerator / denominator : average;
+}
+
+/**
+ * finds the recommended movie according to the user based CF
+ * @param userName the user name of the wanted person who wants recommendation
+ * @param k number of users to check with
+ * @return the movie recommended, empty if none of the users ranked a movie the user didn't
+ */
+std::string RecommenderSystem::recommendByUserCF(const std::string &userName, int k) const
+{
+    METRICS_TIMER(STAGE_USER_CF_QUERY);
+    ScratchScope scope;
+    std::shared_ptr<const ModelSnapshot> snapshot = std::atomic_load(&_snapshot);
+    const RecommenderModel &model = snapshot->model;
+    int user = model.users().find(userName);
+    if (user == NO_ID)
+    {
+        return NO_USER;
+    }
+    ScoredColumns best = _getUserCFRecommendation(*snapshot, user, k, 1);
+    return best.empty() ? "" : model.movies().name(model.rankedMovies()[best[0].second]);
+}
+
+/**
+ * finds the n best movies for the user by the user based CF
+ * @param userName the user name to check
+ * @param k number of users to check with
+ * @param n number of movies to recommend
+ * @return the recommended movies from the best, empty if the user wasn't found
+ */
+std::vector<Recommendation> RecommenderSystem::recommendTopByUserCF(const std::string &userName, int k, int n) const
+{
+    METRICS_TIMER(STAGE_USER_CF_QUERY);
+    ScratchScope scope;
+    std::shared_ptr<const ModelSnapshot> snapshot = std::atomic_load(&_snapshot);
+    int user = snapshot->model.users().find(userName);
+    if (user == NO_ID)
+    {
+        return {};
+    }
+    return _toRecommendations(snapshot->model, _getUserCFRecommendation(*snapshot, user, k, n));
+}
+
+/**
+ * finds the n movies recommended by the user based CF for the user.
+ * The rows of the k most similar users are walked once, summing the centered ranks of every
+ * movie the user didn't rank, so only the movies one of them ranked are scored, each the way
+ * predictByUserCF scores it
+ * @param snapshot the loaded data
+ * @param user the id of the user
+ * @param k number of users to check with
+ * @param n number of movies to recommend
+ * @return the score of the recommended movies with their index in the ranked movies, from the best
+ */
+ScoredColumns RecommenderSystem::_getUserCFRecommendation(const ModelSnapshot &snapshot, int user, int k, int n)
+{
+    const RecommenderModel &model = snapshot.model;
+    const Array<int> &ranked = model.rankedMovies();
+    double average = 0;
+    double normal = 0;
+    snapshot.users.centering(model, user, average, normal);
+    ScratchVector<double> numerators(ranked.size(), 0.0);
+    ScratchVector<double> denominators(ranked.size(), 0.0);
+    ScratchVector<int> candidates;
+    ScratchVector<char> isRanked(ranked.size(), 0);
+    const int *rankedColumn = model.rankedColumns(user);
+    for (size_t i = 0; i < model.rankedCount(user); i++)
+    {
+        isRanked[rankedColumn[i]] = 1;
+    }
+    for (const UserNeighbor &neighbor: snapshot.users.neighbors(model, user, k))
+    {
+        double neighborAverage = 0;
+        double neighborNormal = 0;
+        snapshot.users.centering(model, neighbor.user, neighborAverage, neighborNormal);
+        const int *columns = model.rankedColumns(neighbor.user);
+        const double *ranks = model.userRanks(neighbor.user);
+        for (size_t i = 0; i < model.rankedCount(neighbor.user); i++)
+        {
+            int column = columns[i];
+            if (isRanked[column])
+            {
+                continue;
+            }
+            if (denominators[column] == 0)
+            {
+                candidates.push_back(column);
+            }
+            numerators[column] += neighbor.similarity * (ranks[i] - neighborAverage);
+            denominators[column] += neighbor.similarity;
+        }
+    }
+    ScratchTopN best(ScratchTopN::capacityFor(n, candidates.size()));
+    for (int column: candidates)
+    {
+        METRICS_ADD(CANDIDATES_SCORED, 1);
+        best.push({average + numerators[column] / denominators[column], column});
+    }
+    return best.sorted();
+}
+
+/**
+ * finds the n best movies for the user by the factors. The factors of the user are found once,
+ * and every movie the user didn't rank costs one dot product
+ * @param userName the user name to check
+ * @param n number of movies to recommend
+ * @return the recommended movies from the best, empty if the user wasn't found or no factors were
+ * trained
+ */
+std::vector<Recommendation> RecommenderSystem::recommendByMF(const std::string &userName, int n) const
+{
+    METRICS_TIMER(STAGE_MF_QUERY);
+    ScratchScope scope;
+    std::shared_ptr<const ModelSnapshot> snapshot = std::atomic_load(&_snapshot);
+    const RecommenderModel &model = snapshot->model;
+    int user = model.users().find(userName);
+    if (user == NO_ID || snapshot->factors.empty())
+    {
+        return {};
+    }
+    ScratchVector<double> factors = snapshot->factors.userFactors(model, user);
+    const Array<int> &ranked = model.rankedMovies();
+    const int *rankedColumn = model.rankedColumns(user);
+    const int *rankedEnd = rankedColumn + model.rankedCount(user);
+    ScratchTopN best(ScratchTopN::capacityFor(n, ranked.size() - (rankedEnd - rankedColumn)));
+    for (size_t i = 0; i < ranked.size(); i++)
+    {
+        if (rankedColumn < rankedEnd && *rankedColumn == (int) i)
+        {
+            rankedColumn++;
+        }
+        else if (model.columnOf(ranked[i]) == (int) i)
+        {
+            METRICS_ADD(CANDIDATES_SCORED, 1);
+            best.push({snapshot->factors.predict(factors, (int) i), (int) i});
+        }
+    }
+    return _toRecommendations(model, best.sorted());
+}
+
+/**
+ * predicts the movie score for the user by the factors
+ * @param movieName the movie name
+ * @param userName the name of the user
+ * @return the score given, fail if the movie or the user wasn't found or no factors were trained
+ */
+double RecommenderSystem::predictByMF(const std::string &movieName, const std::string &userName) const
+{
+    METRICS_TIMER(STAGE_MF_QUERY);
+    ScratchScope scope;
+    std::shared_ptr<const ModelSnapshot> snapshot = std::atomic_load(&_snapshot);
+    const RecommenderModel &model = snapshot->model;
+    int user = model.users().find(userName);
+    int movie = model.movies().find(movieName);
+    if (user == NO_ID || movie == NO_ID || snapshot->factors.empty())
+    {
+        return FAIL;
+    }
+    return snapshot->factors.predict(snapshot->factors.userFactors(model, user), model.columnOf(movie));
+}
+
+/**
+ * names the picked movies
+ * @param model the loaded model
+ * @param best the score of the picked movies with their index in the ranked movies
+ * @return the picked movies
+ */
+std::vector<Recommendation> RecommenderSystem::_toRecommendations(const RecommenderModel &model,
+                                                                  const ScoredColumns &best)
+{
+    std::vector<Recommendation> recommendations;
+    for (auto &it: best)
+    {
+        recommendations.push_back({model.movies().name(model.rankedMovies()[it.second]), it.first});
+    }
+    return recommendations;
+}
+
+/**
+ * finds the n movies recommended by content for every one of the users.
+ * The preferences of a chunk of users are scored against the movies together, and the
+ * chunks run in parallel. With the content index every user probes its own clusters instead.
+ * @param userNames the users to recommend to
+ * @param n number of movies to recommend to every user
+ * @return the recommended movies of every user from the best, empty for unknown users
+ */
+std::vector<std::vector<Recommendation>> RecommenderSystem::recommendByContentBatch(
+        const std::vector<std::string> &userNames, int n) const
+{
+    std::shared_ptr<const ModelSnapshot> snapshot = std::atomic_load(&_snapshot);
+    const RecommenderModel &model = snapshot->model;
+    const Array<int> &candidates = model.rankedMovies();
+    std::vector<std::vector<Recommendation>> results(userNames.size());
+    int probes = _config.contentProbes;
+    if (probes > 0 && !snapshot->content.empty())
+    {
+        _pool->parallelFor(userNames.size(), [&](size_t i)
+        {
+            ScratchScope scope;
+            int user = model.users().find(userNames[i]);
+            if (user != NO_ID)
+            {
+                results[i] = _toRecommendations(model, _getContentRecommendation(*snapshot, user, n, probes));
+            }
+        });
+        return results;
+    }
 
-    std::string bestMovie;
-    double bestMovieScore = INT8_MIN;
-    // predict movie for all of the NA and check the maximum
-    for (size_t i = 0; i < _userRank[userName].size(); i++)
+    size_t numChunks = (userNames.size() + BATCH_CHUNK - 1) / BATCH_CHUNK;
+    _pool->parallelFor(numChunks, [&](size_t chunk)
     {
-        if (_userRank[userName][i].rank == NA_VALUE)
+        ScratchScope scope;
+        size_t begin = chunk * BATCH_CHUNK;
+        size_t end = std::min(begin + BATCH_CHUNK, userNames.size());
+        ScratchVector<size_t> slots;
+        ScratchVector<int> users;
+        ScratchVector<double> prefs;
+        ScratchVector<double> prefNormals;
+        for (size_t i = begin; i < end; i++)
         {
-            double score = predictMovieScoreForUser(_userRank[userName][i].movie, userName, k);
-            if (score != FAIL && score > bestMovieScore)
+            int user = model.users().find(userNames[i]);
+            if (user == NO_ID)
             {
-                bestMovie = _userRank[userName][i].movie;
-                bestMovieScore = score;
+                continue;
             }
+            std::shared_ptr<const UserProfile> profile = _userProfile(*snapshot, user);
+            prefNormals.push_back(profile->normal);
+            prefs.insert(prefs.end(), profile->preference.begin(), profile->preference.end());
+            users.push_back(user);
+            slots.push_back(i);
         }
 
+        // users x candidates, every movie is read once for the whole chunk
+        METRICS_ADD(CANDIDATES_SCORED, users.size() * candidates.size());
+        ScratchVector<double> similarity(users.size() * candidates.size());
+        snapshot->features.cosineBlock(model, prefs.data(), prefNormals.data(), users.size(), candidates.data(),
+                                       candidates.size(), similarity.data());
+
+        ScratchTopN best(ScratchTopN::capacityFor(n, candidates.size()));
+        for (size_t u = 0; u < users.size(); u++)
+        {
+            best.clear(ScratchTopN::capacityFor(n, candidates.size()));
+            const int *rankedColumn = model.rankedColumns(users[u]);
+            const int *rankedEnd = rankedColumn + model.rankedCount(users[u]);
+            for (size_t c = 0; c < candidates.size(); c++)
+            {
+                double score = similarity[u * candidates.size() + c];
+                if (rankedColumn < rankedEnd && *rankedColumn == (int) c)
+                {
+                    rankedColumn++;
+                }
+                // a score that is not a number is never picked
+                else if (model.columnOf(candidates[c]) == (int) c && score == score)
+                {
+                    best.push({score, (int) c});
+                }
+            }
+            results[slots[u]] = _toRecommendations(model, best.sorted());
+        }
+    });
+    return results;
+}
+
+/**
+ * finds the n movies recommended by the CF algorithm for every one of the users, the users
+ * run in parallel
+ * @param userNames the users to recommend to
+ * @param k number of movies to check with
+ * @param n number of movies to recommend to every user
+ * @return the recommended movies of every user from the best, empty for unknown users
+ */
+std::vector<std::vector<Recommendation>> RecommenderSystem::recommendByCFBatch(
+        const std::vector<std::string> &userNames, int k, int n) const
+{
+    std::shared_ptr<const ModelSnapshot> snapshot = std::atomic_load(&_snapshot);
+    const RecommenderModel &model = snapshot->model;
+    std::vector<std::vector<Recommendation>> results(userNames.size());
+
+    size_t numChunks = (userNames.size() + BATCH_CHUNK - 1) / BATCH_CHUNK;
+    _pool->parallelFor(numChunks, [&](size_t chunk)
+    {
+        size_t end = std::min((chunk + 1) * BATCH_CHUNK, userNames.size());
+        for (size_t i = chunk * BATCH_CHUNK; i < end; i++)
+        {
+            ScratchScope scope;
+            int user = model.users().find(userNames[i]);
+            if (user != NO_ID)
+            {
+                results[i] = _toRecommendations(model, _getCFRecommendation(*snapshot, user, k, n));
+            }
+        }
+    });
+    return results;
+}
+
+/**
+ * compares the content recommendation through the clusters to the exact scan. The users run one
+ * after the other, so the times are of single queries
+ * @param userNames the users to recommend to, unknown users are skipped
+ * @param n number of movies to recommend to every user
+ * @return the recall of the recommendation and the time both took
+ */
+ContentRecallReport RecommenderSystem::contentRecall(const std::vector<std::string> &userNames, int n) const
+{
+    std::shared_ptr<const ModelSnapshot> snapshot = std::atomic_load(&_snapshot);
+    const RecommenderModel &model = snapshot->model;
+    ContentRecallReport report;
+    report.n = n;
+    size_t found = 0;
+    size_t total = 0;
+    for (const std::string &userName: userNames)
+    {
+        int user = model.users().find(userName);
+        if (user == NO_ID)
+        {
+            continue;
+        }
+        ScratchScope scope;
+        std::shared_ptr<const UserProfile> profile = _userProfile(*snapshot, user);
+        auto start = std::chrono::steady_clock::now();
+        ScoredColumns exact = _getMoviesRecommended(*snapshot, *profile, n, 0);
+        auto middle = std::chrono::steady_clock::now();
+        ScoredColumns approximate = _getMoviesRecommended(*snapshot, *profile, n, _config.contentProbes);
+        auto end = std::chrono::steady_clock::now();
+        report.exactSeconds += std::chrono::duration<double>(middle - start).count();
+        report.approximateSeconds += std::chrono::duration<double>(end - middle).count();
+
+        ScratchVector<int> exactColumns;
+        for (auto &it: exact)
+        {
+            exactColumns.push_back(it.second);
+        }
+        std::sort(exactColumns.begin(), exactColumns.end());
+        for (auto &it: approximate)
+        {
+            found += std::binary_search(exactColumns.begin(), exactColumns.end(), it.second);
+        }
+        total += exact.size();
+        report.users++;
     }
-    return bestMovie;
-}
\ No newline at end of file
+    report.recall = total == 0 ? 1 : (double) found / total;
+    return report;
+}
+
+/**
+ * compares the predictions with the features in the given precision to the predictions in
+ * double precision. Both predict like predictMovieScoreForUser without the neighbor lists and
+ * the cache, so the differences come only from the precision. The users run in parallel
+ * @param precision the precision to check
+ * @param movieNames the movies to predict, unknown movies are skipped
+ * @param userNames the users to predict for, unknown users are skipped
+ * @param k number of movies to check with
+ * @return the differences of the predictions and the memory of both precisions
+ */
+PrecisionReport RecommenderSystem::precisionReport(FeaturePrecision precision,
+                                                   const std::vector<std::string> &movieNames,
+                                                   const std::vector<std::string> &userNames, int k) const
+{
+    std::shared_ptr<const ModelSnapshot> snapshot = std::atomic_load(&_snapshot);
+    const RecommenderModel &model = snapshot->model;
+    FeatureMatrix exact;
+    exact.build(model, FeaturePrecision::DOUBLE, *_pool);
+    FeatureMatrix converted;
+    converted.build(model, precision, *_pool);
+
+    std::vector<int> movies;
+    for (const std::string &movieName: movieNames)
+    {
+        int movie = model.movies().find(movieName);
+        if (movie != NO_ID)
+        {
+            movies.push_back(movie);
+        }
+    }
+    // the errors of every user are summed apart, so the users need no lock
+    std::vector<size_t> counts(userNames.size(), 0);
+    std::vector<double> largest(userNames.size(), 0);
+    std::vector<double> sums(userNames.size(), 0);
+    std::vector<double> squares(userNames.size(), 0);
+    _pool->parallelFor(userNames.size(), [&](size_t i)
+    {
+        int user = model.users().find(userNames[i]);
+        if (user == NO_ID)
+        {
+            return;
+        }
+        ScratchScope scope;
+        const int *columns = model.rankedColumns(user);
+        ScratchVector<int> rated(model.rankedCount(user));
+        for (size_t r = 0; r < rated.size(); r++)
+        {
+            rated[r] = model.rankedMovies()[columns[r]];
+        }
+        ScratchVector<double> exactAngles(rated.size());
+        ScratchVector<double> convertedAngles(rated.size());
+        SimilarMovies exactSimilarity;
+        SimilarMovies convertedSimilarity;
+        for (int movie: movies)
+        {
+            exact.cosineMovie(model, movie, rated.data(), rated.size(), exactAngles.data());
+            converted.cosineMovie(model, movie, rated.data(), rated.size(), convertedAngles.data());
+            exactSimilarity.clear();
+            convertedSimilarity.clear();
+            for (size_t r = 0; r < rated.size(); r++)
+            {
+                if (rated[r] != movie)
+                {
+                    exactSimilarity.emplace_back(rated[r], exactAngles[r]);
+                    convertedSimilarity.emplace_back(rated[r], convertedAngles[r]);
+                }
+            }
+            double expected = _movieScore(model, exactSimilarity, user, k);
+            double actual = _movieScore(model, convertedSimilarity, user, k);
+            // a prediction that is not a number has nothing to be compared to
+            if (expected != expected || actual != actual)
+            {
+                continue;
+            }
+            double error = std::fabs(actual - expected);
+            counts[i]++;
+            largest[i] = std::max(largest[i], error);
+            sums[i] += error;
+            squares[i] += error * error;
+        }
+    });
+
+    PrecisionReport report;
+    report.precision = precision;
+    report.featureBytes = converted.bytes(model);
+    report.doubleBytes = exact.bytes(model);
+    double sum = 0;
+    double squared = 0;
+    for (size_t i = 0; i < userNames.size(); i++)
+    {
+        report.predictions += counts[i];
+        report.maxError = std::max(report.maxError, largest[i]);
+        sum += sums[i];
+        squared += squares[i];
+    }
+    if (report.predictions > 0)
+    {
+        report.meanError = sum / report.predictions;
+        report.rmse = std::sqrt(squared / report.predictions);
+    }
+    return report;
+}
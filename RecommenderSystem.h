@@ -22,162 +22,566 @@
 #include <unordered_map>
 #include <vector>
 #include <string>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include "RecommenderModel.h"
+#include "FeatureMatrix.h"
+#include "SimilarityIndex.h"
+#include "SimilarityCache.h"
+#include "ProfileCache.h"
+#include "ResultCache.h"
+#include "ContentIndex.h"
+#include "FactorModel.h"
+#include "UserNeighborIndex.h"
+#include "SnapshotFile.h"
+#include "ScratchArena.h"
+#include "TopN.h"
+#include "ReturnCodes.h"
 
 /**
- * program failed
+ * default number of most similar movies kept for every movie
  */
-#define FAIL -1
+#define DEFAULT_NEIGHBORS 64
 /**
- * program succeeded
+ * default number of slots of the cache of similarities
  */
-#define SUCCESS 0
+#define DEFAULT_SIMILARITY_CACHE 65536
+/**
+ * default number of slots of the cache of the profiles of users
+ */
+#define DEFAULT_PROFILE_CACHE 65536
+/**
+ * default number of recommendations cached
+ */
+#define DEFAULT_RESULT_CACHE 65536
+/**
+ * default number of clusters a content query scores
+ */
+#define DEFAULT_CONTENT_PROBES 8
+/**
+ * default number of rounds of the training of the factors
+ */
+#define DEFAULT_FACTOR_ITERATIONS 10
+/**
+ * default pull of the factors to 0, for every rank they have
+ */
+#define DEFAULT_FACTOR_REGULARIZATION 0.05
+
+/**
+ * the knobs of the recommendation system, used when the data is loaded
+ */
+typedef struct RecommenderConfig
+{
+    /**
+     * number of most similar movies kept for every movie, 0 computes the similarities on every query
+     */
+    int neighbors = DEFAULT_NEIGHBORS;
+    /**
+     * number of threads the work is spread on, 0 for all of the cores
+     */
+    int threads = 0;
+    /**
+     * number of slots of the cache of similarities calculated by queries, 0 disables it
+     */
+    size_t similarityCacheSize = DEFAULT_SIMILARITY_CACHE;
+    /**
+     * number of slots of the cache of the profiles of users, 0 disables it
+     */
+    size_t profileCacheSize = DEFAULT_PROFILE_CACHE;
+    /**
+     * number of recommendations by content and by the CF algorithm that are cached, 0 disables it
+     */
+    size_t resultCacheSize = DEFAULT_RESULT_CACHE;
+    /**
+     * number of clusters of the approximate index of the content recommendation, about the square
+     * root of the number of ranked movies is a good start. 0 scans all of the movies
+     */
+    int contentClusters = 0;
+    /**
+     * least number of clusters a content query scores, more probes are closer to the exact scan
+     * and slower. Read on every query
+     */
+    int contentProbes = DEFAULT_CONTENT_PROBES;
+    /**
+     * the precision the similarities are calculated in, float32 and int8 keep a compact copy of
+     * the features and trade some accuracy for less memory traffic
+     */
+    FeaturePrecision precision = FeaturePrecision::DOUBLE;
+    /**
+     * number of factors of every user and movie the factorization learns on every load, 0 trains
+     * nothing and recommendByMF recommends nothing
+     */
+    int factors = 0;
+    /**
+     * number of rounds of alternating least squares of the factorization
+     */
+    int factorIterations = DEFAULT_FACTOR_ITERATIONS;
+    /**
+     * how much the factors are pulled to 0 for every rank they have, keeps the users and movies
+     * with few ranks from fitting them exactly
+     */
+    double factorRegularization = DEFAULT_FACTOR_REGULARIZATION;
+    /**
+     * number of most similar users kept for every user by the user based CF, found in parallel
+     * on every load. 0 finds the similar users of a user on every query
+     */
+    int userNeighbors = 0;
+    /**
+     * the shard of the users loadData reads, the users of the other shards are skipped while
+     * every movie is read
+     */
+    int shard = 0;
+    /**
+     * number of shards the users are split into by NameTable::shardOf, 1 reads all of them
+     */
+    int numShards = 1;
+    /**
+     * true to check every row of a snapshot when it is loaded instead of when it is first read,
+     * which reads the whole file and fails the load if any row is damaged
+     */
+    bool verifySnapshots = false;
+} RecommenderConfig;
 
 /**
- * holds the movie and its rank
+ * how close the approximate content recommendation is to the exact scan
  */
-typedef struct userMovieRank
+typedef struct ContentRecallReport
+{
+    /**
+     * number of movies recommended to every user
+     */
+    int n = 0;
+    /**
+     * number of users checked
+     */
+    size_t users = 0;
+    /**
+     * the part of the movies of the exact scan the approximate recommendation found too
+     */
+    double recall = 0;
+    /**
+     * the time the exact scans took
+     */
+    double exactSeconds = 0;
+    /**
+     * the time the approximate recommendations took
+     */
+    double approximateSeconds = 0;
+} ContentRecallReport;
+
+/**
+ * how far the predictions in a precision are from the predictions in double precision
+ */
+typedef struct PrecisionReport
+{
+    FeaturePrecision precision = FeaturePrecision::DOUBLE;
+    /**
+     * number of pairs of movie and user predicted in both precisions
+     */
+    size_t predictions = 0;
+    /**
+     * the largest difference of a prediction
+     */
+    double maxError = 0;
+    /**
+     * the mean absolute difference of the predictions
+     */
+    double meanError = 0;
+    /**
+     * the root of the mean squared difference of the predictions
+     */
+    double rmse = 0;
+    /**
+     * number of bytes the similarities are calculated from in the precision
+     */
+    size_t featureBytes = 0;
+    /**
+     * number of bytes the similarities are calculated from in double precision
+     */
+    size_t doubleBytes = 0;
+} PrecisionReport;
+
+/**
+ * scores of movies with their index in the ranked movies, in the scratch memory of the query
+ */
+typedef ScratchVector<std::pair<double, int>> ScoredColumns;
+/**
+ * movies with their similarity to another movie, in the scratch memory of the query
+ */
+typedef ScratchVector<std::pair<int, double>> SimilarMovies;
+/**
+ * keeps the best scored columns in the scratch memory of the query
+ */
+typedef TopN<std::pair<double, int>, BetterScore, ScratchAllocator<std::pair<double, int>>> ScratchTopN;
+
+/**
+ * a recommended movie and the score it got
+ */
+typedef struct Recommendation
 {
     std::string movie;
-    double rank;
-}userMovieRank;
+    double score;
+} Recommendation;
+
+/**
+ * everything loadData produces. It is never changed after it was published, so any number of
+ * threads may query it, and the cache inside it is safe for concurrent use. An update publishes
+ * a changed copy, which shares the arrays that didn't change.
+ */
+typedef struct ModelSnapshot
+{
+    /**
+     * the movies, users and ranks, all of them by id
+     */
+    RecommenderModel model;
+    /**
+     * the features every similarity is calculated from, in the configured precision
+     */
+    FeatureMatrix features;
+    /**
+     * the most similar movies of every movie
+     */
+    SimilarityIndex index;
+    /**
+     * similarities the queries had to calculate because the neighbor lists weren't enough, by the
+     * ids of the movies. Ranks don't change the similarity of movies and an added movie takes an
+     * id no copy of the snapshot used, so the updated copies share it. A copy of the system makes
+     * its own, two systems that add movies apart give different movies the same ids
+     */
+    std::shared_ptr<SimilarityCache> cache;
+    /**
+     * the clusters of the movies the content recommendation probes, empty for the exact scan
+     */
+    ContentIndex content;
+    /**
+     * the factors of the users and movies, empty unless the factorization is configured. Updated
+     * copies keep them, the users whose ranks changed are solved again when they are queried
+     */
+    FactorModel factors;
+    /**
+     * the average ranks of the users and their most similar users, for the user based CF
+     */
+    UserNeighborIndex users;
+    /**
+     * the profiles of the users the queries calculated, shared by the updated copies since every
+     * profile knows the version of the ranks it came from. A copy of the system makes its own,
+     * the versions of two systems that change apart aren't of the same ranks
+     */
+    std::shared_ptr<ProfileCache> profiles;
+    /**
+     * the version of everything but the ranks, raised by every load and every movie that becomes
+     * a column, added or ranked for the first time. The ranks of every user have their own version
+     * in the model
+     */
+    uint64_t version = 0;
+    /**
+     * creates an empty snapshot
+     * @param cacheSize number of slots of the cache
+     * @param profileCacheSize number of slots of the cache of profiles
+     */
+    ModelSnapshot(size_t cacheSize, size_t profileCacheSize) :
+            cache(std::make_shared<SimilarityCache>(cacheSize)),
+            profiles(std::make_shared<ProfileCache>(profileCacheSize))
+    {
+    }
+} ModelSnapshot;
 
 /**
- * class in charge of the recommendation system
+ * class in charge of the recommendation system.
+ * The queries are const and only read the loaded snapshot, so one system can serve any number of
+ * threads.
  */
 class RecommenderSystem
 {
 private:
     /**
-     * unordered_map with movie and all of its charactersitics
+     * the knobs given on construction
      */
-    std::unordered_map<std::string, std::vector<double>> _moviesChar;
+    RecommenderConfig _config;
     /**
-     * unordered_map with name of the user and vector with all of his ranks for movie
+     * the loaded data, replaced as a whole by loadData and by every update. Always read and
+     * written atomically
      */
-    std::unordered_map<std::string, std::vector<userMovieRank>> _userRank;
+    std::shared_ptr<const ModelSnapshot> _snapshot;
     /**
-     * holds map with all of the movies and their normal
+     * the threads the work is spread on, shared by the copies of the system
      */
-    std::unordered_map<std::string, double> _movieNormal;
+    std::shared_ptr<ThreadPool> _pool;
     /**
-     * holds map with all of the movies and the angles between them
+     * lets one update at a time copy the snapshot, shared by the copies of the system
      */
-    std::unordered_map<std::string, std::unordered_map<std::string, double>> _anglesBetweenMovies;
+    std::shared_ptr<std::mutex> _updateMutex;
     /**
-     * unordered_map with name of the user and movie map to the movie
+     * the recommendations found by the queries, kept by the loads since every entry knows the
+     * versions it was found in. Every copy of the system has its own, two copies that change
+     * apart count the same versions for different data
      */
-    std::unordered_map<std::string, std::unordered_map<std::string, double>> _MovieRanks;
+    std::shared_ptr<ResultCache> _results;
     /**
-    * Reads the given movie paths to our data structure
-    * @param moviesAttributesFilePath path to the file
-    * @return fail to success
-    */
-
-    int _readMovies(char const* moviesAttributesFilePath);
+     * @param snapshot the snapshot of the system copied
+     * @param config the knobs of the copy
+     * @return a snapshot of the same data with caches of its own, for a copy of the system
+     */
+    static std::shared_ptr<const ModelSnapshot> _ownCaches(const std::shared_ptr<const ModelSnapshot> &snapshot,
+                                                           const RecommenderConfig &config);
     /**
-     * reads the users ranks from the given file path
-     * @param userRanksFilePath the path to the file
-     * @return success or fail
+     * makes the snapshot the one the queries read
+     * @param snapshot the new snapshot, given the next version
      */
-    int _readUserRanks(char const* userRanksFilePath);
+    void _publish(std::shared_ptr<ModelSnapshot> snapshot);
     /**
-     * finds the content best suited for the user
-     * @param name the name of the user
-     * @return the movie best fit for the given user
+     * changes a copy of the snapshot and publishes it if the change succeeded
+     * @param change changes the copy, returns success or fail
+     * @return what the change returned
      */
-    std::string _getContentRecommendation(const std::string &name);
+    int _update(const std::function<int(ModelSnapshot &)> &change);
     /**
-     * finds the movies most similiar for the user and the movie
-     * @param movieName the movie to check
-     * @param name the user
-     * @return a unordered_map with the movie and similarity to the given movie name
+     * adds the similarity of the movie to the movies the user ranked in columns that were added
+     * after the neighbor lists were built
+     * @param snapshot the loaded data
+     * @param movie the id of the movie
+     * @param user the id of the user
+     * @param similarity receives the movies with their similarity
      */
-    std::unordered_map<std::string, double> _getMoviesSimilarity(const std::string &movieName, const std::string &name);
+    static void _newColumnsSimilarity(const ModelSnapshot &snapshot, int movie, int user, SimilarMovies &similarity);
     /**
-     * finds the score of the movie according to the algorithm of the targil
-     * @param kLargest k movies to check with
-     * @param name name of the suer
-     * @return double with the score of the movie
+     * finds the n movies recommended by content for the user
+     * @param snapshot the loaded data
+     * @param user the id of the user
+     * @param n number of movies to recommend
+     * @param probes least number of clusters of the content index to score, 0 scans all of the movies
+     * @return the score of the recommended movies with their index in the ranked movies, from the best
      */
-    double _movieScore(const std::unordered_map<std::string, double> &similarity, const std::string &name, int k);
+    static ScoredColumns _getContentRecommendation(const ModelSnapshot &snapshot, int user, int n, int probes);
     /**
-    * calculates the similarity of the 2 vectors according to the equation given
-    * @param vec1 the first vector
-    * @param vec2 the second vector
-    * @return the similarity
-    */
-    double _getSimilarity(const std::vector<double> &vec1, const std::vector<double> &vec2, const std::string &movie);
+     * finds the n movies recommended by the CF algorithm for the user
+     * @param snapshot the loaded data
+     * @param user the id of the user
+     * @param k number of movies to check with
+     * @param n number of movies to recommend
+     * @return the score of the recommended movies with their index in the ranked movies, from the best
+     */
+    static ScoredColumns _getCFRecommendation(const ModelSnapshot &snapshot, int user, int k, int n);
     /**
-     * finds the recommended movies for the user from the given data
-     * @param userPref the users preferences
-     * @param movies the movies
-     * @param userRank the ranks of the user
-     * @return the movie recommended
+     * finds the n movies recommended by the user based CF for the user
+     * @param snapshot the loaded data
+     * @param user the id of the user
+     * @param k number of users to check with
+     * @param n number of movies to recommend
+     * @return the score of the recommended movies with their index in the ranked movies, from the best
      */
-    std::string _getMovieRecommended(const std::vector<double> &userPref,
-                                     std::unordered_map<std::string, std::vector<double>> &movies,
-                                     const std::vector<userMovieRank> &userRank);
+    static ScoredColumns _getUserCFRecommendation(const ModelSnapshot &snapshot, int user, int k, int n);
     /**
-     * builds a vector with all of the movies from the given stream
-     * @param fs stream of data from file
-     * @return vector with all of the movies
+     * finds the similarity of the movie to all of the movies the user ranked
+     * @param snapshot the loaded data
+     * @param movie the id of the movie to check
+     * @param user the id of the user
+     * @return the ranked movies with their similarity to the given movie
      */
-    static std::vector<std::string> getMovies(std::ifstream &fs);
+    static SimilarMovies _getMoviesSimilarity(const ModelSnapshot &snapshot, int movie, int user);
     /**
-     * dot product of the given vectors
-     * @param vec1 vector 1
-     * @param vec2 vector 2
-     * @return the dot product of both
+     * predicts the score of the movie for the user, from the neighbor lists when they are enough
+     * @param snapshot the loaded data
+     * @param movie the id of the movie
+     * @param user the id of the user
+     * @param k number of movies to check with
+     * @return the score of the movie
      */
-    static double dotProduct(const std::vector<double> &vec1, const std::vector<double> &vec2);
+    static double _predictScore(const ModelSnapshot &snapshot, int movie, int user, int k);
     /**
-     * calculates the normal of the given vector
-     * @param vec the vector to normalize
-     * @return the normal of the vector
+     * predicts the score of the movie for the user from its neighbor list, if the list is enough
+     * @param snapshot the loaded data
+     * @param movie the id of the movie
+     * @param user the id of the user
+     * @param k number of movies to check with
+     * @param score receives the score of the movie
+     * @return false if the similarities must be calculated
      */
-    static double normal(const std::vector<double> &vec);
+    static bool _neighborsScore(const ModelSnapshot &snapshot, int movie, int user, int k, double &score);
     /**
-     * normalizes all of the users ranks, according the first step of the given algorithm in 3.2
-     * @param userRank the users ranks
-     * @return new vector with the given ranks
+     * predicts the score of a tile of movies the user didn't rank against all of the movies the
+     * user ranked at once
+     * @param snapshot the loaded data
+     * @param user the id of the user
+     * @param rated the movies the user ranked, in the order of the ranks of the user
+     * @param columns the ranked columns of the movies to score
+     * @param k number of movies to check with
+     * @param best receives the score of every movie with its column
      */
-    static std::vector<userMovieRank> &normalizeUser(std::vector<userMovieRank> &userRank);
+    static void _scoreTile(const ModelSnapshot &snapshot, int user, const ScratchVector<int> &rated,
+                           const ScratchVector<int> &columns, int k, ScratchTopN &best);
     /**
-     * calculates users preference
-     * @param userRank the users ranks
-     * @param movies the movies
-     * @return all of the users preferences
+     * finds the score of the movie according to the algorithm of the targil
+     * @param model the loaded model
+     * @param similarity the ranked movies with their similarity to the movie
+     * @param user id of the user
+     * @param k k movies to check with
+     * @return double with the score of the movie
+     */
+    static double _movieScore(const RecommenderModel &model, SimilarMovies &similarity, int user, int k);
+    /**
+     * finds the n movies recommended for the user from the given preferences
+     * @param snapshot the loaded data
+     * @param profile the profile of the user
+     * @param n number of movies to recommend
+     * @param probes least number of clusters of the content index to score, 0 scans all of the movies
+     * @return the score of the recommended movies with their index in the ranked movies, from the best
+     */
+    static ScoredColumns _getMoviesRecommended(const ModelSnapshot &snapshot, const UserProfile &profile, int n,
+                                               int probes);
+    /**
+     * calculates the average rank and the preferences of the user
+     * @param model the loaded model
+     * @param user the id of the user
+     * @return the profile of the user
      */
-    static std::vector<double> getUserPreference(std::vector<userMovieRank> &userRank,
-                                                 std::unordered_map<std::string,
-                                                 std::vector<double>> movies);
+    static std::shared_ptr<const UserProfile> _buildProfile(const RecommenderModel &model, int user);
+    /**
+     * finds the profile of the user in the cache, calculating it if the ranks of the user
+     * changed since it was cached
+     * @param snapshot the loaded data
+     * @param user the id of the user
+     * @return the profile of the user
+     */
+    static std::shared_ptr<const UserProfile> _userProfile(const ModelSnapshot &snapshot, int user);
+    /**
+     * names the picked movies
+     * @param model the loaded model
+     * @param best the score of the picked movies with their index in the ranked movies
+     * @return the picked movies
+     */
+    static std::vector<Recommendation> _toRecommendations(const RecommenderModel &model, const ScoredColumns &best);
     /**
      * function to help our sort
      * @param a first pair
      * @param b second pair
      * @return how to sort them
      */
-    static bool sortBySimilarity(const std::pair<std::string, double> &a, const std::pair<std::string, double> &b);
+    static bool sortBySimilarity(const std::pair<int, double> &a, const std::pair<int, double> &b);
     /**
-     * sorts the given unordered_map by value
-     * @param m the unordered_map to sort
-     * @return a vector with pairs after we sorted
+     * moves the k largest pairs by value to the front of the vector, in no particular order
+     * @param m the pairs
+     * @param k number of pairs to move
      */
-    static std::vector<std::pair<std::string, double>> sortByValue(const std::unordered_map<std::string, double> &m);
+    static void selectLargest(SimilarMovies &m, int k);
 public:
     /**
-     * in charge of loading user data
+     * creates an empty recommendation system
+     * @param config the knobs of the system
+     */
+    explicit RecommenderSystem(const RecommenderConfig &config = RecommenderConfig());
+    /**
+     * creates a system that answers like the other one until either of them changes, it shares
+     * the loaded data and the threads but caches of its own
+     * @param other the system to copy
+     */
+    RecommenderSystem(const RecommenderSystem &other);
+    /**
+     * makes the system answer like the other one until either of them changes
+     * @param other the system to copy
+     * @return the system
+     */
+    RecommenderSystem &operator=(const RecommenderSystem &other);
+    /**
+     * in charge of loading user data. The queries keep the data loaded before until the new data
+     * is published
      * @param moviesAttributesFilePath
      * @param userRanksFilePath
      * @return
      */
     int loadData(const std::string &moviesAttributesFilePath, const std::string &userRanksFilePath);
+    /**
+     * loads the data like loadData, parsing and building on the given threads instead of the
+     * threads of the queries
+     * @param moviesAttributesFilePath the path of the movies file
+     * @param userRanksFilePath the path of the ranks file
+     * @param pool the threads to load with
+     * @return success or fail
+     */
+    int loadData(const std::string &moviesAttributesFilePath, const std::string &userRanksFilePath,
+                 ThreadPool &pool);
+    /**
+     * writes the loaded data and its neighbor lists to a binary snapshot
+     * @param snapshotFilePath the path of the snapshot
+     * @return success or fail
+     */
+    int saveSnapshot(const std::string &snapshotFilePath) const;
+    /**
+     * loads data saved by saveSnapshot instead of the text files, the snapshot is mapped and
+     * used in place. Its neighbor lists are kept as they were saved. The queries keep the data
+     * loaded before until the new data is published
+     * @param snapshotFilePath the path of the snapshot
+     * @return success or fail
+     */
+    int loadSnapshot(const std::string &snapshotFilePath);
+    /**
+     * loads a snapshot like loadSnapshot, building on the given threads instead of the threads
+     * of the queries
+     * @param snapshotFilePath the path of the snapshot
+     * @param pool the threads to load with
+     * @return success or fail
+     */
+    int loadSnapshot(const std::string &snapshotFilePath, ThreadPool &pool);
+    /**
+     * loads the text files through a snapshot written in bounded memory, for ranks larger than
+     * the memory. The rows of the users and movies stay in the mapped snapshot and are paged in
+     * when the queries read them
+     * @param moviesAttributesFilePath the path of the movies file
+     * @param userRanksFilePath the path of the ranks file
+     * @param storeFilePath the path of the snapshot to write, replaced as a whole
+     * @param memoryBudget number of bytes of ranks to hold in memory at once while writing
+     * @return success or fail
+     */
+    int loadDataStreaming(const std::string &moviesAttributesFilePath, const std::string &userRanksFilePath,
+                          const std::string &storeFilePath, size_t memoryBudget = DEFAULT_INGEST_BUDGET);
+    /**
+     * loads the text files through a snapshot like loadDataStreaming, building on the given
+     * threads instead of the threads of the queries
+     * @param moviesAttributesFilePath the path of the movies file
+     * @param userRanksFilePath the path of the ranks file
+     * @param storeFilePath the path of the snapshot to write, replaced as a whole
+     * @param memoryBudget number of bytes of ranks to hold in memory at once while writing
+     * @param pool the threads to load with
+     * @return success or fail
+     */
+    int loadDataStreaming(const std::string &moviesAttributesFilePath, const std::string &userRanksFilePath,
+                          const std::string &storeFilePath, size_t memoryBudget, ThreadPool &pool);
+    /**
+     * adds a user that ranked nothing yet, the user can be given ranks from now on
+     * @param userName the name of the user
+     * @return fail if the user is already known
+     */
+    int addUser(const std::string &userName);
+    /**
+     * adds a movie that can be ranked and recommended from now on
+     * @param movieName the name of the movie
+     * @param features the features of the movie, as many as every other movie has
+     * @return fail if the movie is already known or the features don't fit
+     */
+    int addMovie(const std::string &movieName, const std::vector<double> &features);
+    /**
+     * sets the rank the user gave the movie, replacing the rank given before. Only the rows of
+     * the user and of the movie are copied, and the next queries see the rank
+     * @param userName the name of the user
+     * @param movieName the name of the movie
+     * @param rank the rank
+     * @return fail if the user or the movie is unknown
+     */
+    int addRating(const std::string &userName, const std::string &movieName, double rank);
+    /**
+     * removes the rank the user gave the movie
+     * @param userName the name of the user
+     * @param movieName the name of the movie
+     * @return fail if the user or the movie is unknown or the user didn't rank the movie
+     */
+    int removeRating(const std::string &userName, const std::string &movieName);
     /**
      * finds the recommended movie for the user
      * @param userName the user name to check
      * @return the movie recommneded
      */
-    std::string recommendByContent(const std::string &userName);
+    std::string recommendByContent(const std::string &userName) const;
     /**
      * predicts the movie score for the user
      * @param movieName the movie name
@@ -185,14 +589,149 @@ public:
      * @param k number of movie to check with
      * @return the score given
      */
-    double predictMovieScoreForUser(const std::string &movieName, const std::string &userName, int k);
+    double predictMovieScoreForUser(const std::string &movieName, const std::string &userName, int k) const;
     /**
      * finds the recommended movie according to the CH algorithm
      * @param userName the user name of the wanted person who wants recommendation
      * @param k k movie to check withthe movie recommended
      * @return the movie recommended
      */
-    std::string recommendByCF(const std::string &userName, int k);
+    std::string recommendByCF(const std::string &userName, int k) const;
+    /**
+     * finds the n best movies for the user by content
+     * @param userName the user name to check
+     * @param n number of movies to recommend
+     * @return the recommended movies from the best, empty if the user wasn't found
+     */
+    std::vector<Recommendation> recommendTopByContent(const std::string &userName, int n) const;
+    /**
+     * finds the n best movies for the user by the CF algorithm
+     * @param userName the user name to check
+     * @param k number of movies to check with
+     * @param n number of movies to recommend
+     * @return the recommended movies from the best, empty if the user wasn't found
+     */
+    std::vector<Recommendation> recommendTopByCF(const std::string &userName, int k, int n) const;
+    /**
+     * finds the n movies recommended by content for every one of the users.
+     * The preferences of a chunk of users are scored against the movies together, and the
+     * chunks run in parallel.
+     * @param userNames the users to recommend to
+     * @param n number of movies to recommend to every user
+     * @return the recommended movies of every user from the best, empty for unknown users
+     */
+    std::vector<std::vector<Recommendation>> recommendByContentBatch(const std::vector<std::string> &userNames,
+                                                                     int n = 1) const;
+    /**
+     * finds the n movies recommended by the CF algorithm for every one of the users, the users
+     * run in parallel
+     * @param userNames the users to recommend to
+     * @param k number of movies to check with
+     * @param n number of movies to recommend to every user
+     * @return the recommended movies of every user from the best, empty for unknown users
+     */
+    std::vector<std::vector<Recommendation>> recommendByCFBatch(const std::vector<std::string> &userNames, int k,
+                                                                int n = 1) const;
+    /**
+     * predicts the movie score for the user from the ranks the k users most similar to the user
+     * gave it, centered around the average ranks of the users
+     * @param movieName the movie name
+     * @param userName the name of the user
+     * @param k number of users to check with
+     * @return the score given, the average rank of the user if none of them ranked the movie
+     */
+    double predictByUserCF(const std::string &movieName, const std::string &userName, int k) const;
+    /**
+     * finds the recommended movie according to the user based CF
+     * @param userName the user name of the wanted person who wants recommendation
+     * @param k number of users to check with
+     * @return the movie recommended, empty if none of the users ranked a movie the user didn't
+     */
+    std::string recommendByUserCF(const std::string &userName, int k) const;
+    /**
+     * finds the n best movies for the user by the user based CF, among the movies the k users
+     * most similar to the user ranked
+     * @param userName the user name to check
+     * @param k number of users to check with
+     * @param n number of movies to recommend
+     * @return the recommended movies from the best, empty if the user wasn't found
+     */
+    std::vector<Recommendation> recommendTopByUserCF(const std::string &userName, int k, int n) const;
+    /**
+     * finds the n best movies for the user by the factors, a dot product for every movie the
+     * user didn't rank
+     * @param userName the user name to check
+     * @param n number of movies to recommend
+     * @return the recommended movies from the best, empty if the user wasn't found or no factors
+     * were trained
+     */
+    std::vector<Recommendation> recommendByMF(const std::string &userName, int n) const;
+    /**
+     * predicts the movie score for the user by the factors
+     * @param movieName the movie name
+     * @param userName the name of the user
+     * @return the score given, fail if the movie or the user wasn't found or no factors were
+     * trained
+     */
+    double predictByMF(const std::string &movieName, const std::string &userName) const;
+    /**
+     * compares the content recommendation through the clusters to the exact scan
+     * @param userNames the users to recommend to, unknown users are skipped
+     * @param n number of movies to recommend to every user
+     * @return the recall of the recommendation and the time both took
+     */
+    ContentRecallReport contentRecall(const std::vector<std::string> &userNames, int n) const;
+    /**
+     * compares the predictions with the features in the given precision to the predictions in
+     * double precision. All of the similarities are calculated, the neighbor lists and the cache
+     * are not used
+     * @param precision the precision to check
+     * @param movieNames the movies to predict, unknown movies are skipped
+     * @param userNames the users to predict for, unknown users are skipped
+     * @param k number of movies to check with
+     * @return the differences of the predictions and the memory of both precisions
+     */
+    PrecisionReport precisionReport(FeaturePrecision precision, const std::vector<std::string> &movieNames,
+                                    const std::vector<std::string> &userNames, int k) const;
+    /**
+     * @return the data the queries read now, it stays valid while it is held even if other
+     * data is published
+     */
+    std::shared_ptr<const ModelSnapshot> snapshot() const
+    {
+        return std::atomic_load(&_snapshot);
+    }
+    /**
+     * @return how long building the neighbor lists took in the last load, copied since the
+     * snapshot may be replaced right after it is read
+     */
+    SimilarityBuildStats similarityBuildStats() const
+    {
+        return std::atomic_load(&_snapshot)->index.buildStats();
+    }
+    /**
+     * @return how long finding the similar users took in the last load, copied since the
+     * snapshot may be replaced right after it is read
+     */
+    SimilarityBuildStats userSimilarityBuildStats() const
+    {
+        return std::atomic_load(&_snapshot)->users.buildStats();
+    }
+    /**
+     * @return how the factors were trained in the last load, copied since the snapshot may be
+     * replaced right after it is read
+     */
+    FactorTrainStats factorTrainStats() const
+    {
+        return std::atomic_load(&_snapshot)->factors.stats();
+    }
+    /**
+     * @return the hits, misses and evictions of the cache of recommendations so far
+     */
+    ResultCacheStats resultCacheStats() const
+    {
+        return _results->stats();
+    }
 };
 
 
@@ -0,0 +1,179 @@
+/**
+ * @file ResultCache.cpp
+ * @author  Nimrod Kremer
+ * @version 1.0
+ * @date 26.5.2020
+ *
+ * @brief Cache of the movies recommended to users
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * A stale entry isn't removed when it is found, the next insert of its key replaces
+ * it in place and the clock replaces it like any other entry. A hit only sets a flag
+ * of its entry, so the order of the entries never moves under the lock.
+ * Input  : the recommendations of users
+ * Process: a hash table and a clock of entries in every shard
+ * Output : the recommendation if it is cached and up to date.
+ */
+
+#include "ResultCache.h"
+
+/**
+ * number of shards of a cache with enough entries for all of them
+ */
+#define RESULT_CACHE_SHARDS 16
+/**
+ * k is kept in the low bits of the key, a user can't rank as many movies as a larger k
+ */
+#define MAX_KEY_K ((1 << 30) - 1)
+
+/**
+ * creates the cache
+ * @param capacity most entries held, 0 disables the cache
+ */
+ResultCache::ResultCache(size_t capacity)
+{
+    if (capacity == 0)
+    {
+        return;
+    }
+    size_t numShards = capacity < RESULT_CACHE_SHARDS ? 1 : RESULT_CACHE_SHARDS;
+    _shards.reset(new Shard[numShards]);
+    _mask = numShards - 1;
+    _shardCapacity = (capacity + numShards - 1) / numShards;
+}
+
+/**
+ * @param user id of the user
+ * @param mode the method of the recommendation
+ * @param k number of movies checked with, every k below 0 recommends like 0
+ * @return the key of the recommendation, the user in the high bits
+ */
+uint64_t ResultCache::_key(int user, ResultMode mode, int k)
+{
+    uint64_t clamped = (uint64_t) (k < 0 ? 0 : (k > MAX_KEY_K ? MAX_KEY_K : k));
+    return ((uint64_t) (uint32_t) user << 32) | ((uint64_t) mode << 30) | clamped;
+}
+
+/**
+ * @param key the key of a recommendation
+ * @return the shard of the key, by the mixed key so that the users spread on all of the shards
+ */
+ResultCache::Shard &ResultCache::_shard(uint64_t key) const
+{
+    uint64_t hash = key * 0x9e3779b97f4a7c15ULL;
+    return _shards[(size_t) (hash >> 32) & _mask];
+}
+
+/**
+ * looks for the recommendation
+ * @param user id of the user
+ * @param mode the method of the recommendation
+ * @param k number of movies checked with, 0 for the content
+ * @param userVersion the current version of the ranks of the user
+ * @param modelVersion the current version of the model
+ * @param result receives the recommendation if it was found
+ * @return true if the recommendation was found and is up to date
+ */
+bool ResultCache::find(int user, ResultMode mode, int k, uint64_t userVersion, uint64_t modelVersion,
+                       std::string &result) const
+{
+    if (!_shards)
+    {
+        return false;
+    }
+    uint64_t key = _key(user, mode, k);
+    Shard &shard = _shard(key);
+    std::lock_guard<std::mutex> guard(shard.lock);
+    auto found = shard.slots.find(key);
+    if (found == shard.slots.end())
+    {
+        shard.stats.misses++;
+        return false;
+    }
+    Entry &entry = shard.entries[found->second];
+    if (entry.userVersion != userVersion || entry.modelVersion != modelVersion)
+    {
+        shard.stats.invalidations++;
+        shard.stats.misses++;
+        return false;
+    }
+    entry.referenced = true;
+    shard.stats.hits++;
+    result = entry.result;
+    return true;
+}
+
+/**
+ * caches the recommendation, replacing the entry of the same key or one the clock picks. The
+ * clock passes over the entries that were hit since it last passed them, and clears them
+ * @param user id of the user
+ * @param mode the method of the recommendation
+ * @param k number of movies checked with, 0 for the content
+ * @param userVersion the version of the ranks of the user it was found from
+ * @param modelVersion the version of the model it was found in
+ * @param result the recommendation
+ */
+void ResultCache::insert(int user, ResultMode mode, int k, uint64_t userVersion, uint64_t modelVersion,
+                         const std::string &result) const
+{
+    if (!_shards)
+    {
+        return;
+    }
+    uint64_t key = _key(user, mode, k);
+    Shard &shard = _shard(key);
+    std::lock_guard<std::mutex> guard(shard.lock);
+    auto found = shard.slots.find(key);
+    if (found != shard.slots.end())
+    {
+        Entry &entry = shard.entries[found->second];
+        // a query of an older model may finish after a newer one, its result is dropped
+        if (modelVersion >= entry.modelVersion)
+        {
+            entry.userVersion = userVersion;
+            entry.modelVersion = modelVersion;
+            entry.result = result;
+        }
+        return;
+    }
+    if (shard.entries.size() < _shardCapacity)
+    {
+        shard.slots.emplace(key, shard.entries.size());
+        shard.entries.push_back({key, userVersion, modelVersion, result, false});
+        return;
+    }
+    while (shard.entries[shard.hand].referenced)
+    {
+        shard.entries[shard.hand].referenced = false;
+        shard.hand = (shard.hand + 1) % shard.entries.size();
+    }
+    Entry &victim = shard.entries[shard.hand];
+    shard.slots.erase(victim.key);
+    shard.slots.emplace(key, shard.hand);
+    victim = {key, userVersion, modelVersion, result, false};
+    shard.hand = (shard.hand + 1) % shard.entries.size();
+    shard.stats.evictions++;
+}
+
+/**
+ * @return the counters of all of the shards, each read under its lock
+ */
+ResultCacheStats ResultCache::stats() const
+{
+    ResultCacheStats total;
+    for (size_t i = 0; _shards && i <= _mask; i++)
+    {
+        Shard &shard = _shards[i];
+        std::lock_guard<std::mutex> guard(shard.lock);
+        total.hits += shard.stats.hits;
+        total.misses += shard.stats.misses;
+        total.evictions += shard.stats.evictions;
+        total.invalidations += shard.stats.invalidations;
+        total.entries += shard.entries.size();
+        total.capacity += _shardCapacity;
+    }
+    return total;
+}
@@ -0,0 +1,157 @@
+/**
+ * @file ResultCache.h
+ * @author  Nimrod Kremer
+ * @version 1.0
+ * @date 26.5.2020
+ *
+ * @brief Cache of the movies recommended to users
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * The recommendation of a user by content or by the CF algorithm depends only on the
+ * ranks of the user and on the movies, so it is cached by the user, the method and
+ * k, with the version of the ranks of the user and the version of the model it was
+ * found in. A change of either makes the entry stale, the ranks of other users don't.
+ * The entries are split into shards by their key, every shard locked on its own and
+ * holding a bounded number of entries, replaced by the CLOCK algorithm.
+ * Input  : the recommendations of users
+ * Process: a hash table and a clock of entries in every shard
+ * Output : the recommendation if it is cached and up to date.
+ */
+
+#ifndef CPP4_RESULTCACHE_H
+#define CPP4_RESULTCACHE_H
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * the recommendations that are cached
+ */
+enum class ResultMode : uint8_t
+{
+    CONTENT,
+    CF
+};
+
+/**
+ * what the cache did so far
+ */
+typedef struct ResultCacheStats
+{
+    uint64_t hits = 0;
+    /**
+     * lookups of entries that weren't cached, stale entries included
+     */
+    uint64_t misses = 0;
+    /**
+     * entries replaced to make room for others
+     */
+    uint64_t evictions = 0;
+    /**
+     * entries found stale since the ranks of their user or the model changed
+     */
+    uint64_t invalidations = 0;
+    /**
+     * number of entries held and the most that can be held
+     */
+    size_t entries = 0;
+    size_t capacity = 0;
+} ResultCacheStats;
+
+/**
+ * cache of recommendations, safe for any number of threads
+ */
+class ResultCache
+{
+private:
+    /**
+     * a cached recommendation
+     */
+    typedef struct Entry
+    {
+        uint64_t key;
+        uint64_t userVersion;
+        uint64_t modelVersion;
+        std::string result;
+        /**
+         * set by every hit, cleared when the clock passes the entry
+         */
+        bool referenced;
+    } Entry;
+    /**
+     * a part of the entries with its lock
+     */
+    typedef struct Shard
+    {
+        std::mutex lock;
+        /**
+         * the index in entries of every key
+         */
+        std::unordered_map<uint64_t, size_t> slots;
+        std::vector<Entry> entries;
+        /**
+         * the entry the clock checks next when the shard is full
+         */
+        size_t hand = 0;
+        ResultCacheStats stats;
+    } Shard;
+    std::unique_ptr<Shard[]> _shards;
+    /**
+     * number of shards minus one, the number of shards is a power of 2
+     */
+    size_t _mask = 0;
+    /**
+     * most entries of every shard
+     */
+    size_t _shardCapacity = 0;
+    /**
+     * @return the key of the recommendation
+     */
+    static uint64_t _key(int user, ResultMode mode, int k);
+    /**
+     * @return the shard of the key
+     */
+    Shard &_shard(uint64_t key) const;
+public:
+    /**
+     * creates the cache
+     * @param capacity most entries held, 0 disables the cache
+     */
+    explicit ResultCache(size_t capacity);
+    /**
+     * looks for the recommendation
+     * @param user id of the user
+     * @param mode the method of the recommendation
+     * @param k number of movies checked with, 0 for the content
+     * @param userVersion the current version of the ranks of the user
+     * @param modelVersion the current version of the model
+     * @param result receives the recommendation if it was found
+     * @return true if the recommendation was found and is up to date
+     */
+    bool find(int user, ResultMode mode, int k, uint64_t userVersion, uint64_t modelVersion,
+              std::string &result) const;
+    /**
+     * caches the recommendation, replacing the entry of the same key or one the clock picks
+     * @param user id of the user
+     * @param mode the method of the recommendation
+     * @param k number of movies checked with, 0 for the content
+     * @param userVersion the version of the ranks of the user it was found from
+     * @param modelVersion the version of the model it was found in
+     * @param result the recommendation
+     */
+    void insert(int user, ResultMode mode, int k, uint64_t userVersion, uint64_t modelVersion,
+                const std::string &result) const;
+    /**
+     * @return the counters of all of the shards
+     */
+    ResultCacheStats stats() const;
+};
+
+#endif //CPP4_RESULTCACHE_H
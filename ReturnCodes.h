@@ -0,0 +1,31 @@
+/**
+ * @file ReturnCodes.h
+ * @author  Nimrod Kremer
+ * @version 1.0
+ * @date 26.5.2020
+ *
+ * @brief What the functions of the recommendation system return
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * The functions that can fail return one of these instead of throwing.
+ * Input  : none
+ * Process: none
+ * Output : the return codes.
+ */
+
+#ifndef CPP4_RETURNCODES_H
+#define CPP4_RETURNCODES_H
+
+/**
+ * program failed
+ */
+#define FAIL -1
+/**
+ * program succeeded
+ */
+#define SUCCESS 0
+
+#endif //CPP4_RETURNCODES_H
@@ -0,0 +1,108 @@
+/**
+ * @file RowChecks.h
+ * @author  Nimrod Kremer
+ * @version 1.0
+ * @date 26.5.2020
+ *
+ * @brief The rows of a mapped snapshot that were checked
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * A snapshot is used in place, so its rows are checked the first time a query
+ * reads them instead of all of them when it is loaded. The result of every row is
+ * kept, a damaged row is read as an empty one from then on. Two threads that read
+ * an unchecked row at once both check it and find the same.
+ * Input  : the number of rows and the limit of their ids
+ * Process: one state per row
+ * Output : whether a row may be read.
+ */
+
+#ifndef CPP4_ROWCHECKS_H
+#define CPP4_ROWCHECKS_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+/**
+ * the state of a row that wasn't read yet
+ */
+#define ROW_UNCHECKED 0
+/**
+ * the state of a row that may be read
+ */
+#define ROW_VALID 1
+/**
+ * the state of a row that is read as empty
+ */
+#define ROW_DAMAGED 2
+
+/**
+ * the rows of a mapped array that were checked, shared by the copies of what reads it
+ */
+class RowChecks
+{
+private:
+    /**
+     * the state of every row
+     */
+    std::unique_ptr<std::atomic<uint8_t>[]> _states;
+    /**
+     * every id of a valid row is below it
+     */
+    size_t _limit;
+public:
+    /**
+     * creates the checks with no row checked
+     * @param numRows number of rows
+     * @param limit every id of a valid row is below it
+     */
+    RowChecks(size_t numRows, size_t limit) : _states(new std::atomic<uint8_t>[numRows]()), _limit(limit)
+    {
+    }
+    /**
+     * @return every id of a valid row is below it
+     */
+    size_t limit() const
+    {
+        return _limit;
+    }
+    /**
+     * @param row the row
+     * @param check returns true if the row is valid, called if the row wasn't checked yet
+     * @return true if the row may be read
+     */
+    template <typename Check>
+    bool valid(size_t row, Check check) const
+    {
+        // the rows never change, so the state needs no ordering with them
+        uint8_t state = _states[row].load(std::memory_order_relaxed);
+        if (state == ROW_UNCHECKED)
+        {
+            state = check() ? ROW_VALID : ROW_DAMAGED;
+            _states[row].store(state, std::memory_order_relaxed);
+        }
+        return state == ROW_VALID;
+    }
+    /**
+     * @param ids the ids of a row
+     * @param count number of ids
+     * @param limit every id must be below it
+     * @return true if the ids ascend and are all in [0, limit)
+     */
+    static bool ascendingBelow(const int *ids, size_t count, size_t limit)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            if (ids[i] < 0 || (size_t) ids[i] >= limit || (i > 0 && ids[i - 1] >= ids[i]))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+#endif //CPP4_ROWCHECKS_H
@@ -0,0 +1,74 @@
+/**
+ * @file ScratchArena.cpp
+ * @author  Nimrod Kremer
+ * @version 1.0
+ * @date 26.5.2020
+ *
+ * @brief Per thread memory for the temporaries of a query
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * The growth of the arenas and the arena of every thread.
+ * Input  : requests for memory of the temporaries
+ * Process: bumping through the blocks of the thread
+ * Output : memory that lives until the enclosing scope ends.
+ */
+
+#include "ScratchArena.h"
+#include <algorithm>
+
+/**
+ * the smallest block an arena adds
+ */
+#define SCRATCH_BLOCK (256 * 1024)
+
+/**
+ * hands out memory, adding a block only if no kept block after the current one has room.
+ * Blocks that are skipped stay unused until the arena is released to before them
+ * @param bytes number of bytes
+ * @param alignment the alignment of the memory, a power of 2
+ * @return the memory, valid until the arena is released to a mark taken before it
+ */
+void *ScratchArena::allocate(size_t bytes, size_t alignment)
+{
+    for (; _block < _blocks.size(); _block++, _offset = 0)
+    {
+        size_t start = (_offset + alignment - 1) & ~(alignment - 1);
+        if (start + bytes <= _sizes[_block])
+        {
+            _offset = start + bytes;
+            return _blocks[_block].get() + start;
+        }
+    }
+    // new char[] is aligned for any fundamental type, so the start of a block needs no padding
+    size_t size = std::max((size_t) SCRATCH_BLOCK, bytes);
+    _blocks.emplace_back(new char[size]);
+    _sizes.push_back(size);
+    _block = _blocks.size() - 1;
+    _offset = bytes;
+    return _blocks[_block].get();
+}
+
+/**
+ * @return total size of the blocks of the arena
+ */
+size_t ScratchArena::capacity() const
+{
+    size_t total = 0;
+    for (size_t size: _sizes)
+    {
+        total += size;
+    }
+    return total;
+}
+
+/**
+ * @return the arena of the calling thread
+ */
+ScratchArena &ScratchArena::local()
+{
+    static thread_local ScratchArena arena;
+    return arena;
+}
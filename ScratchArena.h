@@ -0,0 +1,172 @@
+/**
+ * @file ScratchArena.h
+ * @author  Nimrod Kremer
+ * @version 1.0
+ * @date 26.5.2020
+ *
+ * @brief Per thread memory for the temporaries of a query
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * Every thread has an arena of blocks it hands out by bumping an offset. A scope
+ * remembers the offset when it starts and gives everything after it back when it
+ * ends, and the blocks are kept, so once the blocks are large enough for a query the
+ * following queries don't touch the heap at all.
+ * Input  : requests for memory of the temporaries
+ * Process: bumping through the blocks of the thread
+ * Output : memory that lives until the enclosing scope ends.
+ */
+
+#ifndef CPP4_SCRATCHARENA_H
+#define CPP4_SCRATCHARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+/**
+ * the memory of the temporaries of one thread
+ */
+class ScratchArena
+{
+private:
+    /**
+     * the blocks, kept as long as the thread lives
+     */
+    std::vector<std::unique_ptr<char[]>> _blocks;
+    /**
+     * the size of every block
+     */
+    std::vector<size_t> _sizes;
+    /**
+     * the block memory is handed from
+     */
+    size_t _block = 0;
+    /**
+     * the first free byte of the block
+     */
+    size_t _offset = 0;
+public:
+    /**
+     * where the arena stands, everything handed after it can be given back together
+     */
+    typedef struct Mark
+    {
+        size_t block;
+        size_t offset;
+    } Mark;
+    ScratchArena() = default;
+    ScratchArena(const ScratchArena &) = delete;
+    ScratchArena &operator=(const ScratchArena &) = delete;
+    /**
+     * hands out memory, adding a block only if no kept block after the current one has room
+     * @param bytes number of bytes
+     * @param alignment the alignment of the memory, a power of 2
+     * @return the memory, valid until the arena is released to a mark taken before it
+     */
+    void *allocate(size_t bytes, size_t alignment);
+    /**
+     * @return where the arena stands
+     */
+    Mark mark() const
+    {
+        return {_block, _offset};
+    }
+    /**
+     * gives back everything handed out after the mark
+     * @param mark a mark taken from this arena
+     */
+    void release(const Mark &mark)
+    {
+        _block = mark.block;
+        _offset = mark.offset;
+    }
+    /**
+     * @return total size of the blocks of the arena
+     */
+    size_t capacity() const;
+    /**
+     * @return the arena of the calling thread
+     */
+    static ScratchArena &local();
+};
+
+/**
+ * gives back everything the arena of the thread handed out during the life of the scope
+ */
+class ScratchScope
+{
+private:
+    ScratchArena &_arena;
+    ScratchArena::Mark _mark;
+public:
+    /**
+     * starts a scope of the arena of the calling thread
+     */
+    ScratchScope() : _arena(ScratchArena::local()), _mark(_arena.mark())
+    {
+    }
+    ScratchScope(const ScratchScope &) = delete;
+    ScratchScope &operator=(const ScratchScope &) = delete;
+    /**
+     * releases the memory of the scope
+     */
+    ~ScratchScope()
+    {
+        _arena.release(_mark);
+    }
+};
+
+/**
+ * allocator of containers of temporaries, the memory comes from the arena of the thread that
+ * created the allocator and is given back only when the enclosing scope ends
+ * @tparam T the items
+ */
+template <typename T>
+class ScratchAllocator
+{
+private:
+    ScratchArena *_arena;
+
+    template <typename U> friend class ScratchAllocator;
+public:
+    typedef T value_type;
+
+    ScratchAllocator() : _arena(&ScratchArena::local())
+    {
+    }
+    template <typename U>
+    ScratchAllocator(const ScratchAllocator<U> &other) : _arena(other._arena)
+    {
+    }
+    T *allocate(size_t n)
+    {
+        return static_cast<T *>(_arena->allocate(n * sizeof(T), alignof(T)));
+    }
+    /**
+     * the memory is given back by the scope
+     */
+    void deallocate(T *, size_t)
+    {
+    }
+    template <typename U>
+    bool operator==(const ScratchAllocator<U> &other) const
+    {
+        return _arena == other._arena;
+    }
+    template <typename U>
+    bool operator!=(const ScratchAllocator<U> &other) const
+    {
+        return _arena != other._arena;
+    }
+};
+
+/**
+ * a vector of temporaries, must not outlive the scope it was filled in
+ */
+template <typename T>
+using ScratchVector = std::vector<T, ScratchAllocator<T>>;
+
+#endif //CPP4_SCRATCHARENA_H
@@ -0,0 +1,486 @@
+/**
+ * @file ShardCoordinator.cpp
+ * @author  Nimrod Kremer
+ * @version 1.0
+ * @date 26.5.2020
+ *
+ * @brief Splits the users on worker processes and routes the queries to them
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * The workers are spawned together so that they load at once, and a worker is ready
+ * once its socket accepts. The parts of a batch are all sent before any answer is
+ * read, and the answers are read as they arrive, so the batch takes as long as its
+ * slowest shard and the latency of every shard is its own.
+ * Input  : the files, the worker program and the number of shards
+ * Process: routing the queries to the processes of the shards
+ * Output : the same answers a single recommendation system would give.
+ */
+
+#include "ShardCoordinator.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <iostream>
+#include <thread>
+#include <poll.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+/**
+ * the time between two tries to connect to a shard that is loading
+ */
+#define START_POLL_MILLISECONDS 10
+
+/**
+ * @param start when the time started
+ * @return the seconds since then
+ */
+static double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * stops the shards
+ */
+ShardCoordinator::~ShardCoordinator()
+{
+    stop();
+}
+
+/**
+ * starts a worker process for every shard and waits for all of them to load
+ * @param options how to start the shards
+ * @return success, or fail if a shard couldn't be started or didn't load, then none run
+ */
+int ShardCoordinator::start(const ShardOptions &options)
+{
+    stop();
+    if (options.numShards < 1 || options.connections < 1)
+    {
+        return FAIL;
+    }
+    _connections = options.connections;
+    for (int i = 0; i < options.numShards; i++)
+    {
+        std::unique_ptr<Shard> shard(new Shard());
+        shard->stats.shard = i;
+        shard->socketPath = options.socketDir + "/cpp4_shard_" + std::to_string(::getpid()) + "_" +
+                            std::to_string(i) + ".sock";
+        ::unlink(shard->socketPath.c_str());
+        std::vector<std::string> args = {options.workerPath, "--shard", std::to_string(i),
+                                         "--shards", std::to_string(options.numShards),
+                                         "--movies", options.moviesPath, "--ranks", options.ranksPath,
+                                         "--socket", shard->socketPath,
+                                         "--neighbors", std::to_string(options.neighbors),
+                                         "--threads", std::to_string(options.threads)};
+        std::vector<char *> argv;
+        for (std::string &arg: args)
+        {
+            argv.push_back(&arg[0]);
+        }
+        argv.push_back(nullptr);
+        pid_t pid = -1;
+        if (::posix_spawn(&pid, options.workerPath.c_str(), nullptr, nullptr, argv.data(), environ) != 0)
+        {
+            std::cerr << SHARD_FAILED << i << std::endl;
+            stop();
+            return FAIL;
+        }
+        shard->pid = pid;
+        _shards.push_back(std::move(shard));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (std::unique_ptr<Shard> &shard: _shards)
+    {
+        int fd = ShardProtocol::connect(shard->socketPath);
+        while (fd < 0)
+        {
+            int status = 0;
+            if (::waitpid(shard->pid, &status, WNOHANG) == shard->pid)
+            {
+                // the worker exited, it couldn't load its files or its socket
+                shard->pid = -1;
+            }
+            if (shard->pid < 0 || secondsSince(start) > options.startSeconds)
+            {
+                std::cerr << SHARD_FAILED << shard->stats.shard << std::endl;
+                stop();
+                return FAIL;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(START_POLL_MILLISECONDS));
+            fd = ShardProtocol::connect(shard->socketPath);
+        }
+        shard->idle.push_back(fd);
+        shard->open = 1;
+    }
+    return SUCCESS;
+}
+
+/**
+ * stops the shards and waits for their processes. A shard that doesn't take the stop is
+ * terminated. No query may run while the shards stop
+ */
+void ShardCoordinator::stop()
+{
+    for (std::unique_ptr<Shard> &shard: _shards)
+    {
+        if (shard->pid > 0)
+        {
+            int fd = shard->idle.empty() ? ShardProtocol::connect(shard->socketPath) : shard->idle.back();
+            if (!shard->idle.empty())
+            {
+                shard->idle.pop_back();
+            }
+            ShardRequest request;
+            request.op = OP_STOP;
+            ShardResponse response;
+            bool stopped = fd >= 0 && ShardProtocol::send(fd, request) && ShardProtocol::receive(fd, response);
+            if (fd >= 0)
+            {
+                ::close(fd);
+            }
+            for (int idle: shard->idle)
+            {
+                ::close(idle);
+            }
+            shard->idle.clear();
+            if (!stopped)
+            {
+                ::kill(shard->pid, SIGTERM);
+            }
+            int status = 0;
+            ::waitpid(shard->pid, &status, 0);
+        }
+        ::unlink(shard->socketPath.c_str());
+    }
+    _shards.clear();
+}
+
+/**
+ * @param userName the name of a user
+ * @return the shard the user belongs to
+ */
+int ShardCoordinator::shardOf(const std::string &userName) const
+{
+    return NameTable::shardOf(userName.data(), userName.size(), (int) _shards.size());
+}
+
+/**
+ * takes an idle connection to the shard, opens one if there is room, waits otherwise
+ * @param shard the shard
+ * @return the connection, -1 if a new one couldn't be opened
+ */
+int ShardCoordinator::_acquire(Shard &shard)
+{
+    std::unique_lock<std::mutex> guard(shard.lock);
+    shard.released.wait(guard, [&]()
+    {
+        return !shard.idle.empty() || shard.open < _connections;
+    });
+    if (!shard.idle.empty())
+    {
+        int fd = shard.idle.back();
+        shard.idle.pop_back();
+        return fd;
+    }
+    shard.open++;
+    guard.unlock();
+    int fd = ShardProtocol::connect(shard.socketPath);
+    if (fd < 0)
+    {
+        guard.lock();
+        shard.open--;
+        shard.released.notify_one();
+    }
+    return fd;
+}
+
+/**
+ * gives the connection back, closing it if it failed since a frame may be left half read on it
+ * @param shard the shard
+ * @param fd the connection
+ * @param healthy false if the request on it failed
+ */
+void ShardCoordinator::_release(Shard &shard, int fd, bool healthy)
+{
+    std::lock_guard<std::mutex> guard(shard.lock);
+    if (healthy)
+    {
+        shard.idle.push_back(fd);
+    }
+    else
+    {
+        ::close(fd);
+        shard.open--;
+    }
+    shard.released.notify_one();
+}
+
+/**
+ * counts a request to the shard
+ * @param shard the shard
+ * @param seconds the time it took
+ * @param healthy false if it failed
+ */
+void ShardCoordinator::_count(Shard &shard, double seconds, bool healthy)
+{
+    std::lock_guard<std::mutex> guard(shard.lock);
+    shard.stats.requests++;
+    shard.stats.totalSeconds += seconds;
+    shard.stats.maxSeconds = std::max(shard.stats.maxSeconds, seconds);
+    if (!healthy)
+    {
+        shard.stats.failures++;
+        std::cerr << SHARD_FAILED << shard.stats.shard << std::endl;
+    }
+}
+
+/**
+ * sends the request to the shard and waits for the answer
+ * @param shard the shard
+ * @param request the request
+ * @param response receives the answer
+ * @return false if the shard didn't answer
+ */
+bool ShardCoordinator::_call(Shard &shard, const ShardRequest &request, ShardResponse &response)
+{
+    auto start = std::chrono::steady_clock::now();
+    int fd = _acquire(shard);
+    bool answered = fd >= 0 && ShardProtocol::send(fd, request) && ShardProtocol::receive(fd, response);
+    if (fd >= 0)
+    {
+        _release(shard, fd, answered);
+    }
+    bool healthy = answered && response.status == SUCCESS;
+    _count(shard, secondsSince(start), healthy);
+    return healthy;
+}
+
+/**
+ * sends the request to the shard of the user and waits for the answer
+ * @param userName the user the request is about
+ * @param request the request
+ * @param response receives the answer, a single list of a single item
+ * @return false if the shard didn't answer
+ */
+bool ShardCoordinator::_call(const std::string &userName, const ShardRequest &request, ShardResponse &response)
+{
+    return !_shards.empty() && _call(*_shards[shardOf(userName)], request, response) &&
+           response.lists.size() == 1 && response.lists[0].size() == 1;
+}
+
+/**
+ * finds the recommended movie for the user on its shard
+ * @param userName the user name to check
+ * @return the movie recommended, empty if the shard didn't answer
+ */
+std::string ShardCoordinator::recommendByContent(const std::string &userName)
+{
+    ShardRequest request;
+    request.op = OP_CONTENT;
+    request.names.push_back(userName);
+    ShardResponse response;
+    return _call(userName, request, response) ? response.lists[0][0].movie : std::string();
+}
+
+/**
+ * finds the recommended movie according to the CF algorithm on the shard of the user
+ * @param userName the user name to check
+ * @param k number of movies to check with
+ * @return the movie recommended, empty if the shard didn't answer
+ */
+std::string ShardCoordinator::recommendByCF(const std::string &userName, int k)
+{
+    ShardRequest request;
+    request.op = OP_CF;
+    request.k = k;
+    request.names.push_back(userName);
+    ShardResponse response;
+    return _call(userName, request, response) ? response.lists[0][0].movie : std::string();
+}
+
+/**
+ * predicts the movie score for the user on its shard, every shard has every movie
+ * @param movieName the movie name
+ * @param userName the name of the user
+ * @param k number of movies to check with
+ * @return the score given, fail if the movie or the user is unknown or the shard didn't answer
+ */
+double ShardCoordinator::predictMovieScoreForUser(const std::string &movieName, const std::string &userName, int k)
+{
+    ShardRequest request;
+    request.op = OP_PREDICT;
+    request.k = k;
+    request.names = {movieName, userName};
+    ShardResponse response;
+    return _call(userName, request, response) ? response.lists[0][0].score : FAIL;
+}
+
+/**
+ * splits a batch by shard, sends every part at once and puts the answers back in order. The
+ * answers are read as they arrive, so a slow shard doesn't add to the latency of the others
+ * @param request the request, with every user of the batch
+ * @return the answer of every user, empty for the users whose shard failed
+ */
+std::vector<std::vector<Recommendation>> ShardCoordinator::_scatter(const ShardRequest &request)
+{
+    std::vector<std::vector<Recommendation>> results(request.names.size());
+    size_t numShards = _shards.size();
+    if (numShards == 0)
+    {
+        return results;
+    }
+    ShardRequest empty = request;
+    empty.names.clear();
+    std::vector<ShardRequest> parts(numShards, empty);
+    std::vector<std::vector<size_t>> positions(numShards);
+    for (size_t i = 0; i < request.names.size(); i++)
+    {
+        int shard = shardOf(request.names[i]);
+        parts[shard].names.push_back(request.names[i]);
+        positions[shard].push_back(i);
+    }
+
+    // the connections are taken by the order of the shards, so two batches never wait for each other
+    std::vector<int> fds(numShards, -1);
+    std::vector<std::chrono::steady_clock::time_point> starts(numShards);
+    std::vector<pollfd> pending;
+    std::vector<size_t> pendingShards;
+    for (size_t shard = 0; shard < numShards; shard++)
+    {
+        if (positions[shard].empty())
+        {
+            continue;
+        }
+        starts[shard] = std::chrono::steady_clock::now();
+        fds[shard] = _acquire(*_shards[shard]);
+        if (fds[shard] >= 0 && ShardProtocol::send(fds[shard], parts[shard]))
+        {
+            pending.push_back({fds[shard], POLLIN, 0});
+            pendingShards.push_back(shard);
+            continue;
+        }
+        if (fds[shard] >= 0)
+        {
+            _release(*_shards[shard], fds[shard], false);
+        }
+        _count(*_shards[shard], secondsSince(starts[shard]), false);
+    }
+
+    while (!pending.empty())
+    {
+        if (::poll(pending.data(), pending.size(), -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            // the answers are read in order instead, the reads wait for them
+            for (pollfd &entry: pending)
+            {
+                entry.revents = POLLIN;
+            }
+        }
+        for (size_t i = pending.size(); i-- > 0; )
+        {
+            if (pending[i].revents == 0)
+            {
+                continue;
+            }
+            size_t shard = pendingShards[i];
+            ShardResponse response;
+            bool answered = ShardProtocol::receive(fds[shard], response);
+            bool healthy = answered && response.status == SUCCESS &&
+                           response.lists.size() == positions[shard].size();
+            _release(*_shards[shard], fds[shard], answered);
+            _count(*_shards[shard], secondsSince(starts[shard]), healthy);
+            for (size_t j = 0; healthy && j < positions[shard].size(); j++)
+            {
+                results[positions[shard][j]] = std::move(response.lists[j]);
+            }
+            pending.erase(pending.begin() + i);
+            pendingShards.erase(pendingShards.begin() + i);
+        }
+    }
+    return results;
+}
+
+/**
+ * finds the n movies recommended by content for every one of the users, all of the shards at once
+ * @param userNames the users to recommend to
+ * @param n number of movies to recommend to every user
+ * @return the recommended movies of every user from the best, empty for unknown users
+ */
+std::vector<std::vector<Recommendation>> ShardCoordinator::recommendByContentBatch(
+        const std::vector<std::string> &userNames, int n)
+{
+    ShardRequest request;
+    request.op = OP_CONTENT_BATCH;
+    request.n = n;
+    request.names = userNames;
+    return _scatter(request);
+}
+
+/**
+ * finds the n movies recommended by the CF algorithm for every one of the users, all of the
+ * shards at once
+ * @param userNames the users to recommend to
+ * @param k number of movies to check with
+ * @param n number of movies to recommend to every user
+ * @return the recommended movies of every user from the best, empty for unknown users
+ */
+std::vector<std::vector<Recommendation>> ShardCoordinator::recommendByCFBatch(
+        const std::vector<std::string> &userNames, int k, int n)
+{
+    ShardRequest request;
+    request.op = OP_CF_BATCH;
+    request.k = k;
+    request.n = n;
+    request.names = userNames;
+    return _scatter(request);
+}
+
+/**
+ * asks every shard for its load and the time it spent answering. A shard that doesn't answer
+ * has only the stats of the coordinator, and the question isn't counted as one of its requests
+ * @return the stats of every shard, by shard
+ */
+std::vector<ShardStats> ShardCoordinator::stats()
+{
+    std::vector<ShardStats> all;
+    for (std::unique_ptr<Shard> &shard: _shards)
+    {
+        ShardRequest request;
+        request.op = OP_STATS;
+        ShardWorkerStats answer;
+        int fd = _acquire(*shard);
+        bool answered = fd >= 0 && ShardProtocol::send(fd, request) && ShardProtocol::receive(fd, answer);
+        if (fd >= 0)
+        {
+            _release(*shard, fd, answered);
+        }
+        ShardStats stats;
+        {
+            std::lock_guard<std::mutex> guard(shard->lock);
+            stats = shard->stats;
+        }
+        if (answered)
+        {
+            stats.users = (size_t) answer.users;
+            stats.ranks = (size_t) answer.ranks;
+            stats.loadSeconds = answer.loadSeconds;
+            stats.busySeconds = answer.busySeconds;
+        }
+        all.push_back(stats);
+    }
+    return all;
+}
@@ -0,0 +1,262 @@
+/**
+ * @file ShardCoordinator.h
+ * @author  Nimrod Kremer
+ * @version 1.0
+ * @date 26.5.2020
+ *
+ * @brief Splits the users on worker processes and routes the queries to them
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * The coordinator starts a worker process for every shard, each loading every movie
+ * and the users NameTable::shardOf puts in it, and keeps a few connections to every
+ * worker on Unix sockets. A query goes to the shard of its user, a batch is split by
+ * shard, sent to all of the shards at once and put back in the order it was given.
+ * More shards hold more users, each worker only holds its part of the ranks.
+ * Input  : the files, the worker program and the number of shards
+ * Process: routing the queries to the processes of the shards
+ * Output : the same answers a single recommendation system would give.
+ */
+
+#ifndef CPP4_SHARDCOORDINATOR_H
+#define CPP4_SHARDCOORDINATOR_H
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include "ShardProtocol.h"
+
+/**
+ * default number of connections to every shard, the queries to one shard that run at once
+ */
+#define DEFAULT_SHARD_CONNECTIONS 4
+/**
+ * the message of a shard that didn't answer
+ */
+#define SHARD_FAILED "Shard not responding "
+
+/**
+ * how the shards are started
+ */
+typedef struct ShardOptions
+{
+    /**
+     * the path of the cpp4_shard_worker program
+     */
+    std::string workerPath;
+    std::string moviesPath;
+    std::string ranksPath;
+    /**
+     * the directory the sockets of the shards are made in
+     */
+    std::string socketDir = "/tmp";
+    int numShards = 2;
+    /**
+     * most connections to every shard
+     */
+    int connections = DEFAULT_SHARD_CONNECTIONS;
+    /**
+     * number of most similar movies every shard keeps for every movie
+     */
+    int neighbors = DEFAULT_NEIGHBORS;
+    /**
+     * number of threads of every shard, 0 for all of the cores
+     */
+    int threads = 1;
+    /**
+     * the most seconds a shard may take to load before it is taken as failed
+     */
+    double startSeconds = 60;
+} ShardOptions;
+
+/**
+ * the load of a shard and the latency of its queries, as the coordinator saw them
+ */
+typedef struct ShardStats
+{
+    int shard = 0;
+    /**
+     * number of users and of ranks the shard loaded
+     */
+    size_t users = 0;
+    size_t ranks = 0;
+    /**
+     * the time the shard took to load
+     */
+    double loadSeconds = 0;
+    /**
+     * number of requests sent to the shard and how many of them failed
+     */
+    size_t requests = 0;
+    size_t failures = 0;
+    /**
+     * the time from sending a request to its answer, summed and the longest
+     */
+    double totalSeconds = 0;
+    double maxSeconds = 0;
+    /**
+     * the time the shard itself spent answering
+     */
+    double busySeconds = 0;
+} ShardStats;
+
+/**
+ * runs the shards as processes and routes the queries to them
+ */
+class ShardCoordinator
+{
+private:
+    /**
+     * a worker process with its connections
+     */
+    typedef struct Shard
+    {
+        pid_t pid = -1;
+        std::string socketPath;
+        /**
+         * guards the connections and the stats
+         */
+        std::mutex lock;
+        /**
+         * wakes the queries that wait for a connection
+         */
+        std::condition_variable released;
+        /**
+         * the connections no query uses
+         */
+        std::vector<int> idle;
+        /**
+         * number of open connections, idle or used
+         */
+        int open = 0;
+        ShardStats stats;
+    } Shard;
+    std::vector<std::unique_ptr<Shard>> _shards;
+    /**
+     * most connections to every shard
+     */
+    int _connections = DEFAULT_SHARD_CONNECTIONS;
+    /**
+     * takes an idle connection to the shard, opens one if there is room, waits otherwise
+     * @param shard the shard
+     * @return the connection, -1 if a new one couldn't be opened
+     */
+    int _acquire(Shard &shard);
+    /**
+     * gives the connection back, closing it if it failed
+     * @param shard the shard
+     * @param fd the connection
+     * @param healthy false if the request on it failed
+     */
+    void _release(Shard &shard, int fd, bool healthy);
+    /**
+     * counts a request to the shard
+     * @param shard the shard
+     * @param seconds the time it took
+     * @param healthy false if it failed
+     */
+    static void _count(Shard &shard, double seconds, bool healthy);
+    /**
+     * sends the request to the shard of the user and waits for the answer
+     * @param userName the user the request is about
+     * @param request the request
+     * @param response receives the answer
+     * @return false if the shard didn't answer
+     */
+    bool _call(const std::string &userName, const ShardRequest &request, ShardResponse &response);
+    /**
+     * sends the request to the shard and waits for the answer
+     * @param shard the shard
+     * @param request the request
+     * @param response receives the answer
+     * @return false if the shard didn't answer
+     */
+    bool _call(Shard &shard, const ShardRequest &request, ShardResponse &response);
+    /**
+     * splits a batch by shard, sends every part at once and puts the answers back in order
+     * @param request the request, with every user of the batch
+     * @return the answer of every user, empty for the users whose shard failed
+     */
+    std::vector<std::vector<Recommendation>> _scatter(const ShardRequest &request);
+public:
+    ShardCoordinator() = default;
+    ShardCoordinator(const ShardCoordinator &) = delete;
+    ShardCoordinator &operator=(const ShardCoordinator &) = delete;
+    /**
+     * stops the shards
+     */
+    ~ShardCoordinator();
+    /**
+     * starts a worker process for every shard and waits for all of them to load
+     * @param options how to start the shards
+     * @return success, or fail if a shard couldn't be started or didn't load, then none run
+     */
+    int start(const ShardOptions &options);
+    /**
+     * stops the shards and waits for their processes
+     */
+    void stop();
+    /**
+     * @return number of shards running
+     */
+    int numShards() const
+    {
+        return (int) _shards.size();
+    }
+    /**
+     * @param userName the name of a user
+     * @return the shard the user belongs to
+     */
+    int shardOf(const std::string &userName) const;
+    /**
+     * finds the recommended movie for the user on its shard
+     * @param userName the user name to check
+     * @return the movie recommended, empty if the shard didn't answer
+     */
+    std::string recommendByContent(const std::string &userName);
+    /**
+     * finds the recommended movie according to the CF algorithm on the shard of the user
+     * @param userName the user name to check
+     * @param k number of movies to check with
+     * @return the movie recommended, empty if the shard didn't answer
+     */
+    std::string recommendByCF(const std::string &userName, int k);
+    /**
+     * predicts the movie score for the user on its shard
+     * @param movieName the movie name
+     * @param userName the name of the user
+     * @param k number of movies to check with
+     * @return the score given, fail if the movie or the user is unknown or the shard didn't answer
+     */
+    double predictMovieScoreForUser(const std::string &movieName, const std::string &userName, int k);
+    /**
+     * finds the n movies recommended by content for every one of the users, all of the shards at once
+     * @param userNames the users to recommend to
+     * @param n number of movies to recommend to every user
+     * @return the recommended movies of every user from the best, empty for unknown users
+     */
+    std::vector<std::vector<Recommendation>> recommendByContentBatch(const std::vector<std::string> &userNames,
+                                                                     int n = 1);
+    /**
+     * finds the n movies recommended by the CF algorithm for every one of the users, all of the
+     * shards at once
+     * @param userNames the users to recommend to
+     * @param k number of movies to check with
+     * @param n number of movies to recommend to every user
+     * @return the recommended movies of every user from the best, empty for unknown users
+     */
+    std::vector<std::vector<Recommendation>> recommendByCFBatch(const std::vector<std::string> &userNames, int k,
+                                                                int n = 1);
+    /**
+     * asks every shard for its load and the time it spent answering
+     * @return the stats of every shard, by shard
+     */
+    std::vector<ShardStats> stats();
+};
+
+#endif //CPP4_SHARDCOORDINATOR_H
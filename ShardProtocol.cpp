@@ -0,0 +1,406 @@
+/**
+ * @file ShardProtocol.cpp
+ * @author  Nimrod Kremer
+ * @version 1.0
+ * @date 26.5.2020
+ *
+ * @brief The messages between the coordinator and the shards, over Unix sockets
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * A message is built in a buffer and written with one call, and read back by its
+ * length first. Every read is checked against the end of the frame, so a malformed
+ * frame fails instead of reading past it.
+ * Input  : requests and responses
+ * Process: framing over a stream socket
+ * Output : the same requests and responses on the other side.
+ */
+
+#include "ShardProtocol.h"
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/**
+ * the largest frame read, a longer length is taken for a broken stream
+ */
+#define MAX_FRAME ((uint32_t) 1 << 30)
+/**
+ * number of connections waiting to be accepted
+ */
+#define LISTEN_BACKLOG 64
+
+/**
+ * appends the bytes of a number to a frame
+ * @tparam T the number
+ * @param frame the frame
+ * @param value the number
+ */
+template <typename T>
+static void put(std::string &frame, T value)
+{
+    frame.append((const char *) &value, sizeof(value));
+}
+
+/**
+ * appends a name to a frame, its length and then its characters
+ * @param frame the frame
+ * @param name the name
+ */
+static void putName(std::string &frame, const std::string &name)
+{
+    put(frame, (uint32_t) name.size());
+    frame.append(name);
+}
+
+/**
+ * reads the fields of a frame in order
+ */
+typedef struct FrameReader
+{
+    const char *pos;
+    const char *end;
+    /**
+     * @tparam T the number
+     * @param value receives the number
+     * @return false if the frame ended
+     */
+    template <typename T>
+    bool get(T &value)
+    {
+        if ((size_t) (end - pos) < sizeof(value))
+        {
+            return false;
+        }
+        std::memcpy(&value, pos, sizeof(value));
+        pos += sizeof(value);
+        return true;
+    }
+    /**
+     * @param name receives the name
+     * @return false if the frame ended
+     */
+    bool getName(std::string &name)
+    {
+        uint32_t length = 0;
+        if (!get(length) || (size_t) (end - pos) < length)
+        {
+            return false;
+        }
+        name.assign(pos, length);
+        pos += length;
+        return true;
+    }
+} FrameReader;
+
+/**
+ * writes all of the bytes, the length of the frame first
+ * @param fd a connected socket
+ * @param frame the fields of the frame
+ * @return false if the socket failed
+ */
+static bool writeFrame(int fd, const std::string &frame)
+{
+    std::string data;
+    data.reserve(sizeof(uint32_t) + frame.size());
+    put(data, (uint32_t) frame.size());
+    data.append(frame);
+    for (size_t written = 0; written < data.size(); )
+    {
+        // a shard that went away fails the write instead of killing the process
+        ssize_t count = ::send(fd, data.data() + written, data.size() - written, MSG_NOSIGNAL);
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (count <= 0)
+        {
+            return false;
+        }
+        written += (size_t) count;
+    }
+    return true;
+}
+
+/**
+ * reads exactly size bytes
+ * @param fd a connected socket
+ * @param data receives the bytes
+ * @param size number of bytes to read
+ * @return false if the socket was closed or failed first
+ */
+static bool readExactly(int fd, char *data, size_t size)
+{
+    for (size_t done = 0; done < size; )
+    {
+        ssize_t count = ::recv(fd, data + done, size - done, 0);
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (count <= 0)
+        {
+            return false;
+        }
+        done += (size_t) count;
+    }
+    return true;
+}
+
+/**
+ * waits for a whole frame
+ * @param fd a connected socket
+ * @param frame receives the fields of the frame
+ * @return false if the socket was closed or failed or the length is too large
+ */
+static bool readFrame(int fd, std::string &frame)
+{
+    uint32_t size = 0;
+    if (!readExactly(fd, (char *) &size, sizeof(size)) || size > MAX_FRAME)
+    {
+        return false;
+    }
+    frame.resize(size);
+    return size == 0 || readExactly(fd, &frame[0], size);
+}
+
+/**
+ * @param fd a connected socket
+ * @param request the request to send
+ * @return false if the socket failed
+ */
+bool ShardProtocol::send(int fd, const ShardRequest &request)
+{
+    std::string frame;
+    put(frame, (int32_t) request.op);
+    put(frame, (int32_t) request.k);
+    put(frame, (int32_t) request.n);
+    put(frame, (uint32_t) request.names.size());
+    for (const std::string &name: request.names)
+    {
+        putName(frame, name);
+    }
+    return writeFrame(fd, frame);
+}
+
+/**
+ * @param fd a connected socket
+ * @param response the response to send
+ * @return false if the socket failed
+ */
+bool ShardProtocol::send(int fd, const ShardResponse &response)
+{
+    std::string frame;
+    put(frame, (int32_t) response.status);
+    put(frame, (uint32_t) response.lists.size());
+    for (const std::vector<Recommendation> &list: response.lists)
+    {
+        put(frame, (uint32_t) list.size());
+        for (const Recommendation &item: list)
+        {
+            putName(frame, item.movie);
+            put(frame, item.score);
+        }
+    }
+    return writeFrame(fd, frame);
+}
+
+/**
+ * @param fd a connected socket
+ * @param stats the stats to send
+ * @return false if the socket failed
+ */
+bool ShardProtocol::send(int fd, const ShardWorkerStats &stats)
+{
+    std::string frame;
+    put(frame, stats.users);
+    put(frame, stats.ranks);
+    put(frame, stats.loadSeconds);
+    put(frame, stats.busySeconds);
+    return writeFrame(fd, frame);
+}
+
+/**
+ * waits for a whole request
+ * @param fd a connected socket
+ * @param request receives the request
+ * @return false if the socket was closed or failed or the frame is malformed
+ */
+bool ShardProtocol::receive(int fd, ShardRequest &request)
+{
+    std::string frame;
+    if (!readFrame(fd, frame))
+    {
+        return false;
+    }
+    FrameReader reader{frame.data(), frame.data() + frame.size()};
+    int32_t op = 0;
+    int32_t k = 0;
+    int32_t n = 0;
+    uint32_t count = 0;
+    if (!reader.get(op) || !reader.get(k) || !reader.get(n) || !reader.get(count) ||
+        count > frame.size() / sizeof(uint32_t))
+    {
+        return false;
+    }
+    request.op = op;
+    request.k = k;
+    request.n = n;
+    request.names.resize(count);
+    for (std::string &name: request.names)
+    {
+        if (!reader.getName(name))
+        {
+            return false;
+        }
+    }
+    return reader.pos == reader.end;
+}
+
+/**
+ * waits for a whole response
+ * @param fd a connected socket
+ * @param response receives the response
+ * @return false if the socket was closed or failed or the frame is malformed
+ */
+bool ShardProtocol::receive(int fd, ShardResponse &response)
+{
+    std::string frame;
+    if (!readFrame(fd, frame))
+    {
+        return false;
+    }
+    FrameReader reader{frame.data(), frame.data() + frame.size()};
+    int32_t status = 0;
+    uint32_t numLists = 0;
+    if (!reader.get(status) || !reader.get(numLists) || numLists > frame.size() / sizeof(uint32_t))
+    {
+        return false;
+    }
+    response.status = status;
+    response.lists.resize(numLists);
+    for (std::vector<Recommendation> &list: response.lists)
+    {
+        uint32_t count = 0;
+        if (!reader.get(count) || count > frame.size() / sizeof(uint32_t))
+        {
+            return false;
+        }
+        list.resize(count);
+        for (Recommendation &item: list)
+        {
+            if (!reader.getName(item.movie) || !reader.get(item.score))
+            {
+                return false;
+            }
+        }
+    }
+    return reader.pos == reader.end;
+}
+
+/**
+ * waits for whole stats
+ * @param fd a connected socket
+ * @param stats receives the stats
+ * @return false if the socket was closed or failed or the frame is malformed
+ */
+bool ShardProtocol::receive(int fd, ShardWorkerStats &stats)
+{
+    std::string frame;
+    if (!readFrame(fd, frame))
+    {
+        return false;
+    }
+    FrameReader reader{frame.data(), frame.data() + frame.size()};
+    return reader.get(stats.users) && reader.get(stats.ranks) && reader.get(stats.loadSeconds) &&
+           reader.get(stats.busySeconds) && reader.pos == reader.end;
+}
+
+/**
+ * fills the address of a Unix socket
+ * @param path the path of the socket
+ * @param address receives the address
+ * @return false if the path is too long for a socket
+ */
+static bool socketAddress(const std::string &path, sockaddr_un &address)
+{
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path))
+    {
+        return false;
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+/**
+ * opens a stream socket that the processes started later don't inherit, so that a shard
+ * sees its connections close when the coordinator closes them
+ * @return the socket, -1 on failure
+ */
+static int openSocket()
+{
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0)
+    {
+        ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    return fd;
+}
+
+/**
+ * binds a socket at the path, replacing a file left there, and listens on it
+ * @param path the path of the socket
+ * @return the listening socket, -1 on failure
+ */
+int ShardProtocol::listen(const std::string &path)
+{
+    sockaddr_un address;
+    if (!socketAddress(path, address))
+    {
+        return -1;
+    }
+    int fd = openSocket();
+    if (fd < 0)
+    {
+        return -1;
+    }
+    ::unlink(path.c_str());
+    if (::bind(fd, (const sockaddr *) &address, sizeof(address)) != 0 || ::listen(fd, LISTEN_BACKLOG) != 0)
+    {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * connects to the socket at the path
+ * @param path the path of the socket
+ * @return the connected socket, -1 on failure
+ */
+int ShardProtocol::connect(const std::string &path)
+{
+    sockaddr_un address;
+    if (!socketAddress(path, address))
+    {
+        return -1;
+    }
+    int fd = openSocket();
+    if (fd < 0)
+    {
+        return -1;
+    }
+    if (::connect(fd, (const sockaddr *) &address, sizeof(address)) != 0)
+    {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
@@ -0,0 +1,178 @@
+/**
+ * @file ShardProtocol.h
+ * @author  Nimrod Kremer
+ * @version 1.0
+ * @date 26.5.2020
+ *
+ * @brief The messages between the coordinator and the shards, over Unix sockets
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * Every message is a frame of its length and then its fields, numbers in the byte
+ * order of the machine since both sides run on the same one. A request names an
+ * operation with its numbers and names, a response holds a status and lists of
+ * movies with their scores, which every answer fits in but the stats of a shard,
+ * which have a frame of their own.
+ * Input  : requests and responses
+ * Process: framing over a stream socket
+ * Output : the same requests and responses on the other side.
+ */
+
+#ifndef CPP4_SHARDPROTOCOL_H
+#define CPP4_SHARDPROTOCOL_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "RecommenderSystem.h"
+
+/**
+ * the operations a shard serves
+ */
+enum ShardOp
+{
+    /**
+     * recommendByContent of the one name
+     */
+    OP_CONTENT = 1,
+    /**
+     * recommendByCF of the one name with k
+     */
+    OP_CF,
+    /**
+     * predictMovieScoreForUser of the movie and then the user with k
+     */
+    OP_PREDICT,
+    /**
+     * recommendByContentBatch of the names with n
+     */
+    OP_CONTENT_BATCH,
+    /**
+     * recommendByCFBatch of the names with k and n
+     */
+    OP_CF_BATCH,
+    /**
+     * the stats of the shard, answered with a frame of its own
+     */
+    OP_STATS,
+    /**
+     * stops the shard once it answered
+     */
+    OP_STOP
+};
+
+/**
+ * a request to a shard
+ */
+typedef struct ShardRequest
+{
+    int op = 0;
+    /**
+     * number of movies or users to check with
+     */
+    int k = 0;
+    /**
+     * number of movies to recommend
+     */
+    int n = 0;
+    /**
+     * the users, or the movie and the user of a prediction
+     */
+    std::vector<std::string> names;
+} ShardRequest;
+
+/**
+ * the answer of a shard
+ */
+typedef struct ShardResponse
+{
+    int status = SUCCESS;
+    /**
+     * a list for every user of a batch. A single answer is one list of one item, the movie or
+     * the score
+     */
+    std::vector<std::vector<Recommendation>> lists;
+} ShardResponse;
+
+/**
+ * the answer of a shard to OP_STATS
+ */
+typedef struct ShardWorkerStats
+{
+    /**
+     * number of users and of ranks the shard loaded
+     */
+    uint64_t users = 0;
+    uint64_t ranks = 0;
+    /**
+     * the time the shard took to load
+     */
+    double loadSeconds = 0;
+    /**
+     * the time the shard spent answering
+     */
+    double busySeconds = 0;
+} ShardWorkerStats;
+
+/**
+ * reading and writing the messages on connected Unix sockets
+ */
+class ShardProtocol
+{
+public:
+    /**
+     * @param fd a connected socket
+     * @param request the request to send
+     * @return false if the socket failed
+     */
+    static bool send(int fd, const ShardRequest &request);
+    /**
+     * @param fd a connected socket
+     * @param response the response to send
+     * @return false if the socket failed
+     */
+    static bool send(int fd, const ShardResponse &response);
+    /**
+     * @param fd a connected socket
+     * @param stats the stats to send
+     * @return false if the socket failed
+     */
+    static bool send(int fd, const ShardWorkerStats &stats);
+    /**
+     * waits for a whole request
+     * @param fd a connected socket
+     * @param request receives the request
+     * @return false if the socket was closed or failed or the frame is malformed
+     */
+    static bool receive(int fd, ShardRequest &request);
+    /**
+     * waits for a whole response
+     * @param fd a connected socket
+     * @param response receives the response
+     * @return false if the socket was closed or failed or the frame is malformed
+     */
+    static bool receive(int fd, ShardResponse &response);
+    /**
+     * waits for whole stats
+     * @param fd a connected socket
+     * @param stats receives the stats
+     * @return false if the socket was closed or failed or the frame is malformed
+     */
+    static bool receive(int fd, ShardWorkerStats &stats);
+    /**
+     * binds a socket at the path, replacing a file left there, and listens on it
+     * @param path the path of the socket
+     * @return the listening socket, -1 on failure
+     */
+    static int listen(const std::string &path);
+    /**
+     * connects to the socket at the path
+     * @param path the path of the socket
+     * @return the connected socket, -1 on failure
+     */
+    static int connect(const std::string &path);
+};
+
+#endif //CPP4_SHARDPROTOCOL_H
@@ -0,0 +1,258 @@
+/**
+ * @file ShardWorker.cpp
+ * @author  Nimrod Kremer
+ * @version 1.0
+ * @date 26.5.2020
+ *
+ * @brief Serves the users of one shard to the coordinator
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * The socket is listened on only after the load, so a coordinator that connects
+ * knows the shard is ready. A stop shuts down the listening socket and every open
+ * connection, which wakes their threads, and waits for them.
+ * Input  : the files to load and the path of the socket
+ * Process: loading the shard and answering the requests
+ * Output : the recommendations of the users of the shard.
+ */
+
+#include "ShardWorker.h"
+#include <cerrno>
+#include <chrono>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/**
+ * the time the worker waits before accepting again after a failure other than an interrupt or
+ * a connection that was aborted before it was accepted
+ */
+#define ACCEPT_RETRY_MILLISECONDS 100
+
+/**
+ * loads every movie and the users of the shard
+ * @param moviesAttributesFilePath the path of the movies file
+ * @param userRanksFilePath the path of the ranks file
+ * @return success or fail
+ */
+int ShardWorker::load(const std::string &moviesAttributesFilePath, const std::string &userRanksFilePath)
+{
+    auto start = std::chrono::steady_clock::now();
+    int result = _system.loadData(moviesAttributesFilePath, userRanksFilePath);
+    _loadSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+/**
+ * answers one request
+ * @param request the request
+ * @return the answer, fail for a request of the wrong shape
+ */
+ShardResponse ShardWorker::_answer(const ShardRequest &request)
+{
+    ShardResponse response;
+    const std::vector<std::string> &names = request.names;
+    switch (request.op)
+    {
+        case OP_CONTENT:
+            if (names.size() == 1)
+            {
+                response.lists.push_back({{_system.recommendByContent(names[0]), 0}});
+                return response;
+            }
+            break;
+        case OP_CF:
+            if (names.size() == 1)
+            {
+                response.lists.push_back({{_system.recommendByCF(names[0], request.k), 0}});
+                return response;
+            }
+            break;
+        case OP_PREDICT:
+            if (names.size() == 2)
+            {
+                response.lists.push_back({{"", _system.predictMovieScoreForUser(names[0], names[1], request.k)}});
+                return response;
+            }
+            break;
+        case OP_CONTENT_BATCH:
+            response.lists = _system.recommendByContentBatch(names, request.n);
+            return response;
+        case OP_CF_BATCH:
+            response.lists = _system.recommendByCFBatch(names, request.k, request.n);
+            return response;
+        case OP_STOP:
+            return response;
+        default:
+            break;
+    }
+    response.status = FAIL;
+    return response;
+}
+
+/**
+ * @return the load of the shard and the time it spent answering
+ */
+ShardWorkerStats ShardWorker::_stats()
+{
+    std::shared_ptr<const ModelSnapshot> snapshot = _system.snapshot();
+    ShardWorkerStats stats;
+    stats.users = (uint64_t) snapshot->model.users().size();
+    stats.ranks = (uint64_t) snapshot->model.numRanks();
+    std::lock_guard<std::mutex> guard(_lock);
+    stats.loadSeconds = _loadSeconds;
+    stats.busySeconds = _busySeconds;
+    return stats;
+}
+
+/**
+ * answers the requests of one connection until it is closed or a stop is requested
+ * @param fd the connection
+ */
+void ShardWorker::_serveConnection(int fd)
+{
+    ShardRequest request;
+    bool stop = false;
+    while (!stop && ShardProtocol::receive(fd, request))
+    {
+        if (request.op == OP_STATS)
+        {
+            if (!ShardProtocol::send(fd, _stats()))
+            {
+                break;
+            }
+            continue;
+        }
+        auto start = std::chrono::steady_clock::now();
+        ShardResponse response = _answer(request);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (request.op != OP_STOP)
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            _busySeconds += seconds;
+        }
+        stop = request.op == OP_STOP;
+        if (!ShardProtocol::send(fd, response))
+        {
+            break;
+        }
+    }
+    if (stop)
+    {
+        _stop();
+    }
+}
+
+/**
+ * stops accepting and shuts down the open connections, their threads close them
+ */
+void ShardWorker::_stop()
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    _stopping = true;
+    if (_listen >= 0)
+    {
+        ::shutdown(_listen, SHUT_RDWR);
+    }
+    for (int fd: _connections)
+    {
+        ::shutdown(fd, SHUT_RDWR);
+    }
+}
+
+/**
+ * joins the threads of the connections that were closed
+ * @param threads the threads of the connections, by id
+ */
+void ShardWorker::_reap(std::unordered_map<std::thread::id, std::thread> &threads)
+{
+    std::vector<std::thread::id> finished;
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        finished.swap(_finished);
+    }
+    for (std::thread::id id: finished)
+    {
+        auto it = threads.find(id);
+        it->second.join();
+        threads.erase(it);
+    }
+}
+
+/**
+ * listens on the socket and answers the requests until OP_STOP, a thread for every connection.
+ * The threads of the closed connections are joined on every accept, so a worker whose
+ * coordinators come and go keeps only the threads of the open ones
+ * @param socketPath the path of the socket, replaced if a file is there
+ * @return success, or fail if the socket couldn't be listened on
+ */
+int ShardWorker::serve(const std::string &socketPath)
+{
+    int listenFd = ShardProtocol::listen(socketPath);
+    if (listenFd < 0)
+    {
+        return FAIL;
+    }
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        _listen = listenFd;
+        _stopping = false;
+    }
+    std::unordered_map<std::thread::id, std::thread> threads;
+    while (true)
+    {
+        int fd = ::accept(listenFd, nullptr, nullptr);
+        int error = errno;
+        _reap(threads);
+        if (fd < 0)
+        {
+            {
+                std::lock_guard<std::mutex> guard(_lock);
+                if (_stopping)
+                {
+                    break;
+                }
+            }
+            if (error != EINTR && error != ECONNABORTED)
+            {
+                // out of descriptors or memory, which the closing connections may give back
+                std::this_thread::sleep_for(std::chrono::milliseconds(ACCEPT_RETRY_MILLISECONDS));
+            }
+            continue;
+        }
+        std::lock_guard<std::mutex> guard(_lock);
+        if (_stopping)
+        {
+            ::close(fd);
+            break;
+        }
+        _connections.insert(fd);
+        // the thread is in the map before it can finish, it finishes under the lock held here
+        std::thread thread([this, fd]()
+        {
+            _serveConnection(fd);
+            std::lock_guard<std::mutex> closing(_lock);
+            _connections.erase(fd);
+            ::close(fd);
+            _finished.push_back(std::this_thread::get_id());
+        });
+        std::thread::id id = thread.get_id();
+        threads.emplace(id, std::move(thread));
+    }
+    for (auto &it: threads)
+    {
+        it.second.join();
+    }
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        _finished.clear();
+    }
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        _listen = -1;
+    }
+    ::close(listenFd);
+    ::unlink(socketPath.c_str());
+    return SUCCESS;
+}
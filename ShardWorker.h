@@ -0,0 +1,116 @@
+/**
+ * @file ShardWorker.h
+ * @author  Nimrod Kremer
+ * @version 1.0
+ * @date 26.5.2020
+ *
+ * @brief Serves the users of one shard to the coordinator
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * A worker loads every movie and only the users of its shard, then answers the
+ * requests of the coordinator on a Unix socket, a thread for every connection. The
+ * similarities of the movies come from their features alone, so the answers for its
+ * users are the ones a single system with every user would give.
+ * Input  : the files to load and the path of the socket
+ * Process: loading the shard and answering the requests
+ * Output : the recommendations of the users of the shard.
+ */
+
+#ifndef CPP4_SHARDWORKER_H
+#define CPP4_SHARDWORKER_H
+
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "RecommenderSystem.h"
+#include "ShardProtocol.h"
+
+/**
+ * loads one shard and serves it until the coordinator stops it
+ */
+class ShardWorker
+{
+private:
+    RecommenderSystem _system;
+    /**
+     * the time the load took
+     */
+    double _loadSeconds = 0;
+    /**
+     * guards the connections and the counters
+     */
+    std::mutex _lock;
+    /**
+     * the listening socket, -1 unless serving
+     */
+    int _listen = -1;
+    /**
+     * true once a stop was requested
+     */
+    bool _stopping = false;
+    /**
+     * the open connections, shut down on a stop so that their threads return
+     */
+    std::unordered_set<int> _connections;
+    /**
+     * the threads of the connections that were closed and weren't joined yet
+     */
+    std::vector<std::thread::id> _finished;
+    /**
+     * the time spent answering the queries
+     */
+    double _busySeconds = 0;
+    /**
+     * answers the requests of one connection until it is closed
+     * @param fd the connection
+     */
+    void _serveConnection(int fd);
+    /**
+     * answers one request
+     * @param request the request
+     * @return the answer
+     */
+    ShardResponse _answer(const ShardRequest &request);
+    /**
+     * @return the load of the shard and the time it spent answering
+     */
+    ShardWorkerStats _stats();
+    /**
+     * joins the threads of the connections that were closed
+     * @param threads the threads of the connections, by id
+     */
+    void _reap(std::unordered_map<std::thread::id, std::thread> &threads);
+    /**
+     * stops accepting and shuts down the open connections
+     */
+    void _stop();
+public:
+    /**
+     * creates a worker for the shard set in the config
+     * @param config the knobs of the system, with the shard and the number of shards
+     */
+    explicit ShardWorker(const RecommenderConfig &config) : _system(config)
+    {
+    }
+    /**
+     * loads every movie and the users of the shard
+     * @param moviesAttributesFilePath the path of the movies file
+     * @param userRanksFilePath the path of the ranks file
+     * @return success or fail
+     */
+    int load(const std::string &moviesAttributesFilePath, const std::string &userRanksFilePath);
+    /**
+     * listens on the socket and answers the requests until OP_STOP
+     * @param socketPath the path of the socket, replaced if a file is there
+     * @return success, or fail if the socket couldn't be listened on
+     */
+    int serve(const std::string &socketPath);
+};
+
+#endif //CPP4_SHARDWORKER_H
@@ -0,0 +1,126 @@
+/**
+ * @file ShardWorkerMain.cpp
+ * @author  Nimrod Kremer
+ * @version 1.0
+ * @date 26.5.2020
+ *
+ * @brief The process of one shard, started by the coordinator
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * Loads the users of its shard and serves them on the given socket until the
+ * coordinator stops it.
+ * Input  : the shard, the files and the socket, as --name value options
+ * Process: loading and serving the shard
+ * Output : 0 once stopped, 1 on bad options, files or socket.
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include "ShardWorker.h"
+
+/**
+ * the usage of the worker
+ */
+#define USAGE "Usage: cpp4_shard_worker --shard N --shards N --movies PATH --ranks PATH --socket PATH\n" \
+              "                         [--neighbors N] [--threads N]"
+
+/**
+ * the options of the worker
+ */
+typedef struct WorkerOptions
+{
+    std::string movies;
+    std::string ranks;
+    std::string socket;
+    RecommenderConfig config;
+} WorkerOptions;
+
+/**
+ * reads the options of the command line
+ * @param argc number of arguments
+ * @param argv the arguments
+ * @param options receives the options
+ * @return success or fail on an unknown option, a missing value or a missing path
+ */
+static int parseOptions(int argc, char **argv, WorkerOptions &options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (i + 1 >= argc)
+        {
+            return FAIL;
+        }
+        std::string name = argv[i];
+        const char *value = argv[++i];
+        if (name == "--shard")
+        {
+            options.config.shard = std::atoi(value);
+        }
+        else if (name == "--shards")
+        {
+            options.config.numShards = std::atoi(value);
+        }
+        else if (name == "--movies")
+        {
+            options.movies = value;
+        }
+        else if (name == "--ranks")
+        {
+            options.ranks = value;
+        }
+        else if (name == "--socket")
+        {
+            options.socket = value;
+        }
+        else if (name == "--neighbors")
+        {
+            options.config.neighbors = std::atoi(value);
+        }
+        else if (name == "--threads")
+        {
+            options.config.threads = std::atoi(value);
+        }
+        else
+        {
+            return FAIL;
+        }
+    }
+    const RecommenderConfig &config = options.config;
+    if (options.movies.empty() || options.ranks.empty() || options.socket.empty() || config.numShards < 1 ||
+        config.shard < 0 || config.shard >= config.numShards)
+    {
+        return FAIL;
+    }
+    return SUCCESS;
+}
+
+/**
+ * loads the shard and serves it
+ * @param argc number of arguments
+ * @param argv the options
+ * @return 0 once stopped, 1 on bad options, files or socket
+ */
+int main(int argc, char **argv)
+{
+    WorkerOptions options;
+    if (parseOptions(argc, argv, options) == FAIL)
+    {
+        std::cerr << USAGE << std::endl;
+        return 1;
+    }
+    ShardWorker worker(options.config);
+    if (worker.load(options.movies, options.ranks) == FAIL)
+    {
+        return 1;
+    }
+    if (worker.serve(options.socket) == FAIL)
+    {
+        std::cerr << "Unable to listen on " << options.socket << std::endl;
+        return 1;
+    }
+    return 0;
+}
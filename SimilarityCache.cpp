@@ -0,0 +1,136 @@
+/**
+ * @file SimilarityCache.cpp
+ * @author  Nimrod Kremer
+ * @version 1.0
+ * @date 26.5.2020
+ *
+ * @brief Lock free cache of similarities between pairs of movies
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * A fixed size direct mapped table, every slot guarded by a sequence number so
+ * readers never block and never see half written slots. A writer that finds its
+ * slot busy simply doesn't cache the value.
+ * Input  : pairs of movie ids and their similarity
+ * Process: hashing of the pair into a slot
+ * Output : the similarity if it is cached.
+ */
+
+#include "SimilarityCache.h"
+#include <algorithm>
+#include <cstring>
+
+/**
+ * the key of a slot that holds nothing, no pair of ids has it
+ */
+#define EMPTY_KEY UINT64_MAX
+
+/**
+ * creates the cache
+ * @param capacity number of slots, rounded up to a power of 2, 0 disables the cache
+ */
+SimilarityCache::SimilarityCache(size_t capacity)
+{
+    if (capacity == 0)
+    {
+        return;
+    }
+    size_t size = 1;
+    while (size < capacity)
+    {
+        size <<= 1;
+    }
+    _slots.reset(new Slot[size]);
+    _mask = size - 1;
+    for (size_t i = 0; i < size; i++)
+    {
+        _slots[i].sequence.store(0, std::memory_order_relaxed);
+        _slots[i].key.store(EMPTY_KEY, std::memory_order_relaxed);
+        _slots[i].value.store(0, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * @return the key of the pair, the same for both orders of the movies
+ */
+uint64_t SimilarityCache::_key(int movie1, int movie2)
+{
+    return ((uint64_t) (uint32_t) std::min(movie1, movie2) << 32) | (uint32_t) std::max(movie1, movie2);
+}
+
+/**
+ * @return the slot of the key
+ */
+SimilarityCache::Slot &SimilarityCache::_slot(uint64_t key) const
+{
+    // finalizer of murmur3, spreads the pairs of close ids over the table
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return _slots[key & _mask];
+}
+
+/**
+ * looks for the similarity of the pair.
+ * The slot is read between two loads of its sequence, if the sequence changed or was odd a
+ * writer was in the slot and the read counts as a miss.
+ * @param movie1 id of the first movie
+ * @param movie2 id of the second movie
+ * @param similarity receives the similarity if it was found
+ * @return true if the similarity was found
+ */
+bool SimilarityCache::find(int movie1, int movie2, double &similarity) const
+{
+    if (!_slots)
+    {
+        return false;
+    }
+    uint64_t key = _key(movie1, movie2);
+    Slot &slot = _slot(key);
+    uint32_t before = slot.sequence.load(std::memory_order_acquire);
+    if (before & 1u)
+    {
+        return false;
+    }
+    uint64_t slotKey = slot.key.load(std::memory_order_relaxed);
+    uint64_t value = slot.value.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.sequence.load(std::memory_order_relaxed) != before || slotKey != key)
+    {
+        return false;
+    }
+    std::memcpy(&similarity, &value, sizeof(similarity));
+    return true;
+}
+
+/**
+ * caches the similarity of the pair, may drop it if another thread writes the same slot
+ * @param movie1 id of the first movie
+ * @param movie2 id of the second movie
+ * @param similarity the similarity of the movies
+ */
+void SimilarityCache::insert(int movie1, int movie2, double similarity) const
+{
+    if (!_slots)
+    {
+        return;
+    }
+    uint64_t key = _key(movie1, movie2);
+    Slot &slot = _slot(key);
+    uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+    if ((sequence & 1u) || !slot.sequence.compare_exchange_strong(sequence, sequence + 1,
+                                                                  std::memory_order_acquire))
+    {
+        return;
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    uint64_t value;
+    std::memcpy(&value, &similarity, sizeof(value));
+    slot.key.store(key, std::memory_order_relaxed);
+    slot.value.store(value, std::memory_order_relaxed);
+    slot.sequence.store(sequence + 2, std::memory_order_release);
+}
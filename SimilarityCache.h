@@ -0,0 +1,82 @@
+/**
+ * @file SimilarityCache.h
+ * @author  Nimrod Kremer
+ * @version 1.0
+ * @date 26.5.2020
+ *
+ * @brief Lock free cache of similarities between pairs of movies
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * A fixed size direct mapped table, every slot guarded by a sequence number so
+ * readers never block and never see half written slots. A writer that finds its
+ * slot busy simply doesn't cache the value.
+ * Input  : pairs of movie ids and their similarity
+ * Process: hashing of the pair into a slot
+ * Output : the similarity if it is cached.
+ */
+
+#ifndef CPP4_SIMILARITYCACHE_H
+#define CPP4_SIMILARITYCACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+/**
+ * cache of the similarity of pairs of movies, safe for any number of threads
+ */
+class SimilarityCache
+{
+private:
+    /**
+     * one cached pair, odd sequence means a writer is in the slot
+     */
+    typedef struct Slot
+    {
+        std::atomic<uint32_t> sequence;
+        std::atomic<uint64_t> key;
+        std::atomic<uint64_t> value;
+    } Slot;
+    /**
+     * the slots of the table
+     */
+    std::unique_ptr<Slot[]> _slots;
+    /**
+     * number of slots minus one, the number of slots is a power of 2
+     */
+    size_t _mask = 0;
+    /**
+     * @return the key of the pair, the same for both orders of the movies
+     */
+    static uint64_t _key(int movie1, int movie2);
+    /**
+     * @return the slot of the key
+     */
+    Slot &_slot(uint64_t key) const;
+public:
+    /**
+     * creates the cache
+     * @param capacity number of slots, rounded up to a power of 2, 0 disables the cache
+     */
+    explicit SimilarityCache(size_t capacity);
+    /**
+     * looks for the similarity of the pair
+     * @param movie1 id of the first movie
+     * @param movie2 id of the second movie
+     * @param similarity receives the similarity if it was found
+     * @return true if the similarity was found
+     */
+    bool find(int movie1, int movie2, double &similarity) const;
+    /**
+     * caches the similarity of the pair, may drop it if another thread writes the same slot
+     * @param movie1 id of the first movie
+     * @param movie2 id of the second movie
+     * @param similarity the similarity of the movies
+     */
+    void insert(int movie1, int movie2, double similarity) const;
+};
+
+#endif //CPP4_SIMILARITYCACHE_H
@@ -0,0 +1,209 @@
+/**
+ * @file SimilarityIndex.cpp
+ * @author  Nimrod Kremer
+ * @version 1.0
+ * @date 26.5.2020
+ *
+ * @brief Precomputed lists of the most similar movies of every movie
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * Built once when the data is loaded, keeps for every movie a fixed size list of
+ * the ranked movies most similar to it, sorted from the most similar.
+ * Input  : the loaded model
+ * Process: cosine similarity of all of the pairs of movies
+ * Output : neighbor lists of (id, similarity).
+ */
+
+#include "SimilarityIndex.h"
+#include <algorithm>
+#include <chrono>
+
+/**
+ * number of movies in the side of a tile, the features of two tiles stay in the cache
+ */
+#define TILE_SIZE 64
+
+/**
+ * orders neighbors from the most similar, breaking ties by the smaller id
+ * @param a first neighbor
+ * @param b second neighbor
+ * @return true if a comes before b
+ */
+bool SimilarityIndex::closerThan(const Neighbor &a, const Neighbor &b)
+{
+    return a.similarity > b.similarity || (a.similarity == b.similarity && a.movie < b.movie);
+}
+
+/**
+ * removes all of the lists
+ */
+void SimilarityIndex::clear()
+{
+    _stride = 0;
+    _complete = false;
+    _columns = 0;
+    _neighbors.clear();
+    _counts.clear();
+    _checks.reset();
+    _stats = SimilarityBuildStats();
+}
+
+/**
+ * builds the lists of all of the movies of the model.
+ * The movies are split into tiles of TILE_SIZE rows over TILE_SIZE ranked columns and every tile
+ * is a task of the pool. The similarity is symmetric, so among the ranked movies only the tiles
+ * on and above the diagonal are calculated and every pair is offered to the lists of both movies.
+ * Every list keeps a heap of its best neighbors by a total order, so the result doesn't depend on
+ * the order the tiles run in.
+ * @param model the loaded model
+ * @param features the features the similarities are calculated from
+ * @param listSize number of neighbors to keep for every movie, 0 keeps none
+ * @param pool the threads to build with
+ */
+void SimilarityIndex::build(const RecommenderModel &model, const FeatureMatrix &features, int listSize,
+                            ThreadPool &pool)
+{
+    clear();
+    const Array<int> &ranked = model.rankedMovies();
+    int numMovies = model.movies().size();
+    if (listSize <= 0 || numMovies == 0 || ranked.empty())
+    {
+        return;
+    }
+    auto start = std::chrono::steady_clock::now();
+
+    _stride = std::min(listSize, (int) ranked.size());
+    _complete = _stride == (int) ranked.size();
+    _columns = (int) ranked.size();
+
+    // the rows are the ranked movies first and then the movies no one can rank
+    std::vector<int> rows(ranked.begin(), ranked.end());
+    std::vector<bool> isRankedMovie(numMovies, false);
+    for (int movie: ranked)
+    {
+        isRankedMovie[movie] = true;
+    }
+    for (int movie = 0; movie < numMovies; movie++)
+    {
+        if (!isRankedMovie[movie])
+        {
+            rows.push_back(movie);
+        }
+    }
+    // the ranked rows are tiled exactly like the columns, so a ranked tile is its own mirror
+    size_t numColumnTiles = (ranked.size() + TILE_SIZE - 1) / TILE_SIZE;
+    size_t numRowTiles = numColumnTiles + (rows.size() - ranked.size() + TILE_SIZE - 1) / TILE_SIZE;
+    auto rowTileBegin = [&](size_t rowTile)
+    {
+        return rowTile < numColumnTiles ? rowTile * TILE_SIZE
+                                        : ranked.size() + (rowTile - numColumnTiles) * TILE_SIZE;
+    };
+    auto rowTileEnd = [&](size_t rowTile)
+    {
+        return std::min(rowTileBegin(rowTile) + TILE_SIZE, rowTile < numColumnTiles ? ranked.size() : rows.size());
+    };
+
+    std::vector<std::pair<size_t, size_t>> tiles;
+    for (size_t rowTile = 0; rowTile < numRowTiles; rowTile++)
+    {
+        for (size_t columnTile = 0; columnTile < numColumnTiles; columnTile++)
+        {
+            // below the diagonal the tile is the mirror of one above it
+            if (rowTile < numColumnTiles && columnTile < rowTile)
+            {
+                continue;
+            }
+            tiles.emplace_back(rowTile, columnTile);
+        }
+    }
+
+    std::vector<std::vector<Neighbor>> heaps(rows.size());
+    std::vector<std::mutex> locks(numRowTiles);
+    std::atomic<size_t> pairs(0);
+    // offers the neighbor to the heap of the given row
+    auto offer = [this, &heaps](size_t row, const Neighbor &neighbor)
+    {
+        std::vector<Neighbor> &heap = heaps[row];
+        if ((int) heap.size() < _stride)
+        {
+            heap.push_back(neighbor);
+            std::push_heap(heap.begin(), heap.end(), closerThan);
+        }
+        else if (closerThan(neighbor, heap.front()))
+        {
+            std::pop_heap(heap.begin(), heap.end(), closerThan);
+            heap.back() = neighbor;
+            std::push_heap(heap.begin(), heap.end(), closerThan);
+        }
+    };
+
+    pool.parallelFor(tiles.size(), [&](size_t t)
+    {
+        size_t rowBegin = rowTileBegin(tiles[t].first);
+        size_t rowEnd = rowTileEnd(tiles[t].first);
+        size_t columnBegin = tiles[t].second * TILE_SIZE;
+        size_t columnEnd = std::min(columnBegin + TILE_SIZE, ranked.size());
+        bool mirrored = tiles[t].first < numColumnTiles;
+        bool diagonal = tiles[t].first == tiles[t].second;
+
+        double similarity[TILE_SIZE][TILE_SIZE];
+        for (size_t row = rowBegin; row < rowEnd; row++)
+        {
+            features.cosineMovie(model, rows[row], ranked.data() + columnBegin, columnEnd - columnBegin,
+                                 similarity[row - rowBegin]);
+        }
+        pairs += (rowEnd - rowBegin) * (columnEnd - columnBegin);
+
+        {
+            std::lock_guard<std::mutex> guard(locks[tiles[t].first]);
+            for (size_t row = rowBegin; row < rowEnd; row++)
+            {
+                for (size_t column = columnBegin; column < columnEnd; column++)
+                {
+                    double value = similarity[row - rowBegin][column - columnBegin];
+                    // a similarity that is not a number can't be ordered, it belongs to an all zero movie
+                    if (ranked[column] != rows[row] && value == value)
+                    {
+                        offer(row, {ranked[column], (float) value});
+                    }
+                }
+            }
+        }
+        if (mirrored && !diagonal)
+        {
+            // the columns of a ranked tile are rows as well, in the same order
+            std::lock_guard<std::mutex> guard(locks[tiles[t].second]);
+            for (size_t column = columnBegin; column < columnEnd; column++)
+            {
+                for (size_t row = rowBegin; row < rowEnd; row++)
+                {
+                    double value = similarity[row - rowBegin][column - columnBegin];
+                    if (value == value)
+                    {
+                        offer(column, {rows[row], (float) value});
+                    }
+                }
+            }
+        }
+    });
+
+    std::vector<Neighbor> neighbors((size_t) numMovies * _stride);
+    std::vector<int> counts(numMovies, 0);
+    pool.parallelFor(rows.size(), [&](size_t row)
+    {
+        std::vector<Neighbor> &heap = heaps[row];
+        std::sort_heap(heap.begin(), heap.end(), closerThan);
+        std::copy(heap.begin(), heap.end(), neighbors.begin() + (size_t) rows[row] * _stride);
+        counts[rows[row]] = (int) heap.size();
+        std::vector<Neighbor>().swap(heap);
+    });
+    _neighbors.assign(std::move(neighbors));
+    _counts.assign(std::move(counts));
+
+    _stats.pairs = pairs;
+    _stats.threads = pool.size();
+    _stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
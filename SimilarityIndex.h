@@ -0,0 +1,188 @@
+/**
+ * @file SimilarityIndex.h
+ * @author  Nimrod Kremer
+ * @version 1.0
+ * @date 26.5.2020
+ *
+ * @brief Precomputed lists of the most similar movies of every movie
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * Built once when the data is loaded, keeps for every movie a fixed size list of
+ * the ranked movies most similar to it, sorted from the most similar.
+ * Input  : the loaded model
+ * Process: cosine similarity of all of the pairs of movies
+ * Output : neighbor lists of (id, similarity).
+ */
+
+#ifndef CPP4_SIMILARITYINDEX_H
+#define CPP4_SIMILARITYINDEX_H
+
+#include <vector>
+#include "RecommenderModel.h"
+#include "FeatureMatrix.h"
+#include "ThreadPool.h"
+
+/**
+ * a movie in a neighbor list and its similarity to the owner of the list
+ */
+typedef struct Neighbor
+{
+    int movie;
+    float similarity;
+} Neighbor;
+
+/**
+ * how long the last build took
+ */
+typedef struct SimilarityBuildStats
+{
+    /**
+     * number of pairs of movies whose similarity was calculated
+     */
+    size_t pairs = 0;
+    /**
+     * the time the build took
+     */
+    double seconds = 0;
+    /**
+     * number of threads the build ran on
+     */
+    int threads = 0;
+    /**
+     * @return the throughput of the build
+     */
+    double pairsPerSecond() const
+    {
+        return seconds > 0 ? pairs / seconds : 0;
+    }
+} SimilarityBuildStats;
+
+/**
+ * the neighbor lists of all of the movies
+ */
+class SimilarityIndex
+{
+    friend class SnapshotFile;
+private:
+    /**
+     * the room every movie has in _neighbors
+     */
+    int _stride = 0;
+    /**
+     * true if every list holds all of the ranked movies besides its owner
+     */
+    bool _complete = false;
+    /**
+     * number of ranked columns the lists were built from, columns added later aren't in them
+     */
+    int _columns = 0;
+    /**
+     * movies x _stride neighbors, every list sorted from the most similar
+     */
+    Array<Neighbor> _neighbors;
+    /**
+     * how many neighbors every movie has in its list
+     */
+    Array<int> _counts;
+    /**
+     * the lists read from a snapshot that were checked, nullptr for lists built in memory
+     */
+    std::shared_ptr<const RowChecks> _checks;
+    /**
+     * how long the last build took
+     */
+    SimilarityBuildStats _stats;
+public:
+    /**
+     * orders neighbors from the most similar, breaking ties by the smaller id
+     * @param a first neighbor
+     * @param b second neighbor
+     * @return true if a comes before b
+     */
+    static bool closerThan(const Neighbor &a, const Neighbor &b);
+    /**
+     * builds the lists of all of the movies of the model, the result doesn't depend on the
+     * number of threads of the pool
+     * @param model the loaded model
+     * @param features the features the similarities are calculated from
+     * @param listSize number of neighbors to keep for every movie, 0 keeps none
+     * @param pool the threads to build with
+     */
+    void build(const RecommenderModel &model, const FeatureMatrix &features, int listSize, ThreadPool &pool);
+    /**
+     * @return how long the last build took
+     */
+    const SimilarityBuildStats &buildStats() const
+    {
+        return _stats;
+    }
+    /**
+     * removes all of the lists
+     */
+    void clear();
+    /**
+     * @return true if the lists were built
+     */
+    bool empty() const
+    {
+        return _neighbors.empty();
+    }
+    /**
+     * @return true if every list holds all of the ranked movies besides its owner
+     */
+    bool isComplete() const
+    {
+        return _complete;
+    }
+    /**
+     * @return number of ranked columns the lists were built from, columns added later aren't in them
+     */
+    int columns() const
+    {
+        return _columns;
+    }
+    /**
+     * @param movie id of the movie
+     * @return true if the movie has a list, movies added after the build don't
+     */
+    bool covers(int movie) const
+    {
+        return (size_t) movie < _counts.size();
+    }
+    /**
+     * @param movie id of the movie
+     * @return the neighbors of the movie, sorted from the most similar
+     */
+    const Neighbor *neighbors(int movie) const
+    {
+        return _neighbors.data() + (size_t) movie * _stride;
+    }
+    /**
+     * @param movie id of the movie
+     * @return number of neighbors of the movie, 0 if its list in the snapshot is damaged
+     */
+    int count(int movie) const
+    {
+        if (_checks != nullptr && !_checks->valid(movie, [&]()
+        {
+            const Neighbor *list = neighbors(movie);
+            for (int i = 0; i < _counts[movie]; i++)
+            {
+                if (list[i].movie < 0 || (size_t) list[i].movie >= _checks->limit())
+                {
+                    return false;
+                }
+            }
+            return true;
+        }))
+        {
+            return 0;
+        }
+        return _counts[movie];
+    }
+};
+
+#endif //CPP4_SIMILARITYINDEX_H
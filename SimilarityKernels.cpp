@@ -0,0 +1,392 @@
+/**
+ * @file SimilarityKernels.cpp
+ * @author  Nimrod Kremer
+ * @version 1.0
+ * @date 26.5.2020
+ *
+ * @brief Vectorized kernels of the cosine similarity
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * Dot products, normals and batched cosine similarity of one query against many
+ * rows of a feature matrix. The instruction set (AVX-512, AVX2, SSE2 or plain
+ * scalar code) is chosen once at runtime by the features of the cpu.
+ * Input  : vectors of doubles
+ * Process: vectorized arithmetic
+ * Output : dot products and similarities.
+ */
+
+#include "SimilarityKernels.h"
+#include <cmath>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+/**
+ * the dot product kernel of an instruction set
+ */
+typedef double (*DotKernel)(const double *, const double *, size_t);
+/**
+ * the batched cosine kernel of an instruction set
+ */
+typedef void (*CosineManyKernel)(const double *, double, const double *, const double *, size_t, const int *,
+                                 size_t, double *);
+
+/**
+ * scalar dot product, used when nothing better is supported
+ */
+static inline double dotScalar(const double *vec1, const double *vec2, size_t size)
+{
+    double sum = 0;
+    for (size_t i = 0; i < size; i++)
+    {
+        sum += vec1[i] * vec2[i];
+    }
+    return sum;
+}
+
+/**
+ * scalar batched cosine
+ */
+static void cosineManyScalar(const double *query, double queryNormal, const double *matrix, const double *normals,
+                             size_t numFeatures, const int *rows, size_t numRows, double *out)
+{
+    for (size_t i = 0; i < numRows; i++)
+    {
+        const double *row = matrix + (size_t) rows[i] * numFeatures;
+        out[i] = dotScalar(query, row, numFeatures) / (queryNormal * normals[rows[i]]);
+    }
+}
+
+#ifdef KERNELS_X86
+
+/**
+ * the mask that keeps all of the four lanes of half of an AVX-512 register
+ */
+#define AVX512_HALF ((__mmask8) 0x0F)
+
+/**
+ * SSE2 dot product, two lanes with two accumulators
+ */
+__attribute__((target("sse2")))
+static inline double dotSse2(const double *vec1, const double *vec2, size_t size)
+{
+    __m128d acc0 = _mm_setzero_pd();
+    __m128d acc1 = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4)
+    {
+        acc0 = _mm_add_pd(acc0, _mm_mul_pd(_mm_loadu_pd(vec1 + i), _mm_loadu_pd(vec2 + i)));
+        acc1 = _mm_add_pd(acc1, _mm_mul_pd(_mm_loadu_pd(vec1 + i + 2), _mm_loadu_pd(vec2 + i + 2)));
+    }
+    acc0 = _mm_add_pd(acc0, acc1);
+    double lanes[2];
+    _mm_storeu_pd(lanes, acc0);
+    double sum = lanes[0] + lanes[1];
+    for (; i < size; i++)
+    {
+        sum += vec1[i] * vec2[i];
+    }
+    return sum;
+}
+
+/**
+ * SSE2 batched cosine
+ */
+__attribute__((target("sse2")))
+static void cosineManySse2(const double *query, double queryNormal, const double *matrix, const double *normals,
+                           size_t numFeatures, const int *rows, size_t numRows, double *out)
+{
+    for (size_t i = 0; i < numRows; i++)
+    {
+        const double *row = matrix + (size_t) rows[i] * numFeatures;
+        out[i] = dotSse2(query, row, numFeatures) / (queryNormal * normals[rows[i]]);
+    }
+}
+
+/**
+ * AVX2 dot product, four lanes with four accumulators to hide the latency of the fma
+ */
+__attribute__((target("avx2,fma")))
+static inline double dotAvx2(const double *vec1, const double *vec2, size_t size)
+{
+    __m256d acc0 = _mm256_setzero_pd();
+    __m256d acc1 = _mm256_setzero_pd();
+    __m256d acc2 = _mm256_setzero_pd();
+    __m256d acc3 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16)
+    {
+        acc0 = _mm256_fmadd_pd(_mm256_loadu_pd(vec1 + i), _mm256_loadu_pd(vec2 + i), acc0);
+        acc1 = _mm256_fmadd_pd(_mm256_loadu_pd(vec1 + i + 4), _mm256_loadu_pd(vec2 + i + 4), acc1);
+        acc2 = _mm256_fmadd_pd(_mm256_loadu_pd(vec1 + i + 8), _mm256_loadu_pd(vec2 + i + 8), acc2);
+        acc3 = _mm256_fmadd_pd(_mm256_loadu_pd(vec1 + i + 12), _mm256_loadu_pd(vec2 + i + 12), acc3);
+    }
+    for (; i + 4 <= size; i += 4)
+    {
+        acc0 = _mm256_fmadd_pd(_mm256_loadu_pd(vec1 + i), _mm256_loadu_pd(vec2 + i), acc0);
+    }
+    acc0 = _mm256_add_pd(_mm256_add_pd(acc0, acc1), _mm256_add_pd(acc2, acc3));
+    __m128d half = _mm_add_pd(_mm256_castpd256_pd128(acc0), _mm256_extractf128_pd(acc0, 1));
+    double lanes[2];
+    _mm_storeu_pd(lanes, half);
+    double sum = lanes[0] + lanes[1];
+    for (; i < size; i++)
+    {
+        sum += vec1[i] * vec2[i];
+    }
+    return sum;
+}
+
+/**
+ * AVX2 batched cosine
+ */
+__attribute__((target("avx2,fma")))
+static void cosineManyAvx2(const double *query, double queryNormal, const double *matrix, const double *normals,
+                           size_t numFeatures, const int *rows, size_t numRows, double *out)
+{
+    for (size_t i = 0; i < numRows; i++)
+    {
+        const double *row = matrix + (size_t) rows[i] * numFeatures;
+        if (i + 1 < numRows)
+        {
+            _mm_prefetch((const char *) (matrix + (size_t) rows[i + 1] * numFeatures), _MM_HINT_T0);
+        }
+        out[i] = dotAvx2(query, row, numFeatures) / (queryNormal * normals[rows[i]]);
+    }
+}
+
+/**
+ * AVX-512 dot product, eight lanes with two accumulators and a masked tail
+ */
+__attribute__((target("avx512f")))
+static inline double dotAvx512(const double *vec1, const double *vec2, size_t size)
+{
+    __m512d acc0 = _mm512_setzero_pd();
+    __m512d acc1 = _mm512_setzero_pd();
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16)
+    {
+        acc0 = _mm512_fmadd_pd(_mm512_loadu_pd(vec1 + i), _mm512_loadu_pd(vec2 + i), acc0);
+        acc1 = _mm512_fmadd_pd(_mm512_loadu_pd(vec1 + i + 8), _mm512_loadu_pd(vec2 + i + 8), acc1);
+    }
+    if (i + 8 <= size)
+    {
+        acc0 = _mm512_fmadd_pd(_mm512_loadu_pd(vec1 + i), _mm512_loadu_pd(vec2 + i), acc0);
+        i += 8;
+    }
+    if (i < size)
+    {
+        __mmask8 mask = (__mmask8) ((1u << (size - i)) - 1);
+        acc1 = _mm512_fmadd_pd(_mm512_maskz_loadu_pd(mask, vec1 + i), _mm512_maskz_loadu_pd(mask, vec2 + i), acc1);
+    }
+    // reduced by halves with the zero masked extract, the unmasked one and _mm512_reduce_add_pd read an
+    // undefined register in the gcc headers and warn under -Wall
+    acc0 = _mm512_add_pd(acc0, acc1);
+    __m256d quarter = _mm256_add_pd(_mm512_maskz_extractf64x4_pd(AVX512_HALF, acc0, 0),
+                                    _mm512_maskz_extractf64x4_pd(AVX512_HALF, acc0, 1));
+    __m128d half = _mm_add_pd(_mm256_castpd256_pd128(quarter), _mm256_extractf128_pd(quarter, 1));
+    double lanes[2];
+    _mm_storeu_pd(lanes, half);
+    return lanes[0] + lanes[1];
+}
+
+/**
+ * AVX-512 batched cosine
+ */
+__attribute__((target("avx512f")))
+static void cosineManyAvx512(const double *query, double queryNormal, const double *matrix, const double *normals,
+                             size_t numFeatures, const int *rows, size_t numRows, double *out)
+{
+    for (size_t i = 0; i < numRows; i++)
+    {
+        const double *row = matrix + (size_t) rows[i] * numFeatures;
+        if (i + 1 < numRows)
+        {
+            _mm_prefetch((const char *) (matrix + (size_t) rows[i + 1] * numFeatures), _MM_HINT_T0);
+        }
+        out[i] = dotAvx512(query, row, numFeatures) / (queryNormal * normals[rows[i]]);
+    }
+}
+
+#endif
+
+/**
+ * @param isa an instruction set
+ * @return true if the cpu supports the instruction set
+ */
+static bool isaSupported(KernelIsa isa)
+{
+    switch (isa)
+    {
+        case KernelIsa::SCALAR:
+            return true;
+#ifdef KERNELS_X86
+        case KernelIsa::SSE2:
+            return __builtin_cpu_supports("sse2");
+        case KernelIsa::AVX2:
+            return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        case KernelIsa::AVX512:
+            return __builtin_cpu_supports("avx512f");
+#endif
+        default:
+            return false;
+    }
+}
+
+/**
+ * @return the best instruction set the cpu supports
+ */
+static KernelIsa bestIsa()
+{
+    const KernelIsa order[] = {KernelIsa::AVX512, KernelIsa::AVX2, KernelIsa::SSE2};
+    for (KernelIsa isa: order)
+    {
+        if (isaSupported(isa))
+        {
+            return isa;
+        }
+    }
+    return KernelIsa::SCALAR;
+}
+
+/**
+ * the kernels of the selected instruction set
+ */
+struct KernelTable
+{
+    KernelIsa isa;
+    DotKernel dot;
+    CosineManyKernel cosineMany;
+};
+
+/**
+ * @param isa a supported instruction set
+ * @return the kernels of the instruction set
+ */
+static KernelTable kernelsFor(KernelIsa isa)
+{
+    switch (isa)
+    {
+#ifdef KERNELS_X86
+        case KernelIsa::SSE2:
+            return {isa, dotSse2, cosineManySse2};
+        case KernelIsa::AVX2:
+            return {isa, dotAvx2, cosineManyAvx2};
+        case KernelIsa::AVX512:
+            return {isa, dotAvx512, cosineManyAvx512};
+#endif
+        default:
+            return {KernelIsa::SCALAR, dotScalar, cosineManyScalar};
+    }
+}
+
+/**
+ * the kernels in use, selected on the first use and never changed after, so the queries read it
+ * without a lock
+ */
+static const KernelTable &kernels()
+{
+    static const KernelTable table = kernelsFor(bestIsa());
+    return table;
+}
+
+/**
+ * dot product of the given vectors
+ * @param vec1 vector 1
+ * @param vec2 vector 2
+ * @param size the size of the vectors
+ * @return the dot product of both
+ */
+double SimilarityKernels::dot(const double *vec1, const double *vec2, size_t size)
+{
+    return kernels().dot(vec1, vec2, size);
+}
+
+/**
+ * calculates the normal of the given vector
+ * @param vec the vector
+ * @param size the size of the vector
+ * @return the normal of the vector
+ */
+double SimilarityKernels::normal(const double *vec, size_t size)
+{
+    return std::sqrt(kernels().dot(vec, vec, size));
+}
+
+/**
+ * cosine similarity of one query against many rows of a row-major matrix
+ * @param query the query vector of size numFeatures
+ * @param queryNormal the normal of the query
+ * @param matrix the row-major matrix of numFeatures columns
+ * @param normals the normal of every row of the matrix
+ * @param numFeatures number of columns of the matrix
+ * @param rows the rows of the matrix to compare against
+ * @param numRows number of rows to compare against
+ * @param out receives the similarity of every row, in the order of rows
+ */
+void SimilarityKernels::cosineMany(const double *query, double queryNormal, const double *matrix,
+                                   const double *normals, size_t numFeatures, const int *rows, size_t numRows,
+                                   double *out)
+{
+    kernels().cosineMany(query, queryNormal, matrix, normals, numFeatures, rows, numRows, out);
+}
+
+/**
+ * cosine similarity of many queries against many rows of a row-major matrix. Every row is
+ * read once for all of the queries, and the results equal those of cosineMany.
+ * @param queries row-major matrix of numQueries x numFeatures
+ * @param queryNormals the normal of every query
+ * @param numQueries number of queries
+ * @param matrix the row-major matrix of numFeatures columns
+ * @param normals the normal of every row of the matrix
+ * @param numFeatures number of columns of the matrix
+ * @param rows the rows of the matrix to compare against
+ * @param numRows number of rows to compare against
+ * @param out receives numQueries x numRows similarities, row-major by query
+ */
+void SimilarityKernels::cosineBlock(const double *queries, const double *queryNormals, size_t numQueries,
+                                    const double *matrix, const double *normals, size_t numFeatures,
+                                    const int *rows, size_t numRows, double *out)
+{
+    DotKernel dot = kernels().dot;
+    for (size_t i = 0; i < numRows; i++)
+    {
+        const double *row = matrix + (size_t) rows[i] * numFeatures;
+        for (size_t q = 0; q < numQueries; q++)
+        {
+            out[q * numRows + i] = dot(queries + q * numFeatures, row, numFeatures) /
+                                   (queryNormals[q] * normals[rows[i]]);
+        }
+    }
+}
+
+/**
+ * @return the instruction set the kernels run with
+ */
+KernelIsa SimilarityKernels::isa()
+{
+    return kernels().isa;
+}
+
+/**
+ * @return printable name of the instruction set the kernels run with
+ */
+const char *SimilarityKernels::isaName()
+{
+    switch (isa())
+    {
+        case KernelIsa::SSE2:
+            return "sse2";
+        case KernelIsa::AVX2:
+            return "avx2";
+        case KernelIsa::AVX512:
+            return "avx512";
+        default:
+            return "scalar";
+    }
+}
@@ -0,0 +1,97 @@
+/**
+ * @file SimilarityKernels.h
+ * @author  Nimrod Kremer
+ * @version 1.0
+ * @date 26.5.2020
+ *
+ * @brief Vectorized kernels of the cosine similarity
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * Dot products, normals and batched cosine similarity of one query against many
+ * rows of a feature matrix. The instruction set (AVX-512, AVX2, SSE2 or plain
+ * scalar code) is chosen once at runtime by the features of the cpu.
+ * Input  : vectors of doubles
+ * Process: vectorized arithmetic
+ * Output : dot products and similarities.
+ */
+
+#ifndef CPP4_SIMILARITYKERNELS_H
+#define CPP4_SIMILARITYKERNELS_H
+
+#include <cstddef>
+
+/**
+ * the instruction sets the kernels are written for
+ */
+enum class KernelIsa
+{
+    SCALAR,
+    SSE2,
+    AVX2,
+    AVX512
+};
+
+/**
+ * the similarity kernels, dispatched to the best instruction set of the cpu
+ */
+class SimilarityKernels
+{
+public:
+    /**
+     * dot product of the given vectors
+     * @param vec1 vector 1
+     * @param vec2 vector 2
+     * @param size the size of the vectors
+     * @return the dot product of both
+     */
+    static double dot(const double *vec1, const double *vec2, size_t size);
+    /**
+     * calculates the normal of the given vector
+     * @param vec the vector
+     * @param size the size of the vector
+     * @return the normal of the vector
+     */
+    static double normal(const double *vec, size_t size);
+    /**
+     * cosine similarity of one query against many rows of a row-major matrix
+     * @param query the query vector of size numFeatures
+     * @param queryNormal the normal of the query
+     * @param matrix the row-major matrix of numFeatures columns
+     * @param normals the normal of every row of the matrix
+     * @param numFeatures number of columns of the matrix
+     * @param rows the rows of the matrix to compare against
+     * @param numRows number of rows to compare against
+     * @param out receives the similarity of every row, in the order of rows
+     */
+    static void cosineMany(const double *query, double queryNormal, const double *matrix, const double *normals,
+                           size_t numFeatures, const int *rows, size_t numRows, double *out);
+    /**
+     * cosine similarity of many queries against many rows of a row-major matrix. Every row is
+     * read once for all of the queries, and the results equal those of cosineMany.
+     * @param queries row-major matrix of numQueries x numFeatures
+     * @param queryNormals the normal of every query
+     * @param numQueries number of queries
+     * @param matrix the row-major matrix of numFeatures columns
+     * @param normals the normal of every row of the matrix
+     * @param numFeatures number of columns of the matrix
+     * @param rows the rows of the matrix to compare against
+     * @param numRows number of rows to compare against
+     * @param out receives numQueries x numRows similarities, row-major by query
+     */
+    static void cosineBlock(const double *queries, const double *queryNormals, size_t numQueries,
+                            const double *matrix, const double *normals, size_t numFeatures, const int *rows,
+                            size_t numRows, double *out);
+    /**
+     * @return the instruction set the kernels run with
+     */
+    static KernelIsa isa();
+    /**
+     * @return printable name of the instruction set the kernels run with
+     */
+    static const char *isaName();
+};
+
+#endif //CPP4_SIMILARITYKERNELS_H
@@ -0,0 +1,751 @@
+/**
+ * @file SnapshotFile.cpp
+ * @author  Nimrod Kremer
+ * @version 1.0
+ * @date 26.5.2020
+ *
+ * @brief Binary file of a loaded model that is used in place
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * Saves the arrays of the model and of the neighbor lists exactly as they are in
+ * memory, each in its own aligned section. Loading maps the file and points the
+ * arrays into it, so nothing is parsed or copied and the pages are read on demand.
+ * The file is in the byte order of the machine that wrote it.
+ * Input  : a loaded model, or the path of a snapshot
+ * Process: writing or mapping of the sections
+ * Output : the snapshot file, or the model viewing it.
+ */
+
+#include "SnapshotFile.h"
+#include "MappedFile.h"
+#include "TextParser.h"
+#include "ReturnCodes.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <type_traits>
+
+/**
+ * the first bytes of every snapshot
+ */
+#define SNAPSHOT_MAGIC "CPP4SNAP"
+/**
+ * written as is, reads differently on a machine of the other byte order
+ */
+#define BYTE_ORDER_MARK 0x01020304u
+/**
+ * every section starts on a cache line, which is more than any of the arrays needs
+ */
+#define SECTION_ALIGNMENT 64
+/**
+ * How NA looks in the ranks file
+ */
+#define NA "NA"
+
+/**
+ * the sections of the file, in the order they are written
+ */
+enum SectionId
+{
+    MOVIE_CHARS,
+    MOVIE_OFFSETS,
+    MOVIE_SLOTS,
+    USER_CHARS,
+    USER_OFFSETS,
+    USER_SLOTS,
+    FEATURES,
+    NORMALS,
+    RANKED_MOVIES,
+    MOVIE_COLUMN,
+    USER_START,
+    USER_COLUMNS,
+    USER_RANKS,
+    MOVIE_START,
+    MOVIE_USERS,
+    MOVIE_RANKS,
+    NEIGHBORS,
+    COUNTS,
+    NUM_SECTIONS
+};
+
+/**
+ * where a section is in the file
+ */
+typedef struct SectionEntry
+{
+    /**
+     * the first byte of the section from the start of the file
+     */
+    uint64_t offset;
+    /**
+     * number of bytes in the section
+     */
+    uint64_t size;
+} SectionEntry;
+
+/**
+ * the start of the file
+ */
+typedef struct SnapshotHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t numFeatures;
+    int32_t stride;
+    int32_t complete;
+    int32_t columns;
+    int32_t reserved;
+    SectionEntry sections[NUM_SECTIONS];
+} SnapshotHeader;
+
+/**
+ * @return the first multiple of SECTION_ALIGNMENT from offset
+ */
+static uint64_t alignSection(uint64_t offset)
+{
+    return (offset + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT;
+}
+
+/**
+ * writes the model and its neighbor lists, replacing the file as a whole
+ * @param path the path of the snapshot
+ * @param model the loaded model
+ * @param index the neighbor lists of the model
+ * @return success or fail
+ */
+int SnapshotFile::save(const std::string &path, const RecommenderModel &model, const SimilarityIndex &index)
+{
+    // only packed names and ranks can be written as they are, the copy shares the packed arrays
+    RecommenderModel packed = model;
+    packed.compact();
+    const NameTable &movies = packed._movies;
+    const NameTable &users = packed._users;
+
+    const void *data[NUM_SECTIONS];
+    SnapshotHeader header;
+    std::memset(&header, 0, sizeof(header));
+    auto setSection = [&](int id, const void *begin, size_t size)
+    {
+        data[id] = begin;
+        header.sections[id].size = size;
+    };
+    setSection(MOVIE_CHARS, movies._chars.data(), movies._chars.size() * sizeof(char));
+    setSection(MOVIE_OFFSETS, movies._offsets.data(), movies._offsets.size() * sizeof(uint64_t));
+    setSection(MOVIE_SLOTS, movies._slots.data(), movies._slots.size() * sizeof(int));
+    setSection(USER_CHARS, users._chars.data(), users._chars.size() * sizeof(char));
+    setSection(USER_OFFSETS, users._offsets.data(), users._offsets.size() * sizeof(uint64_t));
+    setSection(USER_SLOTS, users._slots.data(), users._slots.size() * sizeof(int));
+    setSection(FEATURES, packed._features.data(), packed._features.size() * sizeof(double));
+    setSection(NORMALS, packed._movieNormal.data(), packed._movieNormal.size() * sizeof(double));
+    setSection(RANKED_MOVIES, packed._rankedMovies.data(), packed._rankedMovies.size() * sizeof(int));
+    setSection(MOVIE_COLUMN, packed._movieColumn.data(), packed._movieColumn.size() * sizeof(int));
+    setSection(USER_START, packed._userStart.data(), packed._userStart.size() * sizeof(uint64_t));
+    setSection(USER_COLUMNS, packed._userColumns.data(), packed._userColumns.size() * sizeof(int));
+    setSection(USER_RANKS, packed._userRanks.data(), packed._userRanks.size() * sizeof(double));
+    setSection(MOVIE_START, packed._movieStart.data(), packed._movieStart.size() * sizeof(uint64_t));
+    setSection(MOVIE_USERS, packed._movieUsers.data(), packed._movieUsers.size() * sizeof(int));
+    setSection(MOVIE_RANKS, packed._movieRanks.data(), packed._movieRanks.size() * sizeof(double));
+    setSection(NEIGHBORS, index._neighbors.data(), index._neighbors.size() * sizeof(Neighbor));
+    setSection(COUNTS, index._counts.data(), index._counts.size() * sizeof(int));
+
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.byteOrder = BYTE_ORDER_MARK;
+    header.numFeatures = packed._numFeatures;
+    header.stride = index._stride;
+    header.complete = index._complete;
+    header.columns = index._columns;
+    uint64_t offset = sizeof(header);
+    for (int id = 0; id < NUM_SECTIONS; id++)
+    {
+        header.sections[id].offset = offset = alignSection(offset);
+        offset += header.sections[id].size;
+    }
+
+    // written aside and renamed, so a reader never maps a half written snapshot
+    std::string temporary = path + ".tmp";
+    {
+        std::ofstream fs(temporary, std::ios::binary | std::ios::trunc);
+        fs.write((const char *) &header, sizeof(header));
+        const char padding[SECTION_ALIGNMENT] = {0};
+        uint64_t written = sizeof(header);
+        for (int id = 0; id < NUM_SECTIONS && fs; id++)
+        {
+            fs.write(padding, header.sections[id].offset - written);
+            fs.write((const char *) data[id], header.sections[id].size);
+            written = header.sections[id].offset + header.sections[id].size;
+        }
+        if (!fs.flush())
+        {
+            std::remove(temporary.c_str());
+            return FAIL;
+        }
+    }
+    if (std::rename(temporary.c_str(), path.c_str()) != 0)
+    {
+        std::remove(temporary.c_str());
+        return FAIL;
+    }
+    return SUCCESS;
+}
+
+/**
+ * maps the snapshot and points the model and the lists into it, the file stays mapped as
+ * long as any of them uses it.
+ * The arrays are never copied. Only the header, the names and the starts of the rows are checked
+ * here, so a load reads a part of the file that grows with the number of users and movies and not
+ * with the ranks. Every row and neighbor list is checked the first time it is read, so a damaged
+ * file still can't make the queries read outside of it.
+ * @param path the path of the snapshot
+ * @param model receives the model
+ * @param index receives the neighbor lists
+ * @param verify true to check every row and list now, and fail on a damaged one
+ * @return fail if the file can't be read or isn't a valid snapshot of this version
+ */
+int SnapshotFile::load(const std::string &path, RecommenderModel &model, SimilarityIndex &index, bool verify)
+{
+    std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+    // the queries read the rows of the users and movies they are asked about
+    if (!file->open(path.c_str(), false) || file->size() < sizeof(SnapshotHeader))
+    {
+        return FAIL;
+    }
+    SnapshotHeader header;
+    std::memcpy(&header, file->data(), sizeof(header));
+    if (std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != SNAPSHOT_VERSION || header.byteOrder != BYTE_ORDER_MARK || header.stride < 0)
+    {
+        return FAIL;
+    }
+    for (const SectionEntry &section : header.sections)
+    {
+        if (section.offset % SECTION_ALIGNMENT != 0 || section.size > file->size() ||
+            section.offset > file->size() - section.size)
+        {
+            return FAIL;
+        }
+    }
+
+    bool valid = true;
+    auto view = [&](int id, auto &array)
+    {
+        typedef typename std::remove_reference<decltype(array[0])>::type Const;
+        typedef typename std::remove_const<Const>::type Element;
+        const SectionEntry &section = header.sections[id];
+        valid = valid && section.size % sizeof(Element) == 0;
+        array.view((const Element *) (file->data() + section.offset), section.size / sizeof(Element), file);
+    };
+    auto viewNames = [&](int charsId, int offsetsId, int slotsId, NameTable &table)
+    {
+        table.clear();
+        view(charsId, table._chars);
+        view(offsetsId, table._offsets);
+        view(slotsId, table._slots);
+        if (!valid || table._offsets.empty() || table._offsets[0] != 0 || table._slots.empty() ||
+            (table._slots.size() & (table._slots.size() - 1)) != 0)
+        {
+            valid = false;
+            return;
+        }
+        for (size_t i = 1; i < table._offsets.size(); i++)
+        {
+            valid = valid && table._offsets[i - 1] <= table._offsets[i];
+        }
+        valid = valid && table._offsets[table._offsets.size() - 1] <= table._chars.size();
+        // an empty slot ends every probe
+        size_t empty = 0;
+        for (int id : table._slots)
+        {
+            valid = valid && id >= NO_ID && id < table.size();
+            empty += id == NO_ID;
+        }
+        valid = valid && empty > 0;
+    };
+
+    model.clear();
+    index.clear();
+    viewNames(MOVIE_CHARS, MOVIE_OFFSETS, MOVIE_SLOTS, model._movies);
+    viewNames(USER_CHARS, USER_OFFSETS, USER_SLOTS, model._users);
+    if (!valid)
+    {
+        model.clear();
+        return FAIL;
+    }
+    size_t numMovies = model._movies.size();
+    size_t numUsers = model._users.size();
+    model._numFeatures = header.numFeatures;
+    view(FEATURES, model._features);
+    view(NORMALS, model._movieNormal);
+    view(RANKED_MOVIES, model._rankedMovies);
+    view(MOVIE_COLUMN, model._movieColumn);
+    view(USER_START, model._userStart);
+    view(USER_COLUMNS, model._userColumns);
+    view(USER_RANKS, model._userRanks);
+    view(MOVIE_START, model._movieStart);
+    view(MOVIE_USERS, model._movieUsers);
+    view(MOVIE_RANKS, model._movieRanks);
+    model._numRanks = model._userColumns.size();
+    index._stride = header.stride;
+    index._complete = header.complete != 0;
+    index._columns = header.columns;
+    view(NEIGHBORS, index._neighbors);
+    view(COUNTS, index._counts);
+
+    valid = valid && model._features.size() == numMovies * model._numFeatures &&
+            model._movieNormal.size() == numMovies && model._movieColumn.size() == numMovies;
+    size_t numColumns = model._rankedMovies.size();
+    for (int movie : model._rankedMovies)
+    {
+        valid = valid && movie >= 0 && (size_t) movie < numMovies;
+    }
+    for (int column : model._movieColumn)
+    {
+        valid = valid && column >= NO_ID && (column == NO_ID || (size_t) column < numColumns);
+    }
+    // every row of both directions is inside the file, what is in the rows is checked when they are read
+    auto validStarts = [&](const Array<uint64_t> &starts, size_t numRows, const Array<int> &ids,
+                           const Array<double> &ranks)
+    {
+        valid = valid && starts.size() == numRows + 1 && starts[0] == 0 && ids.size() == ranks.size() &&
+                starts[numRows] == ids.size();
+        for (size_t row = 0; valid && row < numRows; row++)
+        {
+            valid = starts[row] <= starts[row + 1];
+        }
+    };
+    validStarts(model._userStart, numUsers, model._userColumns, model._userRanks);
+    validStarts(model._movieStart, numMovies, model._movieUsers, model._movieRanks);
+    if (!index._neighbors.empty())
+    {
+        // movies added after the lists were built have none
+        valid = valid && index._counts.size() <= numMovies && index._columns >= 0 &&
+                (size_t) index._columns <= numColumns &&
+                index._neighbors.size() == index._counts.size() * (size_t) index._stride;
+        for (size_t movie = 0; valid && movie < index._counts.size(); movie++)
+        {
+            valid = index._counts[movie] >= 0 && index._counts[movie] <= index._stride;
+        }
+    }
+    else
+    {
+        valid = valid && index._counts.empty();
+    }
+    if (valid)
+    {
+        model._userChecks = std::make_shared<RowChecks>(numUsers, numColumns);
+        model._movieChecks = std::make_shared<RowChecks>(numMovies, numUsers);
+        index._checks = std::make_shared<RowChecks>(index._counts.size(), numMovies);
+    }
+    // reading every row through its check checks all of them
+    for (size_t user = 0; valid && verify && user < numUsers; user++)
+    {
+        valid = model.rankedCount((int) user) == model._userStart[user + 1] - model._userStart[user];
+    }
+    for (size_t movie = 0; valid && verify && movie < numMovies; movie++)
+    {
+        valid = model.raterCount((int) movie) == model._movieStart[movie + 1] - model._movieStart[movie];
+    }
+    for (size_t movie = 0; valid && verify && movie < index._counts.size(); movie++)
+    {
+        valid = index.count((int) movie) == index._counts[movie];
+    }
+    if (!valid)
+    {
+        model.clear();
+        index.clear();
+        return FAIL;
+    }
+    return SUCCESS;
+}
+
+/**
+ * calls visit(name, nameEnd, lineEnd) for every line of a user, in the order of the file
+ * @param begin the first line of a user
+ * @param end the end of the file
+ * @param visit gets the name of the user and the end of the line, returns false to stop
+ * @return false if visit stopped
+ */
+template <typename Visit>
+static bool forEachUser(const char *begin, const char *end, Visit visit)
+{
+    const char *tokenEnd = nullptr;
+    for (const char *line = begin; line < end; )
+    {
+        const char *lineEnd = TextParser::lineEnd(line, end);
+        const char *token = TextParser::nextToken(line, lineEnd, tokenEnd);
+        if (token < lineEnd && !visit(token, tokenEnd, lineEnd))
+        {
+            return false;
+        }
+        line = lineEnd < end ? lineEnd + 1 : end;
+    }
+    return true;
+}
+
+/**
+ * calls visit(column, token, tokenEnd) for every rank of a line that counts, the way
+ * readUserRanks reads a line
+ * @param pos the first rank in the line
+ * @param end the end of the line
+ * @param rankedMovies the movie of every column
+ * @param movieColumn the column of every movie
+ * @param visit gets the column and the token of the rank, returns false to stop
+ * @return false if visit stopped
+ */
+template <typename Visit>
+static bool forEachRank(const char *pos, const char *end, const std::vector<int> &rankedMovies,
+                        const std::vector<int> &movieColumn, Visit visit)
+{
+    const char *tokenEnd = nullptr;
+    size_t column = 0;
+    for (const char *token = TextParser::nextToken(pos, end, tokenEnd); token < end && column < rankedMovies.size();
+         token = TextParser::nextToken(tokenEnd, end, tokenEnd), column++)
+    {
+        // a movie listed twice in the header is ranked by its last column
+        if (TextParser::equals(token, tokenEnd, NA) || movieColumn[rankedMovies[column]] != (int) column)
+        {
+            continue;
+        }
+        if (!visit((int) column, token, tokenEnd))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * writes a snapshot of the text files without loading the ranks into memory.
+ * The snapshot is written in place through a shared mapping, in passes over the ranks file:
+ * the first bounds the users, the second packs their names and counts their ranks, the third
+ * writes the rows of the users where the counts put them. The rows of the movies are then filled
+ * from the rows of the users in chunks of memoryBudget bytes, every chunk sorted by movie in
+ * memory so every movie gets its part of the chunk in one copy. The pages written are released
+ * as the budget fills, so the memory of the process stays bounded while the page cache and the
+ * file hold the rest. The movies and the name index of the users stay in memory or in the page
+ * cache, they are small next to the ranks.
+ * @param path the path of the snapshot
+ * @param moviesAttributesFilePath the path of the movies file
+ * @param userRanksFilePath the path of the ranks file
+ * @param memoryBudget number of bytes of ranks to hold in memory at once
+ * @return fail if a file can't be read or written
+ */
+int SnapshotFile::ingest(const std::string &path, const std::string &moviesAttributesFilePath,
+                         const std::string &userRanksFilePath, size_t memoryBudget)
+{
+    RecommenderModel model;
+    MappedFile file;
+    if (model.readMovies(moviesAttributesFilePath.c_str()) == FAIL || !file.open(userRanksFilePath.c_str()))
+    {
+        return FAIL;
+    }
+    const NameTable &movies = model._movies;
+    size_t numMovies = movies.size();
+    const char *end = file.data() + file.size();
+    const char *headerEnd = TextParser::lineEnd(file.data(), end);
+    const char *tokenEnd = nullptr;
+    std::vector<int> rankedMovies;
+    std::vector<int> movieColumn(numMovies, NO_ID);
+    for (const char *token = TextParser::nextToken(file.data(), headerEnd, tokenEnd); token < headerEnd;
+         token = TextParser::nextToken(tokenEnd, headerEnd, tokenEnd))
+    {
+        int id = movies.find(std::string(token, tokenEnd));
+        if (id == NO_ID)
+        {
+            return FAIL;
+        }
+        movieColumn[id] = (int) rankedMovies.size();
+        rankedMovies.push_back(id);
+    }
+    const char *firstLine = headerEnd < end ? headerEnd + 1 : end;
+    // the lines a pass read are dropped as the budget fills, every pass reads the file again
+    const char *released = file.data();
+    auto releaseLines = [&](const char *lineEnd, bool lastLine)
+    {
+        if ((size_t) (lineEnd - released) >= memoryBudget || lastLine)
+        {
+            file.release(released - file.data(), lineEnd - released);
+            released = lastLine ? file.data() : lineEnd;
+        }
+    };
+
+    // every line may be a new user
+    size_t numLines = 0;
+    size_t nameChars = 0;
+    forEachUser(firstLine, end, [&](const char *name, const char *nameEnd, const char *lineEnd)
+    {
+        numLines++;
+        nameChars += nameEnd - name;
+        releaseLines(lineEnd, false);
+        return true;
+    });
+    releaseLines(end, true);
+    size_t numSlots = 1;
+    while (numSlots < numLines * 2)
+    {
+        numSlots *= 2;
+    }
+
+    SnapshotHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.byteOrder = BYTE_ORDER_MARK;
+    header.numFeatures = model._numFeatures;
+    // the room of every section, the sections of the users get their size once they are known
+    uint64_t capacity[NUM_SECTIONS] = {0};
+    capacity[MOVIE_CHARS] = movies._chars.size() * sizeof(char);
+    capacity[MOVIE_OFFSETS] = movies._offsets.size() * sizeof(uint64_t);
+    capacity[MOVIE_SLOTS] = movies._slots.size() * sizeof(int);
+    capacity[USER_CHARS] = nameChars * sizeof(char);
+    capacity[USER_OFFSETS] = (numLines + 1) * sizeof(uint64_t);
+    capacity[USER_SLOTS] = numSlots * sizeof(int);
+    capacity[FEATURES] = model._features.size() * sizeof(double);
+    capacity[NORMALS] = model._movieNormal.size() * sizeof(double);
+    capacity[RANKED_MOVIES] = rankedMovies.size() * sizeof(int);
+    capacity[MOVIE_COLUMN] = movieColumn.size() * sizeof(int);
+    capacity[USER_START] = (numLines + 1) * sizeof(uint64_t);
+    uint64_t offset = sizeof(header);
+    auto place = [&](int first, int last)
+    {
+        for (int id = first; id <= last; id++)
+        {
+            header.sections[id].offset = offset = alignSection(offset);
+            header.sections[id].size = capacity[id];
+            offset += capacity[id];
+        }
+    };
+    place(MOVIE_CHARS, USER_START);
+
+    std::string temporary = path + ".tmp";
+    std::string linesPath = path + ".lines";
+    MappedOutput out;
+    MappedOutput lines;
+    auto fail = [&]()
+    {
+        out.close();
+        lines.close();
+        std::remove(temporary.c_str());
+        std::remove(linesPath.c_str());
+        return FAIL;
+    };
+    if (!out.create(temporary.c_str()) || !out.resize(offset) || !lines.create(linesPath.c_str()) ||
+        !lines.resize(numLines * sizeof(uint64_t)))
+    {
+        return fail();
+    }
+    auto section = [&](int id)
+    {
+        return out.data() + header.sections[id].offset;
+    };
+    auto copySection = [&](int id, const void *data)
+    {
+        if (capacity[id] > 0)
+        {
+            std::memcpy(section(id), data, capacity[id]);
+        }
+    };
+    copySection(MOVIE_CHARS, movies._chars.data());
+    copySection(MOVIE_OFFSETS, movies._offsets.data());
+    copySection(MOVIE_SLOTS, movies._slots.data());
+    copySection(FEATURES, model._features.data());
+    copySection(NORMALS, model._movieNormal.data());
+    copySection(RANKED_MOVIES, rankedMovies.data());
+    copySection(MOVIE_COLUMN, movieColumn.data());
+
+    // the names are packed and hashed the way NameTable::freeze does, right in the snapshot
+    char *chars = section(USER_CHARS);
+    uint64_t *offsets = (uint64_t *) section(USER_OFFSETS);
+    int *slots = (int *) section(USER_SLOTS);
+    uint64_t *starts = (uint64_t *) section(USER_START);
+    uint64_t *lastLine = (uint64_t *) lines.data();
+    std::fill_n(slots, numSlots, NO_ID);
+    int numUsers = 0;
+    auto findUser = [&](const char *name, size_t length, size_t &slot)
+    {
+        for (slot = NameTable::_hash(name, length) & (numSlots - 1); slots[slot] != NO_ID;
+             slot = (slot + 1) & (numSlots - 1))
+        {
+            int id = slots[slot];
+            if (offsets[id + 1] - offsets[id] == length && std::memcmp(chars + offsets[id], name, length) == 0)
+            {
+                return id;
+            }
+        }
+        return NO_ID;
+    };
+    uint64_t line = 0;
+    forEachUser(firstLine, end, [&](const char *name, const char *nameEnd, const char *lineEnd)
+    {
+        size_t length = nameEnd - name;
+        size_t slot = 0;
+        int user = findUser(name, length, slot);
+        if (user == NO_ID)
+        {
+            user = numUsers++;
+            slots[slot] = user;
+            std::memcpy(chars + offsets[user], name, length);
+            offsets[user + 1] = offsets[user] + length;
+        }
+        // a later line of the same user wins, so its count replaces the count before
+        lastLine[user] = line++;
+        uint64_t count = 0;
+        forEachRank(nameEnd, lineEnd, rankedMovies, movieColumn, [&](int, const char *, const char *)
+        {
+            count++;
+            return true;
+        });
+        starts[user + 1] = count;
+        releaseLines(lineEnd, false);
+        return true;
+    });
+    releaseLines(end, true);
+    for (int user = 0; user < numUsers; user++)
+    {
+        starts[user + 1] += starts[user];
+    }
+    uint64_t numRanks = starts[numUsers];
+
+    capacity[USER_COLUMNS] = numRanks * sizeof(int);
+    capacity[USER_RANKS] = numRanks * sizeof(double);
+    capacity[MOVIE_START] = (numMovies + 1) * sizeof(uint64_t);
+    capacity[MOVIE_USERS] = numRanks * sizeof(int);
+    capacity[MOVIE_RANKS] = numRanks * sizeof(double);
+    uint64_t ranksBegin = alignSection(offset);
+    place(USER_COLUMNS, COUNTS);
+    if (!out.resize(offset))
+    {
+        return fail();
+    }
+    offsets = (uint64_t *) section(USER_OFFSETS);
+    slots = (int *) section(USER_SLOTS);
+    chars = section(USER_CHARS);
+    starts = (uint64_t *) section(USER_START);
+    int *columns = (int *) section(USER_COLUMNS);
+    double *ranks = (double *) section(USER_RANKS);
+    auto releaseRanks = [&]()
+    {
+        out.release(ranksBegin, offset - ranksBegin);
+    };
+
+    // the rows of the users, a line that lost to a later line of its user is skipped
+    line = 0;
+    size_t pending = 0;
+    bool parsed = forEachUser(firstLine, end, [&](const char *name, const char *nameEnd, const char *lineEnd)
+    {
+        size_t slot = 0;
+        int user = findUser(name, nameEnd - name, slot);
+        if (lastLine[user] != line++)
+        {
+            return true;
+        }
+        uint64_t at = starts[user];
+        bool valid = forEachRank(nameEnd, lineEnd, rankedMovies, movieColumn,
+                                 [&](int column, const char *token, const char *tokenEnd)
+        {
+            double rank = 0;
+            if (!TextParser::parseDouble(token, tokenEnd, rank))
+            {
+                return false;
+            }
+            columns[at] = column;
+            ranks[at] = rank;
+            at++;
+            return true;
+        });
+        pending += (at - starts[user]) * (sizeof(int) + sizeof(double));
+        if (pending >= memoryBudget)
+        {
+            releaseRanks();
+            pending = 0;
+        }
+        releaseLines(lineEnd, false);
+        return valid;
+    });
+    releaseLines(end, true);
+    lines.close();
+    std::remove(linesPath.c_str());
+    if (!parsed)
+    {
+        return fail();
+    }
+
+    // the rows of the movies, users ascending within every movie like _buildMovieRanks
+    std::vector<uint64_t> movieStart(numMovies + 1, 0);
+    for (uint64_t i = 0; i < numRanks; i++)
+    {
+        movieStart[rankedMovies[columns[i]] + 1]++;
+    }
+    releaseRanks();
+    for (size_t movie = 0; movie < numMovies; movie++)
+    {
+        movieStart[movie + 1] += movieStart[movie];
+    }
+    std::memcpy(section(MOVIE_START), movieStart.data(), capacity[MOVIE_START]);
+    int *movieUsers = (int *) section(MOVIE_USERS);
+    double *movieRanks = (double *) section(MOVIE_RANKS);
+    std::vector<uint64_t> next(movieStart.begin(), movieStart.end() - 1);
+    uint64_t chunkSize = std::max((size_t) 1, memoryBudget / (sizeof(int) + sizeof(double)));
+    std::vector<uint64_t> chunkStart(numMovies + 1);
+    std::vector<uint64_t> cursor(numMovies);
+    std::vector<int> chunkUsers;
+    std::vector<double> chunkRanks;
+    for (int user = 0; user < numUsers; )
+    {
+        int first = user;
+        while (user < numUsers && (user == first || starts[user + 1] - starts[first] <= chunkSize))
+        {
+            user++;
+        }
+        std::fill(chunkStart.begin(), chunkStart.end(), 0);
+        for (uint64_t i = starts[first]; i < starts[user]; i++)
+        {
+            chunkStart[rankedMovies[columns[i]] + 1]++;
+        }
+        for (size_t movie = 0; movie < numMovies; movie++)
+        {
+            chunkStart[movie + 1] += chunkStart[movie];
+        }
+        std::copy(chunkStart.begin(), chunkStart.end() - 1, cursor.begin());
+        chunkUsers.resize(starts[user] - starts[first]);
+        chunkRanks.resize(starts[user] - starts[first]);
+        for (int chunkUser = first; chunkUser < user; chunkUser++)
+        {
+            for (uint64_t i = starts[chunkUser]; i < starts[chunkUser + 1]; i++)
+            {
+                uint64_t at = cursor[rankedMovies[columns[i]]]++;
+                chunkUsers[at] = chunkUser;
+                chunkRanks[at] = ranks[i];
+            }
+        }
+        for (size_t movie = 0; movie < numMovies; movie++)
+        {
+            uint64_t count = chunkStart[movie + 1] - chunkStart[movie];
+            std::copy_n(chunkUsers.begin() + chunkStart[movie], count, movieUsers + next[movie]);
+            std::copy_n(chunkRanks.begin() + chunkStart[movie], count, movieRanks + next[movie]);
+            next[movie] += count;
+        }
+        releaseRanks();
+    }
+
+    header.sections[USER_CHARS].size = offsets[numUsers];
+    header.sections[USER_OFFSETS].size = (numUsers + 1) * sizeof(uint64_t);
+    header.sections[USER_START].size = (numUsers + 1) * sizeof(uint64_t);
+    std::memcpy(out.data(), &header, sizeof(header));
+    if (!out.sync())
+    {
+        return fail();
+    }
+    out.close();
+    if (std::rename(temporary.c_str(), path.c_str()) != 0)
+    {
+        return fail();
+    }
+    return SUCCESS;
+}
@@ -0,0 +1,79 @@
+/**
+ * @file SnapshotFile.h
+ * @author  Nimrod Kremer
+ * @version 1.0
+ * @date 26.5.2020
+ *
+ * @brief Binary file of a loaded model that is used in place
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * Saves the arrays of the model and of the neighbor lists exactly as they are in
+ * memory, each in its own aligned section. Loading maps the file and points the
+ * arrays into it, so nothing is parsed or copied and the pages are read on demand.
+ * The rows of the ranks and the neighbor lists are checked when they are first read.
+ * The file is in the byte order of the machine that wrote it. A snapshot can also
+ * be written straight from the text files in a few passes over the ranks, for ranks
+ * that don't fit in memory.
+ * Input  : a loaded model or the text files, or the path of a snapshot
+ * Process: writing or mapping of the sections
+ * Output : the snapshot file, or the model viewing it.
+ */
+
+#ifndef CPP4_SNAPSHOTFILE_H
+#define CPP4_SNAPSHOTFILE_H
+
+#include <string>
+#include "RecommenderModel.h"
+#include "SimilarityIndex.h"
+
+/**
+ * the version of the layout written by save, a file of another version isn't loaded
+ */
+#define SNAPSHOT_VERSION 3
+/**
+ * default number of bytes of ranks ingest holds in memory at once
+ */
+#define DEFAULT_INGEST_BUDGET ((size_t) 64 * 1024 * 1024)
+
+/**
+ * saves and loads snapshot files
+ */
+class SnapshotFile
+{
+public:
+    /**
+     * writes the model and its neighbor lists, replacing the file as a whole
+     * @param path the path of the snapshot
+     * @param model the loaded model
+     * @param index the neighbor lists of the model
+     * @return success or fail
+     */
+    static int save(const std::string &path, const RecommenderModel &model, const SimilarityIndex &index);
+    /**
+     * maps the snapshot and points the model and the lists into it, the file stays mapped as
+     * long as any of them uses it. The rows are checked when they are first read
+     * @param path the path of the snapshot
+     * @param model receives the model
+     * @param index receives the neighbor lists
+     * @param verify true to check every row and list now, which reads the whole file
+     * @return fail if the file can't be read or isn't a valid snapshot of this version
+     */
+    static int load(const std::string &path, RecommenderModel &model, SimilarityIndex &index,
+                    bool verify = false);
+    /**
+     * writes a snapshot of the text files without loading the ranks into memory, the snapshot
+     * has no neighbor lists. Reads the files like readMovies and readUserRanks do
+     * @param path the path of the snapshot
+     * @param moviesAttributesFilePath the path of the movies file
+     * @param userRanksFilePath the path of the ranks file
+     * @param memoryBudget number of bytes of ranks to hold in memory at once
+     * @return fail if a file can't be read or written
+     */
+    static int ingest(const std::string &path, const std::string &moviesAttributesFilePath,
+                      const std::string &userRanksFilePath, size_t memoryBudget = DEFAULT_INGEST_BUDGET);
+};
+
+#endif //CPP4_SNAPSHOTFILE_H
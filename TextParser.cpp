@@ -0,0 +1,188 @@
+/**
+ * @file TextParser.cpp
+ * @author  Nimrod Kremer
+ * @version 1.0
+ * @date 26.5.2020
+ *
+ * @brief Tokenizing and number parsing of text in memory
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * Splits text into lines and white space separated tokens in place, with no
+ * copies, and parses numbers with a fast path that gives the same double as
+ * std::stod.
+ * Input  : ranges of characters
+ * Process: scanning
+ * Output : tokens and numbers.
+ */
+
+#include "TextParser.h"
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+/**
+ * the most significant digits the fast path handles, every such number is exact in a double
+ */
+#define FAST_DIGITS 15
+/**
+ * the largest power of 10 that is exact in a double
+ */
+#define FAST_EXPONENT 22
+
+/**
+ * powers of 10 that are exact in a double
+ */
+static const double POWERS_OF_10[FAST_EXPONENT + 1] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/**
+ * @return true for the white space that separates tokens, the way std::istream sees it
+ */
+static inline bool isBlank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f';
+}
+
+/**
+ * @return true for a decimal digit
+ */
+static inline bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+/**
+ * @param pos start of a line
+ * @param end end of the text
+ * @return the end of the line, the new line or end
+ */
+const char *TextParser::lineEnd(const char *pos, const char *end)
+{
+    const void *newLine = std::memchr(pos, '\n', end - pos);
+    return newLine == nullptr ? end : (const char *) newLine;
+}
+
+/**
+ * finds the next token of a line
+ * @param pos where to start looking
+ * @param end end of the line
+ * @param tokenEnd receives the end of the token
+ * @return the start of the token, end if there are no more tokens
+ */
+const char *TextParser::nextToken(const char *pos, const char *end, const char *&tokenEnd)
+{
+    while (pos < end && isBlank(*pos))
+    {
+        pos++;
+    }
+    tokenEnd = pos;
+    while (tokenEnd < end && !isBlank(*tokenEnd))
+    {
+        tokenEnd++;
+    }
+    return pos;
+}
+
+/**
+ * @param begin start of the token
+ * @param end end of the token
+ * @param word a null terminated word
+ * @return true if the token is the word
+ */
+bool TextParser::equals(const char *begin, const char *end, const char *word)
+{
+    size_t length = std::strlen(word);
+    return (size_t) (end - begin) == length && std::memcmp(begin, word, length) == 0;
+}
+
+/**
+ * parses a whole token as a number, the way std::stod does.
+ * Plain decimal numbers with at most FAST_DIGITS significant digits and a small exponent are
+ * an exact integer times or divided by an exact power of 10, which is rounded correctly by a
+ * single multiplication or division. Everything else goes to strtod.
+ * @param begin start of the token
+ * @param end end of the token
+ * @param value receives the number
+ * @return false if the token isn't a number
+ */
+bool TextParser::parseDouble(const char *begin, const char *end, double &value)
+{
+    const char *pos = begin;
+    bool negative = false;
+    if (pos < end && (*pos == '-' || *pos == '+'))
+    {
+        negative = *pos == '-';
+        pos++;
+    }
+
+    uint64_t mantissa = 0;
+    int significant = 0;
+    int exponent = 0;
+    bool hasDigits = false;
+    for (; pos < end && isDigit(*pos); pos++)
+    {
+        mantissa = mantissa * 10 + (*pos - '0');
+        significant += mantissa != 0;
+        hasDigits = true;
+        if (significant > FAST_DIGITS)
+        {
+            break;
+        }
+    }
+    if (pos < end && *pos == '.' && significant <= FAST_DIGITS)
+    {
+        for (pos++; pos < end && isDigit(*pos); pos++)
+        {
+            mantissa = mantissa * 10 + (*pos - '0');
+            significant += mantissa != 0;
+            exponent--;
+            hasDigits = true;
+            if (significant > FAST_DIGITS)
+            {
+                break;
+            }
+        }
+    }
+    if (pos < end && (*pos == 'e' || *pos == 'E') && hasDigits && significant <= FAST_DIGITS)
+    {
+        const char *exponentStart = ++pos;
+        bool negativeExponent = false;
+        if (pos < end && (*pos == '-' || *pos == '+'))
+        {
+            negativeExponent = *pos == '-';
+            pos++;
+        }
+        int written = 0;
+        for (; pos < end && isDigit(*pos) && written < 1000; pos++)
+        {
+            written = written * 10 + (*pos - '0');
+        }
+        if (pos == exponentStart || !isDigit(pos[-1]))
+        {
+            // "1e" or "1e+" is left for strtod, it reads them as 1
+            pos = begin;
+        }
+        exponent += negativeExponent ? -written : written;
+    }
+
+    if (pos == end && hasDigits && significant <= FAST_DIGITS && exponent >= -FAST_EXPONENT &&
+        exponent <= FAST_EXPONENT)
+    {
+        double result = (double) mantissa;
+        result = exponent < 0 ? result / POWERS_OF_10[-exponent] : result * POWERS_OF_10[exponent];
+        value = negative ? -result : result;
+        return true;
+    }
+
+    // everything the fast path doesn't know, like long numbers, hex, inf and nan
+    std::string token(begin, end);
+    char *parsedEnd = nullptr;
+    value = std::strtod(token.c_str(), &parsedEnd);
+    return parsedEnd != token.c_str();
+}
@@ -0,0 +1,63 @@
+/**
+ * @file TextParser.h
+ * @author  Nimrod Kremer
+ * @version 1.0
+ * @date 26.5.2020
+ *
+ * @brief Tokenizing and number parsing of text in memory
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * Splits text into lines and white space separated tokens in place, with no
+ * copies, and parses numbers with a fast path that gives the same double as
+ * std::stod.
+ * Input  : ranges of characters
+ * Process: scanning
+ * Output : tokens and numbers.
+ */
+
+#ifndef CPP4_TEXTPARSER_H
+#define CPP4_TEXTPARSER_H
+
+#include <cstddef>
+
+/**
+ * scanning of text in memory, a range is [begin, end)
+ */
+class TextParser
+{
+public:
+    /**
+     * @param pos start of a line
+     * @param end end of the text
+     * @return the end of the line, the new line or end
+     */
+    static const char *lineEnd(const char *pos, const char *end);
+    /**
+     * finds the next token of a line
+     * @param pos where to start looking
+     * @param end end of the line
+     * @param tokenEnd receives the end of the token
+     * @return the start of the token, end if there are no more tokens
+     */
+    static const char *nextToken(const char *pos, const char *end, const char *&tokenEnd);
+    /**
+     * parses a whole token as a number, the way std::stod does
+     * @param begin start of the token
+     * @param end end of the token
+     * @param value receives the number
+     * @return false if the token isn't a number
+     */
+    static bool parseDouble(const char *begin, const char *end, double &value);
+    /**
+     * @param begin start of the token
+     * @param end end of the token
+     * @param word a null terminated word
+     * @return true if the token is the word
+     */
+    static bool equals(const char *begin, const char *end, const char *word);
+};
+
+#endif //CPP4_TEXTPARSER_H
@@ -0,0 +1,169 @@
+/**
+ * @file ThreadPool.cpp
+ * @author  Nimrod Kremer
+ * @version 1.0
+ * @date 26.5.2020
+ *
+ * @brief Work stealing pool of threads
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * Every worker has its own queue of tasks, and a worker that runs out of tasks
+ * steals from the queues of the others. The thread that waits for the tasks
+ * runs tasks as well, so a pool of one thread runs everything in the caller.
+ * Input  : tasks
+ * Process: runs the tasks on all of the threads
+ * Output : returns when the tasks are done.
+ */
+
+#include "ThreadPool.h"
+
+/**
+ * creates the pool
+ * @param numThreads number of threads running tasks including the waiting one, 0 for all of the cores
+ */
+ThreadPool::ThreadPool(int numThreads) : _queued(0), _next(0)
+{
+    if (numThreads <= 0)
+    {
+        numThreads = std::max(1, (int) std::thread::hardware_concurrency());
+    }
+    for (int i = 0; i < numThreads; i++)
+    {
+        _queues.emplace_back(new TaskQueue());
+    }
+    for (int i = 0; i < numThreads - 1; i++)
+    {
+        _threads.emplace_back(&ThreadPool::_workerLoop, this, (size_t) i);
+    }
+}
+
+/**
+ * stops the workers, the tasks left in the queues are not run
+ */
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(_sleepLock);
+        _stop = true;
+    }
+    _wake.notify_all();
+    for (auto &thread: _threads)
+    {
+        thread.join();
+    }
+}
+
+/**
+ * takes a task, first from the back of the given queue and then from the front of the others
+ * @param self the queue of the calling thread
+ * @param task receives the task
+ * @return false if there are no tasks
+ */
+bool ThreadPool::_takeTask(size_t self, std::function<void()> &task)
+{
+    for (size_t i = 0; i < _queues.size(); i++)
+    {
+        TaskQueue &queue = *_queues[(self + i) % _queues.size()];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        if (queue.tasks.empty())
+        {
+            continue;
+        }
+        if (i == 0)
+        {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        }
+        else
+        {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+        _queued--;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * the loop of a worker thread
+ * @param self the queue of the worker
+ */
+void ThreadPool::_workerLoop(size_t self)
+{
+    std::function<void()> task;
+    while (true)
+    {
+        if (_takeTask(self, task))
+        {
+            task();
+            task = nullptr;
+            continue;
+        }
+        std::unique_lock<std::mutex> guard(_sleepLock);
+        _wake.wait(guard, [this]
+        { return _stop || _queued > 0; });
+        if (_stop)
+        {
+            return;
+        }
+    }
+}
+
+/**
+ * runs body(i) for every i in [0, count) on the pool and returns when all of them are done.
+ * The calling thread runs tasks too while it waits, so waiting from inside a task can't
+ * leave the pool without threads.
+ * @param count number of calls
+ * @param body the function to call
+ */
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)> &body)
+{
+    if (_threads.empty() || count == 1)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            body(i);
+        }
+        return;
+    }
+
+    auto remaining = std::make_shared<std::atomic<size_t>>(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        TaskQueue &queue = *_queues[_next++ % _queues.size()];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        queue.tasks.emplace_back([this, &body, remaining, i]
+                                 {
+                                     body(i);
+                                     if (--*remaining == 0)
+                                     {
+                                         std::lock_guard<std::mutex> sleepGuard(_sleepLock);
+                                         _done.notify_all();
+                                     }
+                                 });
+        _queued++;
+    }
+    {
+        std::lock_guard<std::mutex> guard(_sleepLock);
+    }
+    _wake.notify_all();
+
+    size_t self = _queues.size() - 1;
+    std::function<void()> task;
+    while (*remaining > 0)
+    {
+        if (_takeTask(self, task))
+        {
+            task();
+            task = nullptr;
+            continue;
+        }
+        std::unique_lock<std::mutex> guard(_sleepLock);
+        _done.wait(guard, [this, &remaining]
+        { return *remaining == 0 || _queued > 0; });
+    }
+}
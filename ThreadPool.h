@@ -0,0 +1,119 @@
+/**
+ * @file ThreadPool.h
+ * @author  Nimrod Kremer
+ * @version 1.0
+ * @date 26.5.2020
+ *
+ * @brief Work stealing pool of threads
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * Every worker has its own queue of tasks, and a worker that runs out of tasks
+ * steals from the queues of the others. The thread that waits for the tasks
+ * runs tasks as well, so a pool of one thread runs everything in the caller.
+ * Input  : tasks
+ * Process: runs the tasks on all of the threads
+ * Output : returns when the tasks are done.
+ */
+
+#ifndef CPP4_THREADPOOL_H
+#define CPP4_THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * pool of threads running tasks with work stealing
+ */
+class ThreadPool
+{
+private:
+    /**
+     * the queue of tasks of one worker
+     */
+    typedef struct TaskQueue
+    {
+        std::mutex lock;
+        std::deque<std::function<void()>> tasks;
+    } TaskQueue;
+    /**
+     * one queue for every thread, the last one belongs to the threads that wait on the pool
+     */
+    std::vector<std::unique_ptr<TaskQueue>> _queues;
+    /**
+     * the worker threads
+     */
+    std::vector<std::thread> _threads;
+    /**
+     * guards the sleeping of the threads
+     */
+    std::mutex _sleepLock;
+    /**
+     * wakes the workers when tasks are added
+     */
+    std::condition_variable _wake;
+    /**
+     * wakes the waiting threads when tasks are done
+     */
+    std::condition_variable _done;
+    /**
+     * number of tasks in the queues
+     */
+    std::atomic<size_t> _queued;
+    /**
+     * the queue the next task goes to
+     */
+    std::atomic<size_t> _next;
+    /**
+     * set when the pool is destroyed
+     */
+    bool _stop = false;
+    /**
+     * takes a task, first from the given queue and then from the others
+     * @param self the queue of the calling thread
+     * @param task receives the task
+     * @return false if there are no tasks
+     */
+    bool _takeTask(size_t self, std::function<void()> &task);
+    /**
+     * the loop of a worker thread
+     * @param self the queue of the worker
+     */
+    void _workerLoop(size_t self);
+public:
+    /**
+     * creates the pool
+     * @param numThreads number of threads running tasks including the waiting one, 0 for all of the cores
+     */
+    explicit ThreadPool(int numThreads = 0);
+    /**
+     * stops the workers, the tasks left in the queues are not run
+     */
+    ~ThreadPool();
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+    /**
+     * @return number of threads running tasks including the waiting one
+     */
+    int size() const
+    {
+        return (int) _threads.size() + 1;
+    }
+    /**
+     * runs body(i) for every i in [0, count) on the pool and returns when all of them are done.
+     * May be called from inside a task.
+     * @param count number of calls
+     * @param body the function to call
+     */
+    void parallelFor(size_t count, const std::function<void(size_t)> &body);
+};
+
+#endif //CPP4_THREADPOOL_H
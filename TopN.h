@@ -0,0 +1,128 @@
+/**
+ * @file TopN.h
+ * @author  Nimrod Kremer
+ * @version 1.0
+ * @date 26.5.2020
+ *
+ * @brief Bounded selection of the best items of a stream
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * Keeps the n best items seen so far in a heap whose top is the worst of them, so
+ * every item costs O(log n) and nothing but the n items is ever stored.
+ * Input  : items one by one
+ * Process: bounded heap
+ * Output : the n best items from the best.
+ */
+
+#ifndef CPP4_TOPN_H
+#define CPP4_TOPN_H
+
+#include <algorithm>
+#include <memory>
+#include <utility>
+#include <vector>
+
+/**
+ * orders scored candidates from the highest score, a tie goes to the smaller index
+ */
+typedef struct BetterScore
+{
+    bool operator()(const std::pair<double, int> &a, const std::pair<double, int> &b) const
+    {
+        return a.first > b.first || (a.first == b.first && a.second < b.second);
+    }
+} BetterScore;
+
+/**
+ * keeps the n best items pushed to it
+ * @tparam T the items
+ * @tparam Better strict order, true if the first item is better than the second
+ * @tparam Allocator the allocator of the kept items
+ */
+template <typename T, typename Better = BetterScore, typename Allocator = std::allocator<T>>
+class TopN
+{
+private:
+    /**
+     * number of items to keep
+     */
+    size_t _capacity;
+    /**
+     * the order of the items
+     */
+    Better _better;
+    /**
+     * the kept items, a heap whose top is the worst of them
+     */
+    std::vector<T, Allocator> _heap;
+public:
+    /**
+     * creates an empty selection
+     * @param capacity number of items to keep
+     * @param better the order of the items
+     * @param allocator the allocator of the kept items
+     */
+    explicit TopN(size_t capacity, Better better = Better(), const Allocator &allocator = Allocator())
+            : _capacity(capacity), _better(better), _heap(allocator)
+    {
+        _heap.reserve(capacity);
+    }
+    /**
+     * the capacity of a selection is reserved up front, so it is bound by the items that can be pushed
+     * @param n number of items asked for, none if below 0
+     * @param candidates most items that will be pushed
+     * @return the capacity that keeps the n best of the candidates
+     */
+    static size_t capacityFor(long n, size_t candidates)
+    {
+        return n <= 0 ? 0 : std::min((size_t) n, candidates);
+    }
+    /**
+     * offers an item, it is kept if it is better than the worst kept item
+     * @param item the item
+     */
+    void push(const T &item)
+    {
+        if (_heap.size() < _capacity)
+        {
+            _heap.push_back(item);
+            std::push_heap(_heap.begin(), _heap.end(), _better);
+        }
+        else if (_capacity > 0 && _better(item, _heap.front()))
+        {
+            std::pop_heap(_heap.begin(), _heap.end(), _better);
+            _heap.back() = item;
+            std::push_heap(_heap.begin(), _heap.end(), _better);
+        }
+    }
+    /**
+     * @return number of kept items
+     */
+    size_t size() const
+    {
+        return _heap.size();
+    }
+    /**
+     * sorts the kept items, after that no more items may be pushed until clear
+     * @return the kept items from the best
+     */
+    std::vector<T, Allocator> &sorted()
+    {
+        std::sort_heap(_heap.begin(), _heap.end(), _better);
+        return _heap;
+    }
+    /**
+     * removes the kept items
+     * @param capacity the new number of items to keep
+     */
+    void clear(size_t capacity)
+    {
+        _heap.clear();
+        _capacity = capacity;
+    }
+};
+
+#endif //CPP4_TOPN_H
@@ -0,0 +1,237 @@
+/**
+ * @file UserNeighborIndex.cpp
+ * @author  Nimrod Kremer
+ * @version 1.0
+ * @date 26.5.2020
+ *
+ * @brief The most similar users of every user, for the user based CF
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * The centered dot product of two users is split so that only the raw ranks of the
+ * other user are needed while walking the raters of a movie:
+ * sum (a - avgA)(b - avgB) = sum (a - avgA) b - avgB sum (a - avgA), both sums over
+ * the movies both ranked. The average of the other user is applied once at the end.
+ * Input  : the loaded model and the length of the lists
+ * Process: summing the centered ranks of the co-raters
+ * Output : the most similar users of every user, from the most similar.
+ */
+
+#include "UserNeighborIndex.h"
+#include "TopN.h"
+#include <chrono>
+#include <cmath>
+
+/**
+ * number of users a task of the build finds the neighbors of
+ */
+#define BUILD_CHUNK 64
+
+/**
+ * keeps the most similar users in the scratch memory of the thread
+ */
+typedef TopN<std::pair<double, int>, BetterScore, ScratchAllocator<std::pair<double, int>>> ScratchUserTopN;
+
+/**
+ * removes the centerings and the lists
+ */
+void UserNeighborIndex::clear()
+{
+    _stride = 0;
+    _numUsers = 0;
+    _centerings.reset();
+    _neighbors.clear();
+    _counts.clear();
+    _listsVersion = 0;
+    _stats = SimilarityBuildStats();
+}
+
+/**
+ * finds the center and the length of the ranks of the user. A user whose ranks didn't change since
+ * the build is found once and kept, two threads that find it at once find the same
+ * @param model the loaded model
+ * @param user the id of the user
+ * @param average receives the average rank of the user
+ * @param normal receives the normal of the ranks of the user centered around the average
+ */
+void UserNeighborIndex::centering(const RecommenderModel &model, int user, double &average, double &normal) const
+{
+    bool built = _built(model, user);
+    UserCentering *kept = built ? _centerings.get() + user : nullptr;
+    if (built && kept->found.load(std::memory_order_acquire))
+    {
+        average = kept->average.load(std::memory_order_relaxed);
+        normal = kept->normal.load(std::memory_order_relaxed);
+        return;
+    }
+    average = model.averageRank(user);
+    const double *ranks = model.userRanks(user);
+    double sum = 0;
+    for (size_t r = 0; r < model.rankedCount(user); r++)
+    {
+        sum += (ranks[r] - average) * (ranks[r] - average);
+    }
+    normal = std::sqrt(sum);
+    if (built)
+    {
+        kept->average.store(average, std::memory_order_relaxed);
+        kept->normal.store(normal, std::memory_order_relaxed);
+        kept->found.store(true, std::memory_order_release);
+    }
+}
+
+/**
+ * finds the k users most similar to the user by walking the raters of its movies. Only the
+ * users that share a movie with it are ever touched
+ * @param model the loaded model
+ * @param user the id of the user
+ * @param k number of users to find
+ * @param pairs receives number of users the user shares a movie with
+ * @return the neighbors from the most similar, in the scratch memory of the thread
+ */
+ScratchVector<UserNeighbor> UserNeighborIndex::_find(const RecommenderModel &model, int user, int k,
+                                                     size_t &pairs) const
+{
+    ScratchVector<UserNeighbor> found;
+    double average = 0;
+    double normal = 0;
+    centering(model, user, average, normal);
+    pairs = 0;
+    if (k <= 0 || !(normal > 0))
+    {
+        // a user that ranked everything the same has no direction to be similar in
+        return found;
+    }
+    size_t numUsers = (size_t) model.users().size();
+    ScratchVector<double> centeredDot(numUsers, 0.0);
+    ScratchVector<double> centeredSum(numUsers, 0.0);
+    ScratchVector<char> isTouched(numUsers, 0);
+    ScratchVector<int> touched;
+    const Array<int> &ranked = model.rankedMovies();
+    const int *columns = model.rankedColumns(user);
+    const double *ranks = model.userRanks(user);
+    for (size_t r = 0; r < model.rankedCount(user); r++)
+    {
+        double centered = ranks[r] - average;
+        int movie = ranked[columns[r]];
+        const int *raters = model.raters(movie);
+        const double *raterRanks = model.raterRanks(movie);
+        for (size_t i = 0; i < model.raterCount(movie); i++)
+        {
+            int other = raters[i];
+            if (other == user)
+            {
+                continue;
+            }
+            if (!isTouched[other])
+            {
+                isTouched[other] = 1;
+                touched.push_back(other);
+            }
+            centeredDot[other] += centered * raterRanks[i];
+            centeredSum[other] += centered;
+        }
+    }
+    pairs = touched.size();
+
+    ScratchUserTopN best(ScratchUserTopN::capacityFor(k, touched.size()));
+    for (int other: touched)
+    {
+        double otherAverage = 0;
+        double otherNormal = 0;
+        centering(model, other, otherAverage, otherNormal);
+        if (!(otherNormal > 0))
+        {
+            continue;
+        }
+        double similarity = (centeredDot[other] - otherAverage * centeredSum[other]) / (normal * otherNormal);
+        // kept as a float, so a similarity too small for one is none
+        if ((float) similarity > 0)
+        {
+            best.push({similarity, other});
+        }
+    }
+    for (auto &it: best.sorted())
+    {
+        found.push_back({it.second, (float) it.first});
+    }
+    return found;
+}
+
+/**
+ * makes room for the centerings of all of the users and finds their lists of neighbors. Without
+ * lists no rank is read, the centerings are found by the queries. Every list is found on its own,
+ * so the users are spread on the threads and the result doesn't depend on how
+ * @param model the loaded model
+ * @param listSize number of most similar users to keep for every user, 0 keeps no lists
+ * @param pool the threads to build with
+ */
+void UserNeighborIndex::build(const RecommenderModel &model, int listSize, ThreadPool &pool)
+{
+    clear();
+    size_t numUsers = (size_t) model.users().size();
+    if (numUsers == 0)
+    {
+        return;
+    }
+    auto start = std::chrono::steady_clock::now();
+    _centerings.reset(new UserCentering[numUsers](), std::default_delete<UserCentering[]>());
+    _numUsers = numUsers;
+    if (listSize <= 0 || numUsers < 2)
+    {
+        return;
+    }
+
+    _stride = (int) std::min((size_t) listSize, numUsers - 1);
+    std::vector<UserNeighbor> neighbors(numUsers * _stride, UserNeighbor{NO_ID, 0});
+    std::vector<int> counts(numUsers, 0);
+    size_t numChunks = (numUsers + BUILD_CHUNK - 1) / BUILD_CHUNK;
+    std::vector<size_t> chunkPairs(numChunks, 0);
+    pool.parallelFor(numChunks, [&](size_t chunk)
+    {
+        size_t end = std::min(numUsers, (chunk + 1) * BUILD_CHUNK);
+        for (size_t user = chunk * BUILD_CHUNK; user < end; user++)
+        {
+            ScratchScope scope;
+            size_t pairs = 0;
+            ScratchVector<UserNeighbor> found = _find(model, (int) user, _stride, pairs);
+            std::copy(found.begin(), found.end(), neighbors.begin() + user * _stride);
+            counts[user] = (int) found.size();
+            chunkPairs[chunk] += pairs;
+        }
+    });
+    for (size_t pairs: chunkPairs)
+    {
+        _stats.pairs += pairs;
+    }
+    _neighbors.assign(std::move(neighbors));
+    _counts.assign(std::move(counts));
+    _listsVersion = model.ranksVersion();
+    _stats.threads = pool.size();
+    _stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * finds the k users most similar to the user. The list of the user is enough if no rank changed
+ * since the build and the list has room for k, or holds every user it shares a positive
+ * similarity with
+ * @param model the loaded model
+ * @param user the id of the user
+ * @param k number of users to find
+ * @return the neighbors from the most similar, a tie goes to the smaller id, in the scratch
+ * memory of the thread
+ */
+ScratchVector<UserNeighbor> UserNeighborIndex::neighbors(const RecommenderModel &model, int user, int k) const
+{
+    bool listed = _stride > 0 && model.ranksVersion() == _listsVersion && (size_t) user < _numUsers;
+    if (listed && (k <= _stride || _counts[user] < _stride))
+    {
+        const UserNeighbor *list = _neighbors.data() + (size_t) user * _stride;
+        size_t count = std::min((size_t) std::max(k, 0), (size_t) _counts[user]);
+        return ScratchVector<UserNeighbor>(list, list + count);
+    }
+    size_t pairs = 0;
+    return _find(model, user, k, pairs);
+}
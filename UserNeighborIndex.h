@@ -0,0 +1,153 @@
+/**
+ * @file UserNeighborIndex.h
+ * @author  Nimrod Kremer
+ * @version 1.0
+ * @date 26.5.2020
+ *
+ * @brief The most similar users of every user, for the user based CF
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * Two users are as similar as the cosine of their ranks centered around their
+ * average ranks. Only the users that ranked a movie the user ranked can be similar
+ * to it, so the similarities of a user are summed by walking the raters of its
+ * movies and never the users that share nothing with it. The lists of all of the
+ * users may be found once on the threads, or the list of a user on every query.
+ * Input  : the loaded model and the length of the lists
+ * Process: summing the centered ranks of the co-raters
+ * Output : the most similar users of every user, from the most similar.
+ */
+
+#ifndef CPP4_USERNEIGHBORINDEX_H
+#define CPP4_USERNEIGHBORINDEX_H
+
+#include <atomic>
+#include <memory>
+#include "RecommenderModel.h"
+#include "SimilarityIndex.h"
+#include "ScratchArena.h"
+#include "ThreadPool.h"
+
+/**
+ * a user with its similarity to the owner of the list
+ */
+typedef struct UserNeighbor
+{
+    int user;
+    float similarity;
+} UserNeighbor;
+
+/**
+ * the center and the length of the ranks of a user, found the first time they are needed
+ */
+typedef struct UserCentering
+{
+    std::atomic<double> average;
+    std::atomic<double> normal;
+    /**
+     * set after the average and the normal were stored
+     */
+    std::atomic<bool> found;
+} UserCentering;
+
+/**
+ * the most similar users of every user
+ */
+class UserNeighborIndex
+{
+private:
+    /**
+     * the room every user has in _neighbors, 0 if the lists weren't built
+     */
+    int _stride = 0;
+    /**
+     * number of users the centerings and the lists were built for
+     */
+    size_t _numUsers = 0;
+    /**
+     * the centering of every user, filled by the queries so that a load reads no ranks unless it
+     * builds the lists. Shared by the copies of the index
+     */
+    std::shared_ptr<UserCentering> _centerings;
+    /**
+     * users x stride neighbors, the most similar first
+     */
+    Array<UserNeighbor> _neighbors;
+    /**
+     * number of neighbors in the list of every user
+     */
+    Array<int> _counts;
+    /**
+     * the version of the ranks the lists were found with, a change of any rank may change the
+     * similarities in the lists of users whose ranks didn't change
+     */
+    uint64_t _listsVersion = 0;
+    SimilarityBuildStats _stats;
+    /**
+     * @param model the loaded model
+     * @param user the id of the user
+     * @return true if the user was built and its ranks didn't change since
+     */
+    bool _built(const RecommenderModel &model, int user) const
+    {
+        return (size_t) user < _numUsers && model.userVersion(user) == 0;
+    }
+    /**
+     * finds the k users most similar to the user by walking the raters of its movies
+     * @param model the loaded model
+     * @param user the id of the user
+     * @param k number of users to find
+     * @param pairs receives number of users the user shares a movie with
+     * @return the neighbors from the most similar, in the scratch memory of the thread
+     */
+    ScratchVector<UserNeighbor> _find(const RecommenderModel &model, int user, int k, size_t &pairs) const;
+public:
+    /**
+     * makes room for the centerings of all of the users and finds their lists of neighbors. The
+     * result doesn't depend on the number of threads of the pool
+     * @param model the loaded model
+     * @param listSize number of most similar users to keep for every user, 0 keeps no lists
+     * @param pool the threads to build with
+     */
+    void build(const RecommenderModel &model, int listSize, ThreadPool &pool);
+    /**
+     * removes the centerings and the lists
+     */
+    void clear();
+    /**
+     * @return number of most similar users kept for every user
+     */
+    int listSize() const
+    {
+        return _stride;
+    }
+    /**
+     * @return how long the last build took
+     */
+    const SimilarityBuildStats &buildStats() const
+    {
+        return _stats;
+    }
+    /**
+     * finds the center and the length of the ranks of the user
+     * @param model the loaded model
+     * @param user the id of the user
+     * @param average receives the average rank of the user
+     * @param normal receives the normal of the ranks of the user centered around the average
+     */
+    void centering(const RecommenderModel &model, int user, double &average, double &normal) const;
+    /**
+     * finds the k users most similar to the user, from its list if the list is enough and from
+     * the raters of its movies if it isn't. Only users with a positive similarity are neighbors
+     * @param model the loaded model
+     * @param user the id of the user
+     * @param k number of users to find
+     * @return the neighbors from the most similar, a tie goes to the smaller id, in the scratch
+     * memory of the thread
+     */
+    ScratchVector<UserNeighbor> neighbors(const RecommenderModel &model, int user, int k) const;
+};
+
+#endif //CPP4_USERNEIGHBORINDEX_H
@@ -0,0 +1,163 @@
+/**
+ * @file AllocationTest.cpp
+ * @author  Nimrod Kremer
+ * @version 1.0
+ * @date 26.5.2020
+ *
+ * @brief Checks that the queries of a warm system make no heap allocation
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * Every allocation of the process is counted. The queries draw their temporaries
+ * from the scratch memory of their thread, which grows on the first queries and is
+ * reused after, so a second pass over the same queries must allocate nothing. The
+ * cache of recommendations is off so that every query is calculated.
+ * Input  : the directory to write the data in
+ * Process: counting the allocations of the second pass of the queries
+ * Output : 0 if every check passed.
+ */
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include "RecommenderSystem.h"
+#include "TestUtils.h"
+
+/**
+ * number of movies the CF queries check with
+ */
+#define K 5
+/**
+ * number of movies the top queries recommend
+ */
+#define N 3
+/**
+ * number of passes over the queries before the counted one
+ */
+#define WARMUP 2
+
+#ifdef CPP4_METRICS
+#include "Metrics.h"
+
+/**
+ * @return number of heap allocations of the process so far, counted by the metrics
+ */
+static uint64_t allocations()
+{
+    return Metrics::read().counters[ALLOCATIONS];
+}
+#else
+/**
+ * number of heap allocations of the process so far
+ */
+static std::atomic<uint64_t> gAllocations(0);
+
+/**
+ * @return number of heap allocations of the process so far
+ */
+static uint64_t allocations()
+{
+    return gAllocations.load(std::memory_order_relaxed);
+}
+
+void *operator new(std::size_t size)
+{
+    gAllocations.fetch_add(1, std::memory_order_relaxed);
+    void *memory = std::malloc(size == 0 ? 1 : size);
+    if (memory == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void *operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void *memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void *memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void *memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+#endif
+
+/**
+ * runs the query on every user, the warm up passes first, and counts the allocations of the
+ * pass after them
+ * @param users the users to query
+ * @param query the query, gets the name of a user
+ * @return number of allocations of the counted pass
+ */
+template <typename Query>
+static uint64_t countSteadyState(const std::vector<std::string> &users, Query query)
+{
+    for (int pass = 0; pass < WARMUP; pass++)
+    {
+        for (const std::string &user: users)
+        {
+            query(user);
+        }
+    }
+    uint64_t before = allocations();
+    for (const std::string &user: users)
+    {
+        query(user);
+    }
+    return allocations() - before;
+}
+
+/**
+ * loads a system and counts the allocations of its warm queries
+ * @param argc number of arguments
+ * @param argv the directory to write the data in
+ * @return 0 if every check passed
+ */
+int main(int argc, char **argv)
+{
+    std::string dir = argc > 1 ? argv[1] : ".";
+    TestData data = TestUtils::generate(17, 60, 50, 6, 0.3);
+    std::string moviesPath = dir + "/allocation_movies.txt";
+    std::string ranksPath = dir + "/allocation_ranks.txt";
+    CHECK(TestUtils::write(data, moviesPath, ranksPath) == 0);
+    RecommenderConfig config;
+    config.threads = 1;
+    config.resultCacheSize = 0;
+    RecommenderSystem system(config);
+    CHECK(system.loadData(moviesPath, ranksPath) == 0);
+
+    // the answers are summed so that the queries can't be optimized away
+    size_t answers = 0;
+    double scores = 0;
+    CHECK(countSteadyState(data.users, [&](const std::string &user)
+    {
+        answers += system.recommendByContent(user).size();
+    }) == 0);
+    CHECK(countSteadyState(data.users, [&](const std::string &user)
+    {
+        answers += system.recommendByCF(user, K).size();
+    }) == 0);
+    CHECK(countSteadyState(data.users, [&](const std::string &user)
+    {
+        scores += system.predictMovieScoreForUser(data.movies[answers % data.movies.size()], user, K);
+    }) == 0);
+    CHECK(answers > 0 && scores == scores);
+    return TestUtils::finish("AllocationTest");
+}
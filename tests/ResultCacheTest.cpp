@@ -0,0 +1,173 @@
+/**
+ * @file ResultCacheTest.cpp
+ * @author  Nimrod Kremer
+ * @version 1.0
+ * @date 26.5.2020
+ *
+ * @brief Checks that the cached recommendations are the ones that would be calculated
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * A system with the cache of recommendations and one without it are updated the
+ * same way, and every cached answer must be the calculated one, also in a copy of
+ * the system that changes apart from it. The counters of the cache must show the
+ * hits, the entries made stale by the updates and the entries evicted to stay
+ * within the capacity.
+ * Input  : the directory to write the data in
+ * Process: updating and querying both systems
+ * Output : 0 if every check passed.
+ */
+
+#include "RecommenderSystem.h"
+#include "TestUtils.h"
+
+/**
+ * number of movies the CF queries check with
+ */
+#define K 2
+
+/**
+ * @param cacheSize number of recommendations cached
+ * @return a system of the config with the cache of the size
+ */
+static RecommenderConfig cacheConfig(size_t cacheSize)
+{
+    RecommenderConfig config;
+    config.threads = 1;
+    config.resultCacheSize = cacheSize;
+    return config;
+}
+
+/**
+ * the first rank of a movie that is no column makes it a candidate of every user, the answers
+ * of the other users that were cached before must not be used
+ * @param dir the directory to write the data in
+ */
+static void checkFirstRankOfMovie(const std::string &dir)
+{
+    TestData data;
+    data.movies = {"A", "B", "C", "D", "E"};
+    data.features = {{1, 9}, {9, 1}, {5, 5}, {2, 8}, {10, 0}};
+    // E is in the movies file only
+    data.columns = {"A", "B", "C", "D"};
+    data.users = {"u1", "u2"};
+    data.ranks = {{1, 10, NO_RANK, NO_RANK}, {5, NO_RANK, NO_RANK, NO_RANK}};
+    std::string moviesPath = dir + "/cache_movies.txt";
+    std::string ranksPath = dir + "/cache_ranks.txt";
+    CHECK(TestUtils::write(data, moviesPath, ranksPath) == 0);
+    RecommenderSystem cached(cacheConfig(DEFAULT_RESULT_CACHE));
+    RecommenderSystem calculated(cacheConfig(0));
+    CHECK(cached.loadData(moviesPath, ranksPath) == 0);
+    CHECK(calculated.loadData(moviesPath, ranksPath) == 0);
+    CHECK(cached.recommendByContent("u1") == calculated.recommendByContent("u1"));
+    CHECK(cached.recommendByCF("u1", K) == calculated.recommendByCF("u1", K));
+
+    CHECK(cached.addRating("u2", "E", 5) == 0);
+    CHECK(calculated.addRating("u2", "E", 5) == 0);
+    CHECK(calculated.recommendByContent("u1") == "E");
+    CHECK(cached.recommendByContent("u1") == "E");
+    CHECK(cached.recommendByCF("u1", K) == calculated.recommendByCF("u1", K));
+    std::vector<Recommendation> top = cached.recommendTopByContent("u1", 1);
+    CHECK(!top.empty() && top[0].movie == cached.recommendByContent("u1"));
+}
+
+/**
+ * a copy of a system that changes apart from it counts the same versions for other ranks, the
+ * answers the system cached must not be used by the copy
+ * @param dir the directory to write the data in
+ */
+static void checkCopies(const std::string &dir)
+{
+    TestData data;
+    data.movies = {"A", "B", "C", "D", "E"};
+    data.features = {{1, 9}, {9, 1}, {5, 5}, {2, 8}, {10, 0}};
+    data.columns = data.movies;
+    data.users = {"u1", "u2"};
+    data.ranks = {{1, NO_RANK, NO_RANK, NO_RANK, 10}, {5, 5, NO_RANK, NO_RANK, NO_RANK}};
+    std::string moviesPath = dir + "/cache_movies.txt";
+    std::string ranksPath = dir + "/cache_ranks.txt";
+    CHECK(TestUtils::write(data, moviesPath, ranksPath) == 0);
+    RecommenderSystem system(cacheConfig(DEFAULT_RESULT_CACHE));
+    CHECK(system.loadData(moviesPath, ranksPath) == 0);
+    RecommenderSystem copy = system;
+    RecommenderSystem calculated(cacheConfig(0));
+    CHECK(calculated.loadData(moviesPath, ranksPath) == 0);
+
+    CHECK(system.addRating("u1", "B", 1) == 0);
+    std::string systemAnswer = system.recommendByContent("u1");
+    CHECK(copy.addRating("u1", "D", 1) == 0);
+    CHECK(calculated.addRating("u1", "D", 1) == 0);
+    CHECK(copy.recommendByContent("u1") == calculated.recommendByContent("u1"));
+    CHECK(copy.recommendByContent("u1") != systemAnswer);
+    CHECK(copy.recommendByCF("u1", K) == calculated.recommendByCF("u1", K));
+}
+
+/**
+ * the counters of the cache and the entries made stale by the ranks of their user
+ * @param dir the directory to write the data in
+ */
+static void checkCounters(const std::string &dir)
+{
+    TestData data = TestUtils::generate(3, 30, 20, 4, 0.3);
+    std::string moviesPath = dir + "/cache_movies.txt";
+    std::string ranksPath = dir + "/cache_ranks.txt";
+    CHECK(TestUtils::write(data, moviesPath, ranksPath) == 0);
+    RecommenderSystem cached(cacheConfig(DEFAULT_RESULT_CACHE));
+    RecommenderSystem calculated(cacheConfig(0));
+    CHECK(cached.loadData(moviesPath, ranksPath) == 0);
+    CHECK(calculated.loadData(moviesPath, ranksPath) == 0);
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (const std::string &user : data.users)
+        {
+            CHECK(cached.recommendByContent(user) == calculated.recommendByContent(user));
+            CHECK(cached.recommendByCF(user, K) == calculated.recommendByCF(user, K));
+        }
+    }
+    ResultCacheStats stats = cached.resultCacheStats();
+    CHECK(stats.misses == 2 * data.users.size());
+    CHECK(stats.hits == 2 * data.users.size());
+    CHECK(stats.entries == 2 * data.users.size());
+    CHECK(calculated.resultCacheStats().capacity == 0);
+
+    // only the entries of the user whose ranks changed are stale
+    CHECK(cached.addRating(data.users[0], data.columns[0], 1) == 0);
+    CHECK(calculated.addRating(data.users[0], data.columns[0], 1) == 0);
+    CHECK(cached.recommendByCF(data.users[0], K) == calculated.recommendByCF(data.users[0], K));
+    CHECK(cached.recommendByCF(data.users[1], K) == calculated.recommendByCF(data.users[1], K));
+    ResultCacheStats after = cached.resultCacheStats();
+    CHECK(after.invalidations == stats.invalidations + 1);
+    CHECK(after.hits == stats.hits + 1);
+
+    // a reload makes every entry stale
+    CHECK(cached.loadData(moviesPath, ranksPath) == 0);
+    CHECK(cached.recommendByContent(data.users[1]) == calculated.recommendByContent(data.users[1]));
+    CHECK(cached.resultCacheStats().invalidations == after.invalidations + 1);
+
+    RecommenderSystem small(cacheConfig(4));
+    CHECK(small.loadData(moviesPath, ranksPath) == 0);
+    for (const std::string &user : data.users)
+    {
+        small.recommendByCF(user, K);
+    }
+    ResultCacheStats bounded = small.resultCacheStats();
+    CHECK(bounded.entries == 4 && bounded.capacity == 4);
+    CHECK(bounded.evictions == data.users.size() - 4);
+}
+
+/**
+ * runs the checks of the cache
+ * @param argc number of arguments
+ * @param argv the directory to write the data in
+ * @return 0 if every check passed
+ */
+int main(int argc, char **argv)
+{
+    std::string dir = argc > 1 ? argv[1] : ".";
+    checkFirstRankOfMovie(dir);
+    checkCopies(dir);
+    checkCounters(dir);
+    return TestUtils::finish("ResultCacheTest");
+}
@@ -0,0 +1,169 @@
+/**
+ * @file ShardTest.cpp
+ * @author  Nimrod Kremer
+ * @version 1.0
+ * @date 26.5.2020
+ *
+ * @brief Checks that the shards answer like a single recommendation system
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * The workers are spawned on the same files a single system loads, and every query
+ * of every user must get the same answer from the shard of the user. Connections
+ * are opened and closed on a worker many times over, and it must go on answering.
+ * Input  : the directory to write the data in and the path of cpp4_shard_worker
+ * Process: querying the shards and the single system
+ * Output : 0 if every check passed.
+ */
+
+#include <unistd.h>
+#include "ShardCoordinator.h"
+#include "TestUtils.h"
+
+/**
+ * number of movies the CF queries check with
+ */
+#define K 4
+/**
+ * number of movies every batch query recommends
+ */
+#define N 3
+/**
+ * number of shards the users are split on
+ */
+#define NUM_SHARDS 3
+/**
+ * number of connections opened and closed on a worker
+ */
+#define RECONNECTS 200
+
+/**
+ * @param a a list of recommendations
+ * @param b a list of recommendations
+ * @return true if both hold the same movies with the same scores in the same order
+ */
+static bool sameList(const std::vector<Recommendation> &a, const std::vector<Recommendation> &b)
+{
+    if (a.size() != b.size())
+    {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        if (a[i].movie != b[i].movie || a[i].score != b[i].score)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * checks every query of every user against the single system
+ * @param shards the running shards
+ * @param single the system that loaded every user
+ * @param data the data both loaded
+ */
+static void checkAnswers(ShardCoordinator &shards, RecommenderSystem &single, const TestData &data)
+{
+    std::vector<std::string> names = data.users;
+    names.push_back("NoUser");
+    for (const std::string &user: names)
+    {
+        CHECK(shards.recommendByContent(user) == single.recommendByContent(user));
+        CHECK(shards.recommendByCF(user, K) == single.recommendByCF(user, K));
+        for (size_t movie = 0; movie < data.movies.size(); movie += 5)
+        {
+            double a = shards.predictMovieScoreForUser(data.movies[movie], user, K);
+            double b = single.predictMovieScoreForUser(data.movies[movie], user, K);
+            CHECK(a == b || (a != a && b != b));
+        }
+    }
+    std::vector<std::vector<Recommendation>> content = shards.recommendByContentBatch(names, N);
+    std::vector<std::vector<Recommendation>> expected = single.recommendByContentBatch(names, N);
+    CHECK(content.size() == expected.size());
+    for (size_t i = 0; i < content.size() && i < expected.size(); i++)
+    {
+        CHECK(sameList(content[i], expected[i]));
+    }
+    std::vector<std::vector<Recommendation>> cf = shards.recommendByCFBatch(names, K, N);
+    expected = single.recommendByCFBatch(names, K, N);
+    CHECK(cf.size() == expected.size());
+    for (size_t i = 0; i < cf.size() && i < expected.size(); i++)
+    {
+        CHECK(sameList(cf[i], expected[i]));
+    }
+}
+
+/**
+ * starts the shards and compares them with the single system
+ * @param argc number of arguments
+ * @param argv the directory to write the data in and the path of the worker
+ * @return 0 if every check passed
+ */
+int main(int argc, char **argv)
+{
+    if (!CHECK(argc >= 3))
+    {
+        return TestUtils::finish("ShardTest");
+    }
+    std::string dir = argv[1];
+    TestData data = TestUtils::generate(23, 90, 50, 5, 0.2);
+    ShardOptions options;
+    options.workerPath = argv[2];
+    options.moviesPath = dir + "/shard_movies.txt";
+    options.ranksPath = dir + "/shard_ranks.txt";
+    options.socketDir = dir;
+    options.numShards = NUM_SHARDS;
+    CHECK(TestUtils::write(data, options.moviesPath, options.ranksPath) == 0);
+
+    RecommenderConfig config;
+    config.neighbors = options.neighbors;
+    config.threads = options.threads;
+    RecommenderSystem single(config);
+    CHECK(single.loadData(options.moviesPath, options.ranksPath) == 0);
+    ShardCoordinator shards;
+    if (!CHECK(shards.start(options) == 0))
+    {
+        return TestUtils::finish("ShardTest");
+    }
+    checkAnswers(shards, single, data);
+
+    // the socket of a shard is named by the process that started it
+    std::string socketPath = dir + "/cpp4_shard_" + std::to_string(::getpid()) + "_0.sock";
+    for (int i = 0; i < RECONNECTS; i++)
+    {
+        int fd = ShardProtocol::connect(socketPath);
+        CHECK(fd >= 0);
+        if (fd >= 0)
+        {
+            ::close(fd);
+        }
+    }
+    checkAnswers(shards, single, data);
+
+    std::vector<ShardStats> stats = shards.stats();
+    CHECK(stats.size() == NUM_SHARDS);
+    size_t users = 0;
+    size_t ranks = 0;
+    for (const ShardStats &shard: stats)
+    {
+        users += shard.users;
+        ranks += shard.ranks;
+        CHECK(shard.requests > 0 && shard.failures == 0);
+    }
+    size_t expectedRanks = 0;
+    for (const std::vector<int> &row: data.ranks)
+    {
+        for (int rank: row)
+        {
+            expectedRanks += rank != NO_RANK;
+        }
+    }
+    CHECK(users == data.users.size());
+    CHECK(ranks == expectedRanks);
+    shards.stop();
+    return TestUtils::finish("ShardTest");
+}
@@ -0,0 +1,185 @@
+/**
+ * @file TestUtils.cpp
+ * @author  Nimrod Kremer
+ * @version 1.0
+ * @date 26.5.2020
+ *
+ * @brief Checks and generated data shared by the tests
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * The files are written in the layout readMovies and readUserRanks read.
+ * Input  : the seed and the size of the data
+ * Process: generating and writing the movies and ranks files
+ * Output : the files, and the count of the failed checks.
+ */
+
+#include "TestUtils.h"
+#include "ReturnCodes.h"
+#include <fstream>
+#include <iostream>
+#include <random>
+
+/**
+ * the highest rank and feature of the generated data
+ */
+#define MAX_VALUE 10
+
+/**
+ * number of checks that failed so far
+ */
+static int numFailures = 0;
+
+/**
+ * counts the check if it failed and prints where
+ * @param passed the result of the check
+ * @param text the checked condition
+ * @param file the file of the check
+ * @param line the line of the check
+ * @return passed
+ */
+bool TestUtils::check(bool passed, const char *text, const char *file, int line)
+{
+    if (!passed)
+    {
+        numFailures++;
+        std::cerr << file << ":" << line << ": check failed: " << text << std::endl;
+    }
+    return passed;
+}
+
+/**
+ * @return number of checks that failed so far
+ */
+int TestUtils::failures()
+{
+    return numFailures;
+}
+
+/**
+ * prints the result of the test
+ * @param name the name of the test
+ * @return the exit code of the test, 0 if no check failed
+ */
+int TestUtils::finish(const char *name)
+{
+    if (numFailures == 0)
+    {
+        std::cout << name << ": passed" << std::endl;
+        return 0;
+    }
+    std::cout << name << ": " << numFailures << " checks failed" << std::endl;
+    return 1;
+}
+
+/**
+ * generates movies named MovieN and users named UserN, every movie is a column and every user
+ * ranked at least one movie
+ * @param seed the seed of the data
+ * @param numUsers number of users
+ * @param numMovies number of movies
+ * @param numFeatures number of features of every movie
+ * @param density part of the users x movies that is ranked
+ * @return the data
+ */
+TestData TestUtils::generate(unsigned long seed, int numUsers, int numMovies, int numFeatures, double density)
+{
+    std::mt19937_64 random(seed);
+    std::uniform_int_distribution<int> value(1, MAX_VALUE);
+    std::uniform_int_distribution<int> anyMovie(0, numMovies - 1);
+    std::bernoulli_distribution ranked(density);
+    TestData data;
+    for (int movie = 0; movie < numMovies; movie++)
+    {
+        data.movies.push_back("Movie" + std::to_string(movie));
+        data.columns.push_back(data.movies.back());
+        std::vector<int> features(numFeatures);
+        for (int &feature : features)
+        {
+            feature = value(random);
+        }
+        data.features.push_back(features);
+    }
+    for (int user = 0; user < numUsers; user++)
+    {
+        data.users.push_back("User" + std::to_string(user));
+        std::vector<int> row(numMovies, NO_RANK);
+        bool any = false;
+        for (int &rank : row)
+        {
+            rank = ranked(random) ? value(random) : NO_RANK;
+            any = any || rank != NO_RANK;
+        }
+        if (!any)
+        {
+            row[anyMovie(random)] = value(random);
+        }
+        data.ranks.push_back(row);
+    }
+    return data;
+}
+
+/**
+ * writes the movies file and the ranks file of the data
+ * @param data the data
+ * @param moviesPath the path of the movies file
+ * @param ranksPath the path of the ranks file
+ * @return success or fail
+ */
+int TestUtils::write(const TestData &data, const std::string &moviesPath, const std::string &ranksPath)
+{
+    std::ofstream movies(moviesPath);
+    for (size_t movie = 0; movie < data.movies.size(); movie++)
+    {
+        movies << data.movies[movie];
+        for (int feature : data.features[movie])
+        {
+            movies << ' ' << feature;
+        }
+        movies << '\n';
+    }
+    std::ofstream ranks(ranksPath);
+    for (size_t column = 0; column < data.columns.size(); column++)
+    {
+        ranks << (column == 0 ? "" : " ") << data.columns[column];
+    }
+    ranks << '\n';
+    for (size_t user = 0; user < data.users.size(); user++)
+    {
+        ranks << data.users[user];
+        for (int rank : data.ranks[user])
+        {
+            if (rank == NO_RANK)
+            {
+                ranks << " NA";
+            }
+            else
+            {
+                ranks << ' ' << rank;
+            }
+        }
+        ranks << '\n';
+    }
+    movies.close();
+    ranks.close();
+    return movies && ranks ? SUCCESS : FAIL;
+}
+
+/**
+ * @param data the data
+ * @param movie the name of a movie
+ * @return the column of the movie, -1 if it isn't one
+ */
+int TestUtils::columnOf(const TestData &data, const std::string &movie)
+{
+    for (size_t column = 0; column < data.columns.size(); column++)
+    {
+        if (data.columns[column] == movie)
+        {
+            return (int) column;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,110 @@
+/**
+ * @file TestUtils.h
+ * @author  Nimrod Kremer
+ * @version 1.0
+ * @date 26.5.2020
+ *
+ * @brief Checks and generated data shared by the tests
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * Every test is an executable that returns 0 only if all of its checks passed. The
+ * data is generated from a seed and kept in memory as well, so a test can change it
+ * the way it changes a loaded system and write it again to load from scratch.
+ * Input  : the seed and the size of the data
+ * Process: generating and writing the movies and ranks files
+ * Output : the files, and the count of the failed checks.
+ */
+
+#ifndef CPP4_TESTUTILS_H
+#define CPP4_TESTUTILS_H
+
+#include <string>
+#include <vector>
+
+/**
+ * counts a failed check with where it failed, the test goes on
+ */
+#define CHECK(condition) TestUtils::check((condition), #condition, __FILE__, __LINE__)
+
+/**
+ * a rank that wasn't given
+ */
+#define NO_RANK 0
+
+/**
+ * movies and ranks as the files hold them
+ */
+typedef struct TestData
+{
+    std::vector<std::string> movies;
+    /**
+     * the features of every movie of movies
+     */
+    std::vector<std::vector<int>> features;
+    /**
+     * the movies of the columns of the ranks file, in its order
+     */
+    std::vector<std::string> columns;
+    std::vector<std::string> users;
+    /**
+     * the rank of every user to every column, NO_RANK for NA
+     */
+    std::vector<std::vector<int>> ranks;
+} TestData;
+
+/**
+ * the checks and the data of the tests
+ */
+class TestUtils
+{
+public:
+    /**
+     * counts the check if it failed and prints where
+     * @param passed the result of the check
+     * @param text the checked condition
+     * @param file the file of the check
+     * @param line the line of the check
+     * @return passed
+     */
+    static bool check(bool passed, const char *text, const char *file, int line);
+    /**
+     * @return number of checks that failed so far
+     */
+    static int failures();
+    /**
+     * prints the result of the test
+     * @param name the name of the test
+     * @return the exit code of the test, 0 if no check failed
+     */
+    static int finish(const char *name);
+    /**
+     * generates movies named MovieN and users named UserN, every movie is a column and every user
+     * ranked at least one movie
+     * @param seed the seed of the data
+     * @param numUsers number of users
+     * @param numMovies number of movies
+     * @param numFeatures number of features of every movie
+     * @param density part of the users x movies that is ranked
+     * @return the data
+     */
+    static TestData generate(unsigned long seed, int numUsers, int numMovies, int numFeatures, double density);
+    /**
+     * writes the movies file and the ranks file of the data
+     * @param data the data
+     * @param moviesPath the path of the movies file
+     * @param ranksPath the path of the ranks file
+     * @return success or fail
+     */
+    static int write(const TestData &data, const std::string &moviesPath, const std::string &ranksPath);
+    /**
+     * @param data the data
+     * @param movie the name of a movie
+     * @return the column of the movie, -1 if it isn't one
+     */
+    static int columnOf(const TestData &data, const std::string &movie);
+};
+
+#endif //CPP4_TESTUTILS_H
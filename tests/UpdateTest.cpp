@@ -0,0 +1,295 @@
+/**
+ * @file UpdateTest.cpp
+ * @author  Nimrod Kremer
+ * @version 1.0
+ * @date 26.5.2020
+ *
+ * @brief Checks that the updates of a loaded system answer like a load of the updated data
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * Users, movies and ranks are added, changed and removed on a loaded system and on
+ * the data it was loaded from. The data is then written and loaded by a second
+ * system, and both must answer every query of every user the same. The neighbor
+ * lists keep their similarities as floats and don't cover added movies, so both
+ * systems calculate every similarity of movies. Both keep lists of similar users,
+ * which a change of any rank makes stale.
+ * Input  : the directory to write the data in
+ * Process: updating, reloading and comparing the answers
+ * Output : 0 if every check passed.
+ */
+
+#include <climits>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include "RecommenderSystem.h"
+#include "TestUtils.h"
+
+/**
+ * number of movies the CF queries check with
+ */
+#define K 5
+/**
+ * number of movies the top queries recommend
+ */
+#define N 3
+/**
+ * most difference of the predictions of the two systems, the order the similarities were calculated
+ * in may change the last bits
+ */
+#define TOLERANCE 1e-9
+/**
+ * number of rank changes that makes the updated system compact its ranks
+ */
+#define MANY_CHANGES 1500
+
+/**
+ * @return the config both systems are created with
+ */
+static RecommenderConfig testConfig()
+{
+    RecommenderConfig config;
+    config.neighbors = 0;
+    config.userNeighbors = K;
+    config.threads = 2;
+    return config;
+}
+
+/**
+ * @param a a list of recommendations
+ * @param b a list of recommendations
+ * @return true if both recommend the same movies in the same order
+ */
+static bool sameMovies(const std::vector<Recommendation> &a, const std::vector<Recommendation> &b)
+{
+    if (a.size() != b.size())
+    {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        if (a[i].movie != b[i].movie)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * writes the data and checks that a system that loads it answers like the updated one
+ * @param updated the updated system
+ * @param data the updated data
+ * @param dir the directory to write the data in
+ * @param stage the name of the updates, printed with the failures
+ */
+static void checkReload(const RecommenderSystem &updated, const TestData &data, const std::string &dir,
+                        const std::string &stage)
+{
+    std::string moviesPath = dir + "/update_movies.txt";
+    std::string ranksPath = dir + "/update_ranks.txt";
+    CHECK(TestUtils::write(data, moviesPath, ranksPath) == 0);
+    RecommenderSystem reloaded(testConfig());
+    CHECK(reloaded.loadData(moviesPath, ranksPath) == 0);
+    int failuresBefore = TestUtils::failures();
+    for (const std::string &user : data.users)
+    {
+        CHECK(updated.recommendByContent(user) == reloaded.recommendByContent(user));
+        CHECK(sameMovies(updated.recommendTopByContent(user, N), reloaded.recommendTopByContent(user, N)));
+        CHECK(updated.recommendByCF(user, K) == reloaded.recommendByCF(user, K));
+        CHECK(updated.recommendByUserCF(user, K) == reloaded.recommendByUserCF(user, K));
+        // more users than there are, found without the lists
+        CHECK(updated.recommendByUserCF(user, INT_MAX) == reloaded.recommendByUserCF(user, INT_MAX));
+        for (size_t movie = 0; movie < data.movies.size(); movie += 7)
+        {
+            double a = updated.predictMovieScoreForUser(data.movies[movie], user, K);
+            double b = reloaded.predictMovieScoreForUser(data.movies[movie], user, K);
+            CHECK(a == b || std::fabs(a - b) <= TOLERANCE || (a != a && b != b));
+        }
+        // the last movie may be the one added last
+        double a = updated.predictMovieScoreForUser(data.movies.back(), user, K);
+        double b = reloaded.predictMovieScoreForUser(data.movies.back(), user, K);
+        CHECK(a == b || std::fabs(a - b) <= TOLERANCE || (a != a && b != b));
+    }
+    if (TestUtils::failures() != failuresBefore)
+    {
+        std::cerr << "after " << stage << std::endl;
+    }
+}
+
+/**
+ * sets the rank on the system and on the data
+ * @param system the loaded system
+ * @param data the data it was loaded from
+ * @param user index of the user in the data
+ * @param movie the name of the movie
+ * @param rank the rank
+ */
+static void setRank(RecommenderSystem &system, TestData &data, size_t user, const std::string &movie, int rank)
+{
+    CHECK(system.addRating(data.users[user], movie, rank) == 0);
+    int column = TestUtils::columnOf(data, movie);
+    if (column < 0)
+    {
+        // the first rank of a movie makes it the last column
+        column = (int) data.columns.size();
+        data.columns.push_back(movie);
+        for (std::vector<int> &row : data.ranks)
+        {
+            row.push_back(NO_RANK);
+        }
+    }
+    data.ranks[user][column] = rank;
+}
+
+/**
+ * removes the rank from the system and from the data
+ * @param system the loaded system
+ * @param data the data it was loaded from
+ * @param user index of the user in the data
+ * @param column the column of the movie
+ */
+static void removeRank(RecommenderSystem &system, TestData &data, size_t user, size_t column)
+{
+    bool ranked = data.ranks[user][column] != NO_RANK;
+    CHECK(system.removeRating(data.users[user], data.columns[column]) == (ranked ? 0 : -1));
+    data.ranks[user][column] = NO_RANK;
+}
+
+/**
+ * adds the movie to the system and to the data, as the last column
+ * @param system the loaded system
+ * @param data the data it was loaded from
+ * @param movie the name of the movie
+ * @param features the features of the movie
+ */
+static void addMovie(RecommenderSystem &system, TestData &data, const std::string &movie,
+                     const std::vector<int> &features)
+{
+    CHECK(system.addMovie(movie, std::vector<double>(features.begin(), features.end())) == 0);
+    data.movies.push_back(movie);
+    data.features.push_back(features);
+    data.columns.push_back(movie);
+    for (std::vector<int> &row : data.ranks)
+    {
+        row.push_back(NO_RANK);
+    }
+}
+
+/**
+ * copies the system and changes both apart after the system was queried, the same rank to
+ * opposite values and a different movie added to each, and checks both against loads of their
+ * own data
+ * @param system the loaded system
+ * @param data the data it was loaded from
+ * @param dir the directory to write the data in
+ */
+static void checkCopy(RecommenderSystem &system, TestData &data, const std::string &dir)
+{
+    RecommenderSystem copy = system;
+    TestData copyData = data;
+    for (size_t user = 0; user < data.users.size(); user++)
+    {
+        setRank(system, data, user, data.columns[1], 10);
+        system.recommendTopByContent(data.users[user], N);
+        setRank(copy, copyData, user, data.columns[1], 1);
+    }
+    addMovie(system, data, "SystemMovie", {1, 2, 3, 4, 5, 6});
+    for (const std::string &user : data.users)
+    {
+        system.predictMovieScoreForUser("SystemMovie", user, K);
+    }
+    addMovie(copy, copyData, "CopyMovie", {6, 5, 4, 3, 2, 1});
+    checkReload(copy, copyData, dir, "changing a copy");
+    checkReload(system, data, dir, "changing the copied system");
+}
+
+/**
+ * runs the updates and checks the system after each kind
+ * @param argc number of arguments
+ * @param argv the directory to write the data in
+ * @return 0 if every check passed
+ */
+int main(int argc, char **argv)
+{
+    std::string dir = argc > 1 ? argv[1] : ".";
+    TestData data = TestUtils::generate(11, 60, 40, 6, 0.2);
+    // a movie that is in the movies file but no column of the ranks
+    data.columns.pop_back();
+    for (std::vector<int> &row : data.ranks)
+    {
+        row.pop_back();
+    }
+    std::string moviesPath = dir + "/update_movies.txt";
+    std::string ranksPath = dir + "/update_ranks.txt";
+    CHECK(TestUtils::write(data, moviesPath, ranksPath) == 0);
+    RecommenderSystem system(testConfig());
+    CHECK(system.loadData(moviesPath, ranksPath) == 0);
+    checkReload(system, data, dir, "the load");
+
+    std::mt19937_64 random(5);
+    std::uniform_int_distribution<int> anyRank(1, 10);
+    auto anyUser = [&]()
+    {
+        return std::uniform_int_distribution<size_t>(0, data.users.size() - 1)(random);
+    };
+    auto anyColumn = [&]()
+    {
+        return std::uniform_int_distribution<size_t>(0, data.columns.size() - 1)(random);
+    };
+    for (int i = 0; i < 40; i++)
+    {
+        setRank(system, data, anyUser(), data.columns[anyColumn()], anyRank(random));
+    }
+    checkReload(system, data, dir, "setting ranks");
+
+    for (int i = 0; i < 40; i++)
+    {
+        removeRank(system, data, anyUser(), anyColumn());
+    }
+    checkReload(system, data, dir, "removing ranks");
+
+    setRank(system, data, 3, data.movies.back(), 9);
+    checkReload(system, data, dir, "the first rank of a movie");
+
+    CHECK(system.addUser("NewUser") == 0);
+    CHECK(system.addUser("NewUser") == -1);
+    data.users.push_back("NewUser");
+    data.ranks.push_back(std::vector<int>(data.columns.size(), NO_RANK));
+    checkReload(system, data, dir, "adding a user");
+    setRank(system, data, data.users.size() - 1, data.columns[0], 7);
+    setRank(system, data, data.users.size() - 1, data.columns[2], 2);
+    checkReload(system, data, dir, "ranking by the added user");
+
+    // an added movie is a column from the start
+    addMovie(system, data, "NewMovie", {9, 1, 9, 1, 9, 1});
+    CHECK(system.addMovie("NewMovie", {9, 1, 9, 1, 9, 1}) == -1);
+    CHECK(system.addMovie("ShortMovie", {1, 2}) == -1);
+    checkReload(system, data, dir, "adding a movie");
+    setRank(system, data, 0, "NewMovie", 10);
+    setRank(system, data, 1, "NewMovie", 1);
+    checkReload(system, data, dir, "ranking the added movie");
+    checkCopy(system, data, dir);
+
+    CHECK(system.addRating("NoUser", data.columns[0], 5) == -1);
+    CHECK(system.addRating(data.users[0], "NoMovie", 5) == -1);
+    CHECK(system.removeRating("NoUser", data.columns[0]) == -1);
+
+    // enough changes to pack the ranks again
+    for (int i = 0; i < MANY_CHANGES; i++)
+    {
+        if (i % 3 == 0)
+        {
+            removeRank(system, data, anyUser(), anyColumn());
+        }
+        else
+        {
+            setRank(system, data, anyUser(), data.columns[anyColumn()], anyRank(random));
+        }
+    }
+    checkReload(system, data, dir, "compacting");
+    return TestUtils::finish("UpdateTest");
+}